@@ -0,0 +1,119 @@
+//
+//  arena.c
+//  VectorC
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "arena.h"
+#include "mem_report.h"
+
+#define ARENA_ALIGNMENT			16
+#define ARENA_DEFAULT_CHUNK		(64 * 1024)
+
+// Round size up to the arena alignment.
+static size_t alignSize(size_t size) {
+	return (size + (ARENA_ALIGNMENT - 1)) & ~(size_t)(ARENA_ALIGNMENT - 1);
+}
+
+// Start of the payload area of a chunk.
+static char* chunkData(ArenaChunk* chunk) {
+	return (char*)chunk + alignSize(sizeof(ArenaChunk));
+}
+
+// Allocate a fresh chunk with room for at least capacity payload bytes.
+static ArenaChunk* createChunk(Arena* arena, size_t capacity) {
+	size_t headerSize = alignSize(sizeof(ArenaChunk));
+	ArenaChunk* chunk = (ArenaChunk*)countedRealloc(NULL, headerSize + capacity);
+	if (!chunk) {
+		perror("Failed to allocate arena chunk");
+		exit(EXIT_FAILURE);
+	}
+	chunk->next = NULL;
+	chunk->capacity = capacity;
+	chunk->used = 0;
+
+	arena->chunkCount++;
+	arena->bytesReserved += headerSize + capacity;
+	return chunk;
+}
+
+void arenaInit(Arena* arena, size_t chunkSize) {
+	memset(arena, 0, sizeof(Arena));
+	arena->chunkSize = chunkSize ? alignSize(chunkSize) : ARENA_DEFAULT_CHUNK;
+}
+
+void* arenaAlloc(Arena* arena, size_t size) {
+	if (arena->chunkSize == 0) {
+		arenaInit(arena, 0);
+	}
+	size = alignSize(size ? size : 1);
+
+	ArenaChunk* chunk = arena->current;
+	if (!chunk) {
+		chunk = createChunk(arena, size > arena->chunkSize ? size : arena->chunkSize);
+		arena->first = chunk;
+		arena->current = chunk;
+	} else if (chunk->used + size > chunk->capacity) {
+		// Reuse the chunk retained from a previous reset when it is big
+		// enough, otherwise splice a new one in after the current chunk.
+		ArenaChunk* next = chunk->next;
+		if (next && next->capacity >= size) {
+			next->used = 0;
+		} else {
+			ArenaChunk* fresh = createChunk(arena, size > arena->chunkSize ? size : arena->chunkSize);
+			fresh->next = next;
+			chunk->next = fresh;
+			next = fresh;
+		}
+		chunk = next;
+		arena->current = chunk;
+	}
+
+	void* result = chunkData(chunk) + chunk->used;
+	chunk->used += size;
+
+	arena->bytesUsed += size;
+	arena->allocationCount++;
+	if (arena->bytesUsed > arena->highWater) {
+		arena->highWater = arena->bytesUsed;
+	}
+	return result;
+}
+
+char* arenaStrndup(Arena* arena, const char* str, size_t length) {
+	char* copy = (char*)arenaAlloc(arena, length + 1);
+	memcpy(copy, str, length);
+	copy[length] = '\0';
+	return copy;
+}
+
+void arenaReset(Arena* arena) {
+	// Later chunks are marked empty lazily as arenaAlloc moves into them.
+	if (arena->first) {
+		arena->first->used = 0;
+	}
+	arena->current = arena->first;
+	arena->bytesUsed = 0;
+	arena->allocationCount = 0;
+}
+
+void arenaFree(Arena* arena) {
+	ArenaChunk* chunk = arena->first;
+	while (chunk) {
+		ArenaChunk* next = chunk->next;
+		countedFree(chunk);
+		chunk = next;
+	}
+	size_t chunkSize = arena->chunkSize;
+	memset(arena, 0, sizeof(Arena));
+	arena->chunkSize = chunkSize;
+}
+
+void printArenaStats(FILE* out, const Arena* arena, const char* label) {
+	fprintf(out, "%s arena: %zu allocations, %zu bytes used, high-water %zu bytes, %zu bytes reserved in %zu chunk(s)\n",
+		   label, arena->allocationCount, arena->bytesUsed, arena->highWater, arena->bytesReserved, arena->chunkCount);
+}
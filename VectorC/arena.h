@@ -0,0 +1,52 @@
+//
+//  arena.h
+//  VectorC
+//
+
+#ifndef arena_h
+#define arena_h
+
+#include <stddef.h>
+#include <stdio.h>
+
+// A chunk of arena storage. The payload follows the header directly.
+typedef struct ArenaChunk {
+	struct ArenaChunk* next;
+	size_t capacity;				// Payload bytes available in this chunk
+	size_t used;					// Payload bytes handed out from this chunk
+} ArenaChunk;
+
+// Bump allocator. Individual allocations are never freed; the whole arena is
+// rewound with arenaReset (keeping its chunks for reuse) or released with
+// arenaFree.
+typedef struct Arena {
+	ArenaChunk* first;
+	ArenaChunk* current;
+	size_t chunkSize;				// Default payload size of new chunks
+	size_t chunkCount;				// Chunks currently owned by the arena
+	size_t bytesUsed;				// Bytes handed out since the last reset
+	size_t bytesReserved;			// Bytes obtained from the system for all chunks
+	size_t highWater;				// Peak of bytesUsed over the arena's lifetime
+	size_t allocationCount;			// Allocations since the last reset
+} Arena;
+
+// Prepare an empty arena. No memory is reserved until the first allocation.
+void arenaInit(Arena* arena, size_t chunkSize);
+
+// Allocate size bytes aligned for any fundamental type. Never returns NULL.
+void* arenaAlloc(Arena* arena, size_t size);
+
+// Copy length bytes of str into the arena and null-terminate the copy.
+char* arenaStrndup(Arena* arena, const char* str, size_t length);
+
+// Rewind the arena in O(1). All previous allocations become invalid but the
+// chunks are retained for subsequent allocations.
+void arenaReset(Arena* arena);
+
+// Release every chunk owned by the arena.
+void arenaFree(Arena* arena);
+
+// Print usage and high-water statistics for the arena.
+void printArenaStats(FILE* out, const Arena* arena, const char* label);
+
+#endif /* arena_h */
@@ -0,0 +1,79 @@
+//
+//  asm_emitter.c
+//  VectorC
+//
+
+#include <stdlib.h>
+
+#include "asm_emitter.h"
+
+void asmBufferInit(AsmBuffer* buffer, FILE* file) {
+	asmBufferInitMemory(buffer, ASM_BUFFER_SIZE);
+	buffer->file = file;
+}
+
+void asmBufferInitMemory(AsmBuffer* buffer, size_t capacity) {
+	buffer->file = NULL;
+	buffer->data = (char*)malloc(capacity);
+	if (buffer->data == NULL) {
+		perror("Failed to allocate assembly buffer");
+		exit(EXIT_FAILURE);
+	}
+	buffer->length = 0;
+	buffer->capacity = capacity;
+	buffer->bytesWritten = 0;
+}
+
+void asmBufferFlush(AsmBuffer* buffer) {
+	if (buffer->file != NULL && buffer->length > 0) {
+		buffer->bytesWritten += fwrite(buffer->data, 1, buffer->length, buffer->file);
+		buffer->length = 0;
+	}
+}
+
+void asmBufferFree(AsmBuffer* buffer) {
+	asmBufferFlush(buffer);
+	free(buffer->data);
+	buffer->data = NULL;
+}
+
+void asmPutCharsOverflow(AsmBuffer* buffer, const char* chars, size_t length) {
+	if (buffer->file != NULL) {
+		asmBufferFlush(buffer);
+		if (length > buffer->capacity) {
+			buffer->bytesWritten += fwrite(chars, 1, length, buffer->file);
+			return;
+		}
+	} else {
+		size_t capacity = buffer->capacity > 0 ? buffer->capacity * 2 : 256;
+		while (capacity < buffer->length + length) {
+			capacity *= 2;
+		}
+		char* data = (char*)realloc(buffer->data, capacity);
+		if (data == NULL) {
+			perror("Failed to grow assembly buffer");
+			exit(EXIT_FAILURE);
+		}
+		buffer->data = data;
+		buffer->capacity = capacity;
+	}
+	memcpy(buffer->data + buffer->length, chars, length);
+	buffer->length += length;
+}
+
+// Format a decimal integer without going through printf.
+void asmPutInt(AsmBuffer* buffer, int32_t value) {
+	char digits[12];
+	char* end = digits + sizeof(digits);
+	char* p = end;
+	// Negate in unsigned arithmetic so INT32_MIN is handled.
+	uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+	do {
+		*--p = (char)('0' + magnitude % 10);
+		magnitude /= 10;
+	} while (magnitude != 0);
+	if (value < 0) {
+		*--p = '-';
+	}
+	asmPutChars(buffer, p, (size_t)(end - p));
+}
@@ -0,0 +1,80 @@
+//
+//  asm_emitter.h
+//  VectorC
+//
+
+#ifndef asm_emitter_h
+#define asm_emitter_h
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define ASM_BUFFER_SIZE (256 * 1024)
+
+// Assembly text accumulates here and is written to `file` in large chunks,
+// so emitting an instruction is a handful of memcpys rather than a stdio call.
+// A buffer without a file keeps everything in memory and grows instead.
+typedef struct {
+	FILE* file;				// NULL for an in-memory buffer
+	char* data;
+	size_t length;			// Bytes waiting to be flushed
+	size_t capacity;
+	size_t bytesWritten;	// Bytes flushed so far
+} AsmBuffer;
+
+// How a function is rendered.
+typedef enum {
+	ASM_STYLE_SOURCE,		// Assembler input: labels, prologue and epilogue
+	ASM_STYLE_LISTING		// Debug listing of the instruction stream only
+} AsmStyle;
+
+// A string with its length precomputed.
+typedef struct {
+	const char* chars;
+	size_t length;
+} AsmString;
+
+// Initializer for an AsmString table entry.
+#define ASM_STRING(literal) { literal, sizeof(literal) - 1 }
+
+void asmBufferInit(AsmBuffer* buffer, FILE* file);
+// Start an in-memory buffer; the text is left in data[0..length).
+void asmBufferInitMemory(AsmBuffer* buffer, size_t capacity);
+void asmBufferFlush(AsmBuffer* buffer);
+// Flush remaining text and release the buffer. Does not close the file.
+void asmBufferFree(AsmBuffer* buffer);
+
+void asmPutInt(AsmBuffer* buffer, int32_t value);
+// Slow path of asmPutChars for text that does not fit in the free space.
+void asmPutCharsOverflow(AsmBuffer* buffer, const char* chars, size_t length);
+
+static inline void asmPutChars(AsmBuffer* buffer, const char* chars, size_t length) {
+	if (buffer->length + length > buffer->capacity) {
+		asmPutCharsOverflow(buffer, chars, length);
+		return;
+	}
+	memcpy(buffer->data + buffer->length, chars, length);
+	buffer->length += length;
+}
+
+static inline void asmPutString(AsmBuffer* buffer, AsmString str) {
+	asmPutChars(buffer, str.chars, str.length);
+}
+
+#define asmPutLiteral(buffer, literal) asmPutChars(buffer, literal, sizeof(literal) - 1)
+
+static inline void asmPutCString(AsmBuffer* buffer, const char* str) {
+	asmPutChars(buffer, str, strlen(str));
+}
+
+static inline void asmPutChar(AsmBuffer* buffer, char c) {
+	if (buffer->length == buffer->capacity) {
+		asmPutCharsOverflow(buffer, &c, 1);
+		return;
+	}
+	buffer->data[buffer->length++] = c;
+}
+
+#endif /* asm_emitter_h */
@@ -10,7 +10,7 @@
 
 #include "ast_asm_common.h"
 #include "tacky.h"
-#include "stb_ds.h"
+#include "stb_ds_config.h"
 
 // ARM64 instruction types
 typedef enum {
@@ -56,11 +56,10 @@ typedef struct ARM64Instruction {
 } ARM64Instruction;
 
 // Function declarations for ARM64 code generation
-const char* getARM64Operand(const Operand* op, char* buffer, size_t bufferSize);
-void generateARM64Function(FILE* outputFile, const Function* func);
-void translateTackyToARM64(const TackyProgram* tackyProgram, Program* asmProgram);
-void replacePseudoRegistersARM64(Program* asmProgram);
-void fixupIllegalInstructionsARM64(Program* asmProgram, Program* finalAsmProgram);
-void printARM64Function(const Function* function);
+void translateTackyFunctionToARM64(const TackyFunction* tackyFunc, Function* asmFunc);
+void replacePseudoRegistersARM64(Function* func);
+void fixupIllegalInstructionsARM64(const Function* srcFunc, Function* outFunc);
+// Append a function to the buffer, either as assembler source or as a listing.
+void emitARM64Function(AsmBuffer* out, const Function* func, AsmStyle style);
 
 #endif /* ast_arm64_h */
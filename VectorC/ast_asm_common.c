@@ -8,6 +8,7 @@
 #include "ast_asm_common.h"
 #include "ast_x64.h"
 #include "ast_arm64.h"
+#include "mem_report.h"
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
@@ -27,59 +28,98 @@ const char* getArchitectureName(Architecture arch)
 	return s_architectureNames[arch];
 }
 
-void generateCode(const Program* program, const char* outputFilename)
+AsmString getRegisterString(Register reg)
 {
-	if (!program || program->functionCount == 0) {
-		fprintf(stderr, "Error: No functions to generate code for.\n");
-		return;
-	}
-
-	FILE* outputFile = fopen(outputFilename, "w");
-	if (!outputFile) {
-		perror("Error opening output file");
-		exit(EXIT_FAILURE);
-	}
-
-	// Iterate over each function in the Program
-	for (size_t i = 0; i < program->functionCount; i++) {
-		const Function* func = &program->functions[i];
-
-		switch (func->arch) {
-			case ARCH_X64:
-				generateX64Function(outputFile, func);
-				break;
+	static const AsmString s_registerNames[] = {
+		[REG_EAX] = ASM_STRING("%eax"),
+		[REG_ECX] = ASM_STRING("%ecx"),
+		[REG_EDX] = ASM_STRING("%edx"),
+		[REG_R10D] = ASM_STRING("%r10d"),
+		[REG_W0] = ASM_STRING("w0"),
+		[REG_W10] = ASM_STRING("w10"),
+		[REG_W11] = ASM_STRING("w11"),
+		[REG_W12] = ASM_STRING("w12"),
+	};
 
-			case ARCH_ARM64:
-				generateARM64Function(outputFile, func);
-				break;
+	static_assert(sizeof(s_registerNames) / sizeof(AsmString) == (int32_t)REG_COUNT, "Invalid Register");
+	return s_registerNames[reg];
+}
 
-			default:
-				fprintf(stderr, "Error: Unsupported architecture.\n");
-				fclose(outputFile);
-				return;
+void initFunctionContext(FunctionContext* fctx, const Function* func, int slotSize)
+{
+	// Counted, so -fmem-report charges the table to the pass that fills it.
+	fctx->slotOffsets = NULL;
+	if (func->pseudoCount > 0) {
+		size_t size = (size_t)func->pseudoCount * sizeof(int);
+		fctx->slotOffsets = (int*)countedRealloc(NULL, size);
+		if (!fctx->slotOffsets) {
+			perror("Failed to allocate stack slots");
+			exit(EXIT_FAILURE);
 		}
+		memset(fctx->slotOffsets, 0, size);
+	}
+	fctx->slotSize = slotSize;
+	fctx->nextOffset = -slotSize;
+}
+
+int getOrAssignStackSlot(FunctionContext* fctx, int32_t pseudoIndex)
+{
+	int offset = fctx->slotOffsets[pseudoIndex];
+	if (offset != 0) {
+		return offset;
 	}
+	// New tmp — assign a new slot
+	offset = fctx->nextOffset;
+	fctx->slotOffsets[pseudoIndex] = offset;
+	fctx->nextOffset -= fctx->slotSize; // Move down the stack
+	return offset;
+}
 
-	fclose(outputFile);
+void destroyFunctionContext(FunctionContext* fctx)
+{
+	countedFree(fctx->slotOffsets);
+	fctx->slotOffsets = NULL;
 }
 
 // Print a program, dispatching based on architecture
-void printAsmProgram(const Program* program)
+void printAsmProgram(FILE* out, const Program* program, const bool* reuse)
 {
+	fflush(out);
+	AsmBuffer buffer;
+	asmBufferInit(&buffer, out);
+
 	for (size_t i = 0; i < program->functionCount; i++) {
 		const Function* func = &program->functions[i];
-		printf("Function %s:\n", func->name);
+		asmPutLiteral(&buffer, "Function ");
+		asmPutCString(&buffer, func->name);
+		if (reuse && reuse[i]) {
+			asmPutLiteral(&buffer, ": (reused from index)\n");
+			continue;
+		}
+		asmPutLiteral(&buffer, ":\n");
 
 		switch (func->arch) {
 			case ARCH_X64:
-				printX64Function(func);
+				emitX64Function(&buffer, func, ASM_STYLE_LISTING);
 				break;
 			case ARCH_ARM64:
-				printARM64Function(func);
+				emitARM64Function(&buffer, func, ASM_STYLE_LISTING);
 				break;
 			default:
-				printf("Unknown architecture\n");
+				asmPutLiteral(&buffer, "Unknown architecture\n");
 				break;
 		}
 	}
+
+	asmBufferFree(&buffer);
+	fflush(out);
+}
+
+void freeAsmProgram(Program* program)
+{
+	for (size_t i = 0; i < program->functionCount; i++) {
+		arrfree(program->functions[i].instructions);
+	}
+	arrfree(program->functions);
+	program->functionCount = 0;
 }
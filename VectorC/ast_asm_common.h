@@ -8,10 +8,13 @@
 #ifndef ast_asm_common_h
 #define ast_asm_common_h
 
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "asm_emitter.h"
+
 typedef enum {
 	ARCH_X64,
 	ARCH_ARM64,
@@ -21,9 +24,11 @@ typedef enum {
 } Architecture;
 
 typedef struct Function {
-	const char* name;    		// Function name
+	const char* name;    		// Function name (interned)
 	void* instructions;  		// Dynamic array of instructions (x64 or ARM64)
 	size_t instructionCount;	// Number of instructions
+	int32_t pseudoCount;		// Number of pseudo-registers (TACKY temporaries)
+	int stackSize;				// Bytes of stack used by pseudo-registers
 	Architecture arch;
 } Function;
 
@@ -35,31 +40,57 @@ typedef struct Program {
 // Operand types (shared across architectures)
 typedef enum {
 	OPERAND_IMM,
-	OPERAND_VARNAME,
+	OPERAND_PSEUDO,
 	OPERAND_STACK_SLOT,
 	OPERAND_REGISTER
 } OperandType;
 
+// Hardware registers referenced by the backends (32-bit views).
+typedef enum {
+	// x64
+	REG_EAX,
+	REG_ECX,
+	REG_EDX,
+	REG_R10D,
+	// ARM64
+	REG_W0,
+	REG_W10,
+	REG_W11,
+	REG_W12,
+
+	REG_COUNT
+} Register;
+
 typedef struct {
 	OperandType type;
 	union {
 		int immValue;        // Immediate value
 		int stackOffset;
-		union {
-			const char* varName; // Temporary variable name (from Tacky).
-			const char* regName; // Register name
-		};
+		int32_t pseudoIndex; // Temporary variable index (from Tacky).
+		Register reg;        // Hardware register
 	};
 } Operand;
 
+// Per-function state of the backend passes. Each function gets a fresh one, so
+// stack slots never carry over from the previous function.
 typedef struct {
-	const char* tmpName;
-	int stackOffset;  // e.g., 4, 8, etc.
-} TmpMapping;
+	int* slotOffsets;			// Stack offset of each pseudo-register; 0 until assigned
+	int nextOffset;				// Offset given to the next new pseudo-register
+	int slotSize;				// Bytes reserved per pseudo-register
+} FunctionContext;
+
+void initFunctionContext(FunctionContext* fctx, const Function* func, int slotSize);
+// Returns: stack offset of the pseudo-register, assigning the next free slot on
+// first use.
+int getOrAssignStackSlot(FunctionContext* fctx, int32_t pseudoIndex);
+void destroyFunctionContext(FunctionContext* fctx);
 
 const char* getArchitectureName(Architecture arch);
-void generateCode(const Program* program, const char* outputFilename);
-void printAsmProgram(const Program* program);
+AsmString getRegisterString(Register reg);
+// Functions flagged in `reuse` (optional) are listed by name only.
+void printAsmProgram(FILE* out, const Program* program, const bool* reuse);
+// Release the instruction arrays of every function and the function array.
+void freeAsmProgram(Program* program);
 
 inline int alignTo(int value, int alignment) {
 	return (value + alignment - 1) & ~(alignment - 1);
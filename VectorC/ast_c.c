@@ -9,53 +9,59 @@
 #include <string.h>
 
 #include "ast_c.h"
+#include "arena.h"
 #include "token.h"
 
-ProgramNode* createProgramNode(FunctionNode* function) {
-	ProgramNode* node = (ProgramNode*)malloc(sizeof(ProgramNode));
+// Allocate storage for a node from the AST arena.
+#define allocNode(type) ((type*)arenaAlloc(arena, sizeof(type)))
+
+ProgramNode* createProgramNode(Arena* arena, FunctionNode* function) {
+	ProgramNode* node = allocNode(ProgramNode);
 	node->function = function;
 	return node;
 }
 
-FunctionNode* createFunctionNode(const char* name, StatementNode* body) {
-	FunctionNode* node = (FunctionNode*)malloc(sizeof(FunctionNode));
-	node->name = strdup(name);  // Duplicate the name
+FunctionNode* createFunctionNode(Arena* arena, const char* internedName, StatementNode* body) {
+	FunctionNode* node = allocNode(FunctionNode);
+	node->name = internedName;
 	node->body = body;
 	node->next = NULL;
+	node->source = NULL;
+	node->sourceLength = 0;
 	return node;
 }
 
-StatementNode* createReturnStatementNode(ExpressionNode* expr) {
-	StatementNode* node = (StatementNode*)malloc(sizeof(StatementNode));
+StatementNode* createReturnStatementNode(Arena* arena, ExpressionNode* expr) {
+	StatementNode* node = allocNode(StatementNode);
 	node->type = STMT_RETURN;
 	node->expr = expr;
 	return node;
 }
 
-ExpressionNode* createIntConstant(int value) {
-	ExpressionNode* node = malloc(sizeof(ExpressionNode));
+ExpressionNode* createIntConstant(Arena* arena, int value) {
+	ExpressionNode* node = allocNode(ExpressionNode);
 	node->type = EXP_CONSTANT;
 	node->value.constant.intValue = value;
 	return node;
 }
 
-ExpressionNode* createDoubleConstant(double value) {
-	ExpressionNode* node = malloc(sizeof(ExpressionNode));
+ExpressionNode* createDoubleConstant(Arena* arena, double value) {
+	ExpressionNode* node = allocNode(ExpressionNode);
 	node->type = EXP_CONSTANT;
 	node->value.constant.doubleValue = value;
 	return node;
 }
 
-ExpressionNode* createUnaryNode(UnaryOperator op, ExpressionNode* operand) {
-	ExpressionNode* node = malloc(sizeof(ExpressionNode));
+ExpressionNode* createUnaryNode(Arena* arena, UnaryOperator op, ExpressionNode* operand) {
+	ExpressionNode* node = allocNode(ExpressionNode);
 	node->type = EXP_UNARY;
 	node->value.unary.op = op;
 	node->value.unary.operand = operand;
 	return node;
 }
 
-ExpressionNode* createBinaryNode(BinaryOperator op, ExpressionNode* left, ExpressionNode* right) {
-	ExpressionNode* node = malloc(sizeof(ExpressionNode));
+ExpressionNode* createBinaryNode(Arena* arena, BinaryOperator op, ExpressionNode* left, ExpressionNode* right) {
+	ExpressionNode* node = allocNode(ExpressionNode);
 	node->type = EXP_BINARY;
 	node->value.binary.op = op;
 	node->value.binary.left = left;
@@ -63,23 +69,23 @@ ExpressionNode* createBinaryNode(BinaryOperator op, ExpressionNode* left, Expres
 	return node;
 }
 
-void printExpression(const ExpressionNode* expr, int indent) {
+void printExpression(FILE* out, const ExpressionNode* expr, int indent) {
 	if (!expr) return;
 
 	// Print indentation
 	for (int i = 0; i < indent; i++) {
-		printf("    "); // 4 spaces per indentation level
+		fprintf(out, "    "); // 4 spaces per indentation level
 	}
 
 	switch (expr->type) {
 		case EXP_CONSTANT:
-			printf("Constant(%d)\n", expr->value.constant.intValue);
+			fprintf(out, "Constant(%d)\n", expr->value.constant.intValue);
 			break;
 
 		case EXP_UNARY:
-			printf("Unary(%s)\n",
+			fprintf(out, "Unary(%s)\n",
 				expr->value.unary.op == UNARY_COMPLEMENT ? "~" : "-");
-			printExpression(expr->value.unary.operand, indent + 1);
+			printExpression(out, expr->value.unary.operand, indent + 1);
 			break;
 		case EXP_BINARY: {
 			const char* opStr;
@@ -118,67 +124,38 @@ void printExpression(const ExpressionNode* expr, int indent) {
 					opStr = "?";
 					break;
 			}
-			printf("Binary(%s)\n", opStr);
-			printExpression(expr->value.binary.left, indent + 1);
-			printExpression(expr->value.binary.right, indent + 1);
+			fprintf(out, "Binary(%s)\n", opStr);
+			printExpression(out, expr->value.binary.left, indent + 1);
+			printExpression(out, expr->value.binary.right, indent + 1);
 			break;
 		}
 	}
 }
 
-void printStatement(const StatementNode* stmt) {
+void printStatement(FILE* out, const StatementNode* stmt) {
 	if (!stmt) return;
 
 	switch (stmt->type) {
 		case STMT_RETURN:
-			printf("Return(\n");
-			printExpression(stmt->expr, 3);
-			printf("        )\n");
+			fprintf(out, "Return(\n");
+			printExpression(out, stmt->expr, 3);
+			fprintf(out, "        )\n");
 			break;
 	}
 }
 
-void printFunction(const FunctionNode* func) {
-	if (!func) return;
-
-	printf("    Function(\n        name=%s,\n        body=", func->name);
-	printStatement(func->body);
-	printf("    )\n");
-}
-
-void printProgram(const ProgramNode* program) {
-	if (!program) return;
-
-	printf("Program(\n");
-	printFunction(program->function);
-	printf(")\n");
-}
-
-void freeExpression(ExpressionNode* expr) {
-	if (!expr) return;
-	free(expr);
-}
-
-void freeStatement(StatementNode* stmt) {
-	if (!stmt) return;
-
-	if (stmt->type == STMT_RETURN) {
-		freeExpression(stmt->expr);
-	}
-	free(stmt);
-}
-
-void freeFunction(FunctionNode* func) {
+void printFunction(FILE* out, const FunctionNode* func) {
 	if (!func) return;
 
-	free(func->name); // Free the duplicated string
-	freeStatement(func->body);
-	free(func);
+	fprintf(out, "    Function(\n        name=%s,\n        body=", func->name);
+	printStatement(out, func->body);
+	fprintf(out, "    )\n");
 }
 
-void freeProgram(ProgramNode* program) {
+void printProgram(FILE* out, const ProgramNode* program) {
 	if (!program) return;
 
-	freeFunction(program->function);
-	free(program);
+	fprintf(out, "Program(\n");
+	printFunction(out, program->function);
+	fprintf(out, ")\n");
 }
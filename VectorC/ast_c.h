@@ -8,8 +8,14 @@
 #ifndef ast_h
 #define ast_h
 
+#include <stdio.h>
 #include <stdlib.h>
 
+#include "arena.h"
+
+// Chunk size of the arena that owns a translation unit's AST.
+#define AST_ARENA_CHUNK_SIZE (256 * 1024)
+
 typedef enum {
 	NODE_PROGRAM,
 	NODE_FUNCTION,
@@ -58,9 +64,11 @@ typedef struct ProgramNode {
 
 // Function node
 typedef struct FunctionNode {
-	char* name;						// Function identifier
+	const char* name;				// Function identifier (interned)
 	struct StatementNode* body;		// Body of the function
 	struct FunctionNode* next; // Allows linking multiple functions
+	const char* source;				// Preprocessed text, from the return type to the closing brace
+	size_t sourceLength;
 } FunctionNode;
 
 // Statement node
@@ -91,13 +99,15 @@ typedef struct ExpressionNode {
 	} value;
 } ExpressionNode;
 
-ProgramNode* createProgramNode(FunctionNode* function);
-FunctionNode* createFunctionNode(const char* name, StatementNode* body);
-StatementNode* createReturnStatementNode(ExpressionNode* expr);
-ExpressionNode* createIntConstant(int value);
-ExpressionNode* createUnaryNode(UnaryOperator op, ExpressionNode* operand);
-ExpressionNode* createBinaryNode(BinaryOperator op, ExpressionNode* left, ExpressionNode* right);
+// Nodes and names live in the arena passed to the create functions; the AST
+// is released all at once by resetting or freeing that arena.
+ProgramNode* createProgramNode(Arena* arena, FunctionNode* function);
+FunctionNode* createFunctionNode(Arena* arena, const char* internedName, StatementNode* body);
+StatementNode* createReturnStatementNode(Arena* arena, ExpressionNode* expr);
+ExpressionNode* createIntConstant(Arena* arena, int value);
+ExpressionNode* createUnaryNode(Arena* arena, UnaryOperator op, ExpressionNode* operand);
+ExpressionNode* createBinaryNode(Arena* arena, BinaryOperator op, ExpressionNode* left, ExpressionNode* right);
 
-void printProgram(const ProgramNode* program);
+void printProgram(FILE* out, const ProgramNode* program);
 
 #endif /* ast_h */
@@ -6,149 +6,136 @@
 //
 
 #include "ast_x64.h"
-#include "stb_ds.h"
+#include "stb_ds_config.h"
 #include "tacky.h"
+#include <assert.h>
 #include <stdio.h>
 #include <stdbool.h>
 
-// Convert an operand to a string for x64 (helper function)
-void getX64Operand(const Operand* op, char* buffer, size_t bufferSize) {
+// Write an operand in AT&T syntax.
+static void putX64Operand(AsmBuffer* out, const Operand* op) {
 	switch (op->type) {
 		case OPERAND_IMM:
-			snprintf(buffer, bufferSize, "$%d", op->immValue);
+			asmPutChar(out, '$');
+			asmPutInt(out, op->immValue);
 			break;
-		case OPERAND_VARNAME:
-			snprintf(buffer, bufferSize, "%s", op->varName);
+		case OPERAND_PSEUDO:
+			asmPutLiteral(out, "tmp.");
+			asmPutInt(out, op->pseudoIndex);
 			break;
 		case OPERAND_STACK_SLOT:
-			snprintf(buffer, bufferSize, "%d(%%rbp)", op->stackOffset);
+			asmPutInt(out, op->stackOffset);
+			asmPutLiteral(out, "(%rbp)");
 			break;
 		case OPERAND_REGISTER:
-			snprintf(buffer, bufferSize, "%s", op->regName);
+			asmPutString(out, getRegisterString(op->reg));
 			break;
 	}
 }
 
-// --------------------------------------------------
-// Local helper to track tmp -> stack offsets
-// --------------------------------------------------
-
-static TmpMapping* s_tmpMappings = NULL;
-
-static int s_nextOffset = -4; // global or passed in
-
-int getOrAssignStackOffsetX64(const char* tmpName) {
-	for (int i = 0; i < arrlenu(s_tmpMappings); i++) {
-		if (strcmp(s_tmpMappings[i].tmpName, tmpName) == 0) {
-			return s_tmpMappings[i].stackOffset;
-		}
-	}
-	// New tmp — assign a new slot
-	arrput(s_tmpMappings, ((TmpMapping){
-		.tmpName = strdup(tmpName),
-		.stackOffset = s_nextOffset
-	}));
-	int assigned = s_nextOffset;
-	s_nextOffset -= 4; // Move down the stack
-	return assigned;
-}
+// Bytes of stack reserved for each pseudo-register.
+#define STACK_SLOT_SIZE_X64 4
 
 //---------------------------------------------------------
 // X64 CODEGEN
 //---------------------------------------------------------
-void generateX64Function(FILE* outputFile, const Function* func)
+
+// Which operands an instruction prints, in AT&T order.
+typedef enum {
+	X64_FORM_NONE,		// cdq
+	X64_FORM_SRC,		// negl src
+	X64_FORM_SRC_DST,	// addl src, dst
+	X64_FORM_CL_DST		// sarl %cl, dst
+} X64OperandForm;
+
+static const struct {
+	AsmString mnemonic;
+	X64OperandForm form;
+} s_x64Formats[] = {
+	[X64_ADD] = { ASM_STRING("addl"), X64_FORM_SRC_DST },
+	[X64_AND] = { ASM_STRING("andl"), X64_FORM_SRC_DST },
+	[X64_CDQ] = { ASM_STRING("cdq"), X64_FORM_NONE },
+	[X64_IMUL] = { ASM_STRING("imull"), X64_FORM_SRC_DST },
+	[X64_IDIV] = { ASM_STRING("idivl"), X64_FORM_SRC },
+	[X64_MOV] = { ASM_STRING("movl"), X64_FORM_SRC_DST },
+	[X64_NEG] = { ASM_STRING("negl"), X64_FORM_SRC },
+	[X64_NOT] = { ASM_STRING("notl"), X64_FORM_SRC },
+	[X64_OR] = { ASM_STRING("orl"), X64_FORM_SRC_DST },
+	[X64_RET] = { ASM_STRING("ret"), X64_FORM_NONE },
+	[X64_SUB] = { ASM_STRING("subl"), X64_FORM_SRC_DST },
+	[X64_XOR] = { ASM_STRING("xorl"), X64_FORM_SRC_DST },
+	[X64_SHL_IMM] = { ASM_STRING("shll"), X64_FORM_SRC_DST },
+	[X64_SHL_CL] = { ASM_STRING("shll"), X64_FORM_CL_DST },
+	[X64_SAR_IMM] = { ASM_STRING("sarl"), X64_FORM_SRC_DST },
+	[X64_SAR_CL] = { ASM_STRING("sarl"), X64_FORM_CL_DST },
+};
+
+static_assert(sizeof(s_x64Formats) / sizeof(s_x64Formats[0]) == (int32_t)X64_SAR_CL + 1, "Invalid Instruction");
+
+void emitX64Function(AsmBuffer* out, const Function* func, AsmStyle style)
 {
-	// Decide function label
-	// Typically: `_main` on macOS or `main` on Linux.
-	// This example just demonstrates the logic:
-	const char* funcName = func->name;
+	const bool source = style == ASM_STYLE_SOURCE;
 
+	if (source) {
+		// `_main` on macOS, `main` on Linux.
+		const char* funcName = func->name;
 #ifdef __APPLE__
-	if (strcmp(func->name, "main") == 0) {
-		funcName = "_main";
-	}
+		if (strcmp(func->name, "main") == 0) {
+			funcName = "_main";
+		}
 #endif
+		asmPutLiteral(out, ".global ");
+		asmPutCString(out, funcName);
+		asmPutChar(out, '\n');
+		asmPutCString(out, funcName);
+		asmPutLiteral(out, ":\n");
+
+		// X86-64 prologue
+		asmPutLiteral(out, "    pushq %rbp\n    movq %rsp, %rbp\n    subq $");
+		asmPutInt(out, alignTo(func->stackSize, 16));
+		asmPutLiteral(out, ", %rsp\n");
+	}
 
-	fprintf(outputFile, ".global %s\n", funcName);
-	fprintf(outputFile, "%s:\n", funcName);
-
-	int bytesToAllocate = alignTo(-s_nextOffset, 16);
-	
-	// X86-64 prologue
-	fprintf(outputFile, "    pushq %%rbp\n");
-	fprintf(outputFile, "    movq %%rsp, %%rbp\n");
-	fprintf(outputFile, "    subq $%d, %%rsp\n", bytesToAllocate); // example stack allocation
-
-	// Emit instructions
 	const X64Instruction* instructions = (const X64Instruction*)func->instructions;
-	for (size_t j = 0; j < func->instructionCount; j++) {
-		const X64Instruction* instr = &instructions[j];
+	for (size_t i = 0; i < func->instructionCount; i++) {
+		const X64Instruction* instr = &instructions[i];
 
-		char srcBuffer[32], dstBuffer[32];
-		getX64Operand(&instr->src, srcBuffer, sizeof(srcBuffer));
-		getX64Operand(&instr->dst, dstBuffer, sizeof(dstBuffer));
+		if (instr->type == X64_RET && source) {
+			// X86-64 epilogue
+			asmPutLiteral(out, "    movq %rbp, %rsp\n    popq %rbp\n    ret\n");
+			continue;
+		}
 
-		switch (instr->type) {
-			case X64_ADD:
-				fprintf(outputFile, "    addl %s, %s\n", srcBuffer, dstBuffer);
-				break;
-			case X64_AND:
-				fprintf(outputFile, "    andl %s, %s\n", srcBuffer, dstBuffer);
-				break;
-			case X64_CDQ:
-				fprintf(outputFile, "    cdq\n");
-				break;
-			case X64_IDIV:
-				fprintf(outputFile, "    idivl %s\n", srcBuffer);
-				break;
-			case X64_IMUL:
-				fprintf(outputFile, "    imull %s, %s\n", srcBuffer, dstBuffer);
-				break;
-			case X64_MOV:
-				// Example: move immediate into a register or memory
-				fprintf(outputFile, "    movl %s, %s\n", srcBuffer, dstBuffer);
-				break;
-			case X64_NEG:
-				fprintf(outputFile, "    negl %s\n", srcBuffer);
-				break;
-			case X64_NOT:
-				fprintf(outputFile, "    notl %s\n", srcBuffer);
-				break;
-			case X64_OR:
-				fprintf(outputFile, "    orl %s, %s\n", srcBuffer, dstBuffer);
-				break;
-			case X64_RET:
-				// X86-64 epilogue
-				fprintf(outputFile, "    movq %%rbp, %%rsp\n");
-				fprintf(outputFile, "    popq %%rbp\n");
-				fprintf(outputFile, "    ret\n");
-				break;
-			case X64_SAR_CL: {
-				fprintf(outputFile, "    sarl %%cl, %s\n", dstBuffer);
-				break;
-			}
-			case X64_SAR_IMM: {
-				fprintf(outputFile, "    sarl %s, %s\n", srcBuffer, dstBuffer);
+		if (source) {
+			asmPutLiteral(out, "    ");
+		} else {
+			asmPutLiteral(out, "  ");
+		}
+		asmPutString(out, s_x64Formats[instr->type].mnemonic);
+		switch (s_x64Formats[instr->type].form) {
+			case X64_FORM_NONE:
 				break;
-			}
-			case X64_SHL_CL: {
-				fprintf(outputFile, "    shll %%cl, %s\n", dstBuffer);
+			case X64_FORM_SRC:
+				asmPutChar(out, ' ');
+				putX64Operand(out, &instr->src);
 				break;
-			}
-			case X64_SHL_IMM: {
-				fprintf(outputFile, "    shll %s, %s\n", srcBuffer, dstBuffer);
+			case X64_FORM_SRC_DST:
+				asmPutChar(out, ' ');
+				putX64Operand(out, &instr->src);
+				asmPutLiteral(out, ", ");
+				putX64Operand(out, &instr->dst);
 				break;
-			}
-			case X64_SUB:
-				fprintf(outputFile, "    subl %s, %s\n", srcBuffer, dstBuffer);
-				break;
-			case X64_XOR:
-				fprintf(outputFile, "    xorl %s, %s\n", srcBuffer, dstBuffer);
+			case X64_FORM_CL_DST:
+				asmPutLiteral(out, " %cl, ");
+				putX64Operand(out, &instr->dst);
 				break;
 		}
+		asmPutChar(out, '\n');
 	}
 
-	fprintf(outputFile, "\n"); // Blank line between functions
+	if (source) {
+		asmPutChar(out, '\n'); // Blank line between functions
+	}
 }
 
 static void emitX64(X64Instruction** instructions, X64Instruction x64Instruction) {
@@ -159,396 +146,302 @@ static void emitX64(X64Instruction** instructions, X64Instruction x64Instruction
 // Main translation function
 // --------------------------------------------------
 
-void translateTackyToX64(const TackyProgram* tackyProgram, Program* asmProgram) {
-#define VAR(var) ((Operand){ .type = OPERAND_VARNAME, .varName = var })
-#define REG(reg) ((Operand){ .type = OPERAND_REGISTER, .regName = reg })
+void translateTackyFunctionToX64(const TackyFunction* tackyFunc, Function* asmFunc) {
+#define VAR(var) ((Operand){ .type = OPERAND_PSEUDO, .pseudoIndex = var })
+#define REG(r) ((Operand){ .type = OPERAND_REGISTER, .reg = r })
 #define IMM(val) ((Operand){ .type = OPERAND_IMM, .immValue = val })
-	for (size_t i = 0; i < arrlenu(tackyProgram->functions); i++) {
-		const TackyFunction* tackyFunc = &tackyProgram->functions[i];
-		Function asmFunc = {0};
-		asmFunc.name = strdup(tackyFunc->name);
-		asmFunc.arch = ARCH_X64;
-
-		X64Instruction* x64Instructions = (X64Instruction*)asmFunc.instructions;
-
-		for (size_t j = 0; j < arrlenu(tackyFunc->instructions); j++) {
-			const TackyInstruction* instr = &tackyFunc->instructions[j];
-
-			switch (instr->type) {
-				case TACKY_INSTR_UNARY: {
-					// Load src into %eax
-					Operand srcOperand;
-					if (instr->unary.src.type == TACKY_VAL_CONSTANT) {
-						srcOperand = IMM(instr->unary.src.constantValue);
-					} else {
-						srcOperand = VAR(instr->unary.src.varName);
-					}
+	*asmFunc = (Function){
+		.name = tackyFunc->name,
+		.pseudoCount = tackyFunc->tempCount,
+		.arch = ARCH_X64
+	};
 
-					emitX64(&x64Instructions, ((X64Instruction) {
-						.type = X64_MOV,
-						.src = srcOperand,
-						.dst = VAR(instr->unary.dst.varName),
-					}));
-					
-					// Apply operation on %eax
-					X64InstructionType opcodeType;
-					switch (instr->unary.op) {
-						case TACKY_NEGATE:
-							opcodeType = X64_NEG;
-							break;
-						case TACKY_COMPLEMENT:
-							opcodeType = X64_NOT;
-							break;
-					}
+	X64Instruction* x64Instructions = NULL;
 
-					emitX64(&x64Instructions, ((X64Instruction) {
-						.type = opcodeType,
-						.src = VAR(instr->unary.dst.varName),
-					}));
-					break;
-				}
-				case TACKY_INSTR_BINARY: {
-					const TackyBinaryOperator op = instr->binary.op;
+	for (size_t j = 0; j < arrlenu(tackyFunc->instructions); j++) {
+		const TackyInstruction* instr = &tackyFunc->instructions[j];
 
-					// --- Special-case: DIV/MOD need EAX/EDX + CDQ + IDIV ---
-					if (op == TACKY_DIVIDE || op == TACKY_MODULO) {
-						// LHS -> %eax (dividend low 32)
-						Operand lhs = (instr->binary.lhs.type == TACKY_VAL_CONSTANT)
-							? IMM(instr->binary.lhs.constantValue)
-							: VAR(instr->binary.lhs.varName);
+		switch (instr->type) {
+			case TACKY_INSTR_UNARY: {
+				// Load src into %eax
+				Operand srcOperand;
+				if (instr->unary.src.type == TACKY_VAL_CONSTANT) {
+					srcOperand = IMM(instr->unary.src.constantValue);
+				} else {
+					srcOperand = VAR(instr->unary.src.varIndex);
+				}
 
-						emitX64(&x64Instructions, (X64Instruction){
-							.type = X64_MOV, .src = lhs, .dst = REG("%eax")
-						});
+				emitX64(&x64Instructions, ((X64Instruction) {
+					.type = X64_MOV,
+					.src = srcOperand,
+					.dst = VAR(instr->unary.dst.varIndex),
+				}));
+				
+				// Apply operation on %eax
+				X64InstructionType opcodeType;
+				switch (instr->unary.op) {
+					case TACKY_NEGATE:
+						opcodeType = X64_NEG;
+						break;
+					case TACKY_COMPLEMENT:
+						opcodeType = X64_NOT;
+						break;
+				}
 
-						// Sign-extend EAX into EDX (so EDX:EAX is the dividend)
-						emitX64(&x64Instructions, (X64Instruction){ .type = X64_CDQ });
+				emitX64(&x64Instructions, ((X64Instruction) {
+					.type = opcodeType,
+					.src = VAR(instr->unary.dst.varIndex),
+				}));
+				break;
+			}
+			case TACKY_INSTR_BINARY: {
+				const TackyBinaryOperator op = instr->binary.op;
 
-						// Divisor can be imm or var; your Pass 3 already fixes imm->reg for IDIV
-						Operand rhs = (instr->binary.rhs.type == TACKY_VAL_CONSTANT)
-							? IMM(instr->binary.rhs.constantValue)
-							: VAR(instr->binary.rhs.varName);
+				// --- Special-case: DIV/MOD need EAX/EDX + CDQ + IDIV ---
+				if (op == TACKY_DIVIDE || op == TACKY_MODULO) {
+					// LHS -> %eax (dividend low 32)
+					Operand lhs = (instr->binary.lhs.type == TACKY_VAL_CONSTANT)
+						? IMM(instr->binary.lhs.constantValue)
+						: VAR(instr->binary.lhs.varIndex);
 
-						emitX64(&x64Instructions, (X64Instruction){
-							.type = X64_IDIV, .src = rhs
-						});
+					emitX64(&x64Instructions, (X64Instruction){
+						.type = X64_MOV, .src = lhs, .dst = REG(REG_EAX)
+					});
 
-						// Store result: quotient -> EAX for DIV, remainder -> EDX for MOD
-						emitX64(&x64Instructions, (X64Instruction){
-							.type = X64_MOV,
-							.src  = (op == TACKY_DIVIDE) ? REG("%eax") : REG("%edx"),
-							.dst  = VAR(instr->binary.dst.varName),
-						});
-						break; // done with DIV/MOD
-					}
+					// Sign-extend EAX into EDX (so EDX:EAX is the dividend)
+					emitX64(&x64Instructions, (X64Instruction){ .type = X64_CDQ });
 
-					// --- Generic path: dst = lhs; then apply op with rhs (covers & | ^ << >> and + - *) ---
-					const char* dst = instr->binary.dst.varName;
+					// Divisor can be imm or var; your Pass 3 already fixes imm->reg for IDIV
+					Operand rhs = (instr->binary.rhs.type == TACKY_VAL_CONSTANT)
+						? IMM(instr->binary.rhs.constantValue)
+						: VAR(instr->binary.rhs.varIndex);
 
-					Operand lhs = (instr->binary.lhs.type == TACKY_VAL_CONSTANT)
-						? IMM(instr->binary.lhs.constantValue)
-						: VAR(instr->binary.lhs.varName);
+					emitX64(&x64Instructions, (X64Instruction){
+						.type = X64_IDIV, .src = rhs
+					});
 
-					// 1) dst = lhs
+					// Store result: quotient -> EAX for DIV, remainder -> EDX for MOD
 					emitX64(&x64Instructions, (X64Instruction){
-						.type = X64_MOV, .src = lhs, .dst = VAR(dst)
+						.type = X64_MOV,
+						.src  = (op == TACKY_DIVIDE) ? REG(REG_EAX) : REG(REG_EDX),
+						.dst  = VAR(instr->binary.dst.varIndex),
 					});
+					break; // done with DIV/MOD
+				}
 
-					// 2) Apply the operation
-					if (op == TACKY_SHIFT_LEFT || op == TACKY_SHIFT_RIGHT) {
-						const bool rhs_is_imm = (instr->binary.rhs.type == TACKY_VAL_CONSTANT);
-						if (rhs_is_imm) {
-							emitX64(&x64Instructions, (X64Instruction){
-								.type = (op == TACKY_SHIFT_LEFT) ? X64_SHL_IMM : X64_SAR_IMM, // signed int => SAR
-								.src  = IMM(instr->binary.rhs.constantValue),
-								.dst  = VAR(dst),
-							});
-						} else {
-							emitX64(&x64Instructions, (X64Instruction){
-								.type = X64_MOV,
-								.src  = VAR(instr->binary.rhs.varName),
-								.dst  = REG("%ecx"), // CL
-							});
-							emitX64(&x64Instructions, (X64Instruction){
-								.type = (op == TACKY_SHIFT_LEFT) ? X64_SHL_CL : X64_SAR_CL,
-								.dst  = VAR(dst), // CL is implicit
-							});
-						}
-					} else {
-						X64InstructionType xop =
-							(op == TACKY_ADD)           ? X64_ADD :
-							(op == TACKY_SUBTRACT)      ? X64_SUB :
-							(op == TACKY_MULTIPLY)      ? X64_IMUL :
-							(op == TACKY_BITWISE_AND)   ? X64_AND :
-							(op == TACKY_BITWISE_OR)    ? X64_OR  :
-							/* TACKY_BITWISE_XOR */       X64_XOR;
-
-						Operand rhs = (instr->binary.rhs.type == TACKY_VAL_CONSTANT)
-							? IMM(instr->binary.rhs.constantValue)
-							: VAR(instr->binary.rhs.varName);
+				// --- Generic path: dst = lhs; then apply op with rhs (covers & | ^ << >> and + - *) ---
+				const int32_t dst = instr->binary.dst.varIndex;
+
+				Operand lhs = (instr->binary.lhs.type == TACKY_VAL_CONSTANT)
+					? IMM(instr->binary.lhs.constantValue)
+					: VAR(instr->binary.lhs.varIndex);
+
+				// 1) dst = lhs
+				emitX64(&x64Instructions, (X64Instruction){
+					.type = X64_MOV, .src = lhs, .dst = VAR(dst)
+				});
 
+				// 2) Apply the operation
+				if (op == TACKY_SHIFT_LEFT || op == TACKY_SHIFT_RIGHT) {
+					const bool rhs_is_imm = (instr->binary.rhs.type == TACKY_VAL_CONSTANT);
+					if (rhs_is_imm) {
 						emitX64(&x64Instructions, (X64Instruction){
-							.type = xop, .src = rhs, .dst = VAR(dst)
+							.type = (op == TACKY_SHIFT_LEFT) ? X64_SHL_IMM : X64_SAR_IMM, // signed int => SAR
+							.src  = IMM(instr->binary.rhs.constantValue),
+							.dst  = VAR(dst),
 						});
-					}
-					break;
-				}
-				case TACKY_INSTR_RETURN: {
-					Operand srcOperand;
-					if (instr->ret.value.type == TACKY_VAL_CONSTANT) {
-						srcOperand = IMM(instr->ret.value.constantValue);
 					} else {
-						srcOperand = VAR(instr->ret.value.varName);
+						emitX64(&x64Instructions, (X64Instruction){
+							.type = X64_MOV,
+							.src  = VAR(instr->binary.rhs.varIndex),
+							.dst  = REG(REG_ECX), // CL
+						});
+						emitX64(&x64Instructions, (X64Instruction){
+							.type = (op == TACKY_SHIFT_LEFT) ? X64_SHL_CL : X64_SAR_CL,
+							.dst  = VAR(dst), // CL is implicit
+						});
 					}
-					emitX64(&x64Instructions, (X64Instruction) {
-						.type = X64_MOV,
-						.src = srcOperand,
-						.dst = REG("%eax")
-					});
+				} else {
+					X64InstructionType xop =
+						(op == TACKY_ADD)           ? X64_ADD :
+						(op == TACKY_SUBTRACT)      ? X64_SUB :
+						(op == TACKY_MULTIPLY)      ? X64_IMUL :
+						(op == TACKY_BITWISE_AND)   ? X64_AND :
+						(op == TACKY_BITWISE_OR)    ? X64_OR  :
+						/* TACKY_BITWISE_XOR */       X64_XOR;
+
+					Operand rhs = (instr->binary.rhs.type == TACKY_VAL_CONSTANT)
+						? IMM(instr->binary.rhs.constantValue)
+						: VAR(instr->binary.rhs.varIndex);
 
-					emitX64(&x64Instructions, (X64Instruction) {
-						.type = X64_RET,
+					emitX64(&x64Instructions, (X64Instruction){
+						.type = xop, .src = rhs, .dst = VAR(dst)
 					});
-					break;
 				}
+				break;
+			}
+			case TACKY_INSTR_RETURN: {
+				Operand srcOperand;
+				if (instr->ret.value.type == TACKY_VAL_CONSTANT) {
+					srcOperand = IMM(instr->ret.value.constantValue);
+				} else {
+					srcOperand = VAR(instr->ret.value.varIndex);
+				}
+				emitX64(&x64Instructions, (X64Instruction) {
+					.type = X64_MOV,
+					.src = srcOperand,
+					.dst = REG(REG_EAX)
+				});
+
+				emitX64(&x64Instructions, (X64Instruction) {
+					.type = X64_RET,
+				});
+				break;
 			}
 		}
+	}
 
-		asmFunc.instructions = x64Instructions;
-		asmFunc.instructionCount = arrlenu(x64Instructions);
-		arrput(asmProgram->functions, asmFunc);
-		asmProgram->functionCount = arrlenu(asmProgram->functions);
+	asmFunc->instructions = x64Instructions;
+	asmFunc->instructionCount = arrlenu(x64Instructions);
 #undef IMM
 #undef REG
 #undef VAR
-	}
 }
 
-void replacePseudoRegistersX64(Program* asmProgram) {
+void replacePseudoRegistersX64(Function* func) {
 #define SLOT(offset) ((Operand){ .type = OPERAND_STACK_SLOT, .stackOffset = offset })
-	for (size_t iFunc = 0; iFunc < asmProgram->functionCount; iFunc++) {
-		const Function* func = &asmProgram->functions[iFunc];
+	const X64Instruction* instructions = (const X64Instruction*)func->instructions;
 
-		const X64Instruction* instructions = (const X64Instruction*)func->instructions;
+	FunctionContext fctx;
+	initFunctionContext(&fctx, func, STACK_SLOT_SIZE_X64);
 
-		for (size_t i = 0; i < func->instructionCount; i++) {
-			X64Instruction* instr = (X64Instruction*)&instructions[i];
-			
-			if (instr->src.type == OPERAND_VARNAME) {
-				int offset = getOrAssignStackOffsetX64(instr->src.varName);
-				instr->src = SLOT(offset);
-			}
+	for (size_t i = 0; i < func->instructionCount; i++) {
+		X64Instruction* instr = (X64Instruction*)&instructions[i];
+		
+		if (instr->src.type == OPERAND_PSEUDO) {
+			int offset = getOrAssignStackSlot(&fctx, instr->src.pseudoIndex);
+			instr->src = SLOT(offset);
+		}
 
-			if (instr->dst.type == OPERAND_VARNAME) {
-				int offset = getOrAssignStackOffsetX64(instr->dst.varName);
-				instr->dst = SLOT(offset);
-			}
+		if (instr->dst.type == OPERAND_PSEUDO) {
+			int offset = getOrAssignStackSlot(&fctx, instr->dst.pseudoIndex);
+			instr->dst = SLOT(offset);
 		}
 	}
+
+	func->stackSize = -fctx.nextOffset;
+	destroyFunctionContext(&fctx);
 #undef SLOT
 }
 
-void fixupIllegalInstructionsX64(Program* asmProgram, Program* finalAsmProgram) {
-#define REG(reg) ((Operand){ .type = OPERAND_REGISTER, .regName = reg })
-	const Operand scratch = REG("%r10d");
+void fixupIllegalInstructionsX64(const Function* srcFunc, Function* outFunc) {
+#define REG(r) ((Operand){ .type = OPERAND_REGISTER, .reg = r })
+	const Operand scratch = REG(REG_R10D);
 
-	for (size_t iFunc = 0; iFunc < asmProgram->functionCount; iFunc++) {
-		const Function* srcFunc = &asmProgram->functions[iFunc];
+	*outFunc = (Function){
+		.name = srcFunc->name,
+		.pseudoCount = srcFunc->pseudoCount,
+		.stackSize = srcFunc->stackSize,
+		.arch = srcFunc->arch
+	};
 
-		Function outFunc = {
-			.name = strdup(srcFunc->name),
-			.arch = srcFunc->arch
-		};
+	X64Instruction* fixedInstructions = NULL;
+	const X64Instruction* instrs = (const X64Instruction*)srcFunc->instructions;
 
-		X64Instruction* fixedInstructions = NULL;
-		const X64Instruction* instrs = (const X64Instruction*)srcFunc->instructions;
+	for (size_t i = 0; i < srcFunc->instructionCount; i++) {
+		const X64Instruction* instr = &instrs[i];
 
-		for (size_t i = 0; i < srcFunc->instructionCount; i++) {
-			const X64Instruction* instr = &instrs[i];
+		bool srcIsMem = instr->src.type == OPERAND_STACK_SLOT;
+		bool dstIsMem = instr->dst.type == OPERAND_STACK_SLOT;
 
-			bool srcIsMem = instr->src.type == OPERAND_STACK_SLOT;
-			bool dstIsMem = instr->dst.type == OPERAND_STACK_SLOT;
-
-			switch (instr->type) {
-				case X64_MOV:
-					if (srcIsMem && dstIsMem) {
-						// mov [mem], [mem] → use scratch reg
-						arrput(fixedInstructions, ((X64Instruction){
-							.type = X64_MOV,
-							.src = instr->src,
-							.dst = scratch
-						}));
-						arrput(fixedInstructions, ((X64Instruction){
-							.type = X64_MOV,
-							.src = scratch,
-							.dst = instr->dst
-						}));
-					} else {
-						arrput(fixedInstructions, *instr);
-					}
-					break;
-
-				case X64_ADD:
-				case X64_SUB:
-				case X64_IMUL:
-				case X64_AND:
-				case X64_OR:
-				case X64_XOR:
-					if (srcIsMem && dstIsMem) {
-						// <op> [mem], [mem] → fix via scratch
-						arrput(fixedInstructions, ((X64Instruction){
-							.type = X64_MOV,
-							.src = instr->dst,
-							.dst = scratch
-						}));
-						arrput(fixedInstructions, ((X64Instruction){
-							.type = instr->type,
-							.src = instr->src,
-							.dst = scratch
-						}));
-						arrput(fixedInstructions, ((X64Instruction){
-							.type = X64_MOV,
-							.src = scratch,
-							.dst = instr->dst
-						}));
-					}
-					else if (instr->type == X64_IMUL && instr->src.type == OPERAND_IMM && instr->dst.type == OPERAND_STACK_SLOT) {
-						// imull $imm, [mem] — illegal
-						arrput(fixedInstructions, ((X64Instruction){
-							.type = X64_MOV,
-							.src = instr->dst,
-							.dst = scratch
-						}));
-						arrput(fixedInstructions, ((X64Instruction){
-							.type = X64_IMUL,
-							.src = instr->src,      // $imm
-							.dst = scratch
-						}));
-						arrput(fixedInstructions, ((X64Instruction){
-							.type = X64_MOV,
-							.src = scratch,
-							.dst = instr->dst
-						}));
-					} else {
-						arrput(fixedInstructions, *instr);  // fallback
-					}
-					break;
-				case X64_IDIV:
-					if (instr->src.type == OPERAND_IMM) {
-						arrput(fixedInstructions, ((X64Instruction){
-							.type = X64_MOV,
-							.src = instr->src,
-							.dst = scratch
-						}));
-						arrput(fixedInstructions, ((X64Instruction){
-							.type = X64_IDIV,
-							.src = scratch
-						}));
-					} else {
-						arrput(fixedInstructions, *instr);
-					}
-					break;
-				default:
-					// All other instructions can be copied directly
+		switch (instr->type) {
+			case X64_MOV:
+				if (srcIsMem && dstIsMem) {
+					// mov [mem], [mem] → use scratch reg
+					arrput(fixedInstructions, ((X64Instruction){
+						.type = X64_MOV,
+						.src = instr->src,
+						.dst = scratch
+					}));
+					arrput(fixedInstructions, ((X64Instruction){
+						.type = X64_MOV,
+						.src = scratch,
+						.dst = instr->dst
+					}));
+				} else {
 					arrput(fixedInstructions, *instr);
-					break;
-			}
-		}
-
-		outFunc.instructions = fixedInstructions;
-		outFunc.instructionCount = arrlenu(fixedInstructions);
-		arrput(finalAsmProgram->functions, outFunc);
-		finalAsmProgram->functionCount = arrlenu(finalAsmProgram->functions);
-	}
-
-#undef REG
-}
-
-void printX64Function(const Function* function) {
-	const X64Instruction* instructions = (const X64Instruction*)function->instructions;
-	char srcBuffer[32];
-	char dstBuffer[32];
+				}
+				break;
 
-	for (size_t i = 0; i < function->instructionCount; i++) {
-		const X64Instruction* instr = &instructions[i];
-		switch (instr->type) {
 			case X64_ADD:
-				getX64Operand(&instr->src, srcBuffer, sizeof(srcBuffer));
-				getX64Operand(&instr->dst, dstBuffer, sizeof(dstBuffer));
-				printf("  addl %s, %s\n", srcBuffer, dstBuffer);
-				break;
-			case X64_AND:
-				getX64Operand(&instr->src, srcBuffer, sizeof(srcBuffer));
-				getX64Operand(&instr->dst, dstBuffer, sizeof(dstBuffer));
-				printf("  andl %s, %s\n", srcBuffer, dstBuffer);
-				break;
-			case X64_CDQ:
-				printf("  cdq\n");
-				break;
-			case X64_IDIV:
-				getX64Operand(&instr->src, srcBuffer, sizeof(srcBuffer));
-				getX64Operand(&instr->dst, dstBuffer, sizeof(dstBuffer));
-				printf("  idivl %s\n", srcBuffer);
-				break;
+			case X64_SUB:
 			case X64_IMUL:
-				getX64Operand(&instr->src, srcBuffer, sizeof(srcBuffer));
-				getX64Operand(&instr->dst, dstBuffer, sizeof(dstBuffer));
-				printf("  imul %s, %s\n", srcBuffer, dstBuffer);
-				break;
-			case X64_MOV:
-				getX64Operand(&instr->src, srcBuffer, sizeof(srcBuffer));
-				getX64Operand(&instr->dst, dstBuffer, sizeof(dstBuffer));
-				printf("  movl %s, %s\n", srcBuffer, dstBuffer);
-				break;
-			case X64_NEG:
-				getX64Operand(&instr->src, srcBuffer, sizeof(srcBuffer));
-				printf("  negl %s\n", srcBuffer);
-				break;
-			case X64_NOT:
-				getX64Operand(&instr->src, srcBuffer, sizeof(srcBuffer));
-				printf("  notl %s\n", srcBuffer);
-				break;
+			case X64_AND:
 			case X64_OR:
-				getX64Operand(&instr->src, srcBuffer, sizeof(srcBuffer));
-				getX64Operand(&instr->dst, dstBuffer, sizeof(dstBuffer));
-				printf("  orl %s, %s\n", srcBuffer, dstBuffer);
-				break;
-			case X64_RET:
-				printf("  ret\n");
-				break;
-			case X64_SAR_CL: {
-				getX64Operand(&instr->dst, dstBuffer, sizeof dstBuffer);
-				printf("  sarl %%cl, %s\n", dstBuffer);
-				break;
-			}
-			case X64_SAR_IMM: {
-				getX64Operand(&instr->dst, dstBuffer, sizeof dstBuffer);
-				printf("  sarl $%d, %s\n", instr->src.immValue, dstBuffer);
-				break;
-			}
-			case X64_SHL_CL: {
-				getX64Operand(&instr->dst, dstBuffer, sizeof dstBuffer);
-				printf("  shll %%cl, %s\n", dstBuffer);
-				break;
-			}
-			case X64_SHL_IMM: {
-				getX64Operand(&instr->dst, dstBuffer, sizeof dstBuffer);
-				printf("  shll $%d, %s\n", instr->src.immValue, dstBuffer);
-				break;
-			}
-			case X64_SUB:
-				getX64Operand(&instr->src, srcBuffer, sizeof(srcBuffer));
-				getX64Operand(&instr->dst, dstBuffer, sizeof(dstBuffer));
-				printf("  subl %s, %s\n", srcBuffer, dstBuffer);
-				break;
 			case X64_XOR:
-				getX64Operand(&instr->src, srcBuffer, sizeof(srcBuffer));
-				getX64Operand(&instr->dst, dstBuffer, sizeof(dstBuffer));
-				printf("  xorl %s, %s\n", srcBuffer, dstBuffer);
+				if (srcIsMem && dstIsMem) {
+					// <op> [mem], [mem] → fix via scratch
+					arrput(fixedInstructions, ((X64Instruction){
+						.type = X64_MOV,
+						.src = instr->dst,
+						.dst = scratch
+					}));
+					arrput(fixedInstructions, ((X64Instruction){
+						.type = instr->type,
+						.src = instr->src,
+						.dst = scratch
+					}));
+					arrput(fixedInstructions, ((X64Instruction){
+						.type = X64_MOV,
+						.src = scratch,
+						.dst = instr->dst
+					}));
+				}
+				else if (instr->type == X64_IMUL && instr->src.type == OPERAND_IMM && instr->dst.type == OPERAND_STACK_SLOT) {
+					// imull $imm, [mem] — illegal
+					arrput(fixedInstructions, ((X64Instruction){
+						.type = X64_MOV,
+						.src = instr->dst,
+						.dst = scratch
+					}));
+					arrput(fixedInstructions, ((X64Instruction){
+						.type = X64_IMUL,
+						.src = instr->src,      // $imm
+						.dst = scratch
+					}));
+					arrput(fixedInstructions, ((X64Instruction){
+						.type = X64_MOV,
+						.src = scratch,
+						.dst = instr->dst
+					}));
+				} else {
+					arrput(fixedInstructions, *instr);  // fallback
+				}
+				break;
+			case X64_IDIV:
+				if (instr->src.type == OPERAND_IMM) {
+					arrput(fixedInstructions, ((X64Instruction){
+						.type = X64_MOV,
+						.src = instr->src,
+						.dst = scratch
+					}));
+					arrput(fixedInstructions, ((X64Instruction){
+						.type = X64_IDIV,
+						.src = scratch
+					}));
+				} else {
+					arrput(fixedInstructions, *instr);
+				}
 				break;
 			default:
-				printf("  Unknown instruction\n");
+				// All other instructions can be copied directly
+				arrput(fixedInstructions, *instr);
 				break;
 		}
 	}
+
+	outFunc->instructions = fixedInstructions;
+	outFunc->instructionCount = arrlenu(fixedInstructions);
+
+#undef REG
 }
@@ -10,7 +10,7 @@
 
 #include "ast_asm_common.h"
 #include "tacky.h"
-#include "stb_ds.h"
+#include "stb_ds_config.h"
 
 // x64 instruction types
 typedef enum {
@@ -43,13 +43,15 @@ typedef struct X64Instruction {
 	Operand dst; // Destination operand
 } X64Instruction;
 
-// Function declarations for x64 code generation
-void getX64Operand(const Operand* op, char* buffer, size_t bufferSize);
-int getOrAssignStackOffsetX64(const char* tmpName);
-void generateX64Function(FILE* outputFile, const Function* func);
-void translateTackyToX64(const TackyProgram* tackyProgram, Program* asmProgram);
-void replacePseudoRegistersX64(Program* asmProgram);
-void fixupIllegalInstructionsX64(Program* asmProgram, Program* finalAsmProgram);
-void printX64Function(const Function* function);
+// Function declarations for x64 code generation. Each pass works on a single
+// function and touches nothing else, so functions can be lowered on
+// different threads.
+void translateTackyFunctionToX64(const TackyFunction* tackyFunc, Function* asmFunc);
+// Assign a stack slot to every pseudo-register, in place.
+void replacePseudoRegistersX64(Function* func);
+// Rewrite operand combinations the instruction set cannot encode into outFunc.
+void fixupIllegalInstructionsX64(const Function* srcFunc, Function* outFunc);
+// Append a function to the buffer, either as assembler source or as a listing.
+void emitX64Function(AsmBuffer* out, const Function* func, AsmStyle style);
 
 #endif /* ast_x64_h */
@@ -0,0 +1,351 @@
+//
+//  backend.c
+//  VectorC
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "backend.h"
+#include "compiler_context.h"
+#include "ast_x64.h"
+#include "ast_arm64.h"
+#include "x64_encoder.h"
+#include "thread.h"
+#include "time_report.h"
+#include "time_trace.h"
+#include "perf_counters.h"
+#include "stb_ds_config.h"
+
+// Below this many functions per thread, starting threads costs more than
+// lowering the functions does.
+#define MIN_FUNCTIONS_PER_THREAD 64
+
+// Functions a worker claims at a time, at most. Runs are kept short enough
+// that the workers finish at about the same time.
+#define MAX_FUNCTIONS_PER_CLAIM 64
+
+// Starting size of a worker's in-memory assembly buffer.
+#define WORKER_TEXT_SIZE (64 * 1024)
+
+typedef struct {
+	const TackyProgram* tackyProgram;
+	Program* program;
+	BackendOutput* output;
+	Architecture arch;
+	const bool* reuse;			// Functions whose output is supplied later
+	PhaseTimes* times;			// The calling thread's, with -ftime-report
+	const char* inputFilename;	// For -ftime-trace events on helper threads
+	bool trace;					// -ftime-trace: an event per function and pass
+	Mutex lock;					// Guards nextFunction
+	size_t nextFunction;
+	size_t functionCount;
+	size_t claimSize;
+} BackendState;
+
+typedef struct {
+	BackendState* state;
+	uint32_t index;
+	bool started;
+	Thread thread;
+	PhaseTimes times;			// Helper threads' own, with -ftime-report
+} BackendWorker;
+
+static bool isReused(const BackendState* state, size_t index) {
+	return state->reuse != NULL && state->reuse[index];
+}
+
+static uint64_t beginFunctionEvent(const BackendState* state) {
+	return state->trace ? readWallNanoseconds() : 0;
+}
+
+// Record one function's share of a pass as a trace event of its own, named
+// after the function, inside the event for the pass.
+static void endFunctionEvent(const BackendState* state, CompilerPhase pass, size_t index, uint64_t start) {
+	if (state->trace) {
+		traceEvent(getPhaseName(pass), state->tackyProgram->functions[index].name, start);
+	}
+}
+
+// Run the three passes over a run of functions, each pass over the whole run
+// before the next, leaving the results at the same indices of the final
+// program. Reused functions keep only their name.
+static void lowerFunctions(BackendState* state, size_t begin, size_t end, PhaseTimes* times) {
+	Function pending[MAX_FUNCTIONS_PER_CLAIM];
+	bool x64 = state->arch == ARCH_X64;
+
+	switchPhase(times, PHASE_TRANSLATE);
+	for (size_t i = begin; i < end; i++) {
+		if (isReused(state, i)) {
+			state->program->functions[i] = (Function){ .name = state->tackyProgram->functions[i].name, .arch = state->arch };
+			continue;
+		}
+		uint64_t start = beginFunctionEvent(state);
+		if (x64) {
+			translateTackyFunctionToX64(&state->tackyProgram->functions[i], &pending[i - begin]);
+		} else {
+			translateTackyFunctionToARM64(&state->tackyProgram->functions[i], &pending[i - begin]);
+		}
+		endFunctionEvent(state, PHASE_TRANSLATE, i, start);
+	}
+
+	switchPhase(times, PHASE_REPLACE_PSEUDOS);
+	for (size_t i = begin; i < end; i++) {
+		if (isReused(state, i)) {
+			continue;
+		}
+		uint64_t start = beginFunctionEvent(state);
+		if (x64) {
+			replacePseudoRegistersX64(&pending[i - begin]);
+		} else {
+			replacePseudoRegistersARM64(&pending[i - begin]);
+		}
+		endFunctionEvent(state, PHASE_REPLACE_PSEUDOS, i, start);
+	}
+
+	switchPhase(times, PHASE_FIXUP);
+	for (size_t i = begin; i < end; i++) {
+		if (isReused(state, i)) {
+			continue;
+		}
+		uint64_t start = beginFunctionEvent(state);
+		if (x64) {
+			fixupIllegalInstructionsX64(&pending[i - begin], &state->program->functions[i]);
+		} else {
+			fixupIllegalInstructionsARM64(&pending[i - begin], &state->program->functions[i]);
+		}
+		arrfree(pending[i - begin].instructions);
+		endFunctionEvent(state, PHASE_FIXUP, i, start);
+	}
+}
+
+static void runBackendWorker(void* argument) {
+	BackendWorker* worker = (BackendWorker*)argument;
+	BackendState* state = worker->state;
+	BackendOutput* output = state->output;
+
+	// The calling thread goes on charging its own times; helpers keep theirs
+	// apart until they are joined.
+	PhaseTimes* times = NULL;
+	if (state->times != NULL && worker->index == 0) {
+		times = state->times;
+	} else if (state->times != NULL) {
+		startPhaseTimes(&worker->times);
+		times = &worker->times;
+	}
+	CompilerPhase previousPhase = switchPhase(times, PHASE_OTHER);
+	if (worker->index != 0 && state->trace) {
+		char threadName[32];
+		snprintf(threadName, sizeof(threadName), "Backend worker %u", worker->index);
+		setTraceThreadName(threadName);
+		setTraceFile(state->inputFilename);
+	}
+
+	AsmBuffer text = { 0 };
+	uint8_t* code = NULL;
+	if (output->emit == BACKEND_EMIT_ASSEMBLY) {
+		asmBufferInitMemory(&text, WORKER_TEXT_SIZE);
+	}
+
+	for (;;) {
+		mutexLock(&state->lock);
+		size_t begin = state->nextFunction;
+		size_t end = begin + state->claimSize < state->functionCount ? begin + state->claimSize : state->functionCount;
+		state->nextFunction = end;
+		mutexUnlock(&state->lock);
+		if (begin >= end) {
+			break;
+		}
+
+		lowerFunctions(state, begin, end, times);
+		switchPhase(times, PHASE_EMIT);
+		for (size_t i = begin; i < end; i++) {
+			FunctionOutput* result = &output->functions[i];
+			if (isReused(state, i)) {
+				*result = (FunctionOutput){ 0 };
+				continue;
+			}
+			const Function* func = &state->program->functions[i];
+			uint64_t start = beginFunctionEvent(state);
+			result->buffer = worker->index;
+			switch (output->emit) {
+				case BACKEND_EMIT_ASSEMBLY:
+					result->offset = text.length;
+					if (func->arch == ARCH_X64) {
+						emitX64Function(&text, func, ASM_STYLE_SOURCE);
+					} else {
+						emitARM64Function(&text, func, ASM_STYLE_SOURCE);
+					}
+					result->length = text.length - result->offset;
+					break;
+				case BACKEND_EMIT_MACHINE_CODE:
+					result->offset = arrlenu(code);
+					encodeX64Function(func, &code);
+					result->length = arrlenu(code) - result->offset;
+					break;
+				case BACKEND_EMIT_NONE:
+					break;
+			}
+			endFunctionEvent(state, PHASE_EMIT, i, start);
+		}
+		switchPhase(times, PHASE_OTHER);
+	}
+
+	if (output->emit == BACKEND_EMIT_MACHINE_CODE) {
+		// Buffers are all plain heap blocks, whoever supplied them.
+		size_t length = arrlenu(code);
+		uint8_t* bytes = (uint8_t*)malloc(length > 0 ? length : 1);
+		if (bytes == NULL) {
+			fprintf(stderr, "Error: Out of memory\n");
+			exit(EXIT_FAILURE);
+		}
+		if (length > 0) {
+			memcpy(bytes, code, length);
+		}
+		arrfree(code);
+		output->buffers[worker->index] = bytes;
+	} else {
+		output->buffers[worker->index] = (uint8_t*)text.data;
+	}
+	switchPhase(times, previousPhase);
+	if (worker->index != 0) {
+		closePerfCounters();
+	}
+}
+
+void runBackend(CompilerContext* ctx, Architecture arch, BackendEmit emit, int jobCount, const bool* reuse) {
+	if (arch != ARCH_X64 && arch != ARCH_ARM64) {
+		compilerError(ctx, "Unsupported architecture");
+	}
+	if (emit == BACKEND_EMIT_MACHINE_CODE && arch != ARCH_X64) {
+		compilerError(ctx, "Machine code can only be encoded for x64");
+	}
+
+	size_t functionCount = ctx->tackyProgram ? arrlenu(ctx->tackyProgram->functions) : 0;
+	Program* program = &ctx->finalAsmProgram;
+	arrsetlen(program->functions, functionCount);
+	program->functionCount = functionCount;
+
+	size_t lowerCount = functionCount;
+	for (size_t i = 0; reuse != NULL && i < functionCount; i++) {
+		lowerCount -= reuse[i];
+	}
+	int threadCount = jobCount > 0 ? jobCount : 1;
+	size_t usefulThreads = lowerCount / MIN_FUNCTIONS_PER_THREAD;
+	if ((size_t)threadCount > usefulThreads) {
+		threadCount = usefulThreads > 1 ? (int)usefulThreads : 1;
+	}
+
+	BackendOutput* output = &ctx->backend;
+	output->emit = emit;
+	output->threadCount = threadCount;
+	arrsetlen(output->functions, functionCount);
+	arrsetlen(output->buffers, threadCount);
+
+	BackendState state = {
+		.tackyProgram = ctx->tackyProgram,
+		.program = program,
+		.output = output,
+		.arch = arch,
+		.reuse = reuse,
+		.times = ctx->times,
+		.inputFilename = ctx->inputFilename,
+		.trace = isTimeTraceEnabled(),
+		.functionCount = functionCount,
+	};
+	state.claimSize = functionCount / ((size_t)threadCount * 8);
+	if (state.claimSize == 0) {
+		state.claimSize = 1;
+	} else if (state.claimSize > MAX_FUNCTIONS_PER_CLAIM) {
+		state.claimSize = MAX_FUNCTIONS_PER_CLAIM;
+	}
+	mutexInit(&state.lock);
+
+	BackendWorker* workers = (BackendWorker*)calloc((size_t)threadCount, sizeof(BackendWorker));
+	if (workers == NULL) {
+		compilerError(ctx, "Out of memory");
+	}
+	for (int w = 0; w < threadCount; w++) {
+		workers[w] = (BackendWorker){ .state = &state, .index = (uint32_t)w };
+	}
+
+	// The calling thread is worker 0. A worker that fails to start leaves an
+	// empty buffer; the others claim its share.
+	for (int w = 1; w < threadCount; w++) {
+		output->buffers[w] = NULL;
+		workers[w].started = threadStart(&workers[w].thread, runBackendWorker, &workers[w]);
+	}
+	uint64_t traceStart = state.trace ? readWallNanoseconds() : 0;
+	runBackendWorker(&workers[0]);
+	for (int w = 1; w < threadCount; w++) {
+		if (workers[w].started) {
+			threadJoin(&workers[w].thread);
+			if (ctx->times != NULL) {
+				addPhaseTimes(ctx->times, &workers[w].times);
+			}
+		}
+	}
+	// Spans the helpers too, so waiting for a straggler shows up.
+	if (state.trace) {
+		traceEvent("Backend", "Lower and emit", traceStart);
+	}
+	mutexDestroy(&state.lock);
+	free(workers);
+}
+
+const uint8_t* getFunctionOutput(const BackendOutput* output, size_t index, size_t* length) {
+	const FunctionOutput* result = &output->functions[index];
+	*length = result->length;
+	return output->buffers[result->buffer] + result->offset;
+}
+
+size_t writeBackendAssembly(const BackendOutput* output, FILE* file) {
+	size_t bytesWritten = 0;
+	size_t functionCount = arrlenu(output->functions);
+	for (size_t i = 0; i < functionCount; i++) {
+		// Neighbours lowered by the same worker sit next to each other in its
+		// buffer, so they go out in one write.
+		const FunctionOutput* first = &output->functions[i];
+		size_t length = first->length;
+		while (i + 1 < functionCount && output->functions[i + 1].buffer == first->buffer &&
+			   output->functions[i + 1].offset == first->offset + length) {
+			length += output->functions[++i].length;
+		}
+		bytesWritten += fwrite(output->buffers[first->buffer] + first->offset, 1, length, file);
+	}
+	return bytesWritten;
+}
+
+char* joinBackendAssembly(const BackendOutput* output, size_t* length) {
+	size_t total = 0;
+	for (ptrdiff_t i = 0; i < arrlen(output->functions); i++) {
+		total += output->functions[i].length;
+	}
+	char* text = (char*)malloc(total > 0 ? total : 1);
+	if (text == NULL) {
+		fprintf(stderr, "Error: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	size_t offset = 0;
+	for (ptrdiff_t i = 0; i < arrlen(output->functions); i++) {
+		size_t functionLength;
+		const uint8_t* bytes = getFunctionOutput(output, (size_t)i, &functionLength);
+		memcpy(text + offset, bytes, functionLength);
+		offset += functionLength;
+	}
+	*length = total;
+	return text;
+}
+
+uint32_t addBackendBuffer(BackendOutput* output, uint8_t* data) {
+	arrput(output->buffers, data);
+	return (uint32_t)(arrlen(output->buffers) - 1);
+}
+
+void freeBackendOutput(BackendOutput* output) {
+	for (ptrdiff_t w = 0; w < arrlen(output->buffers); w++) {
+		free(output->buffers[w]);
+	}
+	arrfree(output->buffers);
+	arrfree(output->functions);
+}
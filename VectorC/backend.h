@@ -0,0 +1,71 @@
+//
+//  backend.h
+//  VectorC
+//
+
+#ifndef backend_h
+#define backend_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ast_asm_common.h"
+
+struct CompilerContext;
+
+// What runBackend produces for each function besides its final instructions.
+typedef enum {
+	BACKEND_EMIT_NONE,			// Instructions only (--codegen)
+	BACKEND_EMIT_ASSEMBLY,		// Assembler source text
+	BACKEND_EMIT_MACHINE_CODE	// x64 machine code for the ELF writer
+} BackendEmit;
+
+// Where the output of one function ended up: each worker appends what it
+// emits to its own buffer, so the functions are scattered across buffers.
+typedef struct {
+	uint32_t buffer;			// Index of the worker's buffer
+	size_t offset;
+	size_t length;
+} FunctionOutput;
+
+typedef struct {
+	BackendEmit emit;
+	uint8_t** buffers;			// One per worker, then any added; malloc'd
+	FunctionOutput* functions;	// One per function, in source order
+	int threadCount;
+} BackendOutput;
+
+//
+// runBackend
+// ----------
+// Lower every function of ctx->tackyProgram into ctx->finalAsmProgram and
+// emit it, sharding the functions across up to `jobCount` threads (the
+// calling thread included). Functions are claimed in small runs, and every
+// result is stored at its function's index, so the output read back through
+// getFunctionOutput is identical whatever the thread count.
+//
+// Functions flagged in `reuse` (optional, one flag per function) are neither
+// lowered nor emitted: they keep only their name and an empty output, for
+// the caller to point at a buffer given to addBackendBuffer.
+//
+void runBackend(struct CompilerContext* ctx, Architecture arch, BackendEmit emit, int jobCount, const bool* reuse);
+
+// The text or code emitted for function `index` of the program.
+const uint8_t* getFunctionOutput(const BackendOutput* output, size_t index, size_t* length);
+
+// Write the assembly of every function in source order.
+// Returns: the number of bytes written.
+size_t writeBackendAssembly(const BackendOutput* output, FILE* file);
+
+// Copy the assembly of every function, in source order, into one buffer.
+// Returns: the text (free with free()), its length in *length.
+char* joinBackendAssembly(const BackendOutput* output, size_t* length);
+
+// Take ownership of a malloc'd block holding output produced elsewhere.
+// Returns: the buffer's index, for FunctionOutput.buffer.
+uint32_t addBackendBuffer(BackendOutput* output, uint8_t* data);
+
+void freeBackendOutput(BackendOutput* output);
+
+#endif /* backend_h */
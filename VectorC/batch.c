@@ -0,0 +1,419 @@
+//
+//  batch.c
+//  VectorC
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "batch.h"
+#include "thread.h"
+#include "intern.h"
+#include "source_file.h"
+#include "time_trace.h"
+#include "perf_counters.h"
+#include "stb_ds_config.h"
+
+typedef struct {
+	const char* path;
+	long long size;				// Bytes on disk, used to schedule large files first
+	double milliseconds;		// Wall time spent compiling the file
+	int status;					// Result of compileFile
+	bool stolen;				// Run by a worker other than the one it was dealt to
+} BatchJob;
+
+// Jobs dealt to one worker, largest first. The owner takes from the head and
+// thieves take from the tail, so they only meet on the last job. Jobs are
+// whole files, so a plain mutex per queue is never contended for long.
+typedef struct {
+	Mutex lock;
+	size_t* jobs;				// stb_ds array of indices into BatchState.jobs
+	size_t head;
+	size_t tail;
+} WorkQueue;
+
+typedef struct {
+	BatchJob* jobs;
+	WorkQueue* queues;
+	int workerCount;
+	const CompileOptions* options;
+} BatchState;
+
+typedef struct {
+	BatchState* state;
+	int index;
+	Thread thread;
+} Worker;
+
+static double getMilliseconds(void) {
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return (double)now.tv_sec * 1e3 + (double)now.tv_nsec * 1e-6;
+}
+
+// Scheduling key of a job. The size is copied in because qsort has no
+// context argument through which the job array could be reached.
+typedef struct {
+	long long size;
+	size_t index;
+} JobOrder;
+
+// Order jobs by decreasing file size, keeping the command line order between
+// files of equal size.
+static int compareJobs(const void* a, const void* b) {
+	const JobOrder* lhs = (const JobOrder*)a;
+	const JobOrder* rhs = (const JobOrder*)b;
+	if (lhs->size != rhs->size) {
+		return lhs->size > rhs->size ? -1 : 1;
+	}
+	return lhs->index < rhs->index ? -1 : 1;
+}
+
+//
+// takeJob
+// -------
+// Pop the next job from the worker's own queue, or steal one from the tail
+// of another worker's queue once its own is empty.
+//
+// Returns:
+//   Index of the job, or -1 when every queue is empty.
+//
+static ptrdiff_t takeJob(BatchState* state, int index, bool* stolen) {
+	WorkQueue* own = &state->queues[index];
+	ptrdiff_t job = -1;
+	mutexLock(&own->lock);
+	if (own->head < own->tail) {
+		job = (ptrdiff_t)own->jobs[own->head++];
+	}
+	mutexUnlock(&own->lock);
+	*stolen = false;
+	if (job >= 0) {
+		return job;
+	}
+
+	for (int offset = 1; offset < state->workerCount && job < 0; offset++) {
+		WorkQueue* victim = &state->queues[(index + offset) % state->workerCount];
+		mutexLock(&victim->lock);
+		if (victim->head < victim->tail) {
+			job = (ptrdiff_t)victim->jobs[--victim->tail];
+		}
+		mutexUnlock(&victim->lock);
+	}
+	*stolen = job >= 0;
+	return job;
+}
+
+static void runWorker(void* argument) {
+	Worker* worker = (Worker*)argument;
+	BatchState* state = worker->state;
+	if (worker->index != 0) {
+		char threadName[32];
+		snprintf(threadName, sizeof(threadName), "Batch worker %d", worker->index);
+		setTraceThreadName(threadName);
+	}
+	bool stolen;
+	ptrdiff_t index;
+	while ((index = takeJob(state, worker->index, &stolen)) >= 0) {
+		BatchJob* job = &state->jobs[index];
+		double start = getMilliseconds();
+		job->status = compileFile(job->path, state->options);
+		job->milliseconds = getMilliseconds() - start;
+		job->stolen = stolen;
+	}
+
+	// Per-file memory is already released; drop this thread's caches too.
+	// The main thread keeps its own until the driver exits.
+	if (worker->index != 0) {
+		destroyPreprocessorCache();
+		destroyInternTable();
+		closePerfCounters();
+	}
+}
+
+int compileBatch(const char* const* inputs, size_t inputCount, const CompileOptions* options) {
+	double batchStart = getMilliseconds();
+
+	BatchJob* jobs = (BatchJob*)calloc(inputCount, sizeof(BatchJob));
+	JobOrder* order = (JobOrder*)malloc(inputCount * sizeof(JobOrder));
+	if (jobs == NULL || order == NULL) {
+		fprintf(stderr, "Error: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	long long totalSize = 0;
+	for (size_t i = 0; i < inputCount; i++) {
+		struct stat info;
+		jobs[i].path = inputs[i];
+		jobs[i].size = stat(inputs[i], &info) == 0 ? (long long)info.st_size : 0;
+		totalSize += jobs[i].size;
+		order[i] = (JobOrder){ .size = jobs[i].size, .index = i };
+	}
+	qsort(order, inputCount, sizeof(JobOrder), compareJobs);
+
+	int workerCount = getProcessorCount();
+	if ((size_t)workerCount > inputCount) {
+		workerCount = (int)inputCount;
+	}
+
+	// Deal the sorted jobs round-robin so every queue starts with a large file.
+	BatchState state = { .jobs = jobs, .workerCount = workerCount, .options = options };
+	state.queues = (WorkQueue*)calloc((size_t)workerCount, sizeof(WorkQueue));
+	Worker* workers = (Worker*)calloc((size_t)workerCount, sizeof(Worker));
+	if (state.queues == NULL || workers == NULL) {
+		fprintf(stderr, "Error: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for (int w = 0; w < workerCount; w++) {
+		mutexInit(&state.queues[w].lock);
+	}
+	for (size_t i = 0; i < inputCount; i++) {
+		arrput(state.queues[i % (size_t)workerCount].jobs, order[i].index);
+	}
+	for (int w = 0; w < workerCount; w++) {
+		state.queues[w].tail = arrlenu(state.queues[w].jobs);
+		workers[w] = (Worker){ .state = &state, .index = w };
+	}
+
+	// The calling thread is worker 0. A worker that fails to start leaves its
+	// queue to be stolen by the others.
+	int started = 1;
+	for (int w = 1; w < workerCount; w++) {
+		if (threadStart(&workers[w].thread, runWorker, &workers[w])) {
+			started++;
+		} else {
+			workers[w].index = -1;
+		}
+	}
+	runWorker(&workers[0]);
+	for (int w = 1; w < workerCount; w++) {
+		if (workers[w].index >= 0) {
+			threadJoin(&workers[w].thread);
+		}
+	}
+	double batchMilliseconds = getMilliseconds() - batchStart;
+
+	int result = EXIT_SUCCESS;
+	size_t failures = 0;
+	size_t steals = 0;
+	double totalMilliseconds = 0.0;
+	for (size_t i = 0; i < inputCount; i++) {
+		const BatchJob* job = &jobs[i];
+		printf("%10.3f ms  %s%s\n", job->milliseconds, job->path, job->status == EXIT_SUCCESS ? "" : " (failed)");
+		totalMilliseconds += job->milliseconds;
+		steals += job->stolen;
+		if (job->status != EXIT_SUCCESS) {
+			failures++;
+			result = EXIT_FAILURE;
+		}
+	}
+	printf("Compiled %zu files (%lld bytes) on %d threads in %.3f ms; %.3f ms of work (%.2fx), %zu stolen",
+		   inputCount, totalSize, started, batchMilliseconds, totalMilliseconds,
+		   batchMilliseconds > 0.0 ? totalMilliseconds / batchMilliseconds : 0.0, steals);
+	if (failures > 0) {
+		printf(", %zu failed", failures);
+	}
+	printf("\n");
+
+	for (int w = 0; w < workerCount; w++) {
+		arrfree(state.queues[w].jobs);
+		mutexDestroy(&state.queues[w].lock);
+	}
+	free(workers);
+	free(state.queues);
+	free(order);
+	free(jobs);
+	return result;
+}
+
+//---------------------------------------------------------
+// compile_commands.json
+//---------------------------------------------------------
+
+typedef struct {
+	const char* at;
+	const char* end;
+	Arena* storage;
+} JsonReader;
+
+static void skipJsonWhitespace(JsonReader* reader) {
+	while (reader->at < reader->end && (*reader->at == ' ' || *reader->at == '\t' || *reader->at == '\n' || *reader->at == '\r')) {
+		reader->at++;
+	}
+}
+
+static bool expectJson(JsonReader* reader, char c) {
+	skipJsonWhitespace(reader);
+	if (reader->at < reader->end && *reader->at == c) {
+		reader->at++;
+		return true;
+	}
+	return false;
+}
+
+static void putUtf8(char** buffer, uint32_t codepoint) {
+	if (codepoint < 0x80) {
+		arrput(*buffer, (char)codepoint);
+	} else if (codepoint < 0x800) {
+		arrput(*buffer, (char)(0xC0 | (codepoint >> 6)));
+		arrput(*buffer, (char)(0x80 | (codepoint & 0x3F)));
+	} else {
+		arrput(*buffer, (char)(0xE0 | (codepoint >> 12)));
+		arrput(*buffer, (char)(0x80 | ((codepoint >> 6) & 0x3F)));
+		arrput(*buffer, (char)(0x80 | (codepoint & 0x3F)));
+	}
+}
+
+//
+// readJsonString
+// --------------
+// Decode a string literal into the reader's arena.
+//
+// Returns:
+//   The decoded string, or NULL if the input is not a valid string.
+//
+static const char* readJsonString(JsonReader* reader) {
+	if (!expectJson(reader, '"')) {
+		return NULL;
+	}
+	char* buffer = NULL;
+	const char* result = NULL;
+	while (reader->at < reader->end) {
+		char c = *reader->at++;
+		if (c == '"') {
+			result = arenaStrndup(reader->storage, buffer ? buffer : "", arrlenu(buffer));
+			break;
+		}
+		if (c != '\\') {
+			arrput(buffer, c);
+			continue;
+		}
+		if (reader->at >= reader->end) {
+			break;
+		}
+		c = *reader->at++;
+		switch (c) {
+			case 'b': arrput(buffer, '\b'); break;
+			case 'f': arrput(buffer, '\f'); break;
+			case 'n': arrput(buffer, '\n'); break;
+			case 'r': arrput(buffer, '\r'); break;
+			case 't': arrput(buffer, '\t'); break;
+			case 'u': {
+				uint32_t codepoint = 0;
+				for (int i = 0; i < 4 && reader->at < reader->end; i++) {
+					char h = *reader->at++;
+					uint32_t digit = (h >= '0' && h <= '9') ? (uint32_t)(h - '0') :
+									 (h >= 'a' && h <= 'f') ? (uint32_t)(h - 'a' + 10) :
+									 (h >= 'A' && h <= 'F') ? (uint32_t)(h - 'A' + 10) : 0;
+					codepoint = (codepoint << 4) | digit;
+				}
+				putUtf8(&buffer, codepoint);
+				break;
+			}
+			default:
+				// \" \\ and \/ stand for themselves.
+				arrput(buffer, c);
+				break;
+		}
+	}
+	arrfree(buffer);
+	return result;
+}
+
+// Skip a value of any type, including nested arrays and objects.
+static bool skipJsonValue(JsonReader* reader) {
+	skipJsonWhitespace(reader);
+	if (reader->at >= reader->end) {
+		return false;
+	}
+	switch (*reader->at) {
+		case '"':
+			return readJsonString(reader) != NULL;
+		case '[':
+		case '{': {
+			char close = *reader->at == '[' ? ']' : '}';
+			reader->at++;
+			if (expectJson(reader, close)) {
+				return true;
+			}
+			do {
+				if (close == '}' && (readJsonString(reader) == NULL || !expectJson(reader, ':'))) {
+					return false;
+				}
+				if (!skipJsonValue(reader)) {
+					return false;
+				}
+			} while (expectJson(reader, ','));
+			return expectJson(reader, close);
+		}
+		default:
+			// Numbers, true, false and null.
+			while (reader->at < reader->end && strchr(",]} \t\r\n", *reader->at) == NULL) {
+				reader->at++;
+			}
+			return true;
+	}
+}
+
+static bool isAbsolutePath(const char* path) {
+	return path[0] == '/' || path[0] == '\\' || (path[0] != '\0' && path[1] == ':');
+}
+
+bool readCompileCommands(const char* path, Arena* storage, const char*** inputs) {
+	SourceFile file;
+	if (!openSourceFile(path, &file)) {
+		fprintf(stderr, "Error: Could not read '%s': %s\n", path, strerror(errno));
+		return false;
+	}
+	JsonReader reader = { .at = file.data, .end = file.data + file.length, .storage = storage };
+	bool valid = expectJson(&reader, '[');
+	if (valid && !expectJson(&reader, ']')) {
+		do {
+			const char* directory = NULL;
+			const char* filename = NULL;
+			valid = expectJson(&reader, '{');
+			if (valid && !expectJson(&reader, '}')) {
+				do {
+					const char* key = readJsonString(&reader);
+					valid = key != NULL && expectJson(&reader, ':');
+					if (!valid) {
+						break;
+					}
+					if (strcmp(key, "directory") == 0) {
+						valid = (directory = readJsonString(&reader)) != NULL;
+					} else if (strcmp(key, "file") == 0) {
+						valid = (filename = readJsonString(&reader)) != NULL;
+					} else {
+						valid = skipJsonValue(&reader);
+					}
+				} while (valid && expectJson(&reader, ','));
+				valid = valid && expectJson(&reader, '}');
+			}
+			if (!valid) {
+				break;
+			}
+			if (filename == NULL) {
+				continue;
+			}
+			if (directory != NULL && !isAbsolutePath(filename)) {
+				size_t directoryLength = strlen(directory);
+				size_t filenameLength = strlen(filename);
+				char* joined = (char*)arenaAlloc(storage, directoryLength + filenameLength + 2);
+				memcpy(joined, directory, directoryLength);
+				joined[directoryLength] = '/';
+				memcpy(joined + directoryLength + 1, filename, filenameLength + 1);
+				filename = joined;
+			}
+			arrput(*inputs, filename);
+		} while (expectJson(&reader, ','));
+		valid = valid && expectJson(&reader, ']');
+	}
+	if (!valid) {
+		fprintf(stderr, "Error: '%s' is not a valid compilation database (offset %zu)\n", path, (size_t)(reader.at - file.data));
+	}
+	closeSourceFile(&file);
+	return valid;
+}
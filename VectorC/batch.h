@@ -0,0 +1,34 @@
+//
+//  batch.h
+//  VectorC
+//
+
+#ifndef batch_h
+#define batch_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "arena.h"
+#include "driver.h"
+
+//
+// compileBatch
+// ------------
+// Compile many independent source files concurrently on a work-stealing
+// thread pool sized to the processor count, largest files first, then print
+// the time taken by each file and by the whole batch.
+//
+// Returns:
+//   EXIT_SUCCESS if every file compiled, otherwise EXIT_FAILURE.
+//
+int compileBatch(const char* const* inputs, size_t inputCount, const CompileOptions* options);
+
+// Append the "file" of every entry of a compile_commands.json to an stb_ds
+// array, resolving relative paths against the entry's "directory". Strings
+// are allocated from `storage`.
+// Returns: false after reporting a file that cannot be read or is not a valid
+// compilation database.
+bool readCompileCommands(const char* path, Arena* storage, const char*** inputs);
+
+#endif /* batch_h */
@@ -0,0 +1,884 @@
+//
+//  benchmark.c
+//  VectorC
+//
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchmark.h"
+#include "driver.h"
+#include "time_report.h"
+#include "version.h"
+#include "stb_ds_config.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#define FUNCTION_OPERATORS 9		// Binary operators in each function of PROGRAM_SHAPE_FUNCTIONS
+#define CHAIN_LENGTH 1000			// Binary operators in each chain
+#define NESTED_DEPTH 100			// Parentheses around the innermost constant
+#define DEFAULT_SIZE 200000
+#define DEFAULT_RUNS 10
+#define DEFAULT_TOLERANCE 10.0		// Percent
+
+static const char* const s_shapeNames[PROGRAM_SHAPE_COUNT] = {
+	[PROGRAM_SHAPE_FUNCTIONS] = "functions",
+	[PROGRAM_SHAPE_CHAIN] = "chain",
+	[PROGRAM_SHAPE_NESTED] = "nested",
+};
+
+typedef enum {
+	METRIC_TOKENS,
+	METRIC_AST_NODES,
+	METRIC_TACKY_INSTRUCTIONS,
+	METRIC_OUTPUT_BYTES,
+	METRIC_SOURCE_BYTES,
+	METRIC_COUNT
+} BenchmarkMetric;
+
+typedef struct {
+	const char* label;				// Table row
+	const char* key;				// Baseline file
+} MetricName;
+
+static const MetricName s_metricNames[METRIC_COUNT] = {
+	[METRIC_TOKENS] = { "Tokens/s (lex)", "tokens" },
+	[METRIC_AST_NODES] = { "AST nodes/s (parse)", "astNodes" },
+	[METRIC_TACKY_INSTRUCTIONS] = { "TACKY instructions/s", "tackyInstructions" },
+	[METRIC_OUTPUT_BYTES] = { "Assembly bytes/s (backend)", "asmBytes" },
+	[METRIC_SOURCE_BYTES] = { "Source bytes/s (end to end)", "sourceBytes" },
+};
+
+typedef struct {
+	char shape[32];
+	char metric[32];
+	double perSecond;
+} BaselineEntry;
+
+typedef struct {
+	size_t size;
+	int runs;
+	double tolerance;
+	const char* baselineFile;
+	const char* saveBaselineFile;
+	bool shapes[PROGRAM_SHAPE_COUNT];
+	CompileOptions compile;
+} BenchmarkOptions;
+
+const char* getProgramShapeName(ProgramShape shape) {
+	return s_shapeNames[shape];
+}
+
+static uint32_t nextRandom(uint32_t* state, uint32_t bound) {
+	*state = *state * 1664525u + 1013904223u;
+	return (*state >> 16) % bound;
+}
+
+// Numbers are kept to 1-9 so no divisor is zero.
+static int nextDigit(uint32_t* state) {
+	return (int)nextRandom(state, 9) + 1;
+}
+
+static void appendText(char** text, const char* format, ...) {
+	char buffer[128];
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(buffer, sizeof(buffer), format, args);
+	va_end(args);
+	memcpy(arraddnptr(*text, length), buffer, (size_t)length);
+}
+
+static const char* const s_operators[] = { "+", "-", "*", "/", "%", "&", "|", "^", "<<", ">>" };
+
+// A constant followed by `length` operators, each with a constant operand.
+// Every operator's right operand is a constant, whatever the precedences, so
+// the divisors are never zero.
+static void appendChain(char** text, uint32_t* state, size_t length) {
+	appendText(text, "%d", nextDigit(state));
+	for (size_t i = 0; i < length; i++) {
+		const char* op = s_operators[nextRandom(state, 10)];
+		appendText(text, "%s %s %d", i % 16 == 15 ? "\n\t\t" : "", op, nextDigit(state));
+	}
+}
+
+// `depth` parenthesized operations, each a constant and an operator applied
+// to the next. The right operands are subexpressions, so division and
+// remainder are left out.
+static void appendNested(char** text, uint32_t* state, size_t depth) {
+	static const char* const unaryOperators[] = { "", "", "", "~", "-" };
+	for (size_t i = 0; i < depth; i++) {
+		const char* unary = unaryOperators[nextRandom(state, 5)];
+		const char* op = s_operators[nextRandom(state, 7)];
+		if (op[0] == '/' || op[0] == '%') {
+			op = "^";
+		}
+		appendText(text, "(%s%d %s ", unary, nextDigit(state), op);
+	}
+	appendText(text, "%d", nextDigit(state));
+	memset(arraddnptr(*text, depth), ')', depth);
+}
+
+char* generateProgram(ProgramShape shape, size_t size) {
+	uint32_t state = 1;
+	char* text = NULL;
+	size_t functionCount;
+
+	switch (shape) {
+		case PROGRAM_SHAPE_FUNCTIONS:
+			functionCount = (size + FUNCTION_OPERATORS - 1) / FUNCTION_OPERATORS;
+			for (size_t f = 0; f < functionCount; f++) {
+				int d[8];
+				for (int i = 0; i < 8; i++) {
+					d[i] = nextDigit(&state);
+				}
+				appendText(&text, "int f%zu(void) { return (%d * %d + (%d << %d) - %d) / %d ^ ~%d %% %d & 255 | 6; }\n",
+						   f, d[0], d[1], d[2], d[3], d[4], d[5], d[6], d[7]);
+			}
+			break;
+		case PROGRAM_SHAPE_CHAIN:
+			functionCount = (size + CHAIN_LENGTH - 1) / CHAIN_LENGTH;
+			for (size_t f = 0; f < functionCount; f++) {
+				appendText(&text, "int f%zu(void) {\n\treturn ", f);
+				appendChain(&text, &state, CHAIN_LENGTH);
+				appendText(&text, ";\n}\n");
+			}
+			break;
+		case PROGRAM_SHAPE_NESTED:
+			functionCount = (size + NESTED_DEPTH - 1) / NESTED_DEPTH;
+			for (size_t f = 0; f < functionCount; f++) {
+				appendText(&text, "int f%zu(void) { return ", f);
+				appendNested(&text, &state, NESTED_DEPTH);
+				appendText(&text, "; }\n");
+			}
+			break;
+		default:
+			break;
+	}
+	arrput(text, '\0');
+	return text;
+}
+
+static double perSecond(size_t count, uint64_t nanoseconds) {
+	return nanoseconds > 0 ? (double)count * 1e9 / (double)nanoseconds : 0.0;
+}
+
+//
+// compileTimed
+// ------------
+// Compile `path` once, timing each phase and the whole compilation.
+//
+// Returns:
+//   false if it did not compile.
+//
+static bool compileTimed(const char* path, const CompileOptions* base, CompileStats* stats, PhaseTimes* times, uint64_t* elapsed) {
+	TimeReport report;
+	initTimeReport(&report);
+	CompileOptions options = *base;
+	options.timeReport = &report;
+	options.stats = stats;
+
+	uint64_t start = readWallNanoseconds();
+	int status = compileFile(path, &options);
+	*elapsed = readWallNanoseconds() - start;
+	*times = report.total;
+	destroyTimeReport(&report);
+	return status == EXIT_SUCCESS;
+}
+
+// Compile `path` once. Returns: false if it did not compile.
+static bool runOnce(const char* path, const BenchmarkOptions* benchmark, CompileStats* stats, double rates[METRIC_COUNT]) {
+	PhaseTimes times;
+	uint64_t elapsed;
+	bool compiled = compileTimed(path, &benchmark->compile, stats, &times, &elapsed);
+
+	const uint64_t* wall = times.wallNanoseconds;
+	uint64_t backend = wall[PHASE_TRANSLATE] + wall[PHASE_REPLACE_PSEUDOS] + wall[PHASE_FIXUP] + wall[PHASE_EMIT];
+	rates[METRIC_TOKENS] = perSecond(stats->tokenCount, wall[PHASE_LEX]);
+	rates[METRIC_AST_NODES] = perSecond(stats->astNodeCount, wall[PHASE_PARSE]);
+	rates[METRIC_TACKY_INSTRUCTIONS] = perSecond(stats->tackyInstructionCount, wall[PHASE_TACKY]);
+	rates[METRIC_OUTPUT_BYTES] = perSecond(stats->outputBytes, backend);
+	rates[METRIC_SOURCE_BYTES] = perSecond(stats->sourceBytes, elapsed);
+	return compiled;
+}
+
+static int compareDoubles(const void* a, const void* b) {
+	double x = *(const double*)a;
+	double y = *(const double*)b;
+	return (x > y) - (x < y);
+}
+
+// Sorts `values` in place.
+static double getMedian(double* values, int count) {
+	qsort(values, (size_t)count, sizeof(double), compareDoubles);
+	return count % 2 ? values[count / 2] : 0.5 * (values[count / 2 - 1] + values[count / 2]);
+}
+
+// The median absolute deviation, which a stray slow run barely moves.
+static double getMedianDeviation(const double* values, int count, double median) {
+	double* deviations = (double*)malloc((size_t)count * sizeof(double));
+	if (deviations == NULL) {
+		fprintf(stderr, "Error: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for (int i = 0; i < count; i++) {
+		deviations[i] = values[i] > median ? values[i] - median : median - values[i];
+	}
+	double deviation = getMedian(deviations, count);
+	free(deviations);
+	return deviation;
+}
+
+static const BaselineEntry* findBaseline(const BaselineEntry* baseline, const char* shape, const char* metric) {
+	for (ptrdiff_t i = 0; i < arrlen(baseline); i++) {
+		if (strcmp(baseline[i].shape, shape) == 0 && strcmp(baseline[i].metric, metric) == 0) {
+			return &baseline[i];
+		}
+	}
+	return NULL;
+}
+
+// A baseline is a `size <N>` line, for the --size it was recorded with, and
+// `<shape> <metric> <per second>` lines; '#' starts a comment.
+static bool readBaseline(const char* path, BaselineEntry** baseline, size_t* size) {
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		return false;
+	}
+	char line[256];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		BaselineEntry entry;
+		if (line[0] == '#' || sscanf(line, "size %zu", size) == 1) {
+			continue;
+		}
+		if (sscanf(line, "%31s %31s %lf", entry.shape, entry.metric, &entry.perSecond) == 3) {
+			arrput(*baseline, entry);
+		}
+	}
+	fclose(file);
+	return true;
+}
+
+static bool writeBaseline(const char* path, const BenchmarkOptions* options, const BaselineEntry* results) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+	fprintf(file, "# vecc %s --benchmark baseline, medians of %d runs\n", VECTORC_VERSION, options->runs);
+	fprintf(file, "size %zu\n", options->size);
+	for (ptrdiff_t i = 0; i < arrlen(results); i++) {
+		fprintf(file, "%s %s %.6g\n", results[i].shape, results[i].metric, results[i].perSecond);
+	}
+	return fclose(file) == 0;
+}
+
+static const char* getTempDirectory(void) {
+#ifdef _WIN32
+	const char* directory = getenv("TEMP");
+	return directory != NULL && *directory ? directory : ".";
+#else
+	const char* directory = getenv("TMPDIR");
+	return directory != NULL && *directory ? directory : "/tmp";
+#endif
+}
+
+// Create a new directory, readable only by us where the platform allows, for
+// the generated programs, so no other user can predict or replace them.
+// Returns: false after reporting the error.
+static bool createWorkDirectory(const char* prefix, char* path, size_t size) {
+	int length = snprintf(path, size, "%s/%s-XXXXXX", getTempDirectory(), prefix);
+	bool created = length > 0 && (size_t)length < size;
+#ifdef _WIN32
+	created = created && _mktemp_s(path, (size_t)length + 1) == 0 && _mkdir(path) == 0;
+#else
+	created = created && mkdtemp(path) != NULL;
+#endif
+	if (!created) {
+		fflush(stdout);
+		fprintf(stderr, "Error: Could not create a temporary directory in '%s'\n", getTempDirectory());
+	}
+	return created;
+}
+
+static void removeWorkDirectory(const char* path) {
+#ifdef _WIN32
+	_rmdir(path);
+#else
+	rmdir(path);
+#endif
+}
+
+static bool writeSource(const char* path, const char* text) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+	fputs(text, file);
+	return fclose(file) == 0;
+}
+
+//
+// benchmarkShape
+// --------------
+// Generate, compile and report one shape, appending its medians to
+// `results`.
+//
+// Returns:
+//   false if the program did not compile or a stage regressed.
+//
+static bool benchmarkShape(ProgramShape shape, const BenchmarkOptions* options, const BaselineEntry* baseline, BaselineEntry** results) {
+	const char* name = s_shapeNames[shape];
+	char directory[1024], sourcePath[1100], outputPath[1100];
+	if (!createWorkDirectory("vecc-benchmark", directory, sizeof(directory))) {
+		return false;
+	}
+	snprintf(sourcePath, sizeof(sourcePath), "%s/%s.c", directory, name);
+	snprintf(outputPath, sizeof(outputPath), "%s/%s.s", directory, name);
+
+	char* text = generateProgram(shape, options->size);
+	bool written = writeSource(sourcePath, text);
+	arrfree(text);
+	if (!written) {
+		fprintf(stderr, "Error: Could not write '%s'\n", sourcePath);
+		remove(sourcePath);
+		removeWorkDirectory(directory);
+		return false;
+	}
+
+	CompileStats stats;
+	double rates[METRIC_COUNT];
+	double* samples[METRIC_COUNT] = { NULL };
+	bool compiled = runOnce(sourcePath, options, &stats, rates);
+	for (int run = 0; compiled && run < options->runs; run++) {
+		compiled = runOnce(sourcePath, options, &stats, rates);
+		for (int m = 0; m < METRIC_COUNT; m++) {
+			arrput(samples[m], rates[m]);
+		}
+	}
+	remove(sourcePath);
+	remove(outputPath);
+	removeWorkDirectory(directory);
+	if (!compiled) {
+		fflush(stdout);
+		fprintf(stderr, "Error: The %s benchmark program did not compile\n", name);
+		for (int m = 0; m < METRIC_COUNT; m++) {
+			arrfree(samples[m]);
+		}
+		return false;
+	}
+
+	printf("%s: %zu KB of source, %zu tokens, %zu AST nodes, %zu TACKY instructions, %zu KB of assembly\n",
+		   name, stats.sourceBytes / 1024, stats.tokenCount, stats.astNodeCount, stats.tackyInstructionCount, stats.outputBytes / 1024);
+	printf("  %-28s  %12s  %8s  %12s  %8s\n", "Median of runs", "Millions", "Spread", "Baseline", "Change");
+	bool regressed = false;
+	for (int m = 0; m < METRIC_COUNT; m++) {
+		double median = getMedian(samples[m], options->runs);
+		double spread = median > 0.0 ? 100.0 * getMedianDeviation(samples[m], options->runs, median) / median : 0.0;
+		printf("  %-28s  %12.3f  %7.1f%%", s_metricNames[m].label, median * 1e-6, spread);
+
+		const BaselineEntry* expected = findBaseline(baseline, name, s_metricNames[m].key);
+		if (expected != NULL && expected->perSecond > 0.0) {
+			double change = 100.0 * (median - expected->perSecond) / expected->perSecond;
+			bool slower = change < -options->tolerance;
+			printf("  %12.3f  %+7.1f%%%s\n", expected->perSecond * 1e-6, change, slower ? "  REGRESSION" : "");
+			regressed |= slower;
+		} else {
+			printf("\n");
+		}
+
+		BaselineEntry result = { .perSecond = median };
+		snprintf(result.shape, sizeof(result.shape), "%s", name);
+		snprintf(result.metric, sizeof(result.metric), "%s", s_metricNames[m].key);
+		arrput(*results, result);
+		arrfree(samples[m]);
+	}
+	if (regressed) {
+		fflush(stdout);
+		fprintf(stderr, "Error: The %s benchmark is more than %.1f%% slower than the baseline\n", name, options->tolerance);
+	}
+	return !regressed;
+}
+
+//
+// selectNames
+// -----------
+// Set `selected[i]` for each of `names` in the comma-separated `list`, or
+// for all of them when `list` is NULL.
+//
+// Returns:
+//   false after reporting a name that is not one of `names`.
+//
+static bool selectNames(const char* list, const char* const* names, int count, bool* selected, const char* what) {
+	for (int i = 0; i < count; i++) {
+		selected[i] = list == NULL;
+	}
+	const char* name = list;
+	while (name != NULL && *name) {
+		size_t length = strcspn(name, ",");
+		int i = 0;
+		while (i < count && !(strlen(names[i]) == length && strncmp(name, names[i], length) == 0)) {
+			i++;
+		}
+		if (i == count) {
+			fprintf(stderr, "Error: Unknown %s '%.*s'; choose from", what, (int)length, name);
+			for (i = 0; i < count; i++) {
+				fprintf(stderr, " %s", names[i]);
+			}
+			fprintf(stderr, "\n");
+			return false;
+		}
+		selected[i] = true;
+		name += length + (name[length] == ',');
+	}
+	return true;
+}
+
+// Returns: false after reporting an invalid switch.
+static bool parseBenchmarkArguments(const char* shapes, int argc, const char* const* argv, BenchmarkOptions* options) {
+	if (!selectNames(shapes, s_shapeNames, PROGRAM_SHAPE_COUNT, options->shapes, "benchmark")) {
+		return false;
+	}
+
+	for (int i = 0; i < argc; i++) {
+		char* end = NULL;
+		if (strncmp(argv[i], "--size=", 7) == 0) {
+			long long size = strtoll(argv[i] + 7, &end, 10);
+			if (*end != '\0' || size < 1) {
+				fprintf(stderr, "Error: '--size' needs a number of binary operators\n");
+				return false;
+			}
+			options->size = (size_t)size;
+		} else if (strncmp(argv[i], "--runs=", 7) == 0) {
+			long runs = strtol(argv[i] + 7, &end, 10);
+			if (*end != '\0' || runs < 1 || runs > 1000) {
+				fprintf(stderr, "Error: '--runs' needs a count between 1 and 1000\n");
+				return false;
+			}
+			options->runs = (int)runs;
+		} else if (strncmp(argv[i], "--tolerance=", 12) == 0) {
+			options->tolerance = strtod(argv[i] + 12, &end);
+			if (*end != '\0' || options->tolerance < 0.0) {
+				fprintf(stderr, "Error: '--tolerance' needs a percentage\n");
+				return false;
+			}
+		} else if (strncmp(argv[i], "--baseline=", 11) == 0) {
+			options->baselineFile = argv[i] + 11;
+		} else if (strncmp(argv[i], "--save-baseline=", 16) == 0) {
+			options->saveBaselineFile = argv[i] + 16;
+		} else if (strcmp(argv[i], "-arch=x64") == 0) {
+			options->compile.arch = ARCH_X64;
+		} else if (strcmp(argv[i], "-arch=arm64") == 0) {
+			options->compile.arch = ARCH_ARM64;
+		} else {
+			fprintf(stderr, "Error: Unknown benchmark switch '%s'\n", argv[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+int runBenchmark(const char* shapes, int argc, const char* const* argv) {
+	// One backend thread, so the backend rate is per thread whatever the
+	// machine.
+	BenchmarkOptions options = {
+		.size = DEFAULT_SIZE,
+		.runs = DEFAULT_RUNS,
+		.tolerance = DEFAULT_TOLERANCE,
+		.compile = {
+			.arch = ARCH_X64,
+			.preprocessor = { .useSystemIncludePaths = true },
+			.assemblyOnly = true,
+			.backendJobs = 1,
+		},
+	};
+	if (!parseBenchmarkArguments(shapes, argc, argv, &options)) {
+		return EXIT_FAILURE;
+	}
+
+	// Throughput depends on the size of the program, through the caches, so
+	// only runs of the same size compare.
+	BaselineEntry* baseline = NULL;
+	size_t baselineSize = options.size;
+	if (options.baselineFile != NULL && !readBaseline(options.baselineFile, &baseline, &baselineSize)) {
+		fprintf(stderr, "Error: Could not read '%s'\n", options.baselineFile);
+		return EXIT_FAILURE;
+	}
+	if (baselineSize != options.size) {
+		fprintf(stderr, "Error: '%s' was recorded with --size=%zu\n", options.baselineFile, baselineSize);
+		arrfree(baseline);
+		return EXIT_FAILURE;
+	}
+
+	printf("Benchmark: --size=%zu binary operators per program, %d runs after a warm-up\n", options.size, options.runs);
+	int result = EXIT_SUCCESS;
+	BaselineEntry* results = NULL;
+	for (int s = 0; s < PROGRAM_SHAPE_COUNT; s++) {
+		if (options.shapes[s] && !benchmarkShape((ProgramShape)s, &options, baseline, &results)) {
+			result = EXIT_FAILURE;
+		}
+	}
+
+	if (options.saveBaselineFile != NULL && !writeBaseline(options.saveBaselineFile, &options, results)) {
+		fprintf(stderr, "Error: Could not write '%s'\n", options.saveBaselineFile);
+		result = EXIT_FAILURE;
+	}
+	arrfree(results);
+	arrfree(baseline);
+	return result;
+}
+
+//
+// Scaling test
+// ------------
+//
+
+#define SCALING_FIRST_SIZE 256
+#define SCALING_NAMED_FUNCTIONS 64		// Functions whose names grow along SCALING_IDENTIFIERS
+#define SCALING_DEFAULT_RUNS 5
+#define SCALING_DEFAULT_TIME_LIMIT 2000	// Milliseconds for one compilation
+#define SCALING_TIME_FLOOR 1000000		// Nanoseconds; shorter phase times are mostly noise
+#define SCALING_MIN_POINTS 4
+#define SCALING_MARGIN 0.25				// Growth exponent allowed beyond n log n, per doubling
+
+typedef struct {
+	const char* name;
+	const char* unit;				// What the size counts
+	size_t maxSize;
+} AxisName;
+
+// Every phase recurses on nesting, so much deeper expressions overflow the
+// stack before they show anything about complexity.
+static const AxisName s_axisNames[SCALING_AXIS_COUNT] = {
+	[SCALING_DEPTH] = { "depth", "levels of parentheses", (size_t)1 << 15 },
+	[SCALING_OPERANDS] = { "operands", "operands in one expression", (size_t)1 << 19 },
+	[SCALING_FUNCTIONS] = { "functions", "functions", (size_t)1 << 17 },
+	[SCALING_IDENTIFIERS] = { "identifiers", "characters per function name", (size_t)1 << 16 },
+};
+
+typedef struct {
+	size_t maxSize;					// 0 for each axis's own limit
+	int runs;
+	uint64_t timeLimit;				// Nanoseconds
+	const char* saveDirectory;
+	bool axes[SCALING_AXIS_COUNT];
+	CompileOptions compile;
+} ScalingOptions;
+
+// The fastest of several runs of one size.
+typedef struct {
+	size_t size;
+	uint64_t wallNanoseconds[PHASE_COUNT];
+	uint64_t elapsedNanoseconds;
+} ScalingPoint;
+
+const char* getScalingAxisName(ScalingAxis axis) {
+	return s_axisNames[axis].name;
+}
+
+char* generateScalingProgram(ScalingAxis axis, size_t size) {
+	uint32_t state = 1;
+	char* text = NULL;
+	switch (axis) {
+		case SCALING_DEPTH:
+			appendText(&text, "int f0(void) { return ");
+			appendNested(&text, &state, size);
+			appendText(&text, "; }\n");
+			break;
+		case SCALING_OPERANDS:
+			appendText(&text, "int f0(void) {\n\treturn ");
+			appendChain(&text, &state, size > 0 ? size - 1 : 0);
+			appendText(&text, ";\n}\n");
+			break;
+		case SCALING_FUNCTIONS:
+			for (size_t f = 0; f < size; f++) {
+				appendText(&text, "int f%zu(void) { return %d + %d; }\n", f, nextDigit(&state), nextDigit(&state));
+			}
+			break;
+		case SCALING_IDENTIFIERS:
+			for (int f = 0; f < SCALING_NAMED_FUNCTIONS; f++) {
+				appendText(&text, "int f%d_", f);
+				memset(arraddnptr(text, size), 'a' + f % 26, size);
+				appendText(&text, "(void) { return %d; }\n", nextDigit(&state));
+			}
+			break;
+		default:
+			break;
+	}
+	arrput(text, '\0');
+	return text;
+}
+
+//
+// measureSize
+// -----------
+// Generate the program of one size and keep the fastest time of each phase
+// over the runs.
+//
+// Returns:
+//   false after reporting a program that could not be written or compiled.
+//
+static bool measureSize(ScalingAxis axis, size_t size, const ScalingOptions* options, ScalingPoint* point) {
+	char directory[1024], sourcePath[1100], outputPath[1100];
+	if (!createWorkDirectory("vecc-scaling", directory, sizeof(directory))) {
+		return false;
+	}
+	snprintf(sourcePath, sizeof(sourcePath), "%s/%s.c", directory, s_axisNames[axis].name);
+	snprintf(outputPath, sizeof(outputPath), "%s/%s.s", directory, s_axisNames[axis].name);
+	char* text = generateScalingProgram(axis, size);
+	bool written = writeSource(sourcePath, text);
+	arrfree(text);
+	if (!written) {
+		fprintf(stderr, "Error: Could not write '%s'\n", sourcePath);
+		remove(sourcePath);
+		removeWorkDirectory(directory);
+		return false;
+	}
+
+	*point = (ScalingPoint){ .size = size, .elapsedNanoseconds = UINT64_MAX };
+	for (int p = 0; p < PHASE_COUNT; p++) {
+		point->wallNanoseconds[p] = UINT64_MAX;
+	}
+	bool compiled = true;
+	for (int run = 0; compiled && run < options->runs; run++) {
+		CompileStats stats;
+		PhaseTimes times;
+		uint64_t elapsed;
+		compiled = compileTimed(sourcePath, &options->compile, &stats, &times, &elapsed);
+		for (int p = 0; p < PHASE_COUNT; p++) {
+			if (times.wallNanoseconds[p] < point->wallNanoseconds[p]) {
+				point->wallNanoseconds[p] = times.wallNanoseconds[p];
+			}
+		}
+		if (elapsed < point->elapsedNanoseconds) {
+			point->elapsedNanoseconds = elapsed;
+		}
+	}
+	remove(sourcePath);
+	remove(outputPath);
+	removeWorkDirectory(directory);
+	if (!compiled) {
+		fflush(stdout);
+		fprintf(stderr, "Error: The %s program of size %zu did not compile\n", s_axisNames[axis].name, size);
+	}
+	return compiled;
+}
+
+//
+// fitGrowthExponent
+// -----------------
+// The least-squares slope of log time against log size, over the points
+// where the phase took long enough to measure.
+//
+// Returns:
+//   false if fewer than SCALING_MIN_POINTS points qualify.
+//
+static bool fitGrowthExponent(const ScalingPoint* points, int count, CompilerPhase phase, double* exponent) {
+	double sumX = 0.0, sumY = 0.0, sumXX = 0.0, sumXY = 0.0;
+	int used = 0;
+	for (int i = 0; i < count; i++) {
+		if (points[i].wallNanoseconds[phase] < SCALING_TIME_FLOOR) {
+			continue;
+		}
+		double x = log((double)points[i].size);
+		double y = log((double)points[i].wallNanoseconds[phase]);
+		sumX += x;
+		sumY += y;
+		sumXX += x * x;
+		sumXY += x * y;
+		used++;
+	}
+	double denominator = used * sumXX - sumX * sumX;
+	if (used < SCALING_MIN_POINTS || denominator <= 0.0) {
+		return false;
+	}
+	*exponent = (used * sumXY - sumX * sumY) / denominator;
+	return true;
+}
+
+// How much faster than n log n the phase grew from point `i` to the next,
+// as an exponent of the size.
+static double getExcessExponent(const ScalingPoint* points, int i, CompilerPhase phase) {
+	double n0 = (double)points[i].size, n1 = (double)points[i + 1].size;
+	double ratio = ((double)points[i + 1].wallNanoseconds[phase] / (n1 * log2(n1))) /
+		((double)points[i].wallNanoseconds[phase] / (n0 * log2(n0)));
+	return log(ratio) / log(n1 / n0);
+}
+
+//
+// measureExcessGrowth
+// -------------------
+// The median excess exponent over the doublings where the phase took long
+// enough to measure, and that of the last doubling. A whole-range fit is
+// thrown by the one-off jump where the working set outgrows a cache, but
+// superlinear work shows at every step, the largest included, so it takes
+// both to flag a phase.
+//
+// Returns:
+//   false if fewer than SCALING_MIN_POINTS points qualify. Otherwise also
+//   the smallest size whose doubling exceeded the margin, the reduced input.
+//
+static bool measureExcessGrowth(const ScalingPoint* points, int count, CompilerPhase phase, double* excess, double* lastExcess, size_t* reducedSize) {
+	double steps[64];				// Sizes double from 256, so there are fewer
+	int stepCount = 0;
+	*reducedSize = points[count - 1].size;
+	for (int i = count - 2; i >= 0; i--) {
+		if (points[i].wallNanoseconds[phase] < SCALING_TIME_FLOOR) {
+			continue;
+		}
+		steps[stepCount] = getExcessExponent(points, i, phase);
+		if (steps[stepCount] > SCALING_MARGIN) {
+			*reducedSize = points[i + 1].size;
+		}
+		stepCount++;
+	}
+	if (stepCount + 1 < SCALING_MIN_POINTS) {
+		return false;
+	}
+	*lastExcess = steps[0];
+	*excess = getMedian(steps, stepCount);
+	return true;
+}
+
+// Write the program of `size` where the regression corpus can pick it up.
+static void saveReducedInput(ScalingAxis axis, CompilerPhase phase, size_t size, const ScalingOptions* options) {
+	char path[1024];
+	snprintf(path, sizeof(path), "%s/scaling_%s_%s_%zu.c", options->saveDirectory, s_axisNames[axis].name, getPhaseKey(phase), size);
+	char* text = generateScalingProgram(axis, size);
+	if (writeSource(path, text)) {
+		printf("    Saved %s\n", path);
+	} else {
+		fprintf(stderr, "Warning: Could not write '%s'\n", path);
+	}
+	arrfree(text);
+}
+
+//
+// scaleAxis
+// ---------
+// Double the size along one axis until the limit, fit each phase's growth
+// and report the phases that grow faster than n log n.
+//
+// Returns:
+//   false if a program did not compile or a phase scaled superlinearly.
+//
+static bool scaleAxis(ScalingAxis axis, const ScalingOptions* options) {
+	const AxisName* name = &s_axisNames[axis];
+	size_t maxSize = options->maxSize != 0 ? options->maxSize : name->maxSize;
+	printf("%s: %s, from %d to at most %zu\n", name->name, name->unit, SCALING_FIRST_SIZE, maxSize);
+
+	ScalingPoint* points = NULL;
+	bool compiled = true;
+	for (size_t size = SCALING_FIRST_SIZE; size <= maxSize; size *= 2) {
+		ScalingPoint point;
+		if (!(compiled = measureSize(axis, size, options, &point))) {
+			break;
+		}
+		arrput(points, point);
+		printf("  %10zu  %10.3f ms\n", size, (double)point.elapsedNanoseconds * 1e-6);
+		fflush(stdout);
+		if (point.elapsedNanoseconds > options->timeLimit) {
+			break;
+		}
+	}
+
+	int count = (int)arrlen(points);
+	bool superlinear = false;
+	printf("  %-28s  %8s  %12s  %12s\n", "Phase", "Exponent", "Over n log n", "Largest (ms)");
+	for (int p = 0; p < PHASE_COUNT && count > 0; p++) {
+		CompilerPhase phase = (CompilerPhase)p;
+		double exponent, excess, lastExcess;
+		size_t reducedSize;
+		if (!fitGrowthExponent(points, count, phase, &exponent) ||
+			!measureExcessGrowth(points, count, phase, &excess, &lastExcess, &reducedSize)) {
+			continue;
+		}
+		bool flagged = excess > SCALING_MARGIN && lastExcess > SCALING_MARGIN;
+		printf("  %-28s  %8.2f  %+12.2f  %12.3f%s\n", getPhaseName(phase), exponent, excess,
+			   (double)points[count - 1].wallNanoseconds[phase] * 1e-6, flagged ? "  SUPERLINEAR" : "");
+		if (flagged) {
+			saveReducedInput(axis, phase, reducedSize, options);
+			superlinear = true;
+		}
+	}
+	arrfree(points);
+	if (superlinear) {
+		fflush(stdout);
+		fprintf(stderr, "Error: A phase grows faster than n log n with %s\n", name->unit);
+	}
+	return compiled && !superlinear;
+}
+
+int runScalingTest(const char* axes, int argc, const char* const* argv) {
+	// Backend times are only comparable across sizes on one thread.
+	ScalingOptions options = {
+		.runs = SCALING_DEFAULT_RUNS,
+		.timeLimit = (uint64_t)SCALING_DEFAULT_TIME_LIMIT * 1000000,
+		.saveDirectory = ".",
+		.compile = {
+			.arch = ARCH_X64,
+			.preprocessor = { .useSystemIncludePaths = true },
+			.assemblyOnly = true,
+			.backendJobs = 1,
+		},
+	};
+	const char* axisNames[SCALING_AXIS_COUNT];
+	for (int a = 0; a < SCALING_AXIS_COUNT; a++) {
+		axisNames[a] = s_axisNames[a].name;
+	}
+	if (!selectNames(axes, axisNames, SCALING_AXIS_COUNT, options.axes, "scaling axis")) {
+		return EXIT_FAILURE;
+	}
+
+	for (int i = 0; i < argc; i++) {
+		char* end = NULL;
+		if (strncmp(argv[i], "--max-size=", 11) == 0) {
+			long long size = strtoll(argv[i] + 11, &end, 10);
+			if (*end != '\0' || size < SCALING_FIRST_SIZE) {
+				fprintf(stderr, "Error: '--max-size' needs a size of at least %d\n", SCALING_FIRST_SIZE);
+				return EXIT_FAILURE;
+			}
+			options.maxSize = (size_t)size;
+		} else if (strncmp(argv[i], "--runs=", 7) == 0) {
+			long runs = strtol(argv[i] + 7, &end, 10);
+			if (*end != '\0' || runs < 1 || runs > 1000) {
+				fprintf(stderr, "Error: '--runs' needs a count between 1 and 1000\n");
+				return EXIT_FAILURE;
+			}
+			options.runs = (int)runs;
+		} else if (strncmp(argv[i], "--time-limit=", 13) == 0) {
+			long long milliseconds = strtoll(argv[i] + 13, &end, 10);
+			if (*end != '\0' || milliseconds < 1) {
+				fprintf(stderr, "Error: '--time-limit' needs a number of milliseconds\n");
+				return EXIT_FAILURE;
+			}
+			options.timeLimit = (uint64_t)milliseconds * 1000000;
+		} else if (strncmp(argv[i], "--save-dir=", 11) == 0) {
+			options.saveDirectory = argv[i] + 11;
+		} else if (strcmp(argv[i], "-arch=x64") == 0) {
+			options.compile.arch = ARCH_X64;
+		} else if (strcmp(argv[i], "-arch=arm64") == 0) {
+			options.compile.arch = ARCH_ARM64;
+		} else {
+			fprintf(stderr, "Error: Unknown scaling switch '%s'\n", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	printf("Scaling: fastest of %d runs per size; phases growing more than %.2f beyond n log n are flagged\n", options.runs, SCALING_MARGIN);
+	int result = EXIT_SUCCESS;
+	for (int a = 0; a < SCALING_AXIS_COUNT; a++) {
+		if (options.axes[a] && !scaleAxis((ScalingAxis)a, &options)) {
+			result = EXIT_FAILURE;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,91 @@
+//
+//  benchmark.h
+//  VectorC
+//
+
+#ifndef benchmark_h
+#define benchmark_h
+
+#include <stddef.h>
+
+// The synthetic programs --benchmark compiles.
+typedef enum {
+	PROGRAM_SHAPE_FUNCTIONS,		// Many small functions
+	PROGRAM_SHAPE_CHAIN,			// Long flat operator chains
+	PROGRAM_SHAPE_NESTED,			// Deeply parenthesized expressions
+	PROGRAM_SHAPE_COUNT
+} ProgramShape;
+
+// Name of a shape on the command line and in baseline files.
+const char* getProgramShapeName(ProgramShape shape);
+
+//
+// generateProgram
+// ---------------
+// Build a C program of the given shape with about `size` binary operators,
+// spread over as many functions as the shape calls for. The constants are
+// pseudo-random but the same for every call with the same arguments.
+//
+// Returns:
+//   The NUL-terminated source as an stb_ds array; release it with arrfree.
+//
+char* generateProgram(ProgramShape shape, size_t size);
+
+//
+// runBenchmark
+// ------------
+// Compile a generated program of each shape to assembly, once to warm up and
+// then a number of times, and print the median throughput of every stage:
+// tokens lexed, AST nodes parsed, TACKY instructions generated and assembly
+// bytes emitted per second, and source bytes per second end to end.
+//
+// Parameters:
+//   shapes - Comma-separated shape names, or NULL for all of them.
+//   argc, argv - The switches after --benchmark: --size=<N> binary operators
+//                per program, --runs=<N>, -arch=<x64|arm64>,
+//                --baseline=<file> to compare against, --tolerance=<percent>
+//                slower than the baseline that counts as a regression, and
+//                --save-baseline=<file>.
+//
+// Returns:
+//   EXIT_FAILURE if a program failed to compile or any stage regressed
+//   against the baseline, otherwise EXIT_SUCCESS.
+//
+int runBenchmark(const char* shapes, int argc, const char* const* argv);
+
+// What grows, one axis at a time, in the programs of runScalingTest.
+typedef enum {
+	SCALING_DEPTH,					// Nesting of one expression
+	SCALING_OPERANDS,				// Operands of one flat expression
+	SCALING_FUNCTIONS,				// Number of functions
+	SCALING_IDENTIFIERS,			// Length of every function name
+	SCALING_AXIS_COUNT
+} ScalingAxis;
+
+// Name of an axis on the command line and in saved inputs.
+const char* getScalingAxisName(ScalingAxis axis);
+
+// Like generateProgram, for a program of `size` along one axis.
+char* generateScalingProgram(ScalingAxis axis, size_t size);
+
+//
+// runScalingTest
+// --------------
+// Compile programs that double in size along each axis, fit every phase's
+// time to size^k, and flag phases that grow faster than n log n. For each
+// flagged phase the smallest program that shows it is saved as
+// `scaling_<axis>_<phase>_<size>.c`, ready for the regression corpus.
+//
+// Parameters:
+//   axes - Comma-separated axis names, or NULL for all of them.
+//   argc, argv - The switches after --scaling: --max-size=<N>, --runs=<N>,
+//                --time-limit=<ms> for one compilation, after which an axis
+//                stops growing, --save-dir=<dir> and -arch=<x64|arm64>.
+//
+// Returns:
+//   EXIT_FAILURE if a program failed to compile or any phase was flagged,
+//   otherwise EXIT_SUCCESS.
+//
+int runScalingTest(const char* axes, int argc, const char* const* argv);
+
+#endif /* benchmark_h */
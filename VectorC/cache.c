@@ -0,0 +1,434 @@
+//
+//  cache.c
+//  VectorC
+//
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+#include "version.h"
+#include "stb_ds_config.h"
+
+void computeCacheKey(CacheKey* key, const char* source, size_t length, Architecture arch, CacheOutput output) {
+	static const char* s_outputNames[] = {
+		[CACHE_OUTPUT_ASSEMBLY] = "assembly",
+		[CACHE_OUTPUT_OBJECT] = "object",
+		[CACHE_OUTPUT_EXECUTABLE] = "executable",
+	};
+	// Every field ends with a NUL so no two combinations hash the same bytes.
+	Sha256 hash;
+	sha256Init(&hash);
+	hashBuildId(&hash);
+	const char* archName = getArchitectureName(arch);
+	sha256Update(&hash, archName, strlen(archName) + 1);
+	sha256Update(&hash, s_outputNames[output], strlen(s_outputNames[output]) + 1);
+	uint64_t sourceLength = length;
+	sha256Update(&hash, &sourceLength, sizeof(sourceLength));
+	sha256Update(&hash, source, length);
+	uint8_t digest[SHA256_DIGEST_SIZE];
+	sha256Final(&hash, digest);
+	sha256ToHex(digest, key->hex);
+}
+
+#ifdef _WIN32
+
+bool cacheLookup(const CacheOptions* options, const CacheKey* key, uint8_t** data, size_t* length, double* milliseconds) {
+	(void)options; (void)key; (void)data; (void)length; (void)milliseconds;
+	return false;
+}
+
+void cacheStore(const CacheOptions* options, const CacheKey* key, const void* data, size_t length, double milliseconds) {
+	(void)options; (void)key; (void)data; (void)length; (void)milliseconds;
+}
+
+void cacheStoreFile(const CacheOptions* options, const CacheKey* key, const char* path, double milliseconds) {
+	(void)options; (void)key; (void)path; (void)milliseconds;
+}
+
+void printCacheStats(FILE* out, const CacheOptions* options) {
+	(void)options;
+	fprintf(out, "The compilation cache is not supported on Windows\n");
+}
+
+const char* getDefaultCacheDirectory(char* buffer, size_t size) {
+	(void)buffer; (void)size;
+	return NULL;
+}
+
+#else
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+
+#define CACHE_ENTRY_MAGIC "VECCENT1"
+#define CACHE_STATS_MAGIC "VECCSTA1"
+
+// Eviction stops once the cache is back under this share of its cap, so a
+// full cache is not scanned again on the very next store.
+#define CACHE_EVICT_TARGET 0.9
+
+// Every entry file starts with this, followed by `length` bytes of output.
+typedef struct {
+	char magic[8];
+	uint64_t length;
+	uint64_t compileMicroseconds;
+} CacheEntryHeader;
+
+// Running totals, kept in the "stats" file and only touched under the lock.
+typedef struct {
+	char magic[8];
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t savedMicroseconds;
+	uint64_t totalBytes;			// Entry files, headers included
+	uint64_t entryCount;
+} CacheStats;
+
+typedef struct {
+	char* path;
+	uint64_t size;
+	time_t modifiedTime;
+} CacheFile;
+
+static _Atomic unsigned s_tempCounter = 0;
+
+// Create a directory and any missing parents.
+static bool makeDirectories(const char* path) {
+	char* copy = strdup(path);
+	if (copy == NULL) {
+		return false;
+	}
+	for (char* c = copy + 1; *c; c++) {
+		if (*c == '/') {
+			*c = '\0';
+			mkdir(copy, 0777);
+			*c = '/';
+		}
+	}
+	bool made = mkdir(copy, 0777) == 0 || errno == EEXIST;
+	free(copy);
+	return made;
+}
+
+static char* formatPath(const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	int length = vsnprintf(NULL, 0, format, args);
+	va_end(args);
+	char* path = (char*)malloc((size_t)length + 1);
+	if (path == NULL) {
+		fprintf(stderr, "Error: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	va_start(args, format);
+	vsnprintf(path, (size_t)length + 1, format, args);
+	va_end(args);
+	return path;
+}
+
+// Entries are spread over 256 subdirectories by the first byte of the key.
+static char* getEntryPath(const CacheOptions* options, const CacheKey* key) {
+	return formatPath("%s/%.2s/%s", options->directory, key->hex, key->hex + 2);
+}
+
+// Returns: the open lock file, held exclusively, or -1.
+static int lockCache(const CacheOptions* options) {
+	char* path = formatPath("%s/lock", options->directory);
+	int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	if (fd < 0 && errno == ENOENT && makeDirectories(options->directory)) {
+		fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+	}
+	free(path);
+	if (fd >= 0 && flock(fd, LOCK_EX) != 0) {
+		close(fd);
+		fd = -1;
+	}
+	return fd;
+}
+
+static void unlockCache(int lock) {
+	flock(lock, LOCK_UN);
+	close(lock);
+}
+
+// Collect every entry file, for eviction and for rebuilding the totals.
+static CacheFile* scanEntries(const CacheOptions* options) {
+	CacheFile* files = NULL;
+	for (int bucket = 0; bucket < 256; bucket++) {
+		char* directoryPath = formatPath("%s/%02x", options->directory, bucket);
+		DIR* directory = opendir(directoryPath);
+		if (directory) {
+			struct dirent* item;
+			while ((item = readdir(directory)) != NULL) {
+				// Skip "." and "..", and temporary files still being written.
+				if (item->d_name[0] == '.' || strchr(item->d_name, '.') != NULL) {
+					continue;
+				}
+				char* path = formatPath("%s/%s", directoryPath, item->d_name);
+				struct stat info;
+				if (stat(path, &info) == 0 && S_ISREG(info.st_mode)) {
+					arrput(files, ((CacheFile){ .path = path, .size = (uint64_t)info.st_size, .modifiedTime = info.st_mtime }));
+				} else {
+					free(path);
+				}
+			}
+			closedir(directory);
+		}
+		free(directoryPath);
+	}
+	return files;
+}
+
+static void freeCacheFiles(CacheFile* files) {
+	for (ptrdiff_t i = 0; i < arrlen(files); i++) {
+		free(files[i].path);
+	}
+	arrfree(files);
+}
+
+// Least recently used first.
+static int compareCacheFiles(const void* a, const void* b) {
+	const CacheFile* lhs = (const CacheFile*)a;
+	const CacheFile* rhs = (const CacheFile*)b;
+	if (lhs->modifiedTime != rhs->modifiedTime) {
+		return lhs->modifiedTime < rhs->modifiedTime ? -1 : 1;
+	}
+	return strcmp(lhs->path, rhs->path);
+}
+
+// Recount the entries on disk, then delete the least recently used ones
+// until the cache is under its target size. Called with the lock held.
+static void evictEntries(const CacheOptions* options, CacheStats* stats, uint64_t targetBytes) {
+	CacheFile* files = scanEntries(options);
+	stats->totalBytes = 0;
+	stats->entryCount = (uint64_t)arrlen(files);
+	for (ptrdiff_t i = 0; i < arrlen(files); i++) {
+		stats->totalBytes += files[i].size;
+	}
+	if (files != NULL) {
+		qsort(files, (size_t)arrlen(files), sizeof(CacheFile), compareCacheFiles);
+	}
+	for (ptrdiff_t i = 0; i < arrlen(files) && stats->totalBytes > targetBytes; i++) {
+		if (unlink(files[i].path) == 0) {
+			stats->totalBytes -= files[i].size;
+			stats->entryCount--;
+		}
+	}
+	freeCacheFiles(files);
+}
+
+// Read the totals, rebuilding them from the entries on disk when the stats
+// file is missing or damaged. Called with the lock held.
+static void readCacheStats(const CacheOptions* options, CacheStats* stats) {
+	char* path = formatPath("%s/stats", options->directory);
+	FILE* file = fopen(path, "rb");
+	bool valid = file != NULL && fread(stats, sizeof(*stats), 1, file) == 1 && memcmp(stats->magic, CACHE_STATS_MAGIC, 8) == 0;
+	if (file) {
+		fclose(file);
+	}
+	free(path);
+	if (!valid) {
+		memset(stats, 0, sizeof(*stats));
+		memcpy(stats->magic, CACHE_STATS_MAGIC, 8);
+		evictEntries(options, stats, UINT64_MAX);
+	}
+}
+
+static void writeCacheStats(const CacheOptions* options, const CacheStats* stats) {
+	char* path = formatPath("%s/stats", options->directory);
+	FILE* file = fopen(path, "wb");
+	if (file) {
+		fwrite(stats, sizeof(*stats), 1, file);
+		fclose(file);
+	}
+	free(path);
+}
+
+// Count a hit or a miss.
+static void recordLookup(const CacheOptions* options, bool hit, uint64_t savedMicroseconds) {
+	int lock = lockCache(options);
+	if (lock < 0) {
+		return;
+	}
+	CacheStats stats;
+	readCacheStats(options, &stats);
+	if (hit) {
+		stats.hits++;
+		stats.savedMicroseconds += savedMicroseconds;
+	} else {
+		stats.misses++;
+	}
+	writeCacheStats(options, &stats);
+	unlockCache(lock);
+}
+
+bool cacheLookup(const CacheOptions* options, const CacheKey* key, uint8_t** data, size_t* length, double* milliseconds) {
+	char* path = getEntryPath(options, key);
+	FILE* file = fopen(path, "rb");
+	CacheEntryHeader header;
+	uint8_t* bytes = NULL;
+	bool hit = file != NULL && fread(&header, sizeof(header), 1, file) == 1 &&
+		memcmp(header.magic, CACHE_ENTRY_MAGIC, 8) == 0 && header.length <= SIZE_MAX;
+	if (hit) {
+		bytes = (uint8_t*)malloc(header.length > 0 ? (size_t)header.length : 1);
+		hit = bytes != NULL && fread(bytes, 1, (size_t)header.length, file) == header.length && fgetc(file) == EOF;
+	}
+	if (file) {
+		fclose(file);
+	}
+	if (hit) {
+		// The modification time doubles as the last use for LRU eviction.
+		utimensat(AT_FDCWD, path, NULL, 0);
+	} else {
+		free(bytes);
+	}
+	free(path);
+
+	recordLookup(options, hit, hit ? header.compileMicroseconds : 0);
+	if (!hit) {
+		return false;
+	}
+	*data = bytes;
+	*length = (size_t)header.length;
+	*milliseconds = (double)header.compileMicroseconds * 1e-3;
+	return true;
+}
+
+// Whether an entry holding `length` bytes of output could survive eviction.
+// Anything bigger would flush every other entry and then itself.
+static bool fitsInCache(const CacheOptions* options, uint64_t length) {
+	return sizeof(CacheEntryHeader) + length <= (uint64_t)((double)options->maxBytes * CACHE_EVICT_TARGET);
+}
+
+void cacheStore(const CacheOptions* options, const CacheKey* key, const void* data, size_t length, double milliseconds) {
+	if (!fitsInCache(options, length)) {
+		return;
+	}
+
+	// Write a temporary file next to the entry and rename it into place, so
+	// a concurrent lookup never sees a partial entry.
+	char* path = getEntryPath(options, key);
+	char* tempPath = formatPath("%s.%d.%u", path, (int)getpid(), atomic_fetch_add(&s_tempCounter, 1));
+	FILE* file = fopen(tempPath, "wb");
+	if (file == NULL) {
+		char* bucket = formatPath("%s/%.2s", options->directory, key->hex);
+		if (makeDirectories(bucket)) {
+			file = fopen(tempPath, "wb");
+		}
+		free(bucket);
+	}
+	CacheEntryHeader header = {
+		.magic = CACHE_ENTRY_MAGIC,
+		.length = length,
+		.compileMicroseconds = milliseconds > 0.0 ? (uint64_t)(milliseconds * 1e3) : 0,
+	};
+	bool written = file != NULL && fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data, 1, length, file) == length;
+	if (file && fclose(file) != 0) {
+		written = false;
+	}
+	if (!written) {
+		unlink(tempPath);
+		free(tempPath);
+		free(path);
+		return;
+	}
+
+	int lock = lockCache(options);
+	if (lock >= 0) {
+		CacheStats stats;
+		readCacheStats(options, &stats);
+		struct stat previous;
+		if (stat(path, &previous) == 0 && stats.entryCount > 0 && stats.totalBytes >= (uint64_t)previous.st_size) {
+			// Replacing an entry stored concurrently by another compile.
+			stats.totalBytes -= (uint64_t)previous.st_size;
+			stats.entryCount--;
+		}
+		if (rename(tempPath, path) == 0) {
+			stats.totalBytes += sizeof(header) + length;
+			stats.entryCount++;
+		} else {
+			unlink(tempPath);
+		}
+		if (stats.totalBytes > options->maxBytes) {
+			evictEntries(options, &stats, (uint64_t)((double)options->maxBytes * CACHE_EVICT_TARGET));
+		}
+		writeCacheStats(options, &stats);
+		unlockCache(lock);
+	} else {
+		unlink(tempPath);
+	}
+	free(tempPath);
+	free(path);
+}
+
+void cacheStoreFile(const CacheOptions* options, const CacheKey* key, const char* path, double milliseconds) {
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		return;
+	}
+	struct stat info;
+	if (fstat(fileno(file), &info) == 0 && !fitsInCache(options, (uint64_t)info.st_size)) {
+		fclose(file);
+		return;
+	}
+	uint8_t* data = NULL;
+	size_t length = 0;
+	size_t count;
+	uint8_t chunk[64 * 1024];
+	while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+		memcpy(arraddnptr(data, count), chunk, count);
+		length += count;
+	}
+	bool complete = !ferror(file);
+	fclose(file);
+	if (complete) {
+		cacheStore(options, key, data, length, milliseconds);
+	}
+	arrfree(data);
+}
+
+void printCacheStats(FILE* out, const CacheOptions* options) {
+	CacheStats stats;
+	int lock = lockCache(options);
+	if (lock < 0) {
+		fprintf(out, "Cache %s could not be opened: %s\n", options->directory, strerror(errno));
+		return;
+	}
+	readCacheStats(options, &stats);
+	unlockCache(lock);
+	uint64_t lookups = stats.hits + stats.misses;
+	fprintf(out, "Cache %s: %llu entries, %.1f MB of %.1f MB\n", options->directory, (unsigned long long)stats.entryCount,
+			(double)stats.totalBytes / (1024.0 * 1024.0), (double)options->maxBytes / (1024.0 * 1024.0));
+	fprintf(out, "Hits: %llu, misses: %llu (%.1f%% hit rate)\n", (unsigned long long)stats.hits, (unsigned long long)stats.misses,
+			lookups > 0 ? 100.0 * (double)stats.hits / (double)lookups : 0.0);
+	fprintf(out, "Compile time saved: %.3f ms\n", (double)stats.savedMicroseconds * 1e-3);
+}
+
+const char* getDefaultCacheDirectory(char* buffer, size_t size) {
+	const char* directory = getenv("VECC_CACHE_DIR");
+	if (directory && *directory) {
+		snprintf(buffer, size, "%s", directory);
+		return buffer;
+	}
+	const char* cacheHome = getenv("XDG_CACHE_HOME");
+	if (cacheHome && *cacheHome) {
+		snprintf(buffer, size, "%s/vecc", cacheHome);
+		return buffer;
+	}
+	const char* home = getenv("HOME");
+	if (home && *home) {
+		snprintf(buffer, size, "%s/.cache/vecc", home);
+		return buffer;
+	}
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,67 @@
+//
+//  cache.h
+//  VectorC
+//
+
+#ifndef cache_h
+#define cache_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "ast_asm_common.h"
+#include "sha256.h"
+
+#define CACHE_DEFAULT_MAX_BYTES (1024ull * 1024 * 1024)
+
+typedef struct {
+	const char* directory;			// NULL when caching is off
+	uint64_t maxBytes;				// Oldest entries are evicted beyond this
+} CacheOptions;
+
+// What a cache entry holds; part of the key.
+typedef enum {
+	CACHE_OUTPUT_ASSEMBLY,			// Assembler source for -S or clang
+	CACHE_OUTPUT_OBJECT,			// ELF object written without the assembler
+	CACHE_OUTPUT_EXECUTABLE			// Static executable from --direct-exe
+} CacheOutput;
+
+typedef struct {
+	char hex[SHA256_DIGEST_SIZE * 2 + 1];
+} CacheKey;
+
+// Hash the preprocessed source together with everything else that decides
+// the output: the target, the kind of output and the compiler build.
+void computeCacheKey(CacheKey* key, const char* source, size_t length, Architecture arch, CacheOutput output);
+
+//
+// cacheLookup
+// -----------
+// Fetch the output stored under a key, marking the entry as recently used
+// and counting a hit or a miss in the cache's statistics.
+//
+// Returns:
+//   true on a hit, with *data (free with free()), *length and the time the
+//   output originally took to compile, *milliseconds, set.
+//
+bool cacheLookup(const CacheOptions* options, const CacheKey* key, uint8_t** data, size_t* length, double* milliseconds);
+
+// Store output under a key along with the time it took to produce, evicting
+// the least recently used entries if the cache has outgrown its size cap.
+// Output too large to fit under the cap is not stored, and failures are
+// ignored; either way the output is simply not cached.
+void cacheStore(const CacheOptions* options, const CacheKey* key, const void* data, size_t length, double milliseconds);
+
+// Store the contents of a file that was just written.
+void cacheStoreFile(const CacheOptions* options, const CacheKey* key, const char* path, double milliseconds);
+
+// Print the entry count, size, hit rate and compile time saved so far.
+void printCacheStats(FILE* out, const CacheOptions* options);
+
+// $VECC_CACHE_DIR, else $XDG_CACHE_HOME/vecc, else $HOME/.cache/vecc.
+// Returns: the directory in `buffer`, or NULL if there is no home directory.
+const char* getDefaultCacheDirectory(char* buffer, size_t size);
+
+#endif /* cache_h */
@@ -0,0 +1,56 @@
+//
+//  compiler_context.c
+//  VectorC
+//
+
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "compiler_context.h"
+#include "stb_ds_config.h"
+
+void initCompilerContext(CompilerContext* ctx, const char* inputFilename, FILE* out, FILE* err) {
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->inputFilename = inputFilename;
+	ctx->out = out;
+	ctx->err = err;
+	arenaInit(&ctx->astArena, AST_ARENA_CHUNK_SIZE);
+}
+
+void destroyCompilerContext(CompilerContext* ctx) {
+	freeBackendOutput(&ctx->backend);
+	freeIncrementalIndex(&ctx->incremental);
+	freeAsmProgram(&ctx->finalAsmProgram);
+	freeTackyProgram(ctx->tackyProgram);
+	ctx->tackyProgram = NULL;
+	arenaFree(&ctx->astArena);
+	arrfree(ctx->tokens);
+	destroyLexer(&ctx->lexer);
+	if (ctx->source.data) {
+		closeSourceFile(&ctx->source);
+	}
+	free(ctx->sourceFilename);
+	free(ctx->objectFilename);
+	free(ctx->outFilename);
+	free(ctx->indexFilename);
+	ctx->sourceFilename = ctx->objectFilename = ctx->outFilename = ctx->indexFilename = NULL;
+}
+
+void compilerError(CompilerContext* ctx, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	fputs("Error: ", ctx->err);
+	vfprintf(ctx->err, format, args);
+	fputc('\n', ctx->err);
+	va_end(args);
+	abortCompilation(ctx);
+}
+
+void abortCompilation(CompilerContext* ctx) {
+	fflush(ctx->out);
+	if (ctx->errorJump == NULL) {
+		exit(EXIT_FAILURE);
+	}
+	longjmp(*ctx->errorJump, 1);
+}
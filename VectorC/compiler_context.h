@@ -0,0 +1,62 @@
+//
+//  compiler_context.h
+//  VectorC
+//
+
+#ifndef compiler_context_h
+#define compiler_context_h
+
+#include <setjmp.h>
+#include <stdio.h>
+
+#include "arena.h"
+#include "lexer.h"
+#include "source_file.h"
+#include "tacky.h"
+#include "ast_asm_common.h"
+#include "backend.h"
+#include "incremental.h"
+#include "time_report.h"
+
+// Everything one compilation owns. Every phase reaches its state through the
+// context rather than through statics, so independent contexts can run on
+// any number of threads at once. The only state shared between compilations
+// on a thread is the intern table and the preprocessor's header cache.
+typedef struct CompilerContext {
+	const char* inputFilename;
+	FILE* out;						// Stage dumps and -v reports
+	FILE* err;						// Diagnostics
+	jmp_buf* errorJump;				// Where compilerError resumes; NULL exits the process
+	PhaseTimes* times;				// Where phases are timed with -ftime-report, else NULL
+
+	SourceFile source;
+	Lexer lexer;
+	Token* tokens;					// stb_ds array, only when the tokens are dumped
+	Arena astArena;					// Owns every AST node
+	TackyProgram* tackyProgram;
+	Program finalAsmProgram;
+	BackendOutput backend;			// Assembly or machine code of each function
+	IncrementalIndex incremental;	// Output reused from the last compilation (--incremental)
+
+	// Output names derived from the input (heap allocated).
+	char* sourceFilename;
+	char* objectFilename;
+	char* outFilename;
+	char* indexFilename;
+} CompilerContext;
+
+// Prepare an empty context for compiling one file. Nothing is allocated.
+void initCompilerContext(CompilerContext* ctx, const char* inputFilename, FILE* out, FILE* err);
+
+// Release everything the phases stored in the context, whether or not the
+// compilation finished.
+void destroyCompilerContext(CompilerContext* ctx);
+
+// Print "Error: <message>" to the context's error stream and abandon the
+// compilation by jumping to ctx->errorJump.
+_Noreturn void compilerError(CompilerContext* ctx, const char* format, ...);
+
+// Abandon the compilation after the caller has reported the problem itself.
+_Noreturn void abortCompilation(CompilerContext* ctx);
+
+#endif /* compiler_context_h */
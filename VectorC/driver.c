@@ -0,0 +1,541 @@
+//
+//  driver.c
+//  VectorC
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <setjmp.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "driver.h"
+#include "compiler_context.h"
+#include "lexer.h"
+#include "parser.h"
+#include "tacky.h"
+#include "ast_x64.h"
+#include "ast_arm64.h"
+#include "source_file.h"
+#include "x64_encoder.h"
+#include "backend.h"
+#include "cache.h"
+#include "incremental.h"
+#include "time_report.h"
+#include "time_trace.h"
+#include "thread.h"
+#include "subprocess.h"
+#include "stb_ds_config.h"
+
+//
+// replaceExtension
+// ----------------
+// Derive an output filename from the input by swapping everything after the
+// last '.' of its final path component, or appending when there is none.
+//
+// Returns:
+//   Heap allocated filename; free with free().
+//
+static char* replaceExtension(const char* path, const char* extension) {
+	const char* base = path;
+	for (const char* c = path; *c; c++) {
+		if (*c == '/' || *c == '\\') {
+			base = c + 1;
+		}
+	}
+	const char* dot = strrchr(base, '.');
+	size_t stemLength = dot ? (size_t)(dot - path) : strlen(path);
+	size_t extensionLength = strlen(extension);
+	char* result = (char*)malloc(stemLength + extensionLength + 1);
+	if (result == NULL) {
+		fprintf(stderr, "Error: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	memcpy(result, path, stemLength);
+	memcpy(result + stemLength, extension, extensionLength + 1);
+	return result;
+}
+
+//
+// assembleProgram
+// ---------------
+// Stream the backend's assembly through a pipe into `clang -x assembler -`,
+// producing an object file or a linked executable without a .s on disk.
+// When `cached` is set, that text is sent instead of the backend's output.
+//
+// Returns:
+//   true if clang succeeded.
+//
+static bool assembleProgram(CompilerContext* ctx, Architecture arch, bool compileOnly, const char* outputFilename, bool verbose, const uint8_t* cached, size_t cachedLength) {
+	const char* args[12];
+	int argCount = 0;
+	args[argCount++] = "clang";
+#ifdef __APPLE__
+	args[argCount++] = "-arch";
+	args[argCount++] = getArchitectureName(arch);
+#else
+	(void)arch;
+#endif
+	if (compileOnly) {
+		args[argCount++] = "-c";
+	}
+	args[argCount++] = "-x";
+	args[argCount++] = "assembler";
+	args[argCount++] = "-";
+	args[argCount++] = "-o";
+	args[argCount++] = outputFilename;
+	args[argCount++] = NULL;
+
+	CompilerPhase phase = switchPhase(ctx->times, PHASE_ASSEMBLE);
+	uint64_t childCpuStart = ctx->times ? readChildCpuNanoseconds() : 0;
+	Process assembler;
+	if (!startProcess(&assembler, args, PROCESS_PIPE_STDIN, verbose)) {
+		switchPhase(ctx->times, phase);
+		return false;
+	}
+	struct timespec emitStart, emitEnd;
+	timespec_get(&emitStart, TIME_UTC);
+	size_t asmBytes = cached ? fwrite(cached, 1, cachedLength, assembler.input) : writeBackendAssembly(&ctx->backend, assembler.input);
+	timespec_get(&emitEnd, TIME_UTC);
+	if (verbose) {
+		double seconds = (double)(emitEnd.tv_sec - emitStart.tv_sec) + (double)(emitEnd.tv_nsec - emitStart.tv_nsec) * 1e-9;
+		fprintf(ctx->out, "Wrote %zu bytes of assembly in %.3f ms (%.1f MB/s)\n",
+			   asmBytes, seconds * 1e3, seconds > 0.0 ? (double)asmBytes / (seconds * 1e6) : 0.0);
+	}
+	int status = waitProcess(&assembler);
+	addChildCpuTime(ctx->times, childCpuStart);
+	switchPhase(ctx->times, phase);
+	if (status != 0) {
+		fprintf(ctx->err, "Error: clang failed to %s %s\n", compileOnly ? "assemble" : "link", outputFilename);
+		return false;
+	}
+	return true;
+}
+
+//
+// loadSource
+// ----------
+// Preprocess the input, either with the built-in preprocessor or by reading
+// `clang -E` output straight from a pipe rather than a .i file.
+//
+// Returns:
+//   false if the external preprocessor failed.
+//
+static bool loadSource(CompilerContext* ctx, const CompileOptions* options) {
+	const char* inputFilename = ctx->inputFilename;
+	SourceFile* source = &ctx->source;
+	const PreprocessorOptions* ppOptions = &options->preprocessor;
+	if (!options->externalPreprocessor) {
+		struct timespec ppStart, ppEnd;
+		timespec_get(&ppStart, TIME_UTC);
+		*source = preprocessFile(ctx, inputFilename, ppOptions);
+		timespec_get(&ppEnd, TIME_UTC);
+		if (options->verbose) {
+			double seconds = (double)(ppEnd.tv_sec - ppStart.tv_sec) + (double)(ppEnd.tv_nsec - ppStart.tv_nsec) * 1e-9;
+			fprintf(ctx->out, "Preprocessed %s into %zu bytes in %.3f ms\n", inputFilename, source->length, seconds * 1e3);
+		}
+		return true;
+	}
+
+	const char** args = NULL;
+	arrput(args, "clang");
+	arrput(args, "-E");
+	arrput(args, "-P");
+	for (ptrdiff_t d = 0; d < arrlen(ppOptions->includePaths); d++) {
+		arrput(args, "-I");
+		arrput(args, ppOptions->includePaths[d]);
+	}
+	for (ptrdiff_t d = 0; d < arrlen(ppOptions->defines); d++) {
+		arrput(args, "-D");
+		arrput(args, ppOptions->defines[d]);
+	}
+	arrput(args, inputFilename);
+	arrput(args, NULL);
+
+	uint64_t childCpuStart = ctx->times ? readChildCpuNanoseconds() : 0;
+	Process preprocessor;
+	bool started = startProcess(&preprocessor, args, PROCESS_PIPE_STDOUT, options->verbose);
+	arrfree(args);
+	if (!started) {
+		return false;
+	}
+	bool read = readSourceStream(preprocessor.output, source);
+	int readError = errno;
+	int status = waitProcess(&preprocessor);
+	addChildCpuTime(ctx->times, childCpuStart);
+	if (!read) {
+		fprintf(ctx->err, "Error: Could not read the preprocessed %s: %s\n", inputFilename, strerror(readError));
+		return false;
+	}
+	if (status != 0) {
+		fprintf(ctx->err, "Error: clang failed to preprocess %s\n", inputFilename);
+		closeSourceFile(source);
+		return false;
+	}
+	return true;
+}
+
+//
+// writeCachedOutput
+// -----------------
+// Produce the output of a compilation from a cache entry: write the .s,
+// object or executable directly, or hand cached assembly to clang.
+//
+// Returns:
+//   EXIT_SUCCESS, or EXIT_FAILURE after reporting the problem.
+//
+static int writeCachedOutput(CompilerContext* ctx, const CompileOptions* options, CacheOutput output, const uint8_t* data, size_t length) {
+	const char* path = ctx->sourceFilename;
+	if (output == CACHE_OUTPUT_OBJECT) {
+		path = ctx->objectFilename;
+	} else if (output == CACHE_OUTPUT_EXECUTABLE) {
+		path = ctx->outFilename;
+	} else if (!options->assemblyOnly) {
+		const char* target = options->compileOnly ? ctx->objectFilename : ctx->outFilename;
+		return assembleProgram(ctx, options->arch, options->compileOnly, target, options->verbose, data, length) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	switchPhase(ctx->times, PHASE_WRITE_OUTPUT);
+	FILE* file = fopen(path, "wb");
+	bool written = file != NULL && fwrite(data, 1, length, file) == length;
+	if (file != NULL && fclose(file) != 0) {
+		written = false;
+	}
+	switchPhase(ctx->times, PHASE_OTHER);
+#ifndef _WIN32
+	if (written && output == CACHE_OUTPUT_EXECUTABLE) {
+		written = chmod(path, 0755) == 0;
+	}
+#endif
+	if (!written) {
+		fprintf(ctx->err, "Error: Could not write '%s': %s\n", path, strerror(errno));
+		return EXIT_FAILURE;
+	}
+	if (options->verbose) {
+		fprintf(ctx->out, "Wrote %s\n", path);
+	}
+	return EXIT_SUCCESS;
+}
+
+// Store the output just written to `path`, or the backend's assembly when
+// it went to clang instead of a file.
+static void storeInCache(CompilerContext* ctx, const CompileOptions* options, const CacheKey* key, const char* path, double milliseconds) {
+	if (path != NULL) {
+		cacheStoreFile(&options->cache, key, path, milliseconds);
+		return;
+	}
+	size_t length;
+	char* text = joinBackendAssembly(&ctx->backend, &length);
+	cacheStore(&options->cache, key, text, length, milliseconds);
+	free(text);
+}
+
+//
+// runPhases
+// ---------
+// Run every stage for the file named by the context, leaving everything it
+// allocates in the context. Errors inside a phase go through compilerError
+// and never return here.
+//
+// Returns:
+//   EXIT_SUCCESS on success, or EXIT_FAILURE if an external tool failed.
+//
+static int runPhases(CompilerContext* ctx, const CompileOptions* options) {
+	const bool bVerbose = options->verbose;
+	const bool bPrint = options->printStages;
+	const Architecture arch = options->arch;
+	FILE* out = ctx->out;
+
+	// Output names are derived from the input, so their length is unbounded.
+	ctx->sourceFilename = replaceExtension(ctx->inputFilename, ".s");
+	ctx->objectFilename = replaceExtension(ctx->inputFilename, ".o");
+#ifdef _WIN32
+	ctx->outFilename = replaceExtension(ctx->inputFilename, ".exe");
+#else
+	ctx->outFilename = replaceExtension(ctx->inputFilename, "");
+#endif
+
+	if (strcmp(ctx->outFilename, ctx->inputFilename) == 0) {
+		compilerError(ctx, "Source file '%s' has no extension", ctx->inputFilename);
+	}
+
+	switchPhase(ctx->times, PHASE_PREPROCESS);
+	bool loaded = loadSource(ctx, options);
+	switchPhase(ctx->times, PHASE_OTHER);
+	if (!loaded) {
+		return EXIT_FAILURE;
+	}
+	if (options->preprocessOnly) {
+		fwrite(ctx->source.data, 1, ctx->source.length, out);
+		return EXIT_SUCCESS;
+	}
+
+	// Decide what gets written up front: the backend emits accordingly, so
+	// each function's text or machine code is produced on the thread that
+	// lowered it, and the cache key depends on it.
+	bool writeObject = false;
+	bool writeExecutable = false;
+#if !defined(__APPLE__) && !defined(_WIN32)
+	// ELF hosts: encode the instructions straight into an object file.
+	writeObject = options->compileOnly && arch == ARCH_X64;
+#endif
+#if defined(__linux__)
+	// The built-in _start relies on the Linux system call interface.
+	writeExecutable = !options->compileOnly && options->directExecutable && arch == ARCH_X64;
+#endif
+	BackendEmit emit = BACKEND_EMIT_ASSEMBLY;
+	CacheOutput cacheOutput = CACHE_OUTPUT_ASSEMBLY;
+	if (options->stopAfterCodegen) {
+		emit = BACKEND_EMIT_NONE;
+	} else if (!options->assemblyOnly && (writeObject || writeExecutable)) {
+		emit = BACKEND_EMIT_MACHINE_CODE;
+		cacheOutput = writeObject ? CACHE_OUTPUT_OBJECT : CACHE_OUTPUT_EXECUTABLE;
+	}
+
+	// A hit skips everything from lexing to code generation, stage dumps
+	// included; runs that stop early to print a stage never use the cache.
+	const bool bCache = options->cache.directory != NULL &&
+		!(options->stopAfterLex || options->stopAfterParse || options->stopAfterTacky || options->stopAfterCodegen);
+	CacheKey cacheKey;
+	if (bCache) {
+		computeCacheKey(&cacheKey, ctx->source.data, ctx->source.length, arch, cacheOutput);
+		uint8_t* cached;
+		size_t cachedLength;
+		double cachedMilliseconds;
+		if (cacheLookup(&options->cache, &cacheKey, &cached, &cachedLength, &cachedMilliseconds)) {
+			if (bVerbose) {
+				fprintf(out, "Cache hit for %s: skipped %.3f ms of compilation\n", ctx->inputFilename, cachedMilliseconds);
+			}
+			int result = writeCachedOutput(ctx, options, cacheOutput, cached, cachedLength);
+			free(cached);
+			return result;
+		}
+	}
+	struct timespec compileStart;
+	timespec_get(&compileStart, TIME_UTC);
+
+	CompileStats* stats = options->stats;
+	if (stats != NULL) {
+		stats->sourceBytes = ctx->source.length;
+	}
+	initLexer(&ctx->lexer, ctx, ctx->source.data);
+	ProgramNode* cProgram;
+	// The token array is only materialized when it is going to be printed or
+	// lexing is timed on its own; otherwise the parser pulls tokens from the
+	// lexer as it goes.
+	if (options->stopAfterLex || bVerbose || ctx->times != NULL) {
+		struct timespec lexStart, lexEnd;
+		timespec_get(&lexStart, TIME_UTC);
+		switchPhase(ctx->times, PHASE_LEX);
+		scanTokens(&ctx->lexer, &ctx->tokens);
+		switchPhase(ctx->times, PHASE_OTHER);
+		timespec_get(&lexEnd, TIME_UTC);
+		size_t tokenCount = arrlenu(ctx->tokens);
+		if (stats != NULL) {
+			stats->tokenCount = tokenCount;
+		}
+		if (bVerbose) {
+			double seconds = (double)(lexEnd.tv_sec - lexStart.tv_sec) + (double)(lexEnd.tv_nsec - lexStart.tv_nsec) * 1e-9;
+			fprintf(out, "Lexed %zu bytes into %zu tokens in %.3f ms (%.1f MB/s)\n",
+				   ctx->source.length, tokenCount, seconds * 1e3, seconds > 0.0 ? (double)ctx->source.length / (seconds * 1e6) : 0.0);
+		}
+		if (bPrint && (options->stopAfterLex || bVerbose)) {
+			for (size_t t = 0; t < tokenCount; ++t) {
+				Token token = ctx->tokens[t];
+				if (token.type == TOKEN_IDENTIFIER || token.type == TOKEN_NUMBER) {
+					fprintf(out, "Token: %s (%.*s)\n", getTokenName(token.type), (int)token.length, token.start);
+				} else {
+					fprintf(out, "Token: %s\n", getTokenName(token.type));
+				}
+			}
+		}
+		if (options->stopAfterLex) {
+			return EXIT_SUCCESS;
+		}
+
+		switchPhase(ctx->times, PHASE_PARSE);
+		cProgram = parseProgramTokens(ctx, ctx->tokens);
+		switchPhase(ctx->times, PHASE_OTHER);
+		arrfree(ctx->tokens);
+	} else {
+		// Lexing is charged to parsing here; the two are interleaved.
+		switchPhase(ctx->times, PHASE_PARSE);
+		cProgram = parseProgramStream(ctx);
+		switchPhase(ctx->times, PHASE_OTHER);
+	}
+	if (stats != NULL) {
+		stats->astNodeCount = ctx->astArena.allocationCount;
+	}
+	if (bPrint) {
+		printProgram(out, cProgram);
+	}
+	if (options->stopAfterParse) {
+		return EXIT_SUCCESS;
+	}
+
+	// Functions whose text has not changed since the last compilation take
+	// their output from the index and skip TACKY and the backend altogether.
+	const bool bIncremental = options->incremental && emit != BACKEND_EMIT_NONE &&
+		!(options->stopAfterTacky || options->stopAfterCodegen);
+	if (bIncremental) {
+		ctx->indexFilename = replaceExtension(ctx->inputFilename, ".vecc-index");
+		loadIncrementalIndex(&ctx->incremental, ctx->indexFilename, cProgram, arch, emit);
+	}
+
+	switchPhase(ctx->times, PHASE_TACKY);
+	ctx->tackyProgram = generateTackyFromAst(ctx, cProgram, ctx->incremental.reuse);
+	switchPhase(ctx->times, PHASE_OTHER);
+	if (stats != NULL) {
+		for (ptrdiff_t i = 0; i < arrlen(ctx->tackyProgram->functions); i++) {
+			stats->tackyInstructionCount += arrlenu(ctx->tackyProgram->functions[i].instructions);
+		}
+	}
+	if (bPrint) {
+		printTackyProgram(out, ctx->tackyProgram, ctx->incremental.reuse);
+	}
+	if (options->stopAfterTacky) {
+		return EXIT_SUCCESS;
+	}
+
+	struct timespec backendStart, backendEnd;
+	timespec_get(&backendStart, TIME_UTC);
+	runBackend(ctx, arch, emit, options->backendJobs > 0 ? options->backendJobs : getProcessorCount(), ctx->incremental.reuse);
+	timespec_get(&backendEnd, TIME_UTC);
+	if (stats != NULL) {
+		for (size_t i = 0; i < ctx->finalAsmProgram.functionCount; i++) {
+			stats->outputBytes += ctx->backend.functions[i].length;
+		}
+	}
+	if (bIncremental) {
+		applyIncrementalIndex(&ctx->incremental, &ctx->backend);
+		if (!saveIncrementalIndex(&ctx->incremental, &ctx->backend, ctx->indexFilename)) {
+			fprintf(ctx->err, "Warning: Could not write '%s': %s\n", ctx->indexFilename, strerror(errno));
+		}
+		size_t functionCount = ctx->finalAsmProgram.functionCount;
+		fprintf(out, "Reused %zu of %zu functions (%.1f%%) from %s\n", ctx->incremental.reusedCount, functionCount,
+			   functionCount > 0 ? 100.0 * (double)ctx->incremental.reusedCount / (double)functionCount : 0.0, ctx->indexFilename);
+	}
+	if (bVerbose) {
+		double seconds = (double)(backendEnd.tv_sec - backendStart.tv_sec) + (double)(backendEnd.tv_nsec - backendStart.tv_nsec) * 1e-9;
+		fprintf(out, "Lowered %zu functions on %d thread%s in %.3f ms\n",
+			   ctx->finalAsmProgram.functionCount - ctx->incremental.reusedCount, ctx->backend.threadCount, ctx->backend.threadCount == 1 ? "" : "s", seconds * 1e3);
+	}
+	// What a later cache hit saves: everything from the lexer to here.
+	const double compileMilliseconds = (double)(backendEnd.tv_sec - compileStart.tv_sec) * 1e3 + (double)(backendEnd.tv_nsec - compileStart.tv_nsec) * 1e-6;
+	if (options->stopAfterCodegen) {
+		return EXIT_SUCCESS;
+	}
+	if (bPrint) {
+		printAsmProgram(out, &ctx->finalAsmProgram, ctx->incremental.reuse);
+	}
+
+	if (options->assemblyOnly) {
+		switchPhase(ctx->times, PHASE_WRITE_OUTPUT);
+		FILE* sourceFile = fopen(ctx->sourceFilename, "w");
+		if (sourceFile == NULL) {
+			compilerError(ctx, "Could not write '%s': %s", ctx->sourceFilename, strerror(errno));
+		}
+		writeBackendAssembly(&ctx->backend, sourceFile);
+		fclose(sourceFile);
+		switchPhase(ctx->times, PHASE_OTHER);
+		if (bCache) {
+			storeInCache(ctx, options, &cacheKey, ctx->sourceFilename, compileMilliseconds);
+		}
+		if (bVerbose) {
+			fprintf(out, "Wrote %s\n", ctx->sourceFilename);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	if (writeObject) {
+		switchPhase(ctx->times, PHASE_WRITE_OUTPUT);
+		generateX64ObjectFile(ctx, &ctx->finalAsmProgram, &ctx->backend, ctx->objectFilename);
+		switchPhase(ctx->times, PHASE_OTHER);
+		if (bCache) {
+			storeInCache(ctx, options, &cacheKey, ctx->objectFilename, compileMilliseconds);
+		}
+		if (bVerbose) {
+			fprintf(out, "Wrote %s\n", ctx->objectFilename);
+		}
+		return EXIT_SUCCESS;
+	}
+	if (options->compileOnly) {
+		if (!assembleProgram(ctx, arch, true, ctx->objectFilename, bVerbose, NULL, 0)) {
+			return EXIT_FAILURE;
+		}
+		if (bCache) {
+			storeInCache(ctx, options, &cacheKey, NULL, compileMilliseconds);
+		}
+		return EXIT_SUCCESS;
+	}
+
+	if (writeExecutable) {
+		switchPhase(ctx->times, PHASE_WRITE_OUTPUT);
+		generateX64Executable(ctx, &ctx->finalAsmProgram, &ctx->backend, ctx->outFilename);
+		switchPhase(ctx->times, PHASE_OTHER);
+		if (bCache) {
+			storeInCache(ctx, options, &cacheKey, ctx->outFilename, compileMilliseconds);
+		}
+		if (bVerbose) {
+			fprintf(out, "Wrote %s\n", ctx->outFilename);
+		}
+		return EXIT_SUCCESS;
+	}
+	if (options->directExecutable && bVerbose) {
+		fprintf(out, "--direct-exe needs a Linux x64 target; linking with clang instead\n");
+	}
+
+	if (!assembleProgram(ctx, arch, false, ctx->outFilename, bVerbose, NULL, 0)) {
+		return EXIT_FAILURE;
+	}
+	if (bCache) {
+		storeInCache(ctx, options, &cacheKey, NULL, compileMilliseconds);
+	}
+
+	if (bVerbose) {
+		printArenaStats(out, &ctx->astArena, "AST");
+	}
+	return EXIT_SUCCESS;
+}
+
+// Run the phases with ctx->errorJump armed. Kept apart from compileFile so
+// nothing setjmp's caller reads afterwards lives in this frame.
+static int runProtected(CompilerContext* ctx, const CompileOptions* options) {
+	jmp_buf errorJump;
+	if (setjmp(errorJump) != 0) {
+		ctx->errorJump = NULL;
+		return EXIT_FAILURE;
+	}
+	ctx->errorJump = &errorJump;
+	int result = runPhases(ctx, options);
+	ctx->errorJump = NULL;
+	return result;
+}
+
+int compileFile(const char* inputFilename, const CompileOptions* options) {
+	CompilerContext ctx;
+	initCompilerContext(&ctx, inputFilename, stdout, stderr);
+	if (options->stats != NULL) {
+		*options->stats = (CompileStats){ 0 };
+	}
+	PhaseTimes times;
+	if (options->timeReport != NULL) {
+		startPhaseTimes(&times);
+		ctx.times = &times;
+	}
+	setTraceFile(inputFilename);
+	uint64_t traceStart = isTimeTraceEnabled() ? readWallNanoseconds() : 0;
+	int result = runProtected(&ctx, options);
+	// An error may have left the thread in any phase.
+	switchPhase(ctx.times, PHASE_OTHER);
+	fflush(ctx.out);
+	destroyCompilerContext(&ctx);
+	traceEvent("File", inputFilename, traceStart);
+	setTraceFile(NULL);
+	if (options->timeReport != NULL) {
+		addToTimeReport(options->timeReport, &times);
+	}
+	return result;
+}
@@ -0,0 +1,67 @@
+//
+//  driver.h
+//  VectorC
+//
+
+#ifndef driver_h
+#define driver_h
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "ast_asm_common.h"
+#include "preprocessor.h"
+#include "cache.h"
+#include "time_report.h"
+
+// How much each stage of one compilation produced.
+typedef struct {
+	size_t sourceBytes;				// After preprocessing
+	size_t tokenCount;
+	size_t astNodeCount;
+	size_t tackyInstructionCount;
+	size_t outputBytes;				// Assembly text or machine code
+} CompileStats;
+
+// Command line settings shared by every file being compiled.
+typedef struct {
+	Architecture arch;
+	PreprocessorOptions preprocessor;
+	CacheOptions cache;				// --cache / --cache-dir=<dir>: reuse the output of identical inputs
+	bool stopAfterLex;				// --lex
+	bool stopAfterParse;			// --parse
+	bool stopAfterTacky;			// --tacky
+	bool stopAfterCodegen;			// --codegen
+	bool preprocessOnly;			// -E
+	bool assemblyOnly;				// -S
+	bool compileOnly;				// -c
+	bool directExecutable;			// --direct-exe
+	bool incremental;				// --incremental: reuse the output of unchanged functions
+	bool externalPreprocessor;		// --external-preprocessor
+	bool verbose;					// -v
+	bool printCacheStats;			// --cache-stats
+	bool printTimeReport;			// -ftime-report
+	bool printMemoryReport;			// -fmem-report
+	bool printPerfCounters;			// -fperf-counters
+	const char* timeReportFile;		// -ftime-report=<file>: the report as JSON instead
+	const char* timeTraceFile;		// -ftime-trace=<file>: Chrome trace events of every phase
+	bool printStages;				// Dump the tokens, AST, TACKY and assembly to stdout
+	int backendJobs;				// -j<N>: threads lowering functions; 0 uses every processor
+	TimeReport* timeReport;			// -ftime-report: every compilation adds its phase times here
+	CompileStats* stats;			// --benchmark: filled in by a single compilation; tokens only when timed
+} CompileOptions;
+
+//
+// compileFile
+// -----------
+// Run every stage for one source file and write its .s, .o or executable
+// next to it. The compilation has its own CompilerContext, so an error
+// abandons only this file, and everything allocated for it is released before
+// returning; only the calling thread's intern table and header cache persist.
+//
+// Returns:
+//   EXIT_SUCCESS on success, or EXIT_FAILURE if an error occurs.
+//
+int compileFile(const char* inputFilename, const CompileOptions* options);
+
+#endif /* driver_h */
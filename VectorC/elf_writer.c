@@ -0,0 +1,252 @@
+//
+//  elf_writer.c
+//  VectorC
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "elf_writer.h"
+#include "stb_ds_config.h"
+
+#ifndef _WIN32
+#include <sys/stat.h>
+#endif
+
+// ELF64 structures, declared here so the writer also builds on hosts without
+// <elf.h>. Every field is naturally aligned, so the in-memory layout matches
+// the file format on the little-endian hosts we support.
+typedef struct {
+	uint8_t  ident[16];
+	uint16_t type;
+	uint16_t machine;
+	uint32_t version;
+	uint64_t entry;
+	uint64_t phoff;
+	uint64_t shoff;
+	uint32_t flags;
+	uint16_t ehsize;
+	uint16_t phentsize;
+	uint16_t phnum;
+	uint16_t shentsize;
+	uint16_t shnum;
+	uint16_t shstrndx;
+} Elf64Header;
+
+typedef struct {
+	uint32_t name;
+	uint32_t type;
+	uint64_t flags;
+	uint64_t addr;
+	uint64_t offset;
+	uint64_t size;
+	uint32_t link;
+	uint32_t info;
+	uint64_t addralign;
+	uint64_t entsize;
+} Elf64SectionHeader;
+
+typedef struct {
+	uint32_t name;
+	uint8_t  info;
+	uint8_t  other;
+	uint16_t shndx;
+	uint64_t value;
+	uint64_t size;
+} Elf64Symbol;
+
+typedef struct {
+	uint32_t type;
+	uint32_t flags;
+	uint64_t offset;
+	uint64_t vaddr;
+	uint64_t paddr;
+	uint64_t filesz;
+	uint64_t memsz;
+	uint64_t align;
+} Elf64ProgramHeader;
+
+static_assert(sizeof(Elf64Header) == 64, "Unexpected ELF header size");
+static_assert(sizeof(Elf64ProgramHeader) == 56, "Unexpected ELF program header size");
+static_assert(sizeof(Elf64SectionHeader) == 64, "Unexpected ELF section header size");
+static_assert(sizeof(Elf64Symbol) == 24, "Unexpected ELF symbol size");
+
+#define ELF_TYPE_REL			1
+#define ELF_TYPE_EXEC			2
+#define PT_LOAD					1
+#define PF_X					0x1
+#define PF_R					0x4
+#define ELF_MACHINE_X86_64		62
+#define SHT_PROGBITS			1
+#define SHT_SYMTAB				2
+#define SHT_STRTAB				3
+#define SHF_ALLOC				0x2
+#define SHF_EXECINSTR			0x4
+#define STB_LOCAL				0
+#define STB_GLOBAL				1
+#define STT_FUNC				2
+#define STT_SECTION				3
+#define SYMBOL_INFO(bind, type)	(uint8_t)(((bind) << 4) | (type))
+
+// Section indices of the object file.
+enum {
+	SECTION_NULL,
+	SECTION_TEXT,
+	SECTION_NOTE_STACK,
+	SECTION_SYMTAB,
+	SECTION_STRTAB,
+	SECTION_SHSTRTAB,
+	SECTION_COUNT
+};
+
+// Append bytes to an stb_ds byte array and return their offset.
+static uint64_t appendBytes(uint8_t** buffer, const void* data, size_t size) {
+	uint64_t offset = arrlenu(*buffer);
+	if (size > 0) {
+		memcpy(arraddnptr(*buffer, size), data, size);
+	}
+	return offset;
+}
+
+static uint32_t appendString(uint8_t** table, const char* str) {
+	return (uint32_t)appendBytes(table, str, strlen(str) + 1);
+}
+
+static void alignBuffer(uint8_t** buffer, size_t alignment) {
+	while (arrlenu(*buffer) % alignment != 0) {
+		arrput(*buffer, 0);
+	}
+}
+
+//
+// writeElfImage
+// -------------
+// Lay out and write an ELF file holding a single .text section. An object
+// file gets no program headers and section-relative symbols. An executable
+// gets one read/execute PT_LOAD segment covering the headers and the code,
+// mapped at ELF_EXECUTABLE_BASE, with symbols holding virtual addresses.
+//
+static bool writeElfImage(const char* path, bool executable, const uint8_t* text, size_t textSize, const ElfSymbol* symbols, size_t symbolCount, uint64_t entryOffset) {
+	uint8_t* shstrtab = NULL;
+	arrput(shstrtab, 0);
+	uint32_t textName = appendString(&shstrtab, ".text");
+	uint32_t noteName = appendString(&shstrtab, ".note.GNU-stack");
+	uint32_t symtabName = appendString(&shstrtab, ".symtab");
+	uint32_t strtabName = appendString(&shstrtab, ".strtab");
+	uint32_t shstrtabName = appendString(&shstrtab, ".shstrtab");
+
+	uint8_t* image = NULL;
+	Elf64Header header = { 0 };
+	appendBytes(&image, &header, sizeof(header));
+	Elf64ProgramHeader segment = { 0 };
+	if (executable) {
+		appendBytes(&image, &segment, sizeof(segment));
+	}
+	alignBuffer(&image, 16);
+	uint64_t textOffset = appendBytes(&image, text, textSize);
+	uint64_t textAddress = executable ? ELF_EXECUTABLE_BASE + textOffset : 0;
+
+	// Locals (the null symbol and the .text section symbol) must precede globals.
+	uint8_t* strtab = NULL;
+	arrput(strtab, 0);
+	Elf64Symbol* symtab = NULL;
+	arrput(symtab, ((Elf64Symbol){ 0 }));
+	arrput(symtab, ((Elf64Symbol){ .info = SYMBOL_INFO(STB_LOCAL, STT_SECTION), .shndx = SECTION_TEXT, .value = textAddress }));
+	uint32_t firstGlobal = (uint32_t)arrlenu(symtab);
+	for (size_t i = 0; i < symbolCount; i++) {
+		arrput(symtab, ((Elf64Symbol){
+			.name = appendString(&strtab, symbols[i].name),
+			.info = SYMBOL_INFO(STB_GLOBAL, STT_FUNC),
+			.shndx = SECTION_TEXT,
+			.value = textAddress + symbols[i].offset,
+			.size = symbols[i].size
+		}));
+	}
+
+	alignBuffer(&image, 8);
+	uint64_t symtabOffset = appendBytes(&image, symtab, arrlenu(symtab) * sizeof(Elf64Symbol));
+	uint64_t strtabOffset = appendBytes(&image, strtab, arrlenu(strtab));
+	uint64_t shstrtabOffset = appendBytes(&image, shstrtab, arrlenu(shstrtab));
+	alignBuffer(&image, 8);
+
+	const Elf64SectionHeader sections[SECTION_COUNT] = {
+		[SECTION_TEXT] = {
+			.name = textName, .type = SHT_PROGBITS, .flags = SHF_ALLOC | SHF_EXECINSTR,
+			.addr = textAddress, .offset = textOffset, .size = textSize, .addralign = 16
+		},
+		// Marks the stack as non-executable for the linker.
+		[SECTION_NOTE_STACK] = {
+			.name = noteName, .type = SHT_PROGBITS, .offset = symtabOffset, .addralign = 1
+		},
+		[SECTION_SYMTAB] = {
+			.name = symtabName, .type = SHT_SYMTAB, .offset = symtabOffset,
+			.size = arrlenu(symtab) * sizeof(Elf64Symbol), .link = SECTION_STRTAB, .info = firstGlobal,
+			.addralign = 8, .entsize = sizeof(Elf64Symbol)
+		},
+		[SECTION_STRTAB] = {
+			.name = strtabName, .type = SHT_STRTAB, .offset = strtabOffset, .size = arrlenu(strtab), .addralign = 1
+		},
+		[SECTION_SHSTRTAB] = {
+			.name = shstrtabName, .type = SHT_STRTAB, .offset = shstrtabOffset, .size = arrlenu(shstrtab), .addralign = 1
+		},
+	};
+	uint64_t sectionsOffset = appendBytes(&image, sections, sizeof(sections));
+
+	header = (Elf64Header){
+		.ident = { 0x7f, 'E', 'L', 'F', 2 /* 64-bit */, 1 /* little-endian */, 1 /* version */ },
+		.type = executable ? ELF_TYPE_EXEC : ELF_TYPE_REL,
+		.machine = ELF_MACHINE_X86_64,
+		.version = 1,
+		.shoff = sectionsOffset,
+		.ehsize = sizeof(Elf64Header),
+		.shentsize = sizeof(Elf64SectionHeader),
+		.shnum = SECTION_COUNT,
+		.shstrndx = SECTION_SHSTRTAB
+	};
+	if (executable) {
+		header.entry = textAddress + entryOffset;
+		header.phoff = sizeof(Elf64Header);
+		header.phentsize = sizeof(Elf64ProgramHeader);
+		header.phnum = 1;
+		segment = (Elf64ProgramHeader){
+			.type = PT_LOAD,
+			.flags = PF_R | PF_X,
+			.offset = 0,
+			.vaddr = ELF_EXECUTABLE_BASE,
+			.paddr = ELF_EXECUTABLE_BASE,
+			.filesz = textOffset + textSize,
+			.memsz = textOffset + textSize,
+			.align = 0x1000
+		};
+		memcpy(image + sizeof(Elf64Header), &segment, sizeof(segment));
+	}
+	memcpy(image, &header, sizeof(header));
+
+	bool written = false;
+	FILE* file = fopen(path, "wb");
+	if (file) {
+		written = fwrite(image, 1, arrlenu(image), file) == arrlenu(image);
+		written = (fclose(file) == 0) && written;
+	}
+#ifndef _WIN32
+	if (written && executable) {
+		written = chmod(path, 0755) == 0;
+	}
+#endif
+
+	arrfree(image);
+	arrfree(symtab);
+	arrfree(strtab);
+	arrfree(shstrtab);
+	return written;
+}
+
+bool writeElfObject(const char* path, const uint8_t* text, size_t textSize, const ElfSymbol* symbols, size_t symbolCount) {
+	return writeElfImage(path, false, text, textSize, symbols, symbolCount, 0);
+}
+
+bool writeElfExecutable(const char* path, const uint8_t* text, size_t textSize, const ElfSymbol* symbols, size_t symbolCount, uint64_t entryOffset) {
+	return writeElfImage(path, true, text, textSize, symbols, symbolCount, entryOffset);
+}
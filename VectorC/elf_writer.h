@@ -0,0 +1,34 @@
+//
+//  elf_writer.h
+//  VectorC
+//
+
+#ifndef elf_writer_h
+#define elf_writer_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A function defined in the .text section.
+typedef struct {
+	const char* name;
+	uint64_t offset;		// Start of the function within .text
+	uint64_t size;			// Bytes of machine code
+} ElfSymbol;
+
+// Write an ELF64 x86-64 relocatable object containing a single .text section
+// and one global FUNC symbol per entry. No relocations are emitted: generated
+// code does not reference other symbols yet.
+// Returns: false if the file could not be written.
+bool writeElfObject(const char* path, const uint8_t* text, size_t textSize, const ElfSymbol* symbols, size_t symbolCount);
+
+// Virtual address the executable's only segment is loaded at.
+#define ELF_EXECUTABLE_BASE 0x400000
+
+// Write a statically linked ELF64 x86-64 executable. The code must be fully
+// resolved; execution starts entryOffset bytes into it.
+// Returns: false if the file could not be written or made executable.
+bool writeElfExecutable(const char* path, const uint8_t* text, size_t textSize, const ElfSymbol* symbols, size_t symbolCount, uint64_t entryOffset);
+
+#endif /* elf_writer_h */
@@ -0,0 +1,186 @@
+//
+//  incremental.c
+//  VectorC
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "incremental.h"
+#include "version.h"
+#include "stb_ds_config.h"
+
+#define INDEX_MAGIC "VECCIDX1"
+
+// The index file starts with this, followed by `count` entries, each a
+// FunctionKey, a uint64_t length and that many bytes of output.
+typedef struct {
+	char magic[8];
+	uint64_t count;
+} IndexHeader;
+
+static void computeFunctionKey(FunctionKey* key, const FunctionNode* function, Architecture arch, BackendEmit emit) {
+	// Every field ends with a NUL, or is preceded by its length, so no two
+	// combinations hash the same bytes.
+	Sha256 hash;
+	sha256Init(&hash);
+	hashBuildId(&hash);
+	const char* archName = getArchitectureName(arch);
+	sha256Update(&hash, archName, strlen(archName) + 1);
+	const char* emitName = emit == BACKEND_EMIT_MACHINE_CODE ? "machine code" : "assembly";
+	sha256Update(&hash, emitName, strlen(emitName) + 1);
+	uint64_t sourceLength = function->sourceLength;
+	sha256Update(&hash, &sourceLength, sizeof(sourceLength));
+	sha256Update(&hash, function->source, function->sourceLength);
+	sha256Final(&hash, key->bytes);
+}
+
+// Read a whole file into a malloc'd block.
+// Returns: the contents, or NULL if the file could not be read.
+static uint8_t* readIndexFile(const char* path, size_t* length) {
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		return NULL;
+	}
+	uint8_t* data = NULL;
+	long size = -1;
+	if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0) {
+		data = (uint8_t*)malloc(size > 0 ? (size_t)size : 1);
+		if (data != NULL && fread(data, 1, (size_t)size, file) != (size_t)size) {
+			free(data);
+			data = NULL;
+		}
+	}
+	fclose(file);
+	*length = (size_t)size;
+	return data;
+}
+
+void loadIncrementalIndex(IncrementalIndex* index, const char* path, const ProgramNode* program, Architecture arch, BackendEmit emit) {
+	*index = (IncrementalIndex){ 0 };
+	for (const FunctionNode* function = program ? program->function : NULL; function != NULL; function = function->next) {
+		FunctionKey key;
+		computeFunctionKey(&key, function, arch, emit);
+		arrput(index->keys, key);
+	}
+	size_t functionCount = arrlenu(index->keys);
+	arrsetlen(index->reuse, functionCount);
+	arrsetlen(index->reused, functionCount);
+	if (functionCount > 0) {
+		memset(index->reuse, 0, functionCount * sizeof(bool));
+	}
+
+	size_t length;
+	uint8_t* data = readIndexFile(path, &length);
+	IndexHeader header;
+	if (data == NULL || length < sizeof(header)) {
+		free(data);
+		return;
+	}
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0) {
+		free(data);
+		return;
+	}
+
+	struct { FunctionKey key; FunctionOutput value; }* entries = NULL;
+	size_t offset = sizeof(header);
+	for (uint64_t e = 0; e < header.count; e++) {
+		FunctionKey key;
+		uint64_t outputLength;
+		if (length - offset < sizeof(key) + sizeof(outputLength)) {
+			break;
+		}
+		memcpy(&key, data + offset, sizeof(key));
+		memcpy(&outputLength, data + offset + sizeof(key), sizeof(outputLength));
+		offset += sizeof(key) + sizeof(outputLength);
+		if (outputLength > length - offset) {
+			break;
+		}
+		hmput(entries, key, ((FunctionOutput){ .offset = offset, .length = (size_t)outputLength }));
+		offset += (size_t)outputLength;
+	}
+
+	for (size_t i = 0; i < functionCount; i++) {
+		ptrdiff_t entry = hmgeti(entries, index->keys[i]);
+		if (entry >= 0) {
+			index->reuse[i] = true;
+			index->reused[i] = entries[entry].value;
+			index->reusedCount++;
+		}
+	}
+	hmfree(entries);
+
+	if (index->reusedCount > 0) {
+		index->data = data;
+	} else {
+		free(data);
+	}
+}
+
+void applyIncrementalIndex(IncrementalIndex* index, BackendOutput* output) {
+	if (index->data == NULL) {
+		return;
+	}
+	uint32_t buffer = addBackendBuffer(output, index->data);
+	index->data = NULL;
+	for (ptrdiff_t i = 0; i < arrlen(index->reuse); i++) {
+		if (index->reuse[i]) {
+			output->functions[i] = index->reused[i];
+			output->functions[i].buffer = buffer;
+		}
+	}
+}
+
+bool saveIncrementalIndex(const IncrementalIndex* index, const BackendOutput* output, const char* path) {
+	size_t pathLength = strlen(path);
+	char* tempPath = (char*)malloc(pathLength + 5);
+	if (tempPath == NULL) {
+		return false;
+	}
+	memcpy(tempPath, path, pathLength);
+	memcpy(tempPath + pathLength, ".tmp", 5);
+
+	// Written beside the index and renamed over it, so an interrupted write
+	// never leaves a truncated index behind.
+	FILE* file = fopen(tempPath, "wb");
+	bool written = file != NULL;
+	if (written) {
+		IndexHeader header = { .count = arrlenu(index->keys) };
+		memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+		written = fwrite(&header, sizeof(header), 1, file) == 1;
+		for (size_t i = 0; written && i < header.count; i++) {
+			size_t length;
+			const uint8_t* bytes = getFunctionOutput(output, i, &length);
+			uint64_t outputLength = length;
+			written = fwrite(&index->keys[i], sizeof(index->keys[i]), 1, file) == 1 &&
+				fwrite(&outputLength, sizeof(outputLength), 1, file) == 1 &&
+				fwrite(bytes, 1, length, file) == length;
+		}
+		if (fclose(file) != 0) {
+			written = false;
+		}
+	}
+#ifdef _WIN32
+	if (written) {
+		remove(path);
+	}
+#endif
+	if (written) {
+		written = rename(tempPath, path) == 0;
+	}
+	if (!written && file != NULL) {
+		remove(tempPath);
+	}
+	free(tempPath);
+	return written;
+}
+
+void freeIncrementalIndex(IncrementalIndex* index) {
+	arrfree(index->keys);
+	arrfree(index->reuse);
+	arrfree(index->reused);
+	free(index->data);
+	*index = (IncrementalIndex){ 0 };
+}
@@ -0,0 +1,52 @@
+//
+//  incremental.h
+//  VectorC
+//
+
+#ifndef incremental_h
+#define incremental_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ast_c.h"
+#include "ast_asm_common.h"
+#include "backend.h"
+#include "sha256.h"
+
+// Identifies the output of one function: a hash of its preprocessed text, the
+// target, the kind of output and the compiler build.
+typedef struct {
+	uint8_t bytes[SHA256_DIGEST_SIZE];
+} FunctionKey;
+
+// The sidecar index of one source file, as loaded for a compilation.
+typedef struct {
+	FunctionKey* keys;				// stb_ds array, one per function in source order
+	bool* reuse;					// stb_ds array, set where the index has the output
+	FunctionOutput* reused;			// stb_ds array, where in `data` that output is
+	uint8_t* data;					// Contents of the index file (malloc'd)
+	size_t reusedCount;
+} IncrementalIndex;
+
+//
+// loadIncrementalIndex
+// --------------------
+// Key every function of the program and look the keys up in the index file
+// at `path`, flagging each function whose output can be reused. A missing or
+// damaged index file reuses nothing.
+//
+void loadIncrementalIndex(IncrementalIndex* index, const char* path, const ProgramNode* program, Architecture arch, BackendEmit emit);
+
+// Hand the index's contents to the backend output and point every reused
+// function at its stored text or code.
+void applyIncrementalIndex(IncrementalIndex* index, BackendOutput* output);
+
+// Replace the index file with the output of every function of the program.
+// Returns: false if the file could not be written.
+bool saveIncrementalIndex(const IncrementalIndex* index, const BackendOutput* output, const char* path);
+
+void freeIncrementalIndex(IncrementalIndex* index);
+
+#endif /* incremental_h */
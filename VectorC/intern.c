@@ -0,0 +1,145 @@
+//
+//  intern.c
+//  VectorC
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "intern.h"
+#include "arena.h"
+#include "stb_ds_config.h"
+
+#define INTERN_INITIAL_CAPACITY 1024
+
+// Storage layout of an interned string. Callers only ever see `chars`.
+typedef struct InternedString {
+	uint32_t hash;
+	uint32_t id;
+	uint32_t length;
+	char chars[];
+} InternedString;
+
+typedef struct {
+	Arena storage;					// Owns every InternedString
+	InternedString** slots;			// Open addressing table, capacity is a power of two
+	size_t capacity;
+	size_t count;
+	InternedString** byId;			// stb_ds array indexed by id
+} InternTable;
+
+// Each thread has its own table, so interning needs no locks. Pointers are
+// only comparable between strings interned on the same thread.
+static _Thread_local InternTable s_internTable = { 0 };
+
+// FNV-1a hash of the given characters.
+static uint32_t hashString(const char* str, size_t length) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < length; i++) {
+		hash ^= (uint8_t)str[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Recover the header of an interned string from its characters.
+static const InternedString* headerOf(const char* interned) {
+	return (const InternedString*)(interned - offsetof(InternedString, chars));
+}
+
+// Rehash all entries into a table of the given capacity.
+static void growTable(InternTable* table, size_t capacity) {
+	InternedString** slots = (InternedString**)calloc(capacity, sizeof(InternedString*));
+	if (!slots) {
+		perror("Failed to allocate intern table");
+		exit(EXIT_FAILURE);
+	}
+	for (size_t i = 0; i < table->capacity; i++) {
+		InternedString* entry = table->slots[i];
+		if (!entry) continue;
+		size_t index = entry->hash & (capacity - 1);
+		while (slots[index]) {
+			index = (index + 1) & (capacity - 1);
+		}
+		slots[index] = entry;
+	}
+	free(table->slots);
+	table->slots = slots;
+	table->capacity = capacity;
+}
+
+const char* internString(const char* str, size_t length) {
+	InternTable* table = &s_internTable;
+	if (table->capacity == 0) {
+		arenaInit(&table->storage, 0);
+		growTable(table, INTERN_INITIAL_CAPACITY);
+	}
+
+	uint32_t hash = hashString(str, length);
+	size_t index = hash & (table->capacity - 1);
+	for (;;) {
+		InternedString* entry = table->slots[index];
+		if (!entry) break;
+		if (entry->hash == hash && entry->length == length && memcmp(entry->chars, str, length) == 0) {
+			return entry->chars;
+		}
+		index = (index + 1) & (table->capacity - 1);
+	}
+
+	InternedString* entry = (InternedString*)arenaAlloc(&table->storage, sizeof(InternedString) + length + 1);
+	entry->hash = hash;
+	entry->id = (uint32_t)table->count;
+	entry->length = (uint32_t)length;
+	memcpy(entry->chars, str, length);
+	entry->chars[length] = '\0';
+
+	table->slots[index] = entry;
+	table->count++;
+	arrput(table->byId, entry);
+
+	// Keep the load factor at or below one half.
+	if (table->count * 2 > table->capacity) {
+		growTable(table, table->capacity * 2);
+	}
+	return entry->chars;
+}
+
+const char* internCString(const char* str) {
+	return internString(str, strlen(str));
+}
+
+uint32_t getInternedId(const char* interned) {
+	return headerOf(interned)->id;
+}
+
+uint32_t getInternedHash(const char* interned) {
+	return headerOf(interned)->hash;
+}
+
+size_t getInternedLength(const char* interned) {
+	return headerOf(interned)->length;
+}
+
+const char* getInternedString(uint32_t id) {
+	return s_internTable.byId[id]->chars;
+}
+
+void printInternStats(void) {
+	printf("Intern table: %zu strings, %zu slots, %zu bytes of storage\n",
+		   s_internTable.count, s_internTable.capacity, s_internTable.storage.bytesUsed);
+}
+
+size_t getInternTableBytes(void) {
+	return s_internTable.storage.bytesReserved + s_internTable.capacity * sizeof(InternedString*)
+		+ arrcap(s_internTable.byId) * sizeof(InternedString*);
+}
+
+void destroyInternTable(void) {
+	InternTable* table = &s_internTable;
+	free(table->slots);
+	arrfree(table->byId);
+	arenaFree(&table->storage);
+	memset(table, 0, sizeof(InternTable));
+}
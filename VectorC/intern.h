@@ -0,0 +1,42 @@
+//
+//  intern.h
+//  VectorC
+//
+
+#ifndef intern_h
+#define intern_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Return the canonical copy of the given characters. Every distinct string is
+// stored exactly once per thread until destroyInternTable, so two strings
+// interned on the same thread are equal if and only if their pointers are equal.
+const char* internString(const char* str, size_t length);
+
+// Convenience wrapper for null-terminated strings.
+const char* internCString(const char* str);
+
+// Dense, stable identifier of an interned string (0, 1, 2, ...).
+uint32_t getInternedId(const char* interned);
+
+// Hash computed when the string was first interned.
+uint32_t getInternedHash(const char* interned);
+
+// Length of an interned string, without the terminator.
+size_t getInternedLength(const char* interned);
+
+// Look up an interned string by its identifier.
+const char* getInternedString(uint32_t id);
+
+// Print the number of strings and bytes held by the intern table.
+void printInternStats(void);
+
+// Bytes held by the calling thread's table, for callers that bound it.
+size_t getInternTableBytes(void);
+
+// Release every string interned on the calling thread. All pointers it
+// previously returned become invalid.
+void destroyInternTable(void);
+
+#endif /* intern_h */
@@ -7,18 +7,68 @@
 #include <stdint.h>
 
 #include "lexer.h"
-#include "trie.h"
-#include "stb_ds.h"
+#include "compiler_context.h"
+#include "intern.h"
+#include "stb_ds_config.h"
+
+// Keywords are recognised with a perfect hash over the lexeme's length, first
+// and last characters followed by a single length + memcmp check, so no table
+// has to be built at startup and the lexeme is never copied. The multipliers
+// were chosen so that every entry below lands in its own slot; when adding a
+// keyword, pick new ones if a _DEBUG build reports a collision.
+#define KEYWORD_TABLE_SIZE	128
+#define KEYWORD_MIN_LENGTH	2
+#define KEYWORD_MAX_LENGTH	8
+#define KEYWORD_HASH(first, last, length) \
+	(((length) + (first) * 9u + (last) * 31u) & (KEYWORD_TABLE_SIZE - 1))
 
 typedef struct {
-	const char* start;
-	const char* current;
-	int32_t line;
-} Lexer;
-
-Lexer lexer;
-
-static TrieNode* s_keywordsTrie = NULL;
+	const char* word;
+	uint32_t length;
+	TokenType type;
+} Keyword;
+
+#define KEYWORD(word, first, last, type) \
+	[KEYWORD_HASH(first, last, sizeof(word) - 1)] = { word, sizeof(word) - 1, type }
+
+static const Keyword s_keywords[KEYWORD_TABLE_SIZE] = {
+	KEYWORD("auto", 'a', 'o', TOKEN_AUTO),
+	KEYWORD("break", 'b', 'k', TOKEN_BREAK),
+	KEYWORD("case", 'c', 'e', TOKEN_CASE),
+	KEYWORD("char", 'c', 'r', TOKEN_CHAR),
+	KEYWORD("const", 'c', 't', TOKEN_CONST),
+	KEYWORD("continue", 'c', 'e', TOKEN_CONTINUE),
+	KEYWORD("default", 'd', 't', TOKEN_DEFAULT),
+	KEYWORD("do", 'd', 'o', TOKEN_DO),
+	KEYWORD("double", 'd', 'e', TOKEN_DOUBLE),
+	KEYWORD("else", 'e', 'e', TOKEN_ELSE),
+	KEYWORD("enum", 'e', 'm', TOKEN_ENUM),
+	KEYWORD("extern", 'e', 'n', TOKEN_EXTERN),
+	KEYWORD("float", 'f', 't', TOKEN_FLOAT),
+	KEYWORD("for", 'f', 'r', TOKEN_FOR),
+	KEYWORD("goto", 'g', 'o', TOKEN_GOTO),
+	KEYWORD("if", 'i', 'f', TOKEN_IF),
+	KEYWORD("inline", 'i', 'e', TOKEN_INLINE),
+	KEYWORD("int", 'i', 't', TOKEN_INT),
+	KEYWORD("long", 'l', 'g', TOKEN_LONG),
+	KEYWORD("register", 'r', 'r', TOKEN_REGISTER),
+	KEYWORD("restrict", 'r', 't', TOKEN_RESTRICT),
+	KEYWORD("return", 'r', 'n', TOKEN_RETURN),
+	KEYWORD("short", 's', 't', TOKEN_SHORT),
+	KEYWORD("signed", 's', 'd', TOKEN_SIGNED),
+	KEYWORD("sizeof", 's', 'f', TOKEN_SIZEOF),
+	KEYWORD("static", 's', 'c', TOKEN_STATIC),
+	KEYWORD("struct", 's', 't', TOKEN_STRUCT),
+	KEYWORD("switch", 's', 'h', TOKEN_SWITCH),
+	KEYWORD("typedef", 't', 'f', TOKEN_TYPEDEF),
+	KEYWORD("union", 'u', 'n', TOKEN_UNION),
+	KEYWORD("unsigned", 'u', 'd', TOKEN_UNSIGNED),
+	KEYWORD("void", 'v', 'd', TOKEN_VOID),
+	KEYWORD("volatile", 'v', 'e', TOKEN_VOLATILE),
+	KEYWORD("while", 'w', 'e', TOKEN_WHILE),
+};
+
+#undef KEYWORD
 
 //
 // initLexer
@@ -26,79 +76,32 @@ static TrieNode* s_keywordsTrie = NULL;
 // Prepare the lexer to scan a new source string.
 //
 // Parameters:
-//   source - Null-terminated source code to lex.
+//   lexer   - Lexer to initialize.
+//   context - Compilation that receives lexical errors.
+//   source  - Null-terminated source code to lex.
 //
 // Returns:
 //   None.
 //
-void initLexer(const char* source) {
-	lexer.start = source;
-	lexer.current = source;
-	lexer.line = 1;
-	
-	TrieNode* root = createTrieNode();
-
-	typedef struct KeyToken {
-		TokenType type;
-		const char* keyword;
-	} KeyToken;
-	
-	static KeyToken s_keywordTokenList[] = {
-//		{ TOKEN_LEFT_PAREN, "(" },
-//		{ TOKEN_RIGHT_PAREN, ")" },
-//		{ TOKEN_LEFT_BRACE, "{" },
-//		{ TOKEN_RIGHT_BRACE, "}" },
-//		{ TOKEN_COMMA, "," },
-//		{ TOKEN_DOT, "." },
-//		{ TOKEN_MINUS, "-" },
-//		{ TOKEN_PLUS, "+" },
-//		{ TOKEN_SEMICOLON, ";" },
-//		{ TOKEN_SLASH, "/" },
-//		{ TOKEN_STAR, "*" },
-//		{ TOKEN_BANG, "!" },
-//		{ TOKEN_BANG_EQUAL, "!=" },
-//		{ TOKEN_EQUAL, "=" },
-//		{ TOKEN_EQUAL_EQUAL, "==" },
-//		{ TOKEN_GREATER, ">" },
-//		{ TOKEN_GREATER_EQUAL, ">=" },
-//		{ TOKEN_LESS, "<" },
-//		{ TOKEN_LESS_EQUAL, "<=" },
-//		{ TOKEN_IDENTIFIER, "Identifier" },
-//		{ TOKEN_STRING, "String" },
-//		{ TOKEN_NUMBER, "Number" },
-//		{ TOKEN_AND, "and" },
-//		{ TOKEN_CLASS, "class" },
-//		{ TOKEN_ELSE, "else" },
-//		{ TOKEN_FALSE, "false" },
-//		{ TOKEN_FUN, "fun" },
-//		{ TOKEN_FOR, "for" },
-//		{ TOKEN_IF, "if" },
-		{ TOKEN_INT, "int" },
-//		{ TOKEN_OR, "or" },
-//		{ TOKEN_PRINT, "print" },
-		{ TOKEN_RETURN, "return" },
-//		{ TOKEN_SUPER, "super" },
-//		{ TOKEN_THIS, "this" },
-//		{ TOKEN_TRUE, "true" },
-		{ TOKEN_VOID, "void" },
-//		{ TOKEN_WHILE, "while" },
-	};
-
-	const size_t kNumTokens = sizeof(s_keywordTokenList) / sizeof(KeyToken);
-	static_assert(kNumTokens < (int32_t)TOKEN_COUNT, "Invalid Token");
-
-	for (int32_t token = 0; token < kNumTokens; ++token) {
-		trieInsert(root, s_keywordTokenList[token].keyword, s_keywordTokenList[token].type);
-	}
-	s_keywordsTrie = root;
-	
-	printf("Begin Trie Test\n");
-	for (int32_t i = 0; i < kNumTokens; i++) {
-		const char* keyword = s_keywordTokenList[i].keyword; // testKeywords[i];
-		TokenType token = trieSearch(root, keyword);
-		printf("Keyword: %-10s => Token: %s\n", keyword, getTokenName(token));
+void initLexer(Lexer* lexer, struct CompilerContext* context, const char* source) {
+	lexer->context = context;
+	lexer->source = source;
+	lexer->start = source;
+	lexer->current = source;
+	lexer->line = 1;
+	lexer->file = context->inputFilename;
+
+#if _DEBUG
+	// A collision would silently overwrite an earlier designated initializer.
+	size_t keywordCount = 0;
+	for (size_t i = 0; i < KEYWORD_TABLE_SIZE; i++) {
+		const Keyword* keyword = &s_keywords[i];
+		if (keyword->length == 0) continue;
+		assert(KEYWORD_HASH((unsigned char)keyword->word[0], (unsigned char)keyword->word[keyword->length - 1], keyword->length) == i);
+		keywordCount++;
 	}
-	printf("End Trie Test\n");
+	assert(keywordCount == 34 && "Keyword hash collision");
+#endif
 }
 
 //
@@ -106,11 +109,14 @@ void initLexer(const char* source) {
 // ------------
 // Release resources associated with the lexer.
 //
-// Parameters: none
-// Returns:    none
+// Parameters:
+//   lexer - Lexer to release.
 //
-void destroyLexer(void) {
-	freeTrie(s_keywordsTrie);
+// Returns:
+//   None.
+//
+void destroyLexer(Lexer* lexer) {
+	(void)lexer;
 }
 
 // Check whether a character is alphabetic or underscore.
@@ -129,51 +135,248 @@ static bool isDigit(char c) {
 	return c >= '0' && c <= '9';
 }
 
+// --------------------------------------------------
+// Bulk character classification
+// --------------------------------------------------
+//
+// Whitespace runs, identifiers and digit strings are scanned 16 bytes at a
+// time using SSE2 on x64 and NEON on ARM64. Blocks are always loaded from
+// 16-byte aligned addresses, so a load never crosses into the next page and
+// it is safe to read past the end of a token up to the '\0' terminator
+// without any padding requirement on the source buffer. Define VECC_NO_SIMD
+// to force the scalar path, e.g. to compare lexing throughput.
+
+#if !defined(VECC_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64))
+#include <emmintrin.h>
+#define LEXER_SIMD 1
+
+typedef __m128i ScanBlock;
+typedef uint64_t ScanMask;			// One bit per byte
+#define SCAN_MASK_STRIDE	1
+#define SCAN_MASK_ALL		0xFFFFull
+
+static inline ScanBlock loadBlock(const char* p) {
+	return _mm_load_si128((const __m128i*)p);
+}
+
+static inline ScanMask toMask(__m128i bytes) {
+	return (ScanMask)(uint32_t)_mm_movemask_epi8(bytes);
+}
+
+// Bytes in [lo, hi]. Signed compares are fine since every range is ASCII and
+// bytes >= 0x80 compare as negative.
+static inline __m128i inRange(__m128i block, char lo, char hi) {
+	return _mm_and_si128(_mm_cmpgt_epi8(block, _mm_set1_epi8(lo - 1)), _mm_cmplt_epi8(block, _mm_set1_epi8(hi + 1)));
+}
+
+static inline ScanMask identifierMask(ScanBlock block) {
+	__m128i lower = _mm_or_si128(block, _mm_set1_epi8(0x20));
+	__m128i letters = inRange(lower, 'a', 'z');
+	__m128i digits = inRange(block, '0', '9');
+	__m128i underscore = _mm_cmpeq_epi8(block, _mm_set1_epi8('_'));
+	return toMask(_mm_or_si128(_mm_or_si128(letters, digits), underscore));
+}
+
+static inline ScanMask digitMask(ScanBlock block) {
+	return toMask(inRange(block, '0', '9'));
+}
+
+static inline ScanMask newlineMask(ScanBlock block) {
+	return toMask(_mm_cmpeq_epi8(block, _mm_set1_epi8('\n')));
+}
+
+static inline ScanMask whitespaceMask(ScanBlock block) {
+	__m128i spaces = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8(' ')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\t')));
+	__m128i breaks = _mm_or_si128(_mm_cmpeq_epi8(block, _mm_set1_epi8('\r')), _mm_cmpeq_epi8(block, _mm_set1_epi8('\n')));
+	return toMask(_mm_or_si128(spaces, breaks));
+}
+
+#elif !defined(VECC_NO_SIMD) && (defined(__ARM_NEON) || defined(__aarch64__) || defined(_M_ARM64))
+#include <arm_neon.h>
+#define LEXER_SIMD 1
+
+typedef uint8x16_t ScanBlock;
+typedef uint64_t ScanMask;			// Four bits per byte
+#define SCAN_MASK_STRIDE	4
+#define SCAN_MASK_ALL		0xFFFFFFFFFFFFFFFFull
+
+static inline ScanBlock loadBlock(const char* p) {
+	return vld1q_u8((const uint8_t*)p);
+}
+
+// NEON has no movemask; narrowing each 16-bit lane by 4 packs the 0x00/0xFF
+// byte results into one nibble per byte of a 64-bit value.
+static inline ScanMask toMask(uint8x16_t bytes) {
+	return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(bytes), 4)), 0);
+}
+
+static inline uint8x16_t inRange(uint8x16_t block, uint8_t lo, uint8_t hi) {
+	return vandq_u8(vcgeq_u8(block, vdupq_n_u8(lo)), vcleq_u8(block, vdupq_n_u8(hi)));
+}
+
+static inline ScanMask identifierMask(ScanBlock block) {
+	uint8x16_t lower = vorrq_u8(block, vdupq_n_u8(0x20));
+	uint8x16_t letters = inRange(lower, 'a', 'z');
+	uint8x16_t digits = inRange(block, '0', '9');
+	uint8x16_t underscore = vceqq_u8(block, vdupq_n_u8('_'));
+	return toMask(vorrq_u8(vorrq_u8(letters, digits), underscore));
+}
+
+static inline ScanMask digitMask(ScanBlock block) {
+	return toMask(inRange(block, '0', '9'));
+}
+
+static inline ScanMask newlineMask(ScanBlock block) {
+	return toMask(vceqq_u8(block, vdupq_n_u8('\n')));
+}
+
+static inline ScanMask whitespaceMask(ScanBlock block) {
+	uint8x16_t spaces = vorrq_u8(vceqq_u8(block, vdupq_n_u8(' ')), vceqq_u8(block, vdupq_n_u8('\t')));
+	uint8x16_t breaks = vorrq_u8(vceqq_u8(block, vdupq_n_u8('\r')), vceqq_u8(block, vdupq_n_u8('\n')));
+	return toMask(vorrq_u8(spaces, breaks));
+}
+#endif
+
+#if LEXER_SIMD
+// Byte offset of the first set bit of a non-zero mask.
+static inline size_t firstMaskByte(ScanMask mask) {
+	return (size_t)__builtin_ctzll(mask) / SCAN_MASK_STRIDE;
+}
+
+// Number of bytes flagged in a mask.
+static inline int32_t countMaskBytes(ScanMask mask) {
+	return (int32_t)(__builtin_popcountll(mask) / SCAN_MASK_STRIDE);
+}
+
+// Mask selecting bytes [index, 16) of a block.
+static inline ScanMask maskFromByte(size_t index) {
+	return (SCAN_MASK_ALL << (index * SCAN_MASK_STRIDE)) & SCAN_MASK_ALL;
+}
+
+// Find the first byte at or after p that is not flagged by classify.
+#define SCAN_WHILE(p, classify)												\
+	do {																	\
+		size_t misalign = (uintptr_t)(p) & 15;								\
+		const char* block = (p) - misalign;									\
+		ScanMask stop = ~classify(loadBlock(block)) & maskFromByte(misalign); \
+		while (stop == 0) {													\
+			block += 16;													\
+			stop = ~classify(loadBlock(block)) & SCAN_MASK_ALL;				\
+		}																	\
+		(p) = block + firstMaskByte(stop);									\
+	} while (0)
+#endif
+
+// Return the end of the run of identifier characters starting at p.
+static const char* scanIdentifierRun(const char* p) {
+#if LEXER_SIMD
+	SCAN_WHILE(p, identifierMask);
+#else
+	while (isAlpha(*p) || isDigit(*p)) p++;
+#endif
+	return p;
+}
+
+// Return the end of the run of decimal digits starting at p.
+static const char* scanDigitRun(const char* p) {
+#if LEXER_SIMD
+	SCAN_WHILE(p, digitMask);
+#else
+	while (isDigit(*p)) p++;
+#endif
+	return p;
+}
+
+// Return the end of the run of whitespace starting at p, adding the number of
+// newlines skipped to *line.
+static const char* scanWhitespaceRun(const char* p, int32_t* line) {
+#if LEXER_SIMD
+	// Single separators between tokens are by far the most common run, so
+	// settle those without touching the vector unit.
+	if (p[1] != ' ' && p[1] != '\t' && p[1] != '\r' && p[1] != '\n') {
+		*line += (*p == '\n');
+		return p + 1;
+	}
+
+	size_t misalign = (uintptr_t)p & 15;
+	const char* block = p - misalign;
+	ScanMask valid = maskFromByte(misalign);
+	for (;;) {
+		ScanBlock bytes = loadBlock(block);
+		ScanMask newlines = newlineMask(bytes) & valid;
+		ScanMask stop = ~whitespaceMask(bytes) & valid;
+		if (stop != 0) {
+			size_t end = firstMaskByte(stop);
+			ScanMask before = ((ScanMask)1 << (end * SCAN_MASK_STRIDE)) - 1;
+			*line += countMaskBytes(newlines & before);
+			return block + end;
+		}
+		*line += countMaskBytes(newlines);
+		block += 16;
+		valid = SCAN_MASK_ALL;
+	}
+#else
+	for (;; p++) {
+		switch (*p) {
+			case '\n':
+				(*line)++;
+				break;
+			case ' ':
+			case '\r':
+			case '\t':
+				break;
+			default:
+				return p;
+		}
+	}
+#endif
+}
+
 // Check if the lexer has reached end of input.
 //
 // Returns: true if there is no more source to read.
-static bool isAtEnd(void) {
-	return *lexer.current == '\0';
+static bool isAtEnd(Lexer* lexer) {
+	return *lexer->current == '\0';
 }
 
 // Consume the next character in the source stream.
 //
 // Returns: the consumed character.
-static char advance(void) {
-	lexer.current++;
-	return lexer.current[-1];
+static char advance(Lexer* lexer) {
+	lexer->current++;
+	return lexer->current[-1];
 }
 
 // Look at the current character without consuming it.
 //
 // Returns: current character.
-static char peek(void) {
-	return *lexer.current;
+static char peek(Lexer* lexer) {
+	return *lexer->current;
 }
 
 // Peek one character ahead without consuming it.
 //
 // Returns: next character, or '\0' if at end of input.
-static char peekNext(void) {
-	if (isAtEnd()) {
+static char peekNext(Lexer* lexer) {
+	if (isAtEnd(lexer)) {
 		return '\0';
 	}
-	return lexer.current[1];
+	return lexer->current[1];
 }
 
 // Try to consume the next character if it matches the expected one.
 //
 // expected - Character to match.
 // Returns: true if the character was consumed, false otherwise.
-static bool match(char expected) {
-	if (isAtEnd()) {
+static bool match(Lexer* lexer, char expected) {
+	if (isAtEnd(lexer)) {
 		return false;
 	}
 
-	if (*lexer.current != expected) {
+	if (*lexer->current != expected) {
 		return false;
 	}
-	lexer.current++;
+	lexer->current++;
 	return true;
 }
 
@@ -181,12 +384,12 @@ static bool match(char expected) {
 //
 // type - Token type to assign.
 // Returns: populated token structure.
-static Token makeToken(TokenType type) {
+static Token makeToken(Lexer* lexer, TokenType type) {
 	Token token;
 	token.type = type;
-	token.start = lexer.start;
-	token.length = (int32_t)(lexer.current - lexer.start);
-	token.line = lexer.line;
+	token.start = lexer->start;
+	token.length = (int32_t)(lexer->current - lexer->start);
+	token.line = lexer->line;
 	return token;
 }
 
@@ -195,83 +398,116 @@ static Token makeToken(TokenType type) {
 // type  - Token type (e.g., TOKEN_NUMBER).
 // value - Numeric value of the literal.
 // Returns: populated token with integer value stored.
-static Token makeNumberToken(TokenType type, int32_t value) {
+static Token makeNumberToken(Lexer* lexer, TokenType type, int32_t value) {
 	Token token;
 	token.type = type;
-	token.start = lexer.start;
-	token.length = (int32_t)(lexer.current - lexer.start);
-	token.line = lexer.line;
+	token.start = lexer->start;
+	token.length = (int32_t)(lexer->current - lexer->start);
+	token.line = lexer->line;
 	token.value.intValue = value;
 	return token;
 }
 
 // Helper used by generic macros for creating integer tokens.
 // lexeme is unused but kept for symmetry with makeDoubleToken.
-Token makeIntToken(TokenType type, const char* lexeme, int value) {
+Token makeIntToken(Lexer* lexer, TokenType type, const char* lexeme, int value) {
 	Token token;
 	token.type = type;
-	token.start = lexer.start;
-	token.length = (int32_t)(lexer.current - lexer.start);
-	token.line = lexer.line;
+	token.start = lexer->start;
+	token.length = (int32_t)(lexer->current - lexer->start);
+	token.line = lexer->line;
 	token.value.intValue = value;
 	return token;
 }
 
 // Helper used by generic macros for creating double tokens.
-Token makeDoubleToken(TokenType type, const char* lexeme, double value) {
+Token makeDoubleToken(Lexer* lexer, TokenType type, const char* lexeme, double value) {
 	Token token;
 	token.type = type;
-	token.start = lexer.start;
-	token.length = (int32_t)(lexer.current - lexer.start);
-	token.line = lexer.line;
+	token.start = lexer->start;
+	token.length = (int32_t)(lexer->current - lexer->start);
+	token.line = lexer->line;
 	token.value.doubleValue = value;
 	return token;
 }
 
 // Generic macro for creating tokens
-#define makeConstantToken(type, lexeme, value) \
+#define makeConstantToken(lexer, type, lexeme, value) \
 	_Generic((value), \
 		int: makeIntToken, \
 		double: makeDoubleToken \
-	)(type, lexeme, value)
+	)(lexer, type, lexeme, value)
 
 // Construct an error token containing the provided message.
 // message - Error description.
 // Returns: token of type TOKEN_ERROR.
-static Token errorToken(const char* message) {
+static Token errorToken(Lexer* lexer, const char* message) {
 	Token token;
 	token.type = TOKEN_ERROR;
 	token.start = message;
 	token.length = (int32_t)strlen(message);
-	token.line = lexer.line;
+	token.line = lexer->line;
 	return token;
 }
 
+// Consume a `# <line> "<file>"` marker (or `#line <line>`) written by the
+// preprocessor at the start of a line. The number is that of the line which
+// follows the marker, and the file, if given, is where that line came from.
+// Returns: false, leaving the input untouched, if there is no marker here.
+static bool skipLineMarker(Lexer* lexer) {
+	if (lexer->current != lexer->source && lexer->current[-1] != '\n') {
+		return false;
+	}
+	const char* p = lexer->current + 1;
+	p += strspn(p, " \t");
+	if (strncmp(p, "line", 4) == 0) {
+		p += 4;
+		p += strspn(p, " \t");
+	}
+	if (!isDigit(*p)) {
+		return false;
+	}
+	int32_t line = 0;
+	while (isDigit(*p)) {
+		line = line * 10 + (*p++ - '0');
+	}
+	p += strspn(p, " \t");
+	if (*p == '"') {
+		size_t length = strcspn(p + 1, "\"\n");
+		if (p[1 + length] == '"') {
+			lexer->file = internString(p + 1, length);
+		}
+	}
+	lexer->current = p + strcspn(p, "\n");
+	lexer->line = line - 1;
+	return true;
+}
+
 // Skip over whitespace and comments.
 // Returns: none.
-static void skipWhitespace(void) {
+static void skipWhitespace(Lexer* lexer) {
 	for (;;) {
-		char c = peek();
+		char c = peek(lexer);
 		switch (c) {
 			case ' ':
 			case '\r':
 			case '\t':
-				advance();
-				break;
 			case '\n':
-				lexer.line++;
-				advance();
+				lexer->current = scanWhitespaceRun(lexer->current, &lexer->line);
 				break;
 			case '/':
-				if (peekNext() == '/') {
+				if (peekNext(lexer) == '/') {
 					// A comment goes until the end of the line.
-					while(peek() != '\n' && !isAtEnd()) {
-						advance();
-					}
+					lexer->current += strcspn(lexer->current, "\n");
 				} else {
 					return;
 				}
 				break;
+			case '#':
+				if (!skipLineMarker(lexer)) {
+					return;
+				}
+				break;
 			default:
 				return;
 		}
@@ -279,130 +515,138 @@ static void skipWhitespace(void) {
 }
 
 // Determine whether the identifier under construction is a keyword and return
-// its corresponding TokenType.
-static TokenType identifierType(void) {
-	size_t len = lexer.current - lexer.start;
-	char keyword[len+1];
-	strncpy(keyword, lexer.start, len);
-	keyword[len] = '\0';
+// its corresponding TokenType. The lexeme is examined in place.
+static TokenType identifierType(Lexer* lexer) {
+	size_t length = lexer->current - lexer->start;
+	if (length < KEYWORD_MIN_LENGTH || length > KEYWORD_MAX_LENGTH) {
+		return TOKEN_IDENTIFIER;
+	}
 
-	return trieSearch(s_keywordsTrie, keyword);
+	const unsigned char* lexeme = (const unsigned char*)lexer->start;
+	const Keyword* keyword = &s_keywords[KEYWORD_HASH(lexeme[0], lexeme[length - 1], length)];
+	if (keyword->length == length && memcmp(keyword->word, lexer->start, length) == 0) {
+		return keyword->type;
+	}
+	return TOKEN_IDENTIFIER;
 }
 
 // Consume a sequence of alphanumeric characters and produce an identifier token.
-static Token identifier(void) {
-	while (isAlpha(peek()) || isDigit(peek())) {
-		advance();
+static Token identifier(Lexer* lexer) {
+	lexer->current = scanIdentifierRun(lexer->current);
+	Token token = makeToken(lexer, identifierType(lexer));
+	if (token.type == TOKEN_IDENTIFIER) {
+		token.value.name = internString(token.start, token.length);
 	}
-	return makeToken(identifierType());
+	return token;
 }
 
 // Parse digits into a number token. Rejects identifiers starting with digits.
-static Token number(void) {
-	const char* start = lexer.start;
-
-	while (isDigit(peek())) advance();
+static Token number(Lexer* lexer) {
+	lexer->current = scanDigitRun(lexer->current);
 
 	// 🚩 New check here
-	if (isAlpha(peek())) {
-		return errorToken("Invalid identifier: cannot start with a digit.");
+	if (isAlpha(peek(lexer))) {
+		return errorToken(lexer, "Invalid identifier: cannot start with a digit.");
 	}
 
-	int len = (int)(lexer.current - start);
-	char numStr[len + 1];
-	strncpy(numStr, start, len);
-	numStr[len] = '\0';
-
-	int value = atoi(numStr);
-	return makeNumberToken(TOKEN_NUMBER, value);
+	// Constants are only ever int, so anything past INT32_MAX is an error
+	// rather than a silently wrapped value.
+	int64_t value = 0;
+	for (const char* digit = lexer->start; digit < lexer->current; digit++) {
+		value = value * 10 + (*digit - '0');
+		if (value > INT32_MAX) {
+			return errorToken(lexer, "Integer constant is too large for 'int'.");
+		}
+	}
+	return makeNumberToken(lexer, TOKEN_NUMBER, (int32_t)value);
 }
 
 // Parse a double quoted string literal.
-static Token string(void) {
-	while (peek() != '"' && !isAtEnd()) {
-		if (peek() == '\n') {
-			lexer.line++;
+static Token string(Lexer* lexer) {
+	while (peek(lexer) != '"' && !isAtEnd(lexer)) {
+		if (peek(lexer) == '\n') {
+			lexer->line++;
 		}
-		advance();
+		advance(lexer);
 	}
 
-	if (isAtEnd()) {
-		return errorToken("Unterminated string.");
+	if (isAtEnd(lexer)) {
+		return errorToken(lexer, "Unterminated string.");
 	}
 
 	// The closing quote.
-	advance();
-	return makeToken(TOKEN_STRING);
+	advance(lexer);
+	return makeToken(lexer, TOKEN_STRING);
 }
 
 // Public interface to scan a single token from the source.
 // Advances the lexer and returns the next token in the stream.
-Token scanToken(void) {
-	skipWhitespace();
-	lexer.start = lexer.current;
+Token scanToken(Lexer* lexer) {
+	skipWhitespace(lexer);
+	lexer->start = lexer->current;
 
-	if (isAtEnd()) {
-		return makeToken(TOKEN_EOF);
+	if (isAtEnd(lexer)) {
+		return makeToken(lexer, TOKEN_EOF);
 	}
  
-	char c = advance();
+	char c = advance(lexer);
 	if (isAlpha(c)) {
-		return identifier();
+		return identifier(lexer);
 	}
 	if (isDigit(c)) {
-		return number();
+		return number(lexer);
 	}
 	switch(c) {
 		case '(':
-			return makeToken(TOKEN_LEFT_PAREN);
+			return makeToken(lexer, TOKEN_LEFT_PAREN);
 		case ')':
-			return makeToken(TOKEN_RIGHT_PAREN);
+			return makeToken(lexer, TOKEN_RIGHT_PAREN);
 		case '{':
-			return makeToken(TOKEN_LEFT_BRACE);
+			return makeToken(lexer, TOKEN_LEFT_BRACE);
 		case '}':
-			return makeToken(TOKEN_RIGHT_BRACE);
+			return makeToken(lexer, TOKEN_RIGHT_BRACE);
 		case ';':
-			return makeToken(TOKEN_SEMICOLON);
+			return makeToken(lexer, TOKEN_SEMICOLON);
 		case ',':
-			return makeToken(TOKEN_COMMA);
+			return makeToken(lexer, TOKEN_COMMA);
 		case '.':
-			return makeToken(TOKEN_DOT);
+			return makeToken(lexer, TOKEN_DOT);
 		case '-':
-			return makeToken(match('-') ? TOKEN_DEC : TOKEN_MINUS);
+			return makeToken(lexer, match(lexer, '-') ? TOKEN_DEC : TOKEN_MINUS);
 		case '+':
-			return makeToken(TOKEN_PLUS);
+			return makeToken(lexer, TOKEN_PLUS);
 		case '/':
-			return makeToken(TOKEN_SLASH);
+			return makeToken(lexer, TOKEN_SLASH);
 		case '*':
-			return makeToken(TOKEN_STAR);
+			return makeToken(lexer, TOKEN_STAR);
 		case '~':
-			return makeToken(TOKEN_TILDE);
+			return makeToken(lexer, TOKEN_TILDE);
 		case '%':
-			return makeToken(TOKEN_MOD);
+			return makeToken(lexer, TOKEN_MOD);
 		case '!':
-			return makeToken(match('=') ? TOKEN_BANG_EQUAL : TOKEN_BANG);
+			return makeToken(lexer, match(lexer, '=') ? TOKEN_BANG_EQUAL : TOKEN_BANG);
 		case '=':
-			return makeToken(match('=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
+			return makeToken(lexer, match(lexer, '=') ? TOKEN_EQUAL_EQUAL : TOKEN_EQUAL);
 		case '<':
-//			return makeToken(match('=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
-			if (match('=')) return makeToken(TOKEN_LESS_EQUAL);
-			if (match('<')) return makeToken(TOKEN_SHIFT_LEFT);
-			return makeToken(TOKEN_LESS);
+//			return makeToken(lexer, match(lexer, '=') ? TOKEN_LESS_EQUAL : TOKEN_LESS);
+			if (match(lexer, '=')) return makeToken(lexer, TOKEN_LESS_EQUAL);
+			if (match(lexer, '<')) return makeToken(lexer, TOKEN_SHIFT_LEFT);
+			return makeToken(lexer, TOKEN_LESS);
 		case '>':
-//			return makeToken(match('=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
-			if (match('=')) return makeToken(TOKEN_GREATER_EQUAL);
-			if (match('>')) return makeToken(TOKEN_SHIFT_RIGHT);
-			return makeToken(TOKEN_GREATER);
+//			return makeToken(lexer, match(lexer, '=') ? TOKEN_GREATER_EQUAL : TOKEN_GREATER);
+			if (match(lexer, '=')) return makeToken(lexer, TOKEN_GREATER_EQUAL);
+			if (match(lexer, '>')) return makeToken(lexer, TOKEN_SHIFT_RIGHT);
+			return makeToken(lexer, TOKEN_GREATER);
 		case '&':
-			return makeToken(TOKEN_AND);
+			return makeToken(lexer, TOKEN_AND);
 		case '|':
-			return makeToken(TOKEN_OR);
+			return makeToken(lexer, TOKEN_OR);
 		case '^':
-			return makeToken(TOKEN_XOR);
+			return makeToken(lexer, TOKEN_XOR);
 		case '"':
-			return string();
+			return string(lexer);
 	}
-	return errorToken("Unexpected character.");
+	return errorToken(lexer, "Unexpected character.");
 }
 
 // Convert a TokenType to a human readable string.
@@ -439,14 +683,41 @@ const char* getTokenName(TokenType tokenType)
 		[TOKEN_STRING] = "TOKEN_STRING",
 		[TOKEN_NUMBER] = "TOKEN_NUMBER",
 		[TOKEN_AND] = "TOKEN_AND",
+		[TOKEN_OR] = "TOKEN_OR",
+		[TOKEN_AUTO] = "TOKEN_AUTO",
+		[TOKEN_BREAK] = "TOKEN_BREAK",
+		[TOKEN_CASE] = "TOKEN_CASE",
+		[TOKEN_CHAR] = "TOKEN_CHAR",
+		[TOKEN_CONST] = "TOKEN_CONST",
+		[TOKEN_CONTINUE] = "TOKEN_CONTINUE",
+		[TOKEN_DEFAULT] = "TOKEN_DEFAULT",
+		[TOKEN_DO] = "TOKEN_DO",
+		[TOKEN_DOUBLE] = "TOKEN_DOUBLE",
 		[TOKEN_ELSE] = "TOKEN_ELSE",
+		[TOKEN_ENUM] = "TOKEN_ENUM",
+		[TOKEN_EXTERN] = "TOKEN_EXTERN",
 		[TOKEN_FALSE] = "TOKEN_FALSE",
+		[TOKEN_FLOAT] = "TOKEN_FLOAT",
 		[TOKEN_FOR] = "TOKEN_FOR",
+		[TOKEN_GOTO] = "TOKEN_GOTO",
 		[TOKEN_IF] = "TOKEN_IF",
+		[TOKEN_INLINE] = "TOKEN_INLINE",
 		[TOKEN_INT] = "TOKEN_INT",
-		[TOKEN_OR] = "TOKEN_OR",
+		[TOKEN_LONG] = "TOKEN_LONG",
+		[TOKEN_REGISTER] = "TOKEN_REGISTER",
+		[TOKEN_RESTRICT] = "TOKEN_RESTRICT",
 		[TOKEN_RETURN] = "TOKEN_RETURN",
+		[TOKEN_SHORT] = "TOKEN_SHORT",
+		[TOKEN_SIGNED] = "TOKEN_SIGNED",
+		[TOKEN_SIZEOF] = "TOKEN_SIZEOF",
+		[TOKEN_STATIC] = "TOKEN_STATIC",
+		[TOKEN_STRUCT] = "TOKEN_STRUCT",
+		[TOKEN_SWITCH] = "TOKEN_SWITCH",
+		[TOKEN_TYPEDEF] = "TOKEN_TYPEDEF",
+		[TOKEN_UNION] = "TOKEN_UNION",
+		[TOKEN_UNSIGNED] = "TOKEN_UNSIGNED",
 		[TOKEN_VOID] = "TOKEN_VOID",
+		[TOKEN_VOLATILE] = "TOKEN_VOLATILE",
 		[TOKEN_WHILE] = "TOKEN_WHILE",
 		[TOKEN_XOR] = "TOKEN_XOR",
 		[TOKEN_ERROR] = "TOKEN_ERROR",
@@ -457,27 +728,26 @@ const char* getTokenName(TokenType tokenType)
 	return s_tokenNames[tokenType];
 }
 
-// Scan the entire source returning an array of tokens terminated by TOKEN_EOF.
-// Returns: stb_ds dynamic array containing all tokens.
-const Token* scanTokens(void)
+// Scan the next token, treating lexical errors as fatal.
+// Returns: the next non-error token.
+Token scanValidToken(Lexer* lexer)
 {
-	Token* tokens = NULL;
+	Token token = scanToken(lexer);
+	if (token.type == TOKEN_ERROR) {
+		compilerError(lexer->context, "%s:%d: %.*s", lexer->file, token.line, (int)token.length, token.start);
+	}
+	return token;
+}
 
+// Scan the entire source, appending every token up to and including
+// TOKEN_EOF to an stb_ds array owned by the caller, so the array is still
+// reachable for release if a lexical error abandons the compilation.
+void scanTokens(Lexer* lexer, Token** tokens)
+{
 	for (;;) {
-		Token token = scanToken();
-		if (token.type == TOKEN_ERROR) {
-			int32_t len = token.length;
-			char keyword[len+1];
-			strncpy(keyword, token.start, token.length);
-			keyword[token.length] = '\0';
-			printf("Error: %s\n", keyword);
-			exit(EXIT_FAILURE);
-		}
-		arrput(tokens, token);
+		Token token = scanValidToken(lexer);
+		arrput(*tokens, token);
 
 		if (token.type == TOKEN_EOF) break;
 	}
-
-	return tokens;
 }
-
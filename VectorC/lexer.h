@@ -1,21 +1,37 @@
 #ifndef lexer_h
 #define lexer_h
 
+#include <stdint.h>
+
 #include "token.h"
 
+struct CompilerContext;
+
+// Scanning state for one source string. Tokens point into the source.
+typedef struct {
+	const char* source;
+	const char* start;
+	const char* current;
+	int32_t line;
+	const char* file;					// Source of the current line, from line markers
+	struct CompilerContext* context;	// Receives lexical errors
+} Lexer;
+
 // Return a string name for the given token type.
 const char* getTokenName(TokenType token);
 
 // Initialize lexer state with the provided source string.
-void initLexer(const char* source);
+void initLexer(Lexer* lexer, struct CompilerContext* context, const char* source);
 
 // Release any resources owned by the lexer.
-void destroyLexer(void);
+void destroyLexer(Lexer* lexer);
 
 // Retrieve the next token from the source stream.
-Token scanToken(void);
+Token scanToken(Lexer* lexer);
 
-// Scan the entire source and return an array of tokens.
-const Token* scanTokens(void);
-#endif
+// Retrieve the next token, reporting lexical errors through the context.
+Token scanValidToken(Lexer* lexer);
 
+// Scan the entire source, appending the tokens to an stb_ds array.
+void scanTokens(Lexer* lexer, Token** tokens);
+#endif
@@ -5,254 +5,411 @@
 //  Created by Claire Rogers on 29/12/2024.
 //
 
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 
-#include "lexer.h"
-#include "parser.h"
-#include "tacky.h"
-#include "ast_x64.h"
-#include "ast_arm64.h"
+#include "driver.h"
+#include "batch.h"
+#include "benchmark.h"
+#include "server.h"
+#include "subprocess.h"
+#include "intern.h"
+#include "source_file.h"
+#include "arena.h"
+#include "mem_report.h"
+#include "perf_counters.h"
+#include "time_trace.h"
+#include "version.h"
 
+#include "stb_ds_config.h"
 #define STB_DS_IMPLEMENTATION
 #include "stb_ds.h"
 
 //
-// readFile
-// ---------
-// Load an entire file into a heap allocated buffer.
-//
-// Parameters:
-//   path - Path to the file to read.
+// readResponseFile
+// ----------------
+// Append the arguments listed in a response file (`@file`) to an stb_ds
+// array. Arguments are separated by whitespace and may be quoted with single
+// or double quotes; a backslash escapes the next character.
 //
 // Returns:
-//   Pointer to a null-terminated string containing the file's contents.
-//   The caller is responsible for freeing the returned buffer.
+//   false after reporting a file that could not be read.
 //
-static char* readFile(const char * path) {
-	FILE* file = fopen(path, "rb");
-	if (file == NULL) {
-		fprintf(stderr, "Cound not open file \"%s\",\n", path);
-		exit(74);
-	}
-	fseek(file, 0L, SEEK_END);
-	size_t fileSize = ftell(file);
-	rewind(file);
-	
-	char* buffer = (char*)malloc(fileSize + 1);
-	if (buffer == NULL) {
-		fprintf(stderr, "Not enough memory to read \"%s\",\n", path);
-		exit(74);
+static bool readResponseFile(const char* path, Arena* storage, const char*** args) {
+	SourceFile file;
+	if (!openSourceFile(path, &file)) {
+		fprintf(stderr, "Error: Could not read response file '%s': %s\n", path, strerror(errno));
+		return false;
 	}
-	size_t bytesRead = fread(buffer, sizeof(char), fileSize, file);
-	if (bytesRead < fileSize) {
-		fprintf(stderr, "Could not read file \"%s\".\n", path);
-		exit(74);
+	const char* c = file.data;
+	char* arg = NULL;
+	while (*c) {
+		while (*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r') {
+			c++;
+		}
+		if (*c == '\0') {
+			break;
+		}
+		arrsetlen(arg, 0);
+		char quote = 0;
+		while (*c && (quote || !(*c == ' ' || *c == '\t' || *c == '\n' || *c == '\r'))) {
+			if (quote && *c == quote) {
+				quote = 0;
+			} else if (!quote && (*c == '"' || *c == '\'')) {
+				quote = *c;
+			} else if (*c == '\\' && c[1] != '\0') {
+				arrput(arg, *++c);
+			} else {
+				arrput(arg, *c);
+			}
+			c++;
+		}
+		arrput(*args, arenaStrndup(storage, arg ? arg : "", arrlenu(arg)));
 	}
-	buffer[bytesRead] = '\0';
-	
-	fclose(file);
-	return buffer;
+	arrfree(arg);
+	closeSourceFile(&file);
+	return true;
 }
 
 //
-// main
-// ----
-// Entry point for the VectorC compiler driver.  It interprets command line
-// switches to run individual compilation stages (lexing, parsing, tacky IR and
-// code generation) and invokes each phase in order.  Intermediate results can
-// be printed when the corresponding flag is supplied.
-//
-// Parameters:
-//   argc - Number of command line arguments.
-//   argv - Array of argument strings.
+// parseArguments
+// --------------
+// Fill in the options and the list of source files from the command line.
+// Response files and compilation databases keep their strings in `storage`.
 //
 // Returns:
-//   EXIT_SUCCESS on success, or EXIT_FAILURE if an error occurs.
+//   false after reporting an invalid argument.
 //
-int main(int argc, const char * argv[]) {
-	// insert code here...
-	bool bLex = false, bParse = false, bTacky = false, bCodegen = false, bVerbose = false;
-	Architecture arch = ARCH_X64;
-
-	// The source filename (if any)
-	const char *inputFilename = NULL;
-
-	// Start parsing from argv[1] onwards (argv[0] is typically the program name).
-	for (int i = 1; i < argc; i++) {
+static bool parseArguments(const char** args, int argCount, CompileOptions* options, Arena* storage, const char*** inputFilenames) {
+	for (int i = 0; i < argCount; i++) {
 		// First check if it's one of our known switches.
 		
 		// 1) --lex
-		if (strcmp(argv[i], "--lex") == 0) {
-			bLex = true;
+		if (strcmp(args[i], "--lex") == 0) {
+			options->stopAfterLex = true;
 		}
 		// 2) --parse
-		else if (strcmp(argv[i], "--parse") == 0) {
-			bParse = true;
+		else if (strcmp(args[i], "--parse") == 0) {
+			options->stopAfterParse = true;
 		}
 		// 3) --tacky
-		else if (strcmp(argv[i], "--tacky") == 0) {
-			bTacky = true;
+		else if (strcmp(args[i], "--tacky") == 0) {
+			options->stopAfterTacky = true;
 		}
 		// 4) --codegen
-		else if (strcmp(argv[i], "--codegen") == 0) {
-			bCodegen = true;
+		else if (strcmp(args[i], "--codegen") == 0) {
+			options->stopAfterCodegen = true;
 		}
 		// 5) -arch=???
-		else if (strncmp(argv[i], "-arch=", 6) == 0) {
-			const char* archValue = argv[i] + 6; // the part after '-arch='
+		else if (strncmp(args[i], "-arch=", 6) == 0) {
+			const char* archValue = args[i] + 6; // the part after '-arch='
 			
 			if (strcmp(archValue, "x64") == 0) {
-				arch = ARCH_X64;
+				options->arch = ARCH_X64;
 			} else if (strcmp(archValue, "arm64") == 0) {
-				arch = ARCH_ARM64;
+				options->arch = ARCH_ARM64;
 			} else {
 				fprintf(stderr, "Error: Unknown architecture '%s'\n", archValue);
-				return 1;
+				return false;
 			}
 		}
 		// 6) -v
-		else if (strcmp(argv[i], "-v") == 0) {
-			bVerbose = true;
+		else if (strcmp(args[i], "-v") == 0) {
+			options->verbose = true;
 		}
-		// Otherwise, we treat it as the source filename (or error if we already have one).
-		else {
-			// If we already have a source filename, raise an error or handle as you see fit.
-			if (inputFilename != NULL) {
-				fprintf(stderr, "Error: Multiple source files specified ('%s' and '%s')\n", inputFilename, argv[i]);
-				return 1;
+		// 7) -E: print the preprocessed source and stop
+		else if (strcmp(args[i], "-E") == 0) {
+			options->preprocessOnly = true;
+		}
+		// 8) -I<dir> / -I <dir>
+		else if (strncmp(args[i], "-I", 2) == 0) {
+			const char* dir = args[i][2] ? args[i] + 2 : (i + 1 < argCount ? args[++i] : NULL);
+			if (dir == NULL) {
+				fprintf(stderr, "Error: Missing directory after '-I'\n");
+				return false;
 			}
-			inputFilename = argv[i];
+			arrput(options->preprocessor.includePaths, dir);
+		}
+		// 9) -D<name>[=<value>] / -D <name>[=<value>]
+		else if (strncmp(args[i], "-D", 2) == 0) {
+			const char* define = args[i][2] ? args[i] + 2 : (i + 1 < argCount ? args[++i] : NULL);
+			if (define == NULL) {
+				fprintf(stderr, "Error: Missing macro name after '-D'\n");
+				return false;
+			}
+			arrput(options->preprocessor.defines, define);
+		}
+		// 10) --external-preprocessor: run `clang -E` instead of the built-in preprocessor
+		else if (strcmp(args[i], "--external-preprocessor") == 0) {
+			options->externalPreprocessor = true;
+		}
+		// 11) -c: write an object file and skip linking
+		else if (strcmp(args[i], "-c") == 0) {
+			options->compileOnly = true;
+		}
+		// 12) --direct-exe: write a static executable without invoking a linker
+		else if (strcmp(args[i], "--direct-exe") == 0) {
+			options->directExecutable = true;
+		}
+		// 13) -S: write the assembly to a .s file and stop
+		else if (strcmp(args[i], "-S") == 0) {
+			options->assemblyOnly = true;
+		}
+		// 14) --compile-commands=<file>: compile every file of a compilation database
+		else if (strncmp(args[i], "--compile-commands=", 19) == 0) {
+			if (!readCompileCommands(args[i] + 19, storage, inputFilenames)) {
+				return false;
+			}
+		}
+		// 15) -j<N> / -j <N>: number of threads lowering the functions of a file
+		else if (strncmp(args[i], "-j", 2) == 0) {
+			const char* jobs = args[i][2] ? args[i] + 2 : (i + 1 < argCount ? args[++i] : NULL);
+			char* end = NULL;
+			long jobCount = jobs ? strtol(jobs, &end, 10) : 0;
+			if (jobs == NULL || *end != '\0' || jobCount < 1 || jobCount > 1024) {
+				fprintf(stderr, "Error: '-j' needs a thread count between 1 and 1024\n");
+				return false;
+			}
+			options->backendJobs = (int)jobCount;
+		}
+		// 16) --cache: reuse the output of identical preprocessed inputs; --cache-stats
+		//     also prints the cache's hit rate and the time it saved
+		else if (strcmp(args[i], "--cache") == 0 || strcmp(args[i], "--cache-stats") == 0) {
+			if (options->cache.directory == NULL) {
+				char directory[4096];
+				if (getDefaultCacheDirectory(directory, sizeof(directory)) == NULL) {
+					fprintf(stderr, "Error: No cache directory; set VECC_CACHE_DIR or use --cache-dir=<dir>\n");
+					return false;
+				}
+				options->cache.directory = arenaStrndup(storage, directory, strlen(directory));
+			}
+			options->printCacheStats |= strcmp(args[i], "--cache-stats") == 0;
+		}
+		// 17) --cache-dir=<dir>: like --cache, in the given directory
+		else if (strncmp(args[i], "--cache-dir=", 12) == 0) {
+			options->cache.directory = args[i] + 12;
+		}
+		// 18) --cache-size=<MB>: evict least recently used entries beyond this size
+		else if (strncmp(args[i], "--cache-size=", 13) == 0) {
+			char* end = NULL;
+			long long megabytes = strtoll(args[i] + 13, &end, 10);
+			if (*end != '\0' || megabytes < 1) {
+				fprintf(stderr, "Error: '--cache-size' needs a size in megabytes\n");
+				return false;
+			}
+			options->cache.maxBytes = (uint64_t)megabytes * 1024 * 1024;
+		}
+		// 19) --incremental: keep each function's output in a .vecc-index file
+		//     beside the source and only regenerate functions that changed
+		else if (strcmp(args[i], "--incremental") == 0) {
+			options->incremental = true;
+		}
+		// 20) -ftime-report: print the time spent in each phase on exit;
+		//     -ftime-report=<file> writes it to a JSON file instead
+		else if (strcmp(args[i], "-ftime-report") == 0) {
+			options->printTimeReport = true;
+		}
+		else if (strncmp(args[i], "-ftime-report=", 14) == 0) {
+			options->timeReportFile = args[i] + 14;
+		}
+		// 21) -fmem-report: print the memory each phase allocated on exit
+		else if (strcmp(args[i], "-fmem-report") == 0) {
+			options->printMemoryReport = true;
+		}
+		// 22) -ftime-trace=<file>: write a Chrome trace of the phases, and of
+		//     every function in each backend pass, for chrome://tracing
+		else if (strncmp(args[i], "-ftime-trace", 12) == 0 && (args[i][12] == '\0' || args[i][12] == '=')) {
+			if (args[i][12] == '\0' || args[i][13] == '\0') {
+				fprintf(stderr, "Error: '-ftime-trace' needs a file, as in -ftime-trace=trace.json\n");
+				return false;
+			}
+			options->timeTraceFile = args[i] + 13;
+		}
+		// 23) -fperf-counters: print hardware performance counters for each
+		//     phase on exit, where the system allows them
+		else if (strcmp(args[i], "-fperf-counters") == 0) {
+			options->printPerfCounters = true;
+		}
+		// Otherwise, we treat it as a source filename.
+		else {
+			arrput(*inputFilenames, args[i]);
 		}
 	}
+	return true;
+}
 
-	// If no source filename was found, we can decide what to do.
-	// For example, error out, or continue if your app doesn't need a file, etc.
-	if (inputFilename == NULL) {
-		// We can consider no file an error or just proceed differently:
-		fprintf(stderr, "No source filename provided.\n");
-		return EXIT_FAILURE;
-	}
-
-
-	char preprocessedFilename[256];
-	strcpy(preprocessedFilename, inputFilename);
-	strncpy(preprocessedFilename + (strlen(preprocessedFilename) - 1), "i", 1);
+//
+// runCommandLine
+// --------------
+// Compile the files named on a command line (without the program name),
+// either one at a time or concurrently through compileBatch. Caches that
+// outlive a compilation are left for the caller, so a server can keep them.
+//
+// Returns:
+//   EXIT_SUCCESS on success, or EXIT_FAILURE if an error occurs.
+//
+static int runCommandLine(int argc, const char* const* argv) {
+	CompileOptions options = {
+		.arch = ARCH_X64,
+		.preprocessor = { .useSystemIncludePaths = true },
+		.cache = { .maxBytes = CACHE_DEFAULT_MAX_BYTES },
+		.printStages = true
+	};
 
-	char sourceFilename[256];
-	strcpy(sourceFilename, inputFilename);
-	strncpy(sourceFilename + (strlen(sourceFilename) - 1), "s", 1);
+	// Response files and compilation databases own their strings here.
+	Arena argStorage;
+	arenaInit(&argStorage, 0);
 
-	char outFilename[256];
-	char* find = strchr(inputFilename, '.');
-	assert(find != NULL);
-	size_t len = find - inputFilename;
-	strncpy(outFilename, inputFilename, len);
-#ifdef _WIN32
-	strncpy(outFilename + len, ".exe", 4);
-	len += 4;
-#endif
+	// Expand @file arguments in place.
+	const char** args = NULL;
+	bool readArguments = true;
+	for (int i = 0; i < argc; i++) {
+		if (argv[i][0] == '@' && argv[i][1] != '\0') {
+			readArguments &= readResponseFile(argv[i] + 1, &argStorage, &args);
+		} else {
+			arrput(args, argv[i]);
+		}
+	}
 
-	outFilename[len] = '\0';
+	// The source filenames
+	const char** inputFilenames = NULL;
+	int result = EXIT_FAILURE;
+	size_t inputCount = 0;
+	bool parsed = readArguments && parseArguments(args, (int)arrlen(args), &options, &argStorage, &inputFilenames);
 
-	char commandline[2048] = "";
-	sprintf(commandline, "clang -E -P %s -o %s", inputFilename, preprocessedFilename);
-	if (bVerbose) {
-		printf("Running: %s\n", commandline);
+	TimeReport timeReport;
+	const bool bTimeReport = parsed && (options.printTimeReport || options.timeReportFile != NULL);
+	if (bTimeReport) {
+		initTimeReport(&timeReport);
+		options.timeReport = &timeReport;
 	}
-	int32_t res = system(commandline);
-	if (res == -1) {
-		perror("Error executing system command");
-		return EXIT_FAILURE;
+	if (parsed && options.printMemoryReport) {
+		enableMemoryReport();
 	}
-	const char* source = readFile(preprocessedFilename);
-	initLexer(source);
-	const Token* tokens = scanTokens();
-	size_t tokenCount = arrlenu(tokens);
-	for (size_t t = 0; t < tokenCount; ++t) {
-		Token token = tokens[t];
-		int32_t len = token.length;
-		char keyword[len+1];
-		switch (token.type)
-		{
-			case TOKEN_IDENTIFIER:
-			case TOKEN_NUMBER:
-				strncpy(keyword, token.start, token.length);
-				keyword[token.length] = '\0';
-				printf("Token: %s (%s)\n", getTokenName(token.type), keyword);
-				break;
-			case TOKEN_ERROR:
-				strncpy(keyword, token.start, token.length);
-				keyword[token.length] = '\0';
-				printf("Error: %s\n", keyword);
-				exit(EXIT_FAILURE);
-			default:
-				printf("Token: %s\n", getTokenName(token.type));
-		}
+	if (parsed && options.timeTraceFile != NULL) {
+		enableTimeTrace();
+		setTraceThreadName("Main");
 	}
-	if (bLex) {
-		return EXIT_SUCCESS;
+	if (parsed && options.printPerfCounters) {
+		enablePerfCounters();
 	}
-
-	const ProgramNode* cProgram = parseProgramTokens(tokens);
-	printProgram(cProgram);
-	if (bParse) {
-		return EXIT_SUCCESS;
+	if (parsed && (options.cache.directory != NULL || options.incremental)) {
+		// Before any batch thread computes a key.
+		initBuildId();
 	}
+	TimeStamp start = readTimeStamp();
 
-	TackyProgram* tackyProgram = generateTackyFromAst(cProgram);
-	printTackyProgram(tackyProgram);
-	if (bTacky) {
-		return EXIT_SUCCESS;
+	if (!parsed) {
+		// Already reported.
+	} else if ((inputCount = arrlenu(inputFilenames)) == 0 && options.printCacheStats) {
+		result = EXIT_SUCCESS;
+	} else if (inputCount == 0) {
+		fprintf(stderr, "No source filename provided.\n");
+	} else if (inputCount == 1) {
+		result = compileFile(inputFilenames[0], &options);
+	} else if (options.stopAfterLex || options.stopAfterParse || options.stopAfterTacky || options.stopAfterCodegen || options.preprocessOnly) {
+		// Stage dumps from concurrent compilations would interleave.
+		fprintf(stderr, "Error: --lex, --parse, --tacky, --codegen and -E take a single source file\n");
+	} else {
+		options.printStages = false;
+		// The batch already keeps every processor busy with whole files.
+		options.backendJobs = 1;
+		result = compileBatch(inputFilenames, inputCount, &options);
 	}
 
-	Program asmProgram = { 0 };
-	Program finalAsmProgram = { 0 };
-	switch (arch)
-	{
-		case ARCH_X64:
-// Pass 1.
-			translateTackyToX64(tackyProgram, &asmProgram);
-// Pass 2.
-			replacePseudoRegistersX64(&asmProgram);
-// Pass 3.
-			fixupIllegalInstructionsX64(&asmProgram, &finalAsmProgram);
-			break;
-		case ARCH_ARM64:
-// Pass 1.
-			translateTackyToARM64(tackyProgram, &asmProgram);
-// Pass 2.
-			replacePseudoRegistersARM64(&asmProgram);
-// Pass 3.
-			fixupIllegalInstructionsARM64(&asmProgram, &finalAsmProgram);
-			break;
-		default:
-			printf("Unsupported architecture`n");
+	if (bTimeReport) {
+		timeReport.elapsedNanoseconds = readTimeStamp().wallNanoseconds - start.wallNanoseconds;
+		if (options.timeReportFile == NULL) {
+			printTimeReport(stderr, &timeReport);
+		} else if (!writeTimeReportJson(options.timeReportFile, &timeReport)) {
+			fprintf(stderr, "Error: Could not write '%s'\n", options.timeReportFile);
+			result = EXIT_FAILURE;
+		}
+		destroyTimeReport(&timeReport);
 	}
-	if (bCodegen) {
-		return EXIT_SUCCESS;
+	if (parsed && options.printMemoryReport) {
+		printMemoryReport(stderr);
+		disableMemoryReport();
+	}
+	if (parsed && options.printPerfCounters) {
+		printPerfCounterReport(stderr);
+		disablePerfCounters();
+	}
+	if (parsed && options.timeTraceFile != NULL) {
+		if (!writeTimeTrace(options.timeTraceFile)) {
+			fprintf(stderr, "Error: Could not write '%s'\n", options.timeTraceFile);
+			result = EXIT_FAILURE;
+		}
+		destroyTimeTrace();
+	}
+	if (options.verbose) {
+		printInternStats();
+	}
+	if (options.printCacheStats) {
+		printCacheStats(stdout, &options.cache);
 	}
-	printAsmProgram(&finalAsmProgram);
 
-	generateCode(&finalAsmProgram, sourceFilename);
-	
-	const char* archString = getArchitectureName(arch);
-	
-#ifdef __APPLE__
-	sprintf(commandline, "clang -arch %s %s -o %s", archString, sourceFilename, outFilename);
-#else
-	sprintf(commandline, "clang %s -o %s", sourceFilename, outFilename);
-#endif
-	if (bVerbose) {
-		printf("Running: %s\n", commandline);
+	arrfree(options.preprocessor.includePaths);
+	arrfree(options.preprocessor.defines);
+	arrfree(inputFilenames);
+	arrfree(args);
+	arenaFree(&argStorage);
+	return result;
+}
+
+// Match `--<name>` or `--<name>=<value>`, setting `value` to the part after
+// the '=' or NULL.
+static bool matchModeSwitch(const char* arg, const char* name, const char** value) {
+	size_t length = strlen(name);
+	if (strncmp(arg, name, length) != 0 || (arg[length] != '\0' && arg[length] != '=')) {
+		return false;
 	}
-	res = system(commandline);
-	if (res == -1) {
-		perror("Error executing system command");
-		return EXIT_FAILURE;
+	*value = arg[length] == '=' ? arg + length + 1 : NULL;
+	return true;
+}
+
+//
+// main
+// ----
+// Entry point for the VectorC compiler driver.  It interprets command line
+// switches to run individual compilation stages (lexing, parsing, tacky IR and
+// code generation) and invokes each phase in order.  Intermediate results can
+// be printed when the corresponding flag is supplied.  Several source files
+// are compiled concurrently by compileBatch.  `--server[=<socket>]` runs a
+// compile server instead, `--client[=<socket>]` hands the rest of the
+// command line to it, `--benchmark[=<shapes>]` measures the compiler's
+// throughput on generated programs, and `--scaling[=<axes>]` looks for phases
+// whose time grows faster than n log n.
+//
+// Parameters:
+//   argc - Number of command line arguments.
+//   argv - Array of argument strings.
+//
+// Returns:
+//   EXIT_SUCCESS on success, or EXIT_FAILURE if an error occurs.
+//
+int main(int argc, const char * argv[]) {
+	const char* socketPath = NULL;
+	const char* shapes = NULL;
+	const char* axes = NULL;
+	int result;
+	initSubprocesses();
+	if (argc == 2 && matchModeSwitch(argv[1], "--server", &socketPath)) {
+		result = runServer(socketPath, runCommandLine);
+	} else if (argc >= 2 && matchModeSwitch(argv[1], "--client", &socketPath)) {
+		result = runClient(socketPath, argc - 2, argv + 2, runCommandLine);
+	} else if (argc >= 2 && matchModeSwitch(argv[1], "--benchmark", &shapes)) {
+		result = runBenchmark(shapes, argc - 2, argv + 2);
+	} else if (argc >= 2 && matchModeSwitch(argv[1], "--scaling", &axes)) {
+		result = runScalingTest(axes, argc - 2, argv + 2);
+	} else {
+		result = runCommandLine(argc - 1, argv + 1);
 	}
 
-	destroyLexer();
-	return EXIT_SUCCESS;
+	destroyPreprocessorCache();
+	destroyInternTable();
+	return result;
 }
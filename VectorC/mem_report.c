@@ -0,0 +1,190 @@
+//
+//  mem_report.c
+//  VectorC
+//
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "mem_report.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Blocks allocated before the report was enabled belong to no phase.
+#define UNCOUNTED_BLOCK ((size_t)PHASE_COUNT)
+
+// A block's owner is its phase in the low bits and the report generation
+// above them, so blocks left over from an earlier report (an earlier server
+// request) are not taken off this one's accounts when they are freed.
+#define OWNER_PHASE_BITS 8
+static_assert(PHASE_COUNT < (1 << OWNER_PHASE_BITS), "Too many phases for a block owner");
+
+// Precedes every counted block. Two words keep the block aligned as malloc's.
+typedef struct {
+	size_t size;
+	size_t owner;					// See OWNER_PHASE_BITS
+} BlockHeader;
+
+// Per phase. Only updated once the report is enabled.
+static _Atomic uint64_t s_allocatedBytes[PHASE_COUNT];
+static _Atomic uint64_t s_blockCount[PHASE_COUNT];
+static _Atomic int64_t s_liveBytes[PHASE_COUNT];		// Allocated by the phase, not yet freed
+static _Atomic int64_t s_peakLiveBytes[PHASE_COUNT];	// Most counted memory live while it ran
+static _Atomic uint64_t s_rssGrowth[PHASE_COUNT];
+
+static _Atomic int64_t s_totalLiveBytes;
+static _Atomic int64_t s_peakTotalLiveBytes;
+static _Atomic uint64_t s_lastPeakRss;
+static atomic_bool s_enabled;
+static _Atomic size_t s_generation;	// Bumped each time the report is enabled
+
+// Peak resident set size of the process so far, in bytes.
+static uint64_t readPeakRss(void) {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!K32GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return (uint64_t)counters.PeakWorkingSetSize;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return (uint64_t)usage.ru_maxrss;
+#else
+	return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+static void raiseToAtLeast(_Atomic int64_t* peak, int64_t value) {
+	int64_t current = atomic_load_explicit(peak, memory_order_relaxed);
+	while (value > current && !atomic_compare_exchange_weak_explicit(peak, &current, value, memory_order_relaxed, memory_order_relaxed)) {
+		// A failed exchange reloads `current`.
+	}
+}
+
+// Move `delta` bytes onto (or off) the account of the phase that allocated
+// them, and track the peaks against the phase that is running.
+static void countBytes(size_t owner, int64_t delta) {
+	atomic_fetch_add_explicit(&s_liveBytes[owner], delta, memory_order_relaxed);
+	int64_t total = atomic_fetch_add_explicit(&s_totalLiveBytes, delta, memory_order_relaxed) + delta;
+	if (delta > 0) {
+		raiseToAtLeast(&s_peakLiveBytes[getCurrentPhase()], total);
+		raiseToAtLeast(&s_peakTotalLiveBytes, total);
+	}
+}
+
+// Returns: the phase a block is charged to in the current report, or
+// UNCOUNTED_BLOCK.
+static size_t getOwnerPhase(size_t owner) {
+	size_t generation = atomic_load_explicit(&s_generation, memory_order_relaxed);
+	if ((owner >> OWNER_PHASE_BITS) != (generation & (SIZE_MAX >> OWNER_PHASE_BITS))) {
+		return UNCOUNTED_BLOCK;
+	}
+	return owner & ((1u << OWNER_PHASE_BITS) - 1);
+}
+
+static size_t makeOwner(size_t phase) {
+	return atomic_load_explicit(&s_generation, memory_order_relaxed) << OWNER_PHASE_BITS | phase;
+}
+
+void* countedRealloc(void* pointer, size_t size) {
+	BlockHeader* header = pointer ? (BlockHeader*)pointer - 1 : NULL;
+	size_t oldSize = header ? header->size : 0;
+	size_t oldPhase = header ? getOwnerPhase(header->owner) : UNCOUNTED_BLOCK;
+	header = (BlockHeader*)realloc(header, sizeof(BlockHeader) + size);
+	if (header == NULL) {
+		return NULL;
+	}
+	header->size = size;
+	header->owner = UNCOUNTED_BLOCK;
+	if (atomic_load_explicit(&s_enabled, memory_order_relaxed)) {
+		// A move counts as a fresh block: the bytes are the allocator's traffic.
+		CompilerPhase phase = getCurrentPhase();
+		header->owner = makeOwner(phase);
+		atomic_fetch_add_explicit(&s_allocatedBytes[phase], size, memory_order_relaxed);
+		atomic_fetch_add_explicit(&s_blockCount[phase], 1, memory_order_relaxed);
+		if (oldPhase != UNCOUNTED_BLOCK) {
+			countBytes(oldPhase, -(int64_t)oldSize);
+		}
+		countBytes(phase, (int64_t)size);
+	}
+	return header + 1;
+}
+
+void countedFree(void* pointer) {
+	if (pointer == NULL) {
+		return;
+	}
+	BlockHeader* header = (BlockHeader*)pointer - 1;
+	size_t phase = getOwnerPhase(header->owner);
+	if (phase != UNCOUNTED_BLOCK) {
+		countBytes(phase, -(int64_t)header->size);
+	}
+	free(header);
+}
+
+void enableMemoryReport(void) {
+	for (int p = 0; p < PHASE_COUNT; p++) {
+		atomic_store(&s_allocatedBytes[p], 0);
+		atomic_store(&s_blockCount[p], 0);
+		atomic_store(&s_liveBytes[p], 0);
+		atomic_store(&s_peakLiveBytes[p], 0);
+		atomic_store(&s_rssGrowth[p], 0);
+	}
+	atomic_store(&s_totalLiveBytes, 0);
+	atomic_store(&s_peakTotalLiveBytes, 0);
+	atomic_fetch_add(&s_generation, 1);
+	atomic_store(&s_lastPeakRss, readPeakRss());
+	atomic_store(&s_enabled, true);
+}
+
+void disableMemoryReport(void) {
+	atomic_store(&s_enabled, false);
+}
+
+bool isMemoryReportEnabled(void) {
+	return atomic_load_explicit(&s_enabled, memory_order_relaxed);
+}
+
+void sampleMemoryPhase(CompilerPhase phase) {
+	// The peak only grows, so each increase is charged once, to whichever
+	// thread notices it; with several threads the split is approximate.
+	uint64_t peak = readPeakRss();
+	uint64_t last = atomic_load_explicit(&s_lastPeakRss, memory_order_relaxed);
+	while (peak > last) {
+		if (atomic_compare_exchange_weak_explicit(&s_lastPeakRss, &last, peak, memory_order_relaxed, memory_order_relaxed)) {
+			atomic_fetch_add_explicit(&s_rssGrowth[phase], peak - last, memory_order_relaxed);
+			break;
+		}
+	}
+}
+
+void printMemoryReport(FILE* out) {
+	sampleMemoryPhase(getCurrentPhase());
+	fprintf(out, "Memory report: peak RSS %.1f MB, peak counted %.1f MB\n",
+			(double)readPeakRss() / (1024.0 * 1024.0), (double)atomic_load(&s_peakTotalLiveBytes) / (1024.0 * 1024.0));
+	fprintf(out, "  %14s  %10s  %14s  %15s  %15s  %s\n", "Allocated (KB)", "Blocks", "Peak live (KB)", "Still live (KB)", "RSS growth (KB)", "Phase");
+	for (int p = 0; p < PHASE_COUNT; p++) {
+		uint64_t blocks = atomic_load(&s_blockCount[p]);
+		uint64_t growth = atomic_load(&s_rssGrowth[p]);
+		if (blocks == 0 && growth == 0) {
+			continue;
+		}
+		fprintf(out, "  %14.1f  %10llu  %14.1f  %15.1f  %15.1f  %s\n",
+				(double)atomic_load(&s_allocatedBytes[p]) / 1024.0, (unsigned long long)blocks,
+				(double)atomic_load(&s_peakLiveBytes[p]) / 1024.0, (double)atomic_load(&s_liveBytes[p]) / 1024.0,
+				(double)growth / 1024.0, getPhaseName((CompilerPhase)p));
+	}
+}
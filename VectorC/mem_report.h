@@ -0,0 +1,45 @@
+//
+//  mem_report.h
+//  VectorC
+//
+
+#ifndef mem_report_h
+#define mem_report_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#include "time_report.h"
+
+//
+// countedRealloc
+// --------------
+// realloc for the compiler's bulk data: every stb_ds array and hash map and
+// every arena chunk. Each block carries a small header with its size and the
+// phase that allocated it, so -fmem-report can charge the bytes to a phase
+// and take them off that phase's account when the block is freed, whichever
+// phase that happens in. Blocks must be released with countedFree.
+//
+// Returns:
+//   The block, or NULL if the system is out of memory.
+//
+void* countedRealloc(void* pointer, size_t size);
+void countedFree(void* pointer);
+
+// Start counting from zero. Blocks allocated before this, including those
+// of an earlier report, are ignored.
+void enableMemoryReport(void);
+// Stop counting, so later requests in a server pay nothing for it.
+void disableMemoryReport(void);
+bool isMemoryReportEnabled(void);
+
+// Charge growth of the peak RSS since the last sample to `phase`, which the
+// calling thread is leaving.
+void sampleMemoryPhase(CompilerPhase phase);
+
+// A table of the bytes and blocks each phase allocated, the most counted
+// memory live while it ran, and the peak RSS growth it caused.
+void printMemoryReport(FILE* out);
+
+#endif /* mem_report_h */
@@ -6,14 +6,34 @@
 //
 
 #include "parser.h"
+#include "lexer.h"
+#include "compiler_context.h"
 #include "token.h"
-#include "stb_ds.h"
+#include "stb_ds_config.h"
 
-// Return a pointer to the current token in the stream.
-// parser - parser state tracking the token array and index.
+// Return a pointer to the current token in the stream, pulling it from the
+// lexer first when streaming.
+// parser - parser state tracking the token source and index.
 // Returns: pointer to current Token.
 static const Token* currentToken(Parser* parser) {
-	return &parser->tokens[parser->current];
+	if (parser->tokens) {
+		return &parser->tokens[parser->current];
+	}
+	while (parser->pulled <= parser->current) {
+		parser->window[parser->pulled & (PARSER_WINDOW_SIZE - 1)] = scanValidToken(&parser->context->lexer);
+		parser->pulled++;
+	}
+	return &parser->window[parser->current & (PARSER_WINDOW_SIZE - 1)];
+}
+
+// Return a pointer to the token consumed by the last successful match.
+// parser - parser state.
+// Returns: pointer to the previous Token.
+static const Token* previousToken(Parser* parser) {
+	if (parser->tokens) {
+		return &parser->tokens[parser->current - 1];
+	}
+	return &parser->window[(parser->current - 1) & (PARSER_WINDOW_SIZE - 1)];
 }
 
 // Move to the next token if not already at EOF.
@@ -105,23 +125,21 @@ ExpressionNode* parseExpression(Parser* parser, int minPrec) {
 	if (match(parser, TOKEN_LEFT_PAREN)) {
 		left = parseExpression(parser, 0);
 		if (!match(parser, TOKEN_RIGHT_PAREN)) {
-			printf("Error: Expected ')'\n");
-			exit(EXIT_FAILURE);
+			compilerError(parser->context, "Expected ')'");
 		}
 	}
 	else if (match(parser, TOKEN_TILDE)) {
-		left = createUnaryNode(UNARY_COMPLEMENT, parseExpression(parser, 100));
+		left = createUnaryNode(&parser->context->astArena, UNARY_COMPLEMENT, parseExpression(parser, 100));
 	}
 	else if (match(parser, TOKEN_MINUS)) {
-		left = createUnaryNode(UNARY_NEGATE, parseExpression(parser, 100));
+		left = createUnaryNode(&parser->context->astArena, UNARY_NEGATE, parseExpression(parser, 100));
 	}
 	else if (match(parser, TOKEN_NUMBER)) {
-		const Token* previousToken = &parser->tokens[parser->current - 1];
-		left = createIntConstant(previousToken->value.intValue);
+		const Token* numberToken = previousToken(parser);
+		left = createIntConstant(&parser->context->astArena, numberToken->value.intValue);
 	}
 	else {
-		printf("Error: ...");
-		exit(EXIT_FAILURE);
+		compilerError(parser->context, "Expected an expression.");
 	}
 
 	// Parse binary ops using precedence climbing
@@ -161,13 +179,12 @@ ExpressionNode* parseExpression(Parser* parser, int minPrec) {
 				op = BINOP_BITWISE_XOR;
 				break;
 			default:
-				printf("Unknown binary operator\n");
-				exit(EXIT_FAILURE);
+				compilerError(parser->context, "Unknown binary operator");
 		}
 		int prec = getPrecedence(currentToken(parser)->type);
 		advance(parser);
 		ExpressionNode* right = parseExpression(parser, prec + 1);
-		left = createBinaryNode(op, left, right);
+		left = createBinaryNode(&parser->context->astArena, op, left, right);
 	}
 	return left;
 }
@@ -178,26 +195,24 @@ ExpressionNode* parseFactor(Parser* parser) {
 	if (match(parser, TOKEN_LEFT_PAREN)) {  // Handle grouped expressions
 		ExpressionNode* expr = parseExpression(parser, 0);  // Parse inside parentheses
 		if (!match(parser, TOKEN_RIGHT_PAREN)) {  // Ensure closing `)`
-			printf("Error: Expected closing ')'\n");
-			exit(EXIT_FAILURE);
+			compilerError(parser->context, "Expected closing ')'");
 		}
 		return expr;
 	}
 	else if (match(parser, TOKEN_TILDE)) {  // Bitwise NOT (~)
 		ExpressionNode* operand = parseFactor(parser);
-		return createUnaryNode(UNARY_COMPLEMENT, operand);
+		return createUnaryNode(&parser->context->astArena, UNARY_COMPLEMENT, operand);
 	}
 	else if (match(parser, TOKEN_MINUS)) {  // Negation (-)
 		ExpressionNode* operand = parseFactor(parser);
-		return createUnaryNode(UNARY_NEGATE, operand);
+		return createUnaryNode(&parser->context->astArena, UNARY_NEGATE, operand);
 	}
 	else if (match(parser, TOKEN_NUMBER)) {  // Constant numbers
-		const Token* token = &parser->tokens[parser->current - 1];
-		return createIntConstant(token->value.intValue);
+		const Token* token = previousToken(parser);
+		return createIntConstant(&parser->context->astArena, token->value.intValue);
 	}
 
-	printf("Error: Expected a number or unary operator, got '%s'\n", currentToken(parser)->start);
-	exit(EXIT_FAILURE);
+	compilerError(parser->context, "Expected a number or unary operator, got '%.*s'", (int)currentToken(parser)->length, currentToken(parser)->start);
 }
 
 // Parse a single statement such as a return statement.
@@ -206,13 +221,11 @@ StatementNode* parseStatement(Parser* parser) {
 	if (match(parser, TOKEN_RETURN)) {
 		ExpressionNode* expr = parseExpression(parser, 0);
 		if (!match(parser, TOKEN_SEMICOLON)) {
-			printf("Error: Expected ';' after return expression.\n");
-			exit(EXIT_FAILURE);
+			compilerError(parser->context, "Expected ';' after return expression.");
 		}
-		return createReturnStatementNode(expr);
+		return createReturnStatementNode(&parser->context->astArena, expr);
 	}
-	printf("Error: Unexpected token '%s'\n", currentToken(parser)->start);
-	exit(EXIT_FAILURE);
+	compilerError(parser->context, "Unexpected token '%.*s'", (int)currentToken(parser)->length, currentToken(parser)->start);
 }
 
 // Parse a block of statements delimited by braces.
@@ -230,50 +243,44 @@ StatementNode* parseStatementList(Parser* parser) {
 // Parse a function definition including its body.
 // Returns: newly allocated FunctionNode.
 FunctionNode* parseFunction(Parser* parser) {
+	const char* source = currentToken(parser)->start;
 	if (!match(parser, TOKEN_INT) && !match(parser, TOKEN_VOID)) {
-		printf("Error: Expected return type ('int' or 'void').\n");
-		exit(EXIT_FAILURE);
+		compilerError(parser->context, "Expected return type ('int' or 'void').");
 	}
 
 	if (!match(parser, TOKEN_IDENTIFIER)) {
-		printf("Error: Expected function name.\n");
-		exit(EXIT_FAILURE);
+		compilerError(parser->context, "Expected function name.");
 	}
-	const Token* nameToken = &parser->tokens[parser->current - 1];
+	const char* name = previousToken(parser)->value.name;
 
 	if (!match(parser, TOKEN_LEFT_PAREN)) {
-		printf("Error: Expected '(' after function name.\n");
-		exit(EXIT_FAILURE);
+		compilerError(parser->context, "Expected '(' after function name.");
 	}
 
 	if (!match(parser, TOKEN_VOID)) {
-		printf("Error: Only 'void' parameters supported for now.\n");
-		exit(EXIT_FAILURE);
+		compilerError(parser->context, "Only 'void' parameters supported for now.");
 	}
 
 	if (!match(parser, TOKEN_RIGHT_PAREN)) {
-		printf("Error: Expected ')' after parameter list.\n");
-		exit(EXIT_FAILURE);
+		compilerError(parser->context, "Expected ')' after parameter list.");
 	}
 
 	if (!match(parser, TOKEN_LEFT_BRACE)) {
-		printf("Error: Expected '{' to start function body.\n");
-		exit(EXIT_FAILURE);
+		compilerError(parser->context, "Expected '{' to start function body.");
 	}
 
 	StatementNode* body = parseStatementList(parser);
 
 	// ✅ Ensure function body ends correctly
 	if (!match(parser, TOKEN_RIGHT_BRACE)) {
-		printf("Error: Expected '}' at end of function body.\n");
-		exit(EXIT_FAILURE);
+		compilerError(parser->context, "Expected '}' at end of function body.");
 	}
 
-	char functionName[nameToken->length + 1];
-	strncpy(functionName, nameToken->start, nameToken->length);
-	functionName[nameToken->length] = '\0';
-
-	return createFunctionNode(functionName, body);
+	FunctionNode* function = createFunctionNode(&parser->context->astArena, name, body);
+	const Token* closingBrace = previousToken(parser);
+	function->source = source;
+	function->sourceLength = (size_t)(closingBrace->start + closingBrace->length - source);
+	return function;
 }
 
 // Parse an entire program consisting of multiple function definitions.
@@ -289,7 +296,7 @@ ProgramNode* parseProgram(Parser* parser) {
 			FunctionNode* function = parseFunction(parser);
 
 			if (!program) {
-				program = createProgramNode(function);
+				program = createProgramNode(&parser->context->astArena, function);
 			} else {
 				// Append the function to the existing program
 				lastFunction->next = function; // Requires `next` in `FunctionNode`
@@ -302,17 +309,26 @@ ProgramNode* parseProgram(Parser* parser) {
 			}
 
 			// Unexpected token error
-			printf("Error: Unexpected token '%.*s' (type: %d) at top level.\n", (int)currentToken(parser)->length, currentToken(parser)->start, currentToken(parser)->type);
-			exit(EXIT_FAILURE);
+			compilerError(parser->context, "Unexpected token '%.*s' (type: %d) at top level.", (int)currentToken(parser)->length, currentToken(parser)->start, currentToken(parser)->type);
 		}
 	}
 	return program;
 }
 
 // Convenience entry point: parse a program from an array of tokens.
-// tokens - array produced by the lexer.
+// context - compilation that owns the AST and receives errors.
+// tokens  - array produced by the lexer.
+// Returns: ProgramNode for the entire input.
+ProgramNode* parseProgramTokens(CompilerContext* context, const Token* tokens) {
+	Parser parser = { .context = context, .tokens = tokens };
+	return parseProgram(&parser);
+}
+
+// Streaming entry point: tokens are pulled from the lexer as the parser needs
+// them, so token memory stays constant regardless of input size.
+// context - compilation whose lexer has been initialized.
 // Returns: ProgramNode for the entire input.
-ProgramNode* parseProgramTokens(const Token* tokens) {
-	Parser parser = {tokens, 0};
+ProgramNode* parseProgramStream(CompilerContext* context) {
+	Parser parser = { .context = context, .tokens = NULL };
 	return parseProgram(&parser);
 }
@@ -12,10 +12,21 @@
 #include "token.h"
 #include "ast_c.h"
 
-// Parser state carrying the token array and current index.
+struct CompilerContext;
+
+// Number of tokens kept when streaming. Must be a power of two and at least 2
+// so the current and previous token are both available.
+#define PARSER_WINDOW_SIZE 4
+
+// Parser state carrying the token source and current index. Tokens come either
+// from a materialized array or, when `tokens` is NULL, are pulled from the
+// lexer on demand into a small ring buffer.
 typedef struct {
+	struct CompilerContext* context;	// Owns the lexer and AST arena; receives errors
 	const Token* tokens;
 	size_t current; // Current token index
+	size_t pulled;  // Tokens pulled from the lexer so far (streaming only)
+	Token window[PARSER_WINDOW_SIZE];
 } Parser;
 
 // Parse an expression starting at the current token with a minimum precedence.
@@ -34,6 +45,10 @@ FunctionNode* parseFunction(Parser* parser);
 ProgramNode* parseProgram(Parser* parser);
 
 // Helper to parse a program directly from a token array.
-ProgramNode* parseProgramTokens(const Token* tokens);
+ProgramNode* parseProgramTokens(struct CompilerContext* context, const Token* tokens);
+
+// Parse a program pulling tokens straight from the context's initialized lexer,
+// without materializing the token array.
+ProgramNode* parseProgramStream(struct CompilerContext* context);
 
 #endif /* parser_h */
@@ -0,0 +1,271 @@
+//
+//  perf_counters.c
+//  VectorC
+//
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "perf_counters.h"
+
+#ifdef __linux__
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+typedef struct {
+	const char* label;				// Table column
+	uint32_t type;					// perf_event_attr type and config
+	uint64_t config;
+} CounterName;
+
+#ifdef __linux__
+static const CounterName s_counterNames[PERF_COUNTER_COUNT] = {
+	[PERF_COUNTER_CYCLES] = { "Cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+	[PERF_COUNTER_INSTRUCTIONS] = { "Instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+	[PERF_COUNTER_CACHE_MISSES] = { "Cache misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES },
+	[PERF_COUNTER_BRANCH_MISSES] = { "Branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+	[PERF_COUNTER_PAGE_FAULTS] = { "Page faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS },
+};
+#else
+static const CounterName s_counterNames[PERF_COUNTER_COUNT] = {
+	[PERF_COUNTER_CYCLES] = { "Cycles" },
+	[PERF_COUNTER_INSTRUCTIONS] = { "Instructions" },
+	[PERF_COUNTER_CACHE_MISSES] = { "Cache misses" },
+	[PERF_COUNTER_BRANCH_MISSES] = { "Branch misses" },
+	[PERF_COUNTER_PAGE_FAULTS] = { "Page faults" },
+};
+#endif
+
+// What read() returns with PERF_FORMAT_TOTAL_TIME_ENABLED | RUNNING.
+typedef struct {
+	uint64_t value;
+	uint64_t enabled;				// Nanoseconds the counter was enabled
+	uint64_t running;				// Nanoseconds it was actually on the PMU
+} CounterReading;
+
+typedef struct {
+	int files[PERF_COUNTER_COUNT];	// -1 if the counter could not be opened
+	CounterReading last[PERF_COUNTER_COUNT];
+	bool open;
+} ThreadCounters;
+
+// Per phase, summed over threads. Only updated once counting is enabled.
+static _Atomic uint64_t s_counts[PHASE_COUNT][PERF_COUNTER_COUNT];
+static atomic_bool s_available[PERF_COUNTER_COUNT];	// Opened on at least one thread
+static atomic_int s_openError[PERF_COUNTER_COUNT];		// First errno a failed open gave
+static atomic_bool s_enabled;
+
+static _Thread_local ThreadCounters s_thread;
+
+#ifdef __linux__
+
+static int openCounter(PerfCounter counter) {
+	struct perf_event_attr attr;
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = s_counterNames[counter].type;
+	attr.config = s_counterNames[counter].config;
+	attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+	// User space only, which is all perf_event_paranoid 2 (the usual
+	// default) allows anyway.
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	int file = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC);
+	if (file < 0) {
+		int expected = 0;
+		atomic_compare_exchange_strong(&s_openError[counter], &expected, errno);
+	}
+	return file;
+}
+
+static bool readCounter(int file, CounterReading* reading) {
+	return read(file, reading, sizeof(*reading)) == (ssize_t)sizeof(*reading);
+}
+
+static void closeCounter(int file) {
+	close(file);
+}
+
+#else
+
+static int openCounter(PerfCounter counter) {
+	(void)counter;
+	return -1;
+}
+
+static bool readCounter(int file, CounterReading* reading) {
+	(void)file;
+	(void)reading;
+	return false;
+}
+
+static void closeCounter(int file) {
+	(void)file;
+}
+
+#endif
+
+static void openThreadCounters(void) {
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+		s_thread.files[c] = openCounter((PerfCounter)c);
+		if (s_thread.files[c] >= 0 && !readCounter(s_thread.files[c], &s_thread.last[c])) {
+			closeCounter(s_thread.files[c]);
+			s_thread.files[c] = -1;
+		}
+		if (s_thread.files[c] >= 0) {
+			atomic_store_explicit(&s_available[c], true, memory_order_relaxed);
+		}
+	}
+	s_thread.open = true;
+}
+
+void enablePerfCounters(void) {
+	// A server worker serves many requests; each report starts from zero.
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+		for (int p = 0; p < PHASE_COUNT; p++) {
+			atomic_store(&s_counts[p][c], 0);
+		}
+		atomic_store(&s_available[c], false);
+		atomic_store(&s_openError[c], 0);
+	}
+	atomic_store(&s_enabled, true);
+	openThreadCounters();
+}
+
+void disablePerfCounters(void) {
+	closePerfCounters();
+	atomic_store(&s_enabled, false);
+}
+
+bool arePerfCountersEnabled(void) {
+	return atomic_load_explicit(&s_enabled, memory_order_relaxed);
+}
+
+void samplePerfCounters(CompilerPhase phase) {
+	if (!s_thread.open) {
+		// Nothing counted on this thread yet.
+		openThreadCounters();
+		return;
+	}
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+		CounterReading now;
+		if (s_thread.files[c] < 0 || !readCounter(s_thread.files[c], &now)) {
+			continue;
+		}
+		const CounterReading* last = &s_thread.last[c];
+		uint64_t value = now.value - last->value;
+		uint64_t enabled = now.enabled - last->enabled;
+		uint64_t running = now.running - last->running;
+		// When the PMU is shared the kernel rotates counters; scale up the
+		// part that was counted to the whole interval.
+		if (running > 0 && running < enabled) {
+			value = (uint64_t)((double)value * (double)enabled / (double)running);
+		}
+		atomic_fetch_add_explicit(&s_counts[phase][c], value, memory_order_relaxed);
+		s_thread.last[c] = now;
+	}
+}
+
+void closePerfCounters(void) {
+	if (!s_thread.open) {
+		return;
+	}
+	samplePerfCounters(getCurrentPhase());
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+		if (s_thread.files[c] >= 0) {
+			closeCounter(s_thread.files[c]);
+		}
+	}
+	s_thread.open = false;
+}
+
+static const char* describeOpenError(int error) {
+#ifdef __linux__
+	switch (error) {
+		case EACCES:
+		case EPERM:
+			return "not permitted (see /proc/sys/kernel/perf_event_paranoid)";
+		case ENOENT:
+		case EOPNOTSUPP:
+		case EINVAL:
+			return "not supported by this processor or virtual machine";
+		case ENOSYS:
+			return "not supported by this kernel";
+		default:
+			return strerror(error);
+	}
+#else
+	(void)error;
+	return "not supported on this platform";
+#endif
+}
+
+static void printCount(FILE* out, PerfCounter counter, uint64_t count) {
+	if (atomic_load(&s_available[counter])) {
+		fprintf(out, "  %14llu", (unsigned long long)count);
+	} else {
+		fprintf(out, "  %14s", "-");
+	}
+}
+
+static void printRatio(FILE* out, bool available, uint64_t numerator, uint64_t denominator, double scale) {
+	if (available && denominator > 0) {
+		fprintf(out, "  %6.2f", (double)numerator * scale / (double)denominator);
+	} else {
+		fprintf(out, "  %6s", "-");
+	}
+}
+
+void printPerfCounterReport(FILE* out) {
+	samplePerfCounters(getCurrentPhase());
+
+	bool any = false;
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+		any |= atomic_load(&s_available[c]);
+	}
+	if (!any) {
+		fprintf(out, "Performance counters: unavailable, %s\n", describeOpenError(atomic_load(&s_openError[0])));
+		return;
+	}
+
+	bool haveCycles = atomic_load(&s_available[PERF_COUNTER_CYCLES]);
+	bool haveInstructions = atomic_load(&s_available[PERF_COUNTER_INSTRUCTIONS]);
+	bool haveCacheMisses = atomic_load(&s_available[PERF_COUNTER_CACHE_MISSES]);
+	bool haveBranchMisses = atomic_load(&s_available[PERF_COUNTER_BRANCH_MISSES]);
+
+	// MPKI is misses per thousand instructions.
+	fprintf(out, "Performance counters (user space):\n");
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+		fprintf(out, "  %14s", s_counterNames[c].label);
+	}
+	fprintf(out, "  %6s  %6s  %6s  %s\n", "IPC", "Cache", "Branch", "Phase");
+	fprintf(out, "%*s  %6s  %6s  %6s\n", 16 * PERF_COUNTER_COUNT, "", "", "MPKI", "MPKI");
+	for (int p = 0; p < PHASE_COUNT; p++) {
+		uint64_t counts[PERF_COUNTER_COUNT];
+		bool counted = false;
+		for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+			counts[c] = atomic_load(&s_counts[p][c]);
+			counted |= counts[c] != 0;
+		}
+		if (!counted) {
+			continue;
+		}
+		for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+			printCount(out, (PerfCounter)c, counts[c]);
+		}
+		uint64_t instructions = counts[PERF_COUNTER_INSTRUCTIONS];
+		printRatio(out, haveCycles && haveInstructions, instructions, counts[PERF_COUNTER_CYCLES], 1.0);
+		printRatio(out, haveCacheMisses && haveInstructions, counts[PERF_COUNTER_CACHE_MISSES], instructions, 1000.0);
+		printRatio(out, haveBranchMisses && haveInstructions, counts[PERF_COUNTER_BRANCH_MISSES], instructions, 1000.0);
+		fprintf(out, "  %s\n", getPhaseName((CompilerPhase)p));
+	}
+	for (int c = 0; c < PERF_COUNTER_COUNT; c++) {
+		if (!atomic_load(&s_available[c])) {
+			fprintf(out, "  %s: unavailable, %s\n", s_counterNames[c].label, describeOpenError(atomic_load(&s_openError[c])));
+		}
+	}
+}
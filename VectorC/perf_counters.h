@@ -0,0 +1,49 @@
+//
+//  perf_counters.h
+//  VectorC
+//
+
+#ifndef perf_counters_h
+#define perf_counters_h
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "time_report.h"
+
+typedef enum {
+	PERF_COUNTER_CYCLES,
+	PERF_COUNTER_INSTRUCTIONS,
+	PERF_COUNTER_CACHE_MISSES,
+	PERF_COUNTER_BRANCH_MISSES,
+	PERF_COUNTER_PAGE_FAULTS,
+	PERF_COUNTER_COUNT
+} PerfCounter;
+
+// Start counting for -fperf-counters. Each thread opens its own counters the
+// first time it switches phase; counters the kernel refuses are left out.
+// Any earlier counts are cleared.
+void enablePerfCounters(void);
+bool arePerfCountersEnabled(void);
+
+// Close the calling thread's counters and stop counting, once the report is
+// printed.
+void disablePerfCounters(void);
+
+// Called by switchPhase: charge the events counted on this thread since its
+// last sample to `phase`, which it is leaving.
+void samplePerfCounters(CompilerPhase phase);
+
+// Close the calling thread's counters. Threads call this before they exit.
+void closePerfCounters(void);
+
+//
+// printPerfCounterReport
+// ----------------------
+// A table of the events each phase counted, with instructions per cycle and
+// cache and branch misses per thousand instructions. Counters that could not
+// be opened are shown as "-", and the reason is printed once.
+//
+void printPerfCounterReport(FILE* out);
+
+#endif /* perf_counters_h */
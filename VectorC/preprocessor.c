@@ -0,0 +1,1717 @@
+//
+//  preprocessor.c
+//  VectorC
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include "preprocessor.h"
+#include "compiler_context.h"
+#include "intern.h"
+#include "arena.h"
+#include "stb_ds_config.h"
+
+#define PP_MAX_INCLUDE_DEPTH	200
+#define PP_MAX_PATH				4096
+
+// Growable, always null-terminated character buffer.
+typedef struct {
+	char* data;
+	size_t length;
+	size_t capacity;
+} TextBuffer;
+
+// One logical source line: comments replaced by a single space and
+// backslash-newline continuations joined.
+typedef struct {
+	const char* text;		// Null-terminated, points into CachedFile.storage
+	int32_t length;
+	int32_t firstLine;		// Physical line the logical line starts on
+	int32_t physicalLines;	// Physical lines spanned, at least one
+	bool isDirective;
+} LogicalLine;
+
+// A file split into logical lines. Entries live until destroyPreprocessorCache
+// and are revalidated against the file's size and modification time.
+typedef struct {
+	const char* path;		// Interned canonical path
+	char* storage;			// Owns the text of every line
+	size_t storageSize;
+	LogicalLine* lines;		// stb_ds array
+	const char* guardMacro;	// Interned include guard wrapping the whole file, or NULL
+	bool pragmaOnce;
+	time_t modifiedTime;
+	long long size;
+} CachedFile;
+
+typedef struct {
+	const char* key;		// Interned canonical path
+	CachedFile* value;
+} FileCacheEntry;
+
+static _Thread_local FileCacheEntry* s_fileCache = NULL;
+static _Thread_local size_t s_fileCacheHits = 0;
+static _Thread_local size_t s_fileCacheMisses = 0;
+static _Thread_local size_t s_fileCacheBytes = 0;
+
+// Heap bytes owned by a cached file.
+static size_t getCachedFileBytes(const CachedFile* file) {
+	return sizeof(CachedFile) + file->storageSize + arrcap(file->lines) * sizeof(LogicalLine);
+}
+
+typedef struct {
+	const char* name;		// Interned
+	const char** params;	// stb_ds array of interned parameter names
+	const char* body;		// Trimmed replacement list
+	bool functionLike;
+	bool variadic;
+	bool disabled;			// Set while the macro's own replacement is rescanned
+} Macro;
+
+typedef struct {
+	const char* key;		// Interned macro name
+	Macro value;
+} MacroEntry;
+
+typedef struct {
+	const char* key;		// Interned canonical path
+	bool value;
+} OnceEntry;
+
+// State of an #if group.
+typedef struct {
+	bool wasActive;			// Whether the enclosing region is active
+	bool taken;				// A branch of the group has already been selected
+	bool sawElse;
+} Conditional;
+
+typedef struct {
+	CompilerContext* context;			// Receives diagnostics
+	const PreprocessorOptions* options;
+	const char** systemIncludePaths;	// stb_ds array
+	MacroEntry* macros;
+	OnceEntry* onceIncluded;			// Files that used #pragma once during this run
+	Conditional* conditionals;			// stb_ds stack of open #if groups of every file being processed
+	TextBuffer** scratch;				// stb_ds array of reusable temporary buffers
+	size_t scratchDepth;				// Scratch buffers currently in use
+	TextBuffer** argumentLists;			// stb_ds stack of the argument arrays of macros being expanded
+	Arena storage;						// Macro bodies
+	TextBuffer output;
+	const char* file;					// Name of the file being processed, as spelled by the user or set by #line
+	const char* path;					// Name of the file being processed; #line leaves it alone
+	int32_t line;						// Line being processed, as numbered by #line
+	int32_t lineDelta;					// What #line added to the physical line numbers of this file
+	int32_t includeDepth;
+	const char* lineName;				// Interned "__LINE__", "__FILE__" and "__VA_ARGS__"
+	const char* fileName;
+	const char* vaArgsName;
+} Preprocessor;
+
+static const char* const s_predefinedMacros[] = {
+	"__STDC__ 1",
+	"__STDC_VERSION__ 201710L",
+	"__STDC_HOSTED__ 1",
+	"__VECTORC__ 1",
+};
+
+static void expandText(Preprocessor* pp, const char* text, size_t length, TextBuffer* out, bool trackLines);
+
+// Report an error at the given location and abandon the compilation.
+static _Noreturn void fatalErrorAt(CompilerContext* context, const char* file, int32_t line, const char* format, ...) {
+	va_list args;
+	va_start(args, format);
+	fprintf(context->err, "%s:%d: error: ", file, line);
+	vfprintf(context->err, format, args);
+	fputc('\n', context->err);
+	va_end(args);
+	abortCompilation(context);
+}
+
+// Report an error at the line being processed.
+#define fatalError(pp, ...) fatalErrorAt((pp)->context, (pp)->file, (pp)->line, __VA_ARGS__)
+
+static void reserveText(TextBuffer* buffer, size_t extra) {
+	size_t needed = buffer->length + extra + 1;
+	if (needed <= buffer->capacity) {
+		return;
+	}
+	size_t capacity = buffer->capacity ? buffer->capacity * 2 : 256;
+	while (capacity < needed) {
+		capacity *= 2;
+	}
+	buffer->data = (char*)realloc(buffer->data, capacity);
+	if (buffer->data == NULL) {
+		perror("Failed to grow preprocessor buffer");
+		exit(EXIT_FAILURE);
+	}
+	buffer->capacity = capacity;
+}
+
+static void appendText(TextBuffer* buffer, const char* text, size_t length) {
+	reserveText(buffer, length);
+	memcpy(buffer->data + buffer->length, text, length);
+	buffer->length += length;
+	buffer->data[buffer->length] = '\0';
+}
+
+static void appendChar(TextBuffer* buffer, char c) {
+	reserveText(buffer, 1);
+	buffer->data[buffer->length++] = c;
+	buffer->data[buffer->length] = '\0';
+}
+
+static void appendNewlines(TextBuffer* buffer, int32_t count) {
+	for (int32_t i = 0; i < count; i++) {
+		appendChar(buffer, '\n');
+	}
+}
+
+static void freeText(TextBuffer* buffer) {
+	free(buffer->data);
+	memset(buffer, 0, sizeof(TextBuffer));
+}
+
+// Take an empty temporary buffer. Temporaries live in the Preprocessor rather
+// than in C locals so an error part way through an expansion can still
+// release them, and their storage is reused by later directives. Buffers must
+// be returned with popScratch in reverse order.
+static TextBuffer* pushScratch(Preprocessor* pp) {
+	if (pp->scratchDepth == arrlenu(pp->scratch)) {
+		TextBuffer* buffer = (TextBuffer*)calloc(1, sizeof(TextBuffer));
+		if (buffer == NULL) {
+			perror("Failed to allocate preprocessor buffer");
+			exit(EXIT_FAILURE);
+		}
+		arrput(pp->scratch, buffer);
+	}
+	TextBuffer* buffer = pp->scratch[pp->scratchDepth++];
+	buffer->length = 0;
+	if (buffer->data) {
+		buffer->data[0] = '\0';
+	}
+	return buffer;
+}
+
+static void popScratch(Preprocessor* pp) {
+	pp->scratchDepth--;
+}
+
+static bool isIdentifierStart(char c) {
+	return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool isIdentifierChar(char c) {
+	return isIdentifierStart(c) || (c >= '0' && c <= '9');
+}
+
+static bool isDigitChar(char c) {
+	return c >= '0' && c <= '9';
+}
+
+static bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static const char* skipBlanks(const char* p) {
+	while (isBlank(*p)) p++;
+	return p;
+}
+
+static const char* scanIdentifierEnd(const char* p, const char* end) {
+	while (p < end && isIdentifierChar(*p)) p++;
+	return p;
+}
+
+// Skip a string or character literal starting at its opening quote. An
+// unterminated literal ends at the newline.
+static const char* skipLiteral(const char* p, const char* end) {
+	char quote = *p++;
+	while (p < end && *p != quote && *p != '\n') {
+		p += (*p == '\\' && p + 1 < end) ? 2 : 1;
+	}
+	if (p < end && *p == quote) p++;
+	return p;
+}
+
+// Skip a preprocessing number such as 42, 0x1F, 1.5e+3 or 10UL.
+static const char* skipNumber(const char* p, const char* end) {
+	p++;
+	while (p < end) {
+		if ((*p == '+' || *p == '-') && (p[-1] == 'e' || p[-1] == 'E' || p[-1] == 'p' || p[-1] == 'P')) {
+			p++;
+		} else if (isIdentifierChar(*p) || *p == '.') {
+			p++;
+		} else {
+			break;
+		}
+	}
+	return p;
+}
+
+//
+// File cache
+//
+
+static bool readFileInfo(const char* path, time_t* modifiedTime, long long* size) {
+	struct stat info;
+	if (stat(path, &info) != 0) {
+		return false;
+	}
+	*modifiedTime = info.st_mtime;
+	*size = (long long)info.st_size;
+	return true;
+}
+
+static const char* canonicalPath(const char* path) {
+#ifdef _WIN32
+	char full[_MAX_PATH];
+	if (_fullpath(full, path, sizeof(full))) {
+		return internCString(full);
+	}
+#else
+	char* full = realpath(path, NULL);
+	if (full) {
+		const char* interned = internCString(full);
+		free(full);
+		return interned;
+	}
+#endif
+	return internCString(path);
+}
+
+// Split source text into logical lines, removing comments and joining
+// continuation lines. The number of physical lines each logical line spans is
+// recorded so the output can keep every token on its original line.
+// Returns: line on which an unterminated comment starts, or 0.
+static int32_t splitLogicalLines(CachedFile* file, const char* source, size_t length) {
+	// Output never exceeds the input plus one terminator for a final line
+	// without a newline.
+	file->storage = (char*)malloc(length + 2);
+	file->storageSize = length + 2;
+	if (file->storage == NULL) {
+		perror("Failed to allocate preprocessor line storage");
+		exit(EXIT_FAILURE);
+	}
+	const char* p = source;
+	const char* end = source + length;
+	char* out = file->storage;
+	int32_t line = 1;
+
+	while (p < end) {
+		char* text = out;
+		int32_t firstLine = line;
+		int32_t physicalLines = 1;
+		while (p < end && *p != '\n') {
+			if (p[0] == '\\' && (p[1] == '\n' || (p[1] == '\r' && p[2] == '\n'))) {
+				p += (p[1] == '\n') ? 2 : 3;
+				physicalLines++;
+				line++;
+			} else if (p[0] == '/' && p[1] == '*') {
+				p += 2;
+				while (p < end && !(p[0] == '*' && p[1] == '/')) {
+					if (*p == '\n') {
+						physicalLines++;
+						line++;
+					}
+					p++;
+				}
+				if (p >= end) {
+					return firstLine;
+				}
+				p += 2;
+				*out++ = ' ';
+			} else if (p[0] == '/' && p[1] == '/') {
+				while (p < end && *p != '\n') {
+					if (p[0] == '\\' && p[1] == '\n') {
+						p++;
+						physicalLines++;
+						line++;
+					}
+					p++;
+				}
+				*out++ = ' ';
+			} else if (*p == '"' || *p == '\'') {
+				char quote = *p;
+				*out++ = *p++;
+				while (p < end && *p != quote && *p != '\n') {
+					if (p[0] == '\\' && p[1] == '\n') {
+						p += 2;
+						physicalLines++;
+						line++;
+						continue;
+					}
+					if (*p == '\\' && p + 1 < end) {
+						*out++ = *p++;
+					}
+					*out++ = *p++;
+				}
+				if (p < end && *p == quote) {
+					*out++ = *p++;
+				}
+			} else {
+				*out++ = *p++;
+			}
+		}
+		if (p < end) {
+			p++;
+		}
+		line++;
+		*out++ = '\0';
+
+		LogicalLine logical = {
+			.text = text,
+			.length = (int32_t)(out - 1 - text),
+			.firstLine = firstLine,
+			.physicalLines = physicalLines,
+			.isDirective = *skipBlanks(text) == '#'
+		};
+		arrput(file->lines, logical);
+	}
+	return 0;
+}
+
+typedef struct {
+	const char* name;
+	size_t nameLength;
+	const char* rest;		// Text after the directive name
+} Directive;
+
+static Directive splitDirective(const char* text) {
+	const char* p = skipBlanks(skipBlanks(text) + 1);
+	const char* nameEnd = p;
+	// A GNU line marker (`# 12 "file"`) has no name, only a number.
+	if (isIdentifierStart(*p)) {
+		while (isIdentifierChar(*nameEnd)) nameEnd++;
+	}
+	return (Directive){ .name = p, .nameLength = (size_t)(nameEnd - p), .rest = nameEnd };
+}
+
+static bool directiveIs(const Directive* directive, const char* name) {
+	return directive->nameLength == strlen(name) && memcmp(directive->name, name, directive->nameLength) == 0;
+}
+
+static bool isBlankLine(const LogicalLine* line) {
+	return *skipBlanks(line->text) == '\0';
+}
+
+// Recognise the `#ifndef X / #define X ... #endif` pattern wrapping an entire
+// file. Re-including such a file while X is defined can be skipped outright.
+static const char* detectIncludeGuard(const CachedFile* file) {
+	size_t count = arrlenu(file->lines);
+	size_t first = 0;
+	while (first < count && isBlankLine(&file->lines[first])) first++;
+	if (first >= count || !file->lines[first].isDirective) {
+		return NULL;
+	}
+	Directive opening = splitDirective(file->lines[first].text);
+	if (!directiveIs(&opening, "ifndef")) {
+		return NULL;
+	}
+	const char* name = skipBlanks(opening.rest);
+	const char* nameEnd = name;
+	while (isIdentifierChar(*nameEnd)) nameEnd++;
+	if (nameEnd == name || *skipBlanks(nameEnd) != '\0') {
+		return NULL;
+	}
+
+	size_t second = first + 1;
+	while (second < count && isBlankLine(&file->lines[second])) second++;
+	if (second >= count || !file->lines[second].isDirective) {
+		return NULL;
+	}
+	Directive define = splitDirective(file->lines[second].text);
+	const char* defined = skipBlanks(define.rest);
+	if (!directiveIs(&define, "define") || strncmp(defined, name, (size_t)(nameEnd - name)) != 0 ||
+		isIdentifierChar(defined[nameEnd - name])) {
+		return NULL;
+	}
+
+	int32_t depth = 0;
+	size_t i = first;
+	for (; i < count; i++) {
+		if (!file->lines[i].isDirective) continue;
+		Directive directive = splitDirective(file->lines[i].text);
+		if (directiveIs(&directive, "if") || directiveIs(&directive, "ifdef") || directiveIs(&directive, "ifndef")) {
+			depth++;
+		} else if (directiveIs(&directive, "endif") && --depth == 0) {
+			break;
+		}
+	}
+	for (i++; i < count; i++) {
+		if (!isBlankLine(&file->lines[i])) {
+			return NULL;
+		}
+	}
+	return internString(name, (size_t)(nameEnd - name));
+}
+
+// Return the cached logical lines for a file, loading it on first use or when
+// it has changed on disk since it was cached.
+static CachedFile* loadCachedFile(Preprocessor* pp, const char* path) {
+	time_t modifiedTime = 0;
+	long long size = 0;
+	bool haveInfo = readFileInfo(path, &modifiedTime, &size);
+
+	FileCacheEntry* entry = hmgetp_null(s_fileCache, path);
+	if (entry) {
+		CachedFile* cached = entry->value;
+		if (!haveInfo || (cached->modifiedTime == modifiedTime && cached->size == size)) {
+			s_fileCacheHits++;
+			return cached;
+		}
+		s_fileCacheBytes -= getCachedFileBytes(cached);
+		free(cached->storage);
+		arrfree(cached->lines);
+		free(cached);
+		(void)hmdel(s_fileCache, path);
+	}
+
+	s_fileCacheMisses++;
+	CompilerPhase phase = switchPhase(pp->context->times, PHASE_READ_FILE);
+	SourceFile source;
+	bool opened = openSourceFile(path, &source);
+	int openError = errno;
+	switchPhase(pp->context->times, phase);
+	if (!opened) {
+		// Fails this translation unit only; a batch carries on with the rest.
+		fatalError(pp, "could not read '%s': %s", path, strerror(openError));
+	}
+	CachedFile* file = (CachedFile*)calloc(1, sizeof(CachedFile));
+	if (file == NULL) {
+		perror("Failed to allocate preprocessor cache entry");
+		exit(EXIT_FAILURE);
+	}
+	file->path = path;
+	file->modifiedTime = modifiedTime;
+	file->size = size;
+	int32_t unterminatedLine = splitLogicalLines(file, source.data, source.length);
+	closeSourceFile(&source);
+	if (unterminatedLine != 0) {
+		free(file->storage);
+		arrfree(file->lines);
+		free(file);
+		fatalErrorAt(pp->context, path, unterminatedLine, "unterminated /* comment");
+	}
+	file->guardMacro = detectIncludeGuard(file);
+	hmput(s_fileCache, path, file);
+	s_fileCacheBytes += getCachedFileBytes(file);
+	return file;
+}
+
+void destroyPreprocessorCache(void) {
+	for (ptrdiff_t i = 0; i < hmlen(s_fileCache); i++) {
+		CachedFile* file = s_fileCache[i].value;
+		free(file->storage);
+		arrfree(file->lines);
+		free(file);
+	}
+	hmfree(s_fileCache);
+	s_fileCacheBytes = 0;
+}
+
+void getPreprocessorCacheStats(size_t* hits, size_t* misses) {
+	*hits = s_fileCacheHits;
+	*misses = s_fileCacheMisses;
+}
+
+size_t getPreprocessorCacheBytes(void) {
+	return s_fileCacheBytes + (size_t)hmlen(s_fileCache) * sizeof(FileCacheEntry);
+}
+
+//
+// Macros
+//
+
+static Macro* findMacro(Preprocessor* pp, const char* name) {
+	MacroEntry* entry = hmgetp_null(pp->macros, name);
+	return entry ? &entry->value : NULL;
+}
+
+// Handle the text of a #define after the directive name, e.g. `MAX(a, b) ((a) > (b) ? (a) : (b))`.
+static void defineMacro(Preprocessor* pp, const char* text) {
+	const char* p = skipBlanks(text);
+	if (!isIdentifierStart(*p)) {
+		fatalError(pp, "macro name must be an identifier");
+	}
+	const char* nameEnd = p;
+	while (isIdentifierChar(*nameEnd)) nameEnd++;
+
+	Macro macro = { .name = internString(p, (size_t)(nameEnd - p)) };
+	p = nameEnd;
+	// Only a parenthesis directly after the name makes the macro function-like.
+	if (*p == '(') {
+		macro.functionLike = true;
+		p++;
+		for (;;) {
+			p = skipBlanks(p);
+			if (*p == ')') {
+				p++;
+				break;
+			}
+			if (p[0] == '.' && p[1] == '.' && p[2] == '.') {
+				macro.variadic = true;
+				p = skipBlanks(p + 3);
+				if (*p != ')') {
+					fatalError(pp, "missing ')' after '...' in macro parameter list");
+				}
+				p++;
+				break;
+			}
+			if (!isIdentifierStart(*p)) {
+				fatalError(pp, "expected parameter name in definition of '%s'", macro.name);
+			}
+			const char* paramEnd = p;
+			while (isIdentifierChar(*paramEnd)) paramEnd++;
+			arrput(macro.params, internString(p, (size_t)(paramEnd - p)));
+			p = skipBlanks(paramEnd);
+			if (*p == ',') {
+				p++;
+			} else if (*p != ')') {
+				fatalError(pp, "expected ',' or ')' in parameter list of '%s'", macro.name);
+			}
+		}
+	}
+
+	p = skipBlanks(p);
+	const char* bodyEnd = p + strlen(p);
+	while (bodyEnd > p && isBlank(bodyEnd[-1])) bodyEnd--;
+	macro.body = arenaStrndup(&pp->storage, p, (size_t)(bodyEnd - p));
+
+	Macro* existing = findMacro(pp, macro.name);
+	if (existing) {
+		arrfree(existing->params);
+	}
+	hmput(pp->macros, macro.name, macro);
+}
+
+static void undefineMacro(Preprocessor* pp, const char* name) {
+	Macro* existing = findMacro(pp, name);
+	if (existing) {
+		arrfree(existing->params);
+		(void)hmdel(pp->macros, name);
+	}
+}
+
+// Index of a parameter in the macro's parameter list. __VA_ARGS__ maps to the
+// slot after the named parameters.
+static ptrdiff_t findParameter(const Preprocessor* pp, const Macro* macro, const char* name) {
+	for (ptrdiff_t i = 0; i < arrlen(macro->params); i++) {
+		if (macro->params[i] == name) {
+			return i;
+		}
+	}
+	if (macro->variadic && name == pp->vaArgsName) {
+		return arrlen(macro->params);
+	}
+	return -1;
+}
+
+// Append an argument with surrounding whitespace trimmed and newlines turned
+// into spaces, so an invocation spread over several lines expands onto one.
+static void pushArgument(TextBuffer** args, const char* start, const char* end) {
+	while (start < end && (isBlank(*start) || *start == '\n')) start++;
+	while (end > start && (isBlank(end[-1]) || end[-1] == '\n')) end--;
+	TextBuffer arg = { 0 };
+	appendText(&arg, start, (size_t)(end - start));
+	for (size_t i = 0; i < arg.length; i++) {
+		if (arg.data[i] == '\n') arg.data[i] = ' ';
+	}
+	arrput(*args, arg);
+}
+
+// Split the arguments of a function-like macro invocation. `p` points just
+// past the opening parenthesis. Returns a pointer to the closing parenthesis.
+static const char* collectArguments(Preprocessor* pp, const Macro* macro, const char* p, const char* end, TextBuffer** args) {
+	int32_t depth = 0;
+	const char* argStart = p;
+	for (;;) {
+		if (p >= end) {
+			for (ptrdiff_t i = 0; i < arrlen(*args); i++) {
+				freeText(&(*args)[i]);
+			}
+			arrfree(*args);
+			fatalError(pp, "unterminated argument list invoking macro '%s'", macro->name);
+		}
+		char c = *p;
+		if (c == '"' || c == '\'') {
+			p = skipLiteral(p, end);
+			continue;
+		}
+		if (c == '(') {
+			depth++;
+		} else if (c == ')') {
+			if (depth == 0) {
+				pushArgument(args, argStart, p);
+				return p;
+			}
+			depth--;
+		} else if (c == ',' && depth == 0 && !(macro->variadic && arrlen(*args) >= arrlen(macro->params))) {
+			// Commas inside the variadic part stay in __VA_ARGS__.
+			pushArgument(args, argStart, p);
+			argStart = p + 1;
+		}
+		p++;
+	}
+}
+
+// Append an argument as a string literal for the # operator.
+static void stringifyArgument(const TextBuffer* arg, TextBuffer* out) {
+	appendChar(out, '"');
+	bool pendingSpace = false;
+	char quote = 0;			// Quote character of the literal being copied, if any
+	for (size_t i = 0; i < arg->length; i++) {
+		char c = arg->data[i];
+		if (quote == 0 && isBlank(c)) {
+			pendingSpace = true;
+			continue;
+		}
+		if (pendingSpace) {
+			appendChar(out, ' ');
+			pendingSpace = false;
+		}
+		// Quotes and backslashes inside literals must survive the extra level of quoting.
+		if (c == '"' || (c == '\\' && quote != 0)) {
+			appendChar(out, '\\');
+		}
+		appendChar(out, c);
+		if (quote != 0 && c == '\\' && i + 1 < arg->length) {
+			appendChar(out, arg->data[++i]);
+		} else if (quote == 0 && (c == '"' || c == '\'')) {
+			quote = c;
+		} else if (c == quote) {
+			quote = 0;
+		}
+	}
+	appendChar(out, '"');
+}
+
+static bool nextIsPaste(const char* p) {
+	p = skipBlanks(p);
+	return p[0] == '#' && p[1] == '#';
+}
+
+// Build a macro's replacement list with parameters substituted and the # and
+// ## operators applied. Arguments are macro-expanded first unless they are
+// operands of # or ##.
+static void substituteMacro(Preprocessor* pp, const Macro* macro, const TextBuffer* args, ptrdiff_t argCount, TextBuffer* out) {
+	static const TextBuffer emptyArgument = { .data = (char*)"", .length = 0 };
+	const char* p = macro->body;
+	const char* end = p + strlen(p);
+	bool afterPaste = false;
+
+	while (p < end) {
+		char c = *p;
+		if (c == '#' && p[1] == '#') {
+			while (out->length > 0 && isBlank(out->data[out->length - 1])) {
+				out->data[--out->length] = '\0';
+			}
+			p = skipBlanks(p + 2);
+			afterPaste = true;
+			continue;
+		}
+		if (c == '#' && macro->functionLike) {
+			const char* name = skipBlanks(p + 1);
+			const char* nameEnd = scanIdentifierEnd(name, end);
+			ptrdiff_t index = nameEnd > name ? findParameter(pp, macro, internString(name, (size_t)(nameEnd - name))) : -1;
+			if (index < 0) {
+				fatalError(pp, "'#' is not followed by a macro parameter in '%s'", macro->name);
+			}
+			stringifyArgument(index < argCount ? &args[index] : &emptyArgument, out);
+			p = nameEnd;
+			afterPaste = false;
+			continue;
+		}
+		if (isIdentifierStart(c)) {
+			const char* nameEnd = scanIdentifierEnd(p, end);
+			ptrdiff_t index = findParameter(pp, macro, internString(p, (size_t)(nameEnd - p)));
+			if (index < 0) {
+				appendText(out, p, (size_t)(nameEnd - p));
+			} else {
+				const TextBuffer* arg = index < argCount ? &args[index] : &emptyArgument;
+				if (afterPaste || nextIsPaste(nameEnd)) {
+					appendText(out, arg->data, arg->length);
+				} else {
+					expandText(pp, arg->data, arg->length, out, false);
+				}
+			}
+			p = nameEnd;
+			afterPaste = false;
+			continue;
+		}
+		if (c == '"' || c == '\'') {
+			const char* literalEnd = skipLiteral(p, end);
+			appendText(out, p, (size_t)(literalEnd - p));
+			p = literalEnd;
+			afterPaste = false;
+			continue;
+		}
+		if (isDigitChar(c)) {
+			const char* numberEnd = skipNumber(p, end);
+			appendText(out, p, (size_t)(numberEnd - p));
+			p = numberEnd;
+			afterPaste = false;
+			continue;
+		}
+		appendChar(out, c);
+		p++;
+		if (!isBlank(c)) {
+			afterPaste = false;
+		}
+	}
+}
+
+// Find the parenthesis closing the one at `open`, or NULL if it is not in the text.
+static const char* findClosingParen(const char* open, const char* end) {
+	int32_t depth = 0;
+	for (const char* p = open; p < end;) {
+		if (*p == '"' || *p == '\'') {
+			p = skipLiteral(p, end);
+			continue;
+		}
+		if (*p == '(') {
+			depth++;
+		} else if (*p == ')' && --depth == 0) {
+			return p;
+		}
+		p++;
+	}
+	return NULL;
+}
+
+// Whether the replacement ends with the name of another function-like macro,
+// as in `#define CALL f` where f(x) is itself a macro.
+static bool endsWithFunctionLikeMacro(Preprocessor* pp, const Macro* macro, const TextBuffer* replaced) {
+	const char* end = replaced->data + replaced->length;
+	while (end > replaced->data && isBlank(end[-1])) end--;
+	const char* name = end;
+	while (name > replaced->data && isIdentifierChar(name[-1])) name--;
+	if (name == end || !isIdentifierStart(*name)) {
+		return false;
+	}
+	const Macro* last = findMacro(pp, internString(name, (size_t)(end - name)));
+	return last && last != macro && last->functionLike && !last->disabled;
+}
+
+// Replace one macro invocation and rescan the result with the macro disabled
+// so it cannot expand recursively. `rest` is the text following the
+// invocation; if the replacement ends in a function-like macro name, that
+// macro's argument list is taken from it.
+// Returns: the position in `rest` where scanning continues.
+static const char* expandMacro(Preprocessor* pp, Macro* macro, TextBuffer* args, ptrdiff_t argCount, const char* rest, const char* end, TextBuffer* out) {
+	if (macro->functionLike) {
+		ptrdiff_t paramCount = arrlen(macro->params);
+		if (argCount == 1 && args[0].length == 0 && paramCount == 0) {
+			argCount = 0;
+		}
+		bool countOk = macro->variadic ? (argCount >= paramCount && argCount <= paramCount + 1) : argCount == paramCount;
+		if (!countOk) {
+			fatalError(pp, "macro '%s' expects %td argument(s), but %td given", macro->name, paramCount, argCount);
+		}
+	}
+
+	TextBuffer* replaced = pushScratch(pp);
+	substituteMacro(pp, macro, args, argCount, replaced);
+	if (endsWithFunctionLikeMacro(pp, macro, replaced)) {
+		const char* open = rest;
+		while (open < end && (isBlank(*open) || *open == '\n')) open++;
+		const char* close = (open < end && *open == '(') ? findClosingParen(open, end) : NULL;
+		if (close) {
+			appendText(replaced, open, (size_t)(close + 1 - open));
+			rest = close + 1;
+		}
+	}
+	macro->disabled = true;
+	expandText(pp, replaced->data ? replaced->data : "", replaced->length, out, false);
+	macro->disabled = false;
+	popScratch(pp);
+	return rest;
+}
+
+//
+// expandText
+// ----------
+// Copy text to the output with every macro invocation replaced. When
+// trackLines is set the text is top-level source and pp->line follows the
+// newlines in it; an invocation whose arguments span several lines is
+// followed by the newlines it swallowed so later lines keep their numbers.
+//
+static void expandText(Preprocessor* pp, const char* text, size_t length, TextBuffer* out, bool trackLines) {
+	const char* p = text;
+	const char* end = text + length;
+	while (p < end) {
+		char c = *p;
+		if (isIdentifierStart(c)) {
+			const char* nameEnd = scanIdentifierEnd(p, end);
+			const char* name = internString(p, (size_t)(nameEnd - p));
+			Macro* macro = findMacro(pp, name);
+			if (macro == NULL || macro->disabled) {
+				if (name == pp->lineName) {
+					char number[16];
+					int numberLength = snprintf(number, sizeof(number), "%d", pp->line);
+					appendText(out, number, (size_t)numberLength);
+				} else if (name == pp->fileName) {
+					appendChar(out, '"');
+					appendText(out, pp->file, strlen(pp->file));
+					appendChar(out, '"');
+				} else {
+					appendText(out, p, (size_t)(nameEnd - p));
+				}
+				p = nameEnd;
+				continue;
+			}
+			if (!macro->functionLike) {
+				p = expandMacro(pp, macro, NULL, 0, nameEnd, end, out);
+				continue;
+			}
+
+			// A function-like macro name not followed by '(' is left alone.
+			const char* open = nameEnd;
+			while (open < end && (isBlank(*open) || *open == '\n')) open++;
+			if (open >= end || *open != '(') {
+				appendText(out, p, (size_t)(nameEnd - p));
+				p = nameEnd;
+				continue;
+			}
+			TextBuffer* args = NULL;
+			const char* close = collectArguments(pp, macro, open + 1, end, &args);
+			arrput(pp->argumentLists, args);
+			const char* next = expandMacro(pp, macro, args, arrlen(args), close + 1, end, out);
+			(void)arrpop(pp->argumentLists);
+			for (ptrdiff_t i = 0; i < arrlen(args); i++) {
+				freeText(&args[i]);
+			}
+			arrfree(args);
+			if (trackLines) {
+				for (const char* q = p; q < next; q++) {
+					if (*q == '\n') {
+						appendChar(out, '\n');
+						pp->line++;
+					}
+				}
+			}
+			p = next;
+			continue;
+		}
+		if (isDigitChar(c) || (c == '.' && p + 1 < end && isDigitChar(p[1]))) {
+			const char* numberEnd = skipNumber(p, end);
+			appendText(out, p, (size_t)(numberEnd - p));
+			p = numberEnd;
+			continue;
+		}
+		if (c == '"' || c == '\'') {
+			const char* literalEnd = skipLiteral(p, end);
+			appendText(out, p, (size_t)(literalEnd - p));
+			p = literalEnd;
+			continue;
+		}
+		if (c == '\n' && trackLines) {
+			pp->line++;
+		}
+		appendChar(out, c);
+		p++;
+	}
+}
+
+//
+// #if expressions
+//
+
+typedef struct {
+	Preprocessor* pp;
+	const char* p;
+	int32_t skipDepth;		// Non-zero inside an operand that short-circuiting discards
+} ExpressionParser;
+
+// Every #if value is an intmax_t or a uintmax_t. Both are held as the bits of
+// a uintmax_t, so arithmetic wraps rather than overflowing.
+typedef struct {
+	uintmax_t bits;
+	bool isUnsigned;
+} ExpressionValue;
+
+static ExpressionValue parseConditional(ExpressionParser* parser);
+
+static ExpressionValue makeSigned(intmax_t value) {
+	return (ExpressionValue){ .bits = (uintmax_t)value };
+}
+
+static bool isTrue(ExpressionValue value) {
+	return value.bits != 0;
+}
+
+static void skipExpressionBlanks(ExpressionParser* parser) {
+	parser->p = skipBlanks(parser->p);
+}
+
+static ExpressionValue parseCharacterConstant(ExpressionParser* parser) {
+	const char* p = parser->p + 1;
+	intmax_t value = 0;
+	if (*p == '\\') {
+		p++;
+		switch (*p) {
+			case 'n': value = '\n'; p++; break;
+			case 't': value = '\t'; p++; break;
+			case 'r': value = '\r'; p++; break;
+			case 'a': value = '\a'; p++; break;
+			case 'b': value = '\b'; p++; break;
+			case 'f': value = '\f'; p++; break;
+			case 'v': value = '\v'; p++; break;
+			case 'x':
+				value = (intmax_t)strtol(p + 1, (char**)&p, 16);
+				break;
+			default:
+				if (*p >= '0' && *p <= '7') {
+					value = (intmax_t)strtol(p, (char**)&p, 8);
+				} else {
+					value = (unsigned char)*p++;
+				}
+				break;
+		}
+	} else if (*p && *p != '\'') {
+		value = (unsigned char)*p++;
+	}
+	if (*p != '\'') {
+		fatalError(parser->pp, "invalid character constant in preprocessor expression");
+	}
+	parser->p = p + 1;
+	return makeSigned(value);
+}
+
+static ExpressionValue parsePrimary(ExpressionParser* parser) {
+	skipExpressionBlanks(parser);
+	char c = *parser->p;
+	if (c == '(') {
+		parser->p++;
+		ExpressionValue value = parseConditional(parser);
+		skipExpressionBlanks(parser);
+		if (*parser->p != ')') {
+			fatalError(parser->pp, "expected ')' in preprocessor expression");
+		}
+		parser->p++;
+		return value;
+	}
+	if (isDigitChar(c)) {
+		char* numberEnd = NULL;
+		ExpressionValue value = { .bits = strtoumax(parser->p, &numberEnd, 0) };
+		// A u suffix, or a value only uintmax_t can hold, makes it unsigned.
+		value.isUnsigned = value.bits > (uintmax_t)INTMAX_MAX;
+		while (*numberEnd == 'u' || *numberEnd == 'U' || *numberEnd == 'l' || *numberEnd == 'L') {
+			value.isUnsigned |= *numberEnd == 'u' || *numberEnd == 'U';
+			numberEnd++;
+		}
+		if (isIdentifierChar(*numberEnd) || *numberEnd == '.') {
+			fatalError(parser->pp, "invalid integer constant in preprocessor expression");
+		}
+		parser->p = numberEnd;
+		return value;
+	}
+	if (c == '\'') {
+		return parseCharacterConstant(parser);
+	}
+	if (isIdentifierStart(c)) {
+		// Identifiers left after macro expansion evaluate to zero.
+		while (isIdentifierChar(*parser->p)) parser->p++;
+		return makeSigned(0);
+	}
+	if (c == '\0') {
+		fatalError(parser->pp, "expected value in preprocessor expression");
+	}
+	fatalError(parser->pp, "unexpected '%c' in preprocessor expression", c);
+	return makeSigned(0);
+}
+
+static ExpressionValue parseUnary(ExpressionParser* parser) {
+	skipExpressionBlanks(parser);
+	ExpressionValue value;
+	switch (*parser->p) {
+		case '+':
+			parser->p++;
+			return parseUnary(parser);
+		case '-':
+			parser->p++;
+			value = parseUnary(parser);
+			value.bits = 0 - value.bits;
+			return value;
+		case '~':
+			parser->p++;
+			value = parseUnary(parser);
+			value.bits = ~value.bits;
+			return value;
+		case '!':
+			parser->p++;
+			return makeSigned(!isTrue(parseUnary(parser)));
+		default:
+			return parsePrimary(parser);
+	}
+}
+
+// Precedence of the binary operator at p, higher binds tighter, or 0 when
+// there is none. The operator's length is returned through `length`.
+static int getBinaryPrecedence(const char* p, size_t* length) {
+	*length = 1;
+	switch (p[0]) {
+		case '*': case '/': case '%':
+			return 10;
+		case '+': case '-':
+			return 9;
+		case '<':
+		case '>':
+			if (p[1] == p[0]) {
+				*length = 2;
+				return 8;
+			}
+			if (p[1] == '=') {
+				*length = 2;
+			}
+			return 7;
+		case '=':
+			if (p[1] != '=') return 0;
+			*length = 2;
+			return 6;
+		case '!':
+			if (p[1] != '=') return 0;
+			*length = 2;
+			return 6;
+		case '&':
+			if (p[1] == '&') {
+				*length = 2;
+				return 2;
+			}
+			return 5;
+		case '^':
+			return 4;
+		case '|':
+			if (p[1] == '|') {
+				*length = 2;
+				return 1;
+			}
+			return 3;
+		default:
+			return 0;
+	}
+}
+
+//
+// applyBinary
+// -----------
+// Apply a binary operator with the usual arithmetic conversions: if either
+// operand is unsigned both are, and so is the result. Comparisons and logical
+// operators give a signed 0 or 1; a shift has the type of its left operand.
+//
+static ExpressionValue applyBinary(ExpressionParser* parser, char op, char op2, size_t length, ExpressionValue left, ExpressionValue right) {
+	bool isUnsigned = left.isUnsigned || right.isUnsigned;
+	uintmax_t a = left.bits;
+	uintmax_t b = right.bits;
+	intmax_t sa = (intmax_t)a;
+	intmax_t sb = (intmax_t)b;
+	ExpressionValue result = { .isUnsigned = isUnsigned };
+	switch (op) {
+		case '*': result.bits = a * b; break;
+		case '/':
+		case '%':
+			if (b == 0) {
+				if (parser->skipDepth == 0) {
+					fatalError(parser->pp, "division by zero in preprocessor expression");
+				}
+				result.bits = 0;
+			} else if (isUnsigned) {
+				result.bits = op == '/' ? a / b : a % b;
+			} else if (sb == -1) {
+				// INTMAX_MIN / -1 would trap; it wraps like the other operators.
+				result.bits = op == '/' ? 0 - a : 0;
+			} else {
+				result.bits = (uintmax_t)(op == '/' ? sa / sb : sa % sb);
+			}
+			break;
+		case '+': result.bits = a + b; break;
+		case '-': result.bits = a - b; break;
+		case '<':
+		case '>':
+			if (length == 2 && op2 == op) {
+				result.isUnsigned = left.isUnsigned;
+				uintmax_t count = b < sizeof(uintmax_t) * 8 ? b : sizeof(uintmax_t) * 8 - 1;
+				if (op == '<') {
+					result.bits = a << count;
+				} else if (left.isUnsigned) {
+					result.bits = a >> count;
+				} else {
+					result.bits = (uintmax_t)(sa >> count);
+				}
+				break;
+			}
+			bool less = isUnsigned ? a < b : sa < sb;
+			bool equal = a == b;
+			bool greater = !less && !equal;
+			if (op == '<') {
+				result = makeSigned(length == 2 ? (less || equal) : less);
+			} else {
+				result = makeSigned(length == 2 ? (greater || equal) : greater);
+			}
+			break;
+		case '=': result = makeSigned(a == b); break;
+		case '!': result = makeSigned(a != b); break;
+		case '&':
+			if (length == 2) {
+				result = makeSigned(a && b);
+			} else {
+				result.bits = a & b;
+			}
+			break;
+		case '^': result.bits = a ^ b; break;
+		case '|':
+			if (length == 2) {
+				result = makeSigned(a || b);
+			} else {
+				result.bits = a | b;
+			}
+			break;
+	}
+	return result;
+}
+
+static ExpressionValue parseBinary(ExpressionParser* parser, int minPrec) {
+	ExpressionValue left = parseUnary(parser);
+	for (;;) {
+		skipExpressionBlanks(parser);
+		size_t length;
+		int prec = getBinaryPrecedence(parser->p, &length);
+		if (prec == 0 || prec < minPrec) {
+			return left;
+		}
+		char op = parser->p[0];
+		char op2 = parser->p[1];
+		parser->p += length;
+
+		bool shortCircuit = (prec == 2 && !isTrue(left)) || (prec == 1 && isTrue(left));
+		parser->skipDepth += shortCircuit;
+		ExpressionValue right = parseBinary(parser, prec + 1);
+		parser->skipDepth -= shortCircuit;
+		left = applyBinary(parser, op, op2, length, left, right);
+	}
+}
+
+static ExpressionValue parseConditional(ExpressionParser* parser) {
+	ExpressionValue condition = parseBinary(parser, 1);
+	skipExpressionBlanks(parser);
+	if (*parser->p != '?') {
+		return condition;
+	}
+	parser->p++;
+	bool taken = isTrue(condition);
+	parser->skipDepth += !taken;
+	ExpressionValue whenTrue = parseConditional(parser);
+	parser->skipDepth -= !taken;
+	skipExpressionBlanks(parser);
+	if (*parser->p != ':') {
+		fatalError(parser->pp, "expected ':' in preprocessor expression");
+	}
+	parser->p++;
+	parser->skipDepth += taken;
+	ExpressionValue whenFalse = parseConditional(parser);
+	parser->skipDepth -= taken;
+	// The result has the common type of both branches.
+	ExpressionValue result = taken ? whenTrue : whenFalse;
+	result.isUnsigned = whenTrue.isUnsigned || whenFalse.isUnsigned;
+	return result;
+}
+
+static const char* findIncludeFile(Preprocessor* pp, const char* name, size_t length, bool quoted, const char* includer, char* candidate);
+
+// Replace `defined X`, `defined(X)` and `__has_include(...)` with 0 or 1.
+// This must happen before macro expansion so the operands are not expanded.
+static void replaceDefinedOperators(Preprocessor* pp, const char* text, TextBuffer* out) {
+	const char* p = text;
+	const char* end = text + strlen(text);
+	while (p < end) {
+		if (*p == '"' || *p == '\'') {
+			const char* literalEnd = skipLiteral(p, end);
+			appendText(out, p, (size_t)(literalEnd - p));
+			p = literalEnd;
+			continue;
+		}
+		if (!isIdentifierStart(*p)) {
+			appendChar(out, *p++);
+			continue;
+		}
+		const char* wordEnd = scanIdentifierEnd(p, end);
+		size_t wordLength = (size_t)(wordEnd - p);
+		if (wordLength == 7 && memcmp(p, "defined", 7) == 0) {
+			const char* q = skipBlanks(wordEnd);
+			bool parenthesized = *q == '(';
+			if (parenthesized) q = skipBlanks(q + 1);
+			const char* nameEnd = scanIdentifierEnd(q, end);
+			if (nameEnd == q) {
+				fatalError(pp, "operator 'defined' requires an identifier");
+			}
+			bool isDefined = findMacro(pp, internString(q, (size_t)(nameEnd - q))) != NULL;
+			q = skipBlanks(nameEnd);
+			if (parenthesized) {
+				if (*q != ')') {
+					fatalError(pp, "missing ')' after 'defined'");
+				}
+				q++;
+			}
+			appendChar(out, isDefined ? '1' : '0');
+			p = q;
+			continue;
+		}
+		if (wordLength == 13 && memcmp(p, "__has_include", 13) == 0) {
+			const char* q = skipBlanks(wordEnd);
+			if (*q != '(') {
+				fatalError(pp, "missing '(' after '__has_include'");
+			}
+			q = skipBlanks(q + 1);
+			char close = *q == '<' ? '>' : '"';
+			if (*q != '<' && *q != '"') {
+				fatalError(pp, "__has_include expects \"FILENAME\" or <FILENAME>");
+			}
+			const char* nameStart = q + 1;
+			const char* nameEnd = strchr(nameStart, close);
+			if (nameEnd == NULL) {
+				fatalError(pp, "missing terminating %c character", close);
+			}
+			q = skipBlanks(nameEnd + 1);
+			if (*q != ')') {
+				fatalError(pp, "missing ')' after '__has_include'");
+			}
+			char candidate[PP_MAX_PATH];
+			bool found = findIncludeFile(pp, nameStart, (size_t)(nameEnd - nameStart), close == '"', pp->path, candidate) != NULL;
+			appendChar(out, found ? '1' : '0');
+			p = q + 1;
+			continue;
+		}
+		appendText(out, p, wordLength);
+		p = wordEnd;
+	}
+}
+
+// Evaluate the controlling expression of #if or #elif.
+static bool evaluateCondition(Preprocessor* pp, const char* text) {
+	TextBuffer* replaced = pushScratch(pp);
+	TextBuffer* expanded = pushScratch(pp);
+	replaceDefinedOperators(pp, text, replaced);
+	expandText(pp, replaced->data ? replaced->data : "", replaced->length, expanded, false);
+
+	ExpressionParser parser = { .pp = pp, .p = expanded->data ? expanded->data : "" };
+	skipExpressionBlanks(&parser);
+	if (*parser.p == '\0') {
+		fatalError(pp, "#if with no expression");
+	}
+	ExpressionValue value = parseConditional(&parser);
+	skipExpressionBlanks(&parser);
+	if (*parser.p != '\0') {
+		fatalError(pp, "unexpected '%c' in preprocessor expression", *parser.p);
+	}
+	popScratch(pp);
+	popScratch(pp);
+	return isTrue(value);
+}
+
+//
+// #include
+//
+
+static bool fileExists(const char* path) {
+	struct stat info;
+	return stat(path, &info) == 0 && (info.st_mode & S_IFMT) == S_IFREG;
+}
+
+static bool isAbsolutePath(const char* path) {
+#ifdef _WIN32
+	return path[0] == '/' || path[0] == '\\' || (path[0] && path[1] == ':');
+#else
+	return path[0] == '/';
+#endif
+}
+
+// Length of the directory part of a path, including the trailing separator.
+static size_t directoryLength(const char* path) {
+	size_t length = strlen(path);
+	while (length > 0 && path[length - 1] != '/' && path[length - 1] != '\\') {
+		length--;
+	}
+	return length;
+}
+
+static bool tryIncludePath(const char* directory, size_t directoryLength, const char* name, size_t length, char* candidate) {
+	const char* separator = (directoryLength > 0 && directory[directoryLength - 1] != '/' && directory[directoryLength - 1] != '\\') ? "/" : "";
+	int written = snprintf(candidate, PP_MAX_PATH, "%.*s%s%.*s", (int)directoryLength, directory, separator, (int)length, name);
+	return written > 0 && written < PP_MAX_PATH && fileExists(candidate);
+}
+
+// Search for an included file: the includer's directory first for quoted
+// names, then each -I directory, then the system directories. On success the
+// path as found is written to candidate and returned.
+static const char* findIncludeFile(Preprocessor* pp, const char* name, size_t length, bool quoted, const char* includer, char* candidate) {
+	if (isAbsolutePath(name)) {
+		int written = snprintf(candidate, PP_MAX_PATH, "%.*s", (int)length, name);
+		return (written > 0 && written < PP_MAX_PATH && fileExists(candidate)) ? candidate : NULL;
+	}
+	if (quoted && tryIncludePath(includer, directoryLength(includer), name, length, candidate)) {
+		return candidate;
+	}
+	for (ptrdiff_t i = 0; i < arrlen(pp->options->includePaths); i++) {
+		const char* directory = pp->options->includePaths[i];
+		if (tryIncludePath(directory, strlen(directory), name, length, candidate)) {
+			return candidate;
+		}
+	}
+	for (ptrdiff_t i = 0; i < arrlen(pp->systemIncludePaths); i++) {
+		const char* directory = pp->systemIncludePaths[i];
+		if (tryIncludePath(directory, strlen(directory), name, length, candidate)) {
+			return candidate;
+		}
+	}
+	return NULL;
+}
+
+static void emitLineMarker(Preprocessor* pp, int32_t line, const char* file) {
+	char marker[PP_MAX_PATH + 32];
+	int length = snprintf(marker, sizeof(marker), "# %d \"%s\"\n", line, file);
+	appendText(&pp->output, marker, (size_t)length < sizeof(marker) ? (size_t)length : sizeof(marker) - 1);
+}
+
+static void processFile(Preprocessor* pp, CachedFile* file, const char* displayName);
+
+// Handle #include. resumeLine is the line following the directive, where
+// numbering continues once the included file has been emitted.
+// Returns: false when the file was skipped because of its include guard or
+// #pragma once.
+static bool includeFile(Preprocessor* pp, const char* text, int32_t resumeLine) {
+	const char* p = skipBlanks(text);
+	TextBuffer* expanded = pushScratch(pp);
+	if (*p != '"' && *p != '<') {
+		// Computed include: the operand must expand to one of the two forms.
+		expandText(pp, p, strlen(p), expanded, false);
+		p = skipBlanks(expanded->data ? expanded->data : "");
+	}
+	if (*p != '"' && *p != '<') {
+		fatalError(pp, "#include expects \"FILENAME\" or <FILENAME>");
+	}
+	char close = *p == '<' ? '>' : '"';
+	const char* nameStart = p + 1;
+	const char* nameEnd = strchr(nameStart, close);
+	if (nameEnd == NULL) {
+		fatalError(pp, "missing terminating %c character", close);
+	}
+
+	char candidate[PP_MAX_PATH];
+	const char* found = findIncludeFile(pp, nameStart, (size_t)(nameEnd - nameStart), close == '"', pp->path, candidate);
+	if (found == NULL) {
+		fatalError(pp, "'%.*s' file not found", (int)(nameEnd - nameStart), nameStart);
+	}
+	popScratch(pp);
+
+	CachedFile* file = loadCachedFile(pp, canonicalPath(found));
+	if ((file->guardMacro && findMacro(pp, file->guardMacro)) ||
+		(file->pragmaOnce && hmget(pp->onceIncluded, file->path))) {
+		return false;
+	}
+	if (pp->includeDepth >= PP_MAX_INCLUDE_DEPTH) {
+		fatalError(pp, "#include nested too deeply");
+	}
+
+	const char* displayName = internCString(found);
+	const char* includer = pp->file;
+	emitLineMarker(pp, 1, displayName);
+	pp->includeDepth++;
+	processFile(pp, file, displayName);
+	pp->includeDepth--;
+	emitLineMarker(pp, resumeLine + pp->lineDelta, includer);
+	return true;
+}
+
+// Expand and emit the pending run of ordinary text lines.
+static void flushText(Preprocessor* pp, TextBuffer* text, int32_t firstLine) {
+	if (text->length == 0) {
+		return;
+	}
+	int32_t directiveLine = pp->line;
+	pp->line = firstLine;
+	expandText(pp, text->data, text->length, &pp->output, true);
+	pp->line = directiveLine;
+	text->length = 0;
+	text->data[0] = '\0';
+}
+
+//
+// processFile
+// -----------
+// Run every logical line of a file through the preprocessor. Consecutive text
+// lines are expanded together so a macro invocation may span several lines.
+// Directive and skipped lines are replaced by blank lines.
+//
+static void processFile(Preprocessor* pp, CachedFile* file, const char* displayName) {
+	const char* savedFile = pp->file;
+	const char* savedPath = pp->path;
+	int32_t savedLine = pp->line;
+	int32_t savedDelta = pp->lineDelta;
+	pp->file = displayName;
+	pp->path = displayName;
+	pp->lineDelta = 0;
+
+	size_t conditionalBase = arrlenu(pp->conditionals);
+	bool active = true;
+	TextBuffer* text = pushScratch(pp);
+	int32_t textLine = 0;
+
+	for (size_t i = 0; i < arrlenu(file->lines); i++) {
+		const LogicalLine* line = &file->lines[i];
+		if (!line->isDirective) {
+			if (!active) {
+				appendNewlines(&pp->output, line->physicalLines);
+				continue;
+			}
+			if (text->length == 0) {
+				textLine = line->firstLine;
+			}
+			appendText(text, line->text, (size_t)line->length);
+			appendNewlines(text, line->physicalLines);
+			continue;
+		}
+
+		pp->line = line->firstLine + pp->lineDelta;
+		flushText(pp, text, textLine + pp->lineDelta);
+
+		Directive directive = splitDirective(line->text);
+		if (directiveIs(&directive, "if") || directiveIs(&directive, "ifdef") || directiveIs(&directive, "ifndef")) {
+			Conditional conditional = { .wasActive = active };
+			if (active) {
+				if (directiveIs(&directive, "if")) {
+					conditional.taken = evaluateCondition(pp, directive.rest);
+				} else {
+					const char* name = skipBlanks(directive.rest);
+					const char* nameEnd = name;
+					while (isIdentifierChar(*nameEnd)) nameEnd++;
+					if (nameEnd == name) {
+						fatalError(pp, "macro name missing in #%.*s", (int)directive.nameLength, directive.name);
+					}
+					bool isDefined = findMacro(pp, internString(name, (size_t)(nameEnd - name))) != NULL;
+					conditional.taken = directiveIs(&directive, "ifdef") ? isDefined : !isDefined;
+				}
+			}
+			active = active && conditional.taken;
+			arrput(pp->conditionals, conditional);
+		} else if (directiveIs(&directive, "elif")) {
+			if (arrlenu(pp->conditionals) == conditionalBase) {
+				fatalError(pp, "#elif without #if");
+			}
+			Conditional* conditional = &arrlast(pp->conditionals);
+			if (conditional->sawElse) {
+				fatalError(pp, "#elif after #else");
+			}
+			if (!conditional->wasActive || conditional->taken) {
+				active = false;
+			} else {
+				active = evaluateCondition(pp, directive.rest);
+				conditional->taken = active;
+			}
+		} else if (directiveIs(&directive, "else")) {
+			if (arrlenu(pp->conditionals) == conditionalBase) {
+				fatalError(pp, "#else without #if");
+			}
+			Conditional* conditional = &arrlast(pp->conditionals);
+			if (conditional->sawElse) {
+				fatalError(pp, "#else after #else");
+			}
+			conditional->sawElse = true;
+			active = conditional->wasActive && !conditional->taken;
+			conditional->taken = true;
+		} else if (directiveIs(&directive, "endif")) {
+			if (arrlenu(pp->conditionals) == conditionalBase) {
+				fatalError(pp, "#endif without #if");
+			}
+			active = arrpop(pp->conditionals).wasActive;
+		} else if (!active) {
+			// Everything else in a skipped group is ignored.
+		} else if (directiveIs(&directive, "include") || directiveIs(&directive, "include_next")) {
+			if (includeFile(pp, directive.rest, line->firstLine + line->physicalLines)) {
+				continue;
+			}
+		} else if (directiveIs(&directive, "define")) {
+			defineMacro(pp, directive.rest);
+		} else if (directiveIs(&directive, "undef")) {
+			const char* name = skipBlanks(directive.rest);
+			const char* nameEnd = name;
+			while (isIdentifierChar(*nameEnd)) nameEnd++;
+			if (nameEnd == name) {
+				fatalError(pp, "macro name missing in #undef");
+			}
+			undefineMacro(pp, internString(name, (size_t)(nameEnd - name)));
+		} else if (directiveIs(&directive, "pragma")) {
+			const char* pragma = skipBlanks(directive.rest);
+			if (strncmp(pragma, "once", 4) == 0 && !isIdentifierChar(pragma[4])) {
+				file->pragmaOnce = true;
+				hmput(pp->onceIncluded, file->path, true);
+			}
+		} else if (directiveIs(&directive, "error")) {
+			fatalError(pp, "#error%s", directive.rest);
+		} else if (directiveIs(&directive, "warning")) {
+			fprintf(pp->context->err, "%s:%d: warning: #warning%s\n", pp->file, pp->line, directive.rest);
+		} else if (directiveIs(&directive, "line") || (directive.nameLength == 0 && isDigitChar(*skipBlanks(directive.rest)))) {
+			// Renumber the lines that follow, here for __LINE__, __FILE__ and
+			// diagnostics and in a marker for the lexer. Flags after a GNU
+			// marker's filename are ignored.
+			TextBuffer* expanded = pushScratch(pp);
+			expandText(pp, directive.rest, strlen(directive.rest), expanded, false);
+			const char* p = skipBlanks(expanded->data ? expanded->data : "");
+			if (!isDigitChar(*p)) {
+				fatalError(pp, "#line directive requires a positive integer argument");
+			}
+			int32_t number = 0;
+			while (isDigitChar(*p)) {
+				if (number > (INT32_MAX - 9) / 10) {
+					fatalError(pp, "line number out of range in #line directive");
+				}
+				number = number * 10 + (*p++ - '0');
+			}
+			p = skipBlanks(p);
+			if (*p == '"') {
+				const char* nameEnd = strchr(p + 1, '"');
+				if (nameEnd == NULL) {
+					fatalError(pp, "invalid filename in #line directive");
+				}
+				pp->file = internString(p + 1, (size_t)(nameEnd - p - 1));
+			} else if (*p != '\0') {
+				fatalError(pp, "invalid filename in #line directive");
+			}
+			popScratch(pp);
+			pp->lineDelta = number - (line->firstLine + line->physicalLines);
+			emitLineMarker(pp, number, pp->file);
+			continue;
+		} else if (directive.nameLength != 0) {
+			fatalError(pp, "invalid preprocessing directive #%.*s", (int)directive.nameLength, directive.name);
+		}
+		appendNewlines(&pp->output, line->physicalLines);
+	}
+	flushText(pp, text, textLine + pp->lineDelta);
+
+	if (arrlenu(pp->conditionals) > conditionalBase) {
+		fatalError(pp, "unterminated conditional directive");
+	}
+	popScratch(pp);
+
+	pp->file = savedFile;
+	pp->path = savedPath;
+	pp->line = savedLine;
+	pp->lineDelta = savedDelta;
+}
+
+static void addSystemIncludePaths(Preprocessor* pp) {
+#ifdef _WIN32
+	// Use the directories a Visual Studio developer prompt exports.
+	const char* include = getenv("INCLUDE");
+	while (include && *include) {
+		size_t length = strcspn(include, ";");
+		if (length > 0) {
+			arrput(pp->systemIncludePaths, arenaStrndup(&pp->storage, include, length));
+		}
+		include += length + (include[length] == ';');
+	}
+#else
+	arrput(pp->systemIncludePaths, "/usr/local/include");
+	arrput(pp->systemIncludePaths, "/usr/include");
+#endif
+}
+
+// Release everything a run allocated except the output buffer.
+static void destroyPreprocessor(Preprocessor* pp) {
+	for (ptrdiff_t i = 0; i < hmlen(pp->macros); i++) {
+		arrfree(pp->macros[i].value.params);
+	}
+	hmfree(pp->macros);
+	hmfree(pp->onceIncluded);
+	arrfree(pp->conditionals);
+	for (size_t i = 0; i < arrlenu(pp->scratch); i++) {
+		freeText(pp->scratch[i]);
+		free(pp->scratch[i]);
+	}
+	arrfree(pp->scratch);
+	// Only left non-empty by an error inside an expansion.
+	for (size_t i = 0; i < arrlenu(pp->argumentLists); i++) {
+		TextBuffer* args = pp->argumentLists[i];
+		for (ptrdiff_t j = 0; j < arrlen(args); j++) {
+			freeText(&args[j]);
+		}
+		arrfree(args);
+	}
+	arrfree(pp->argumentLists);
+	arrfree(pp->systemIncludePaths);
+	arenaFree(&pp->storage);
+	free(pp);
+}
+
+SourceFile preprocessFile(CompilerContext* ctx, const char* path, const PreprocessorOptions* options) {
+	if (!fileExists(path)) {
+		compilerError(ctx, "Could not open file \"%s\"", path);
+	}
+
+	static const PreprocessorOptions defaultOptions = { 0 };
+	// On the heap so its contents are well defined after an error longjmps
+	// back here.
+	Preprocessor* pp = (Preprocessor*)calloc(1, sizeof(Preprocessor));
+	if (pp == NULL) {
+		perror("Failed to allocate preprocessor");
+		exit(EXIT_FAILURE);
+	}
+	pp->context = ctx;
+	pp->options = options ? options : &defaultOptions;
+	pp->file = path;
+	pp->path = path;
+	pp->line = 1;
+	pp->lineName = internCString("__LINE__");
+	pp->fileName = internCString("__FILE__");
+	pp->vaArgsName = internCString("__VA_ARGS__");
+	arenaInit(&pp->storage, 0);
+
+	// Errors release the run's state here, then continue to the caller's handler.
+	jmp_buf* outerJump = ctx->errorJump;
+	jmp_buf errorJump;
+	if (setjmp(errorJump) != 0) {
+		ctx->errorJump = outerJump;
+		freeText(&pp->output);
+		destroyPreprocessor(pp);
+		abortCompilation(ctx);
+	}
+	ctx->errorJump = &errorJump;
+
+	if (pp->options->useSystemIncludePaths) {
+		addSystemIncludePaths(pp);
+	}
+
+	for (size_t i = 0; i < sizeof(s_predefinedMacros) / sizeof(s_predefinedMacros[0]); i++) {
+		defineMacro(pp, s_predefinedMacros[i]);
+	}
+	// -DNAME defines NAME as 1, -DNAME=VALUE as VALUE.
+	for (ptrdiff_t i = 0; i < arrlen(pp->options->defines); i++) {
+		const char* define = pp->options->defines[i];
+		TextBuffer* text = pushScratch(pp);
+		const char* equals = strchr(define, '=');
+		if (equals) {
+			appendText(text, define, (size_t)(equals - define));
+			appendChar(text, ' ');
+			appendText(text, equals + 1, strlen(equals + 1));
+		} else {
+			appendText(text, define, strlen(define));
+			appendText(text, " 1", 2);
+		}
+		defineMacro(pp, text->data);
+		popScratch(pp);
+	}
+
+	reserveText(&pp->output, 4096);
+	processFile(pp, loadCachedFile(pp, canonicalPath(path)), path);
+
+	ctx->errorJump = outerJump;
+	SourceFile result = { .data = pp->output.data, .length = pp->output.length };
+	destroyPreprocessor(pp);
+	return result;
+}
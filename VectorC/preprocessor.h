@@ -0,0 +1,42 @@
+//
+//  preprocessor.h
+//  VectorC
+//
+
+#ifndef preprocessor_h
+#define preprocessor_h
+
+#include <stdbool.h>
+
+#include "source_file.h"
+
+struct CompilerContext;
+
+// Settings taken from the command line.
+typedef struct {
+	const char** includePaths;		// stb_ds array of -I directories, searched in order
+	const char** defines;			// stb_ds array of -D arguments ("NAME" or "NAME=VALUE")
+	bool useSystemIncludePaths;		// Also search the platform's standard include directories
+} PreprocessorOptions;
+
+// Run the built-in preprocessor over a source file. Handles #include,
+// object-like and function-like macros (including # and ##), conditional
+// compilation and line tracking. The result is a heap buffer ready to be
+// handed to initLexer; it contains `# <line> "<file>"` markers wherever the
+// current file changes so the lexer keeps reporting original line numbers.
+// Preprocessing errors are reported through the context, which abandons the
+// compilation after the run's state has been released.
+SourceFile preprocessFile(struct CompilerContext* ctx, const char* path, const PreprocessorOptions* options);
+
+// Drop every header cached by preprocessFile on the calling thread. Files are
+// otherwise loaded and split into logical lines once per thread and reused by
+// later runs on it.
+void destroyPreprocessorCache(void);
+
+// Files found in, and loaded into, the calling thread's cache so far.
+void getPreprocessorCacheStats(size_t* hits, size_t* misses);
+
+// Bytes held by the calling thread's cache, for callers that bound it.
+size_t getPreprocessorCacheBytes(void);
+
+#endif /* preprocessor_h */
@@ -0,0 +1,692 @@
+//
+//  server.c
+//  VectorC
+//
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE				// struct ucred
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "server.h"
+
+#ifdef _WIN32
+
+int runServer(const char* socketPath, ServerCommandHandler handler) {
+	(void)socketPath;
+	(void)handler;
+	fprintf(stderr, "Error: --server needs Unix domain sockets\n");
+	return EXIT_FAILURE;
+}
+
+int runClient(const char* socketPath, int argc, const char* const* argv, ServerCommandHandler fallback) {
+	(void)socketPath;
+	return fallback(argc, argv);
+}
+
+#else
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include "intern.h"
+#include "preprocessor.h"
+#include "thread.h"
+#include "stb_ds_config.h"
+
+#define SERVER_MAGIC 0x43434556u			// "VECC"
+#define MAX_REQUEST_BYTES (16 * 1024 * 1024)
+#define REQUEST_FD_COUNT 3					// Working directory, stdout, stderr
+#define REQUEST_TIMEOUT_SECONDS 10			// For the request itself, not the compile
+#define SOCKET_PATH_SIZE 256
+#define WORKER_CACHE_LIMIT (256u * 1024 * 1024)	// Headers and interned strings kept between requests
+#define WORKER_REQUEST_LIMIT 1000				// Requests before a worker is replaced
+
+typedef enum {
+	REQUEST_COMPILE,
+	REQUEST_STATS,
+	REQUEST_STOP
+} RequestKind;
+
+// Fixed part of a request. The descriptors travel with it, and `argc`
+// NUL-terminated arguments follow it. The reply is the int32_t exit status.
+typedef struct {
+	uint32_t magic;
+	uint32_t kind;
+	uint32_t argc;
+	uint32_t argBytes;
+} RequestHeader;
+
+// Counters shared by every worker, in memory mapped before the fork.
+typedef struct {
+	_Atomic uint64_t requests;
+	_Atomic uint64_t failures;				// Commands that returned non-zero
+	_Atomic uint64_t totalMicroseconds;
+	_Atomic uint64_t maxMicroseconds;
+	_Atomic uint64_t lastMicroseconds;
+	_Atomic uint64_t sourceHits;
+	_Atomic uint64_t sourceMisses;
+	_Atomic uint64_t restarts;				// Workers replaced after dying
+	_Atomic uint64_t recycled;				// Workers replaced after WORKER_REQUEST_LIMIT requests
+	double startSeconds;
+	pid_t serverPid;
+	int workerCount;
+} ServerStats;
+
+// What a worker needs to serve requests.
+typedef struct {
+	int listener;
+	ServerStats* stats;
+	ServerCommandHandler handler;
+	int serverDirectory;					// Returned to after every request
+	int serverOut;
+	int serverErr;
+} WorkerState;
+
+static volatile sig_atomic_t s_stopping = 0;
+
+static void handleStopSignal(int signal) {
+	(void)signal;
+	s_stopping = 1;
+}
+
+// Only there so that sigsuspend returns when a worker exits.
+static void handleChildSignal(int signal) {
+	(void)signal;
+}
+
+static double getSeconds(void) {
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return (double)now.tv_sec + (double)now.tv_nsec * 1e-9;
+}
+
+// Returns: true if `path` is a directory owned by us that nobody else can
+// enter, so nobody else can put a socket of their own in it.
+static bool isPrivateDirectory(const char* path) {
+	struct stat status;
+	return lstat(path, &status) == 0 && S_ISDIR(status.st_mode) &&
+		status.st_uid == getuid() && (status.st_mode & 077) == 0;
+}
+
+//
+// getSocketPath
+// -------------
+// The socket given on the command line or in VECC_SERVER_SOCKET, or else
+// `vecc.sock` in $XDG_RUNTIME_DIR, or else in a 0700 directory /tmp/vecc-<uid>
+// that the server creates. A default directory that another user could
+// write to is refused.
+//
+// Returns:
+//   The path, or NULL after reporting an unsafe directory.
+//
+static const char* getSocketPath(const char* socketPath, char* buffer, size_t size, bool create) {
+	if (socketPath && *socketPath) {
+		return socketPath;
+	}
+	const char* environment = getenv("VECC_SERVER_SOCKET");
+	if (environment && *environment) {
+		return environment;
+	}
+	char directory[SOCKET_PATH_SIZE];
+	const char* runtime = getenv("XDG_RUNTIME_DIR");
+	if (runtime && *runtime) {
+		snprintf(directory, sizeof(directory), "%s", runtime);
+	} else {
+		snprintf(directory, sizeof(directory), "/tmp/vecc-%u", (unsigned)getuid());
+		if (create && mkdir(directory, 0700) != 0 && errno != EEXIST) {
+			fprintf(stderr, "Error: Could not create %s: %s\n", directory, strerror(errno));
+			return NULL;
+		}
+	}
+	// A directory that does not exist yet cannot hold a server either.
+	if (!isPrivateDirectory(directory) && (create || access(directory, F_OK) == 0)) {
+		fprintf(stderr, "Error: %s is not a directory only this user can access\n", directory);
+		return NULL;
+	}
+	snprintf(buffer, size, "%s/vecc.sock", directory);
+	return buffer;
+}
+
+static bool makeAddress(const char* path, struct sockaddr_un* address) {
+	memset(address, 0, sizeof(*address));
+	address->sun_family = AF_UNIX;
+	if (strlen(path) >= sizeof(address->sun_path)) {
+		fprintf(stderr, "Error: Socket path '%s' is too long\n", path);
+		return false;
+	}
+	strcpy(address->sun_path, path);
+	return true;
+}
+
+static bool readFully(int fd, void* data, size_t length) {
+	char* at = (char*)data;
+	while (length > 0) {
+		ssize_t count = read(fd, at, length);
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		if (count <= 0) {
+			return false;
+		}
+		at += count;
+		length -= (size_t)count;
+	}
+	return true;
+}
+
+static bool writeFully(int fd, const void* data, size_t length) {
+	const char* at = (const char*)data;
+	while (length > 0) {
+		ssize_t count = write(fd, at, length);
+		if (count < 0 && errno == EINTR) {
+			continue;
+		}
+		if (count <= 0) {
+			return false;
+		}
+		at += count;
+		length -= (size_t)count;
+	}
+	return true;
+}
+
+static void setCloseOnExec(int fd) {
+	fcntl(fd, F_SETFD, fcntl(fd, F_GETFD) | FD_CLOEXEC);
+}
+
+// Returns: true if the process at the other end of a Unix domain socket runs
+// as the same user as this one.
+static bool isPeerSameUser(int connection) {
+#ifdef SO_PEERCRED
+	struct ucred credentials;
+	socklen_t length = sizeof(credentials);
+	if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED, &credentials, &length) != 0) {
+		return false;
+	}
+	return credentials.uid == getuid();
+#else
+	uid_t uid;
+	gid_t gid;
+	return getpeereid(connection, &uid, &gid) == 0 && uid == getuid();
+#endif
+}
+
+// Returns: the connected socket, or -1 when no server is listening.
+static int connectToServer(const char* path) {
+	struct sockaddr_un address;
+	if (!makeAddress(path, &address)) {
+		return -1;
+	}
+	int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (connection < 0) {
+		return -1;
+	}
+	if (connect(connection, (const struct sockaddr*)&address, sizeof(address)) != 0) {
+		close(connection);
+		return -1;
+	}
+	// Requests carry our directory and terminal, so only hand them to a
+	// server of our own.
+	if (!isPeerSameUser(connection)) {
+		fprintf(stderr, "Error: The server on %s belongs to another user\n", path);
+		close(connection);
+		return -1;
+	}
+	return connection;
+}
+
+//
+// openListener
+// ------------
+// Bind the server socket, replacing a socket file left behind by a server
+// that did not shut down cleanly. The socket is only accessible to the user
+// running the server, since requests run commands with the server's rights.
+//
+// Returns:
+//   The listening socket, or -1 after reporting the problem.
+//
+static int openListener(const char* path) {
+	struct sockaddr_un address;
+	if (!makeAddress(path, &address)) {
+		return -1;
+	}
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0) {
+		fprintf(stderr, "Error: Could not create socket: %s\n", strerror(errno));
+		return -1;
+	}
+	setCloseOnExec(listener);
+
+	mode_t oldMask = umask(077);
+	int bound = bind(listener, (const struct sockaddr*)&address, sizeof(address));
+	if (bound != 0 && errno == EADDRINUSE) {
+		int probe = connectToServer(path);
+		if (probe >= 0) {
+			close(probe);
+			umask(oldMask);
+			close(listener);
+			fprintf(stderr, "Error: A vecc server is already listening on %s\n", path);
+			return -1;
+		}
+		unlink(path);
+		bound = bind(listener, (const struct sockaddr*)&address, sizeof(address));
+	}
+	umask(oldMask);
+	if (bound != 0 || listen(listener, SOMAXCONN) != 0) {
+		fprintf(stderr, "Error: Could not listen on %s: %s\n", path, strerror(errno));
+		close(listener);
+		return -1;
+	}
+	return listener;
+}
+
+// Receive a request header along with its descriptors.
+// Returns: false, with every descriptor closed, unless all of them arrived.
+static bool receiveHeader(int connection, RequestHeader* header, int fds[REQUEST_FD_COUNT]) {
+	union {
+		char buffer[CMSG_SPACE(sizeof(int) * REQUEST_FD_COUNT)];
+		struct cmsghdr align;
+	} control;
+	struct iovec io = { .iov_base = header, .iov_len = sizeof(*header) };
+	struct msghdr message = { 0 };
+	message.msg_iov = &io;
+	message.msg_iovlen = 1;
+	message.msg_control = control.buffer;
+	message.msg_controllen = sizeof(control.buffer);
+
+	ssize_t received;
+	do {
+		received = recvmsg(connection, &message, 0);
+	} while (received < 0 && errno == EINTR);
+
+	int fdCount = 0;
+	for (int i = 0; i < REQUEST_FD_COUNT; i++) {
+		fds[i] = -1;
+	}
+	if (received < 0) {
+		message.msg_controllen = 0;
+	}
+	for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message); cmsg; cmsg = CMSG_NXTHDR(&message, cmsg)) {
+		if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS) {
+			continue;
+		}
+		size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		for (size_t i = 0; i < count; i++) {
+			int fd;
+			memcpy(&fd, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+			if (fdCount < REQUEST_FD_COUNT) {
+				setCloseOnExec(fd);
+				fds[fdCount++] = fd;
+			} else {
+				close(fd);
+			}
+		}
+	}
+
+	bool valid = received > 0 && fdCount == REQUEST_FD_COUNT && !(message.msg_flags & MSG_CTRUNC);
+	if (valid && (size_t)received < sizeof(*header)) {
+		valid = readFully(connection, (char*)header + received, sizeof(*header) - (size_t)received);
+	}
+	if (!valid) {
+		for (int i = 0; i < fdCount; i++) {
+			close(fds[i]);
+		}
+	}
+	return valid;
+}
+
+static void updateMaximum(_Atomic uint64_t* maximum, uint64_t value) {
+	uint64_t current = atomic_load(maximum);
+	while (value > current && !atomic_compare_exchange_weak(maximum, &current, value)) {
+	}
+}
+
+static void printServerStats(const ServerStats* stats) {
+	uint64_t requests = atomic_load(&stats->requests);
+	uint64_t hits = atomic_load(&stats->sourceHits);
+	uint64_t misses = atomic_load(&stats->sourceMisses);
+	double totalMilliseconds = (double)atomic_load(&stats->totalMicroseconds) * 1e-3;
+	printf("vecc server %d: %d workers, up %.1f s\n", (int)stats->serverPid, stats->workerCount, getSeconds() - stats->startSeconds);
+	printf("Requests: %llu (%llu failed)\n", (unsigned long long)requests, (unsigned long long)atomic_load(&stats->failures));
+	printf("Latency: last %.3f ms, mean %.3f ms, max %.3f ms\n",
+		   (double)atomic_load(&stats->lastMicroseconds) * 1e-3,
+		   requests > 0 ? totalMilliseconds / (double)requests : 0.0,
+		   (double)atomic_load(&stats->maxMicroseconds) * 1e-3);
+	printf("Source cache: %llu hits, %llu misses (%.1f%% hit rate)\n", (unsigned long long)hits, (unsigned long long)misses,
+		   hits + misses > 0 ? 100.0 * (double)hits / (double)(hits + misses) : 0.0);
+	printf("Worker restarts: %llu, recycled: %llu\n", (unsigned long long)atomic_load(&stats->restarts),
+		   (unsigned long long)atomic_load(&stats->recycled));
+}
+
+// Run a compile request and add it to the shared counters.
+static int runCompileRequest(WorkerState* worker, int argc, const char* const* argv) {
+	ServerStats* stats = worker->stats;
+	size_t hitsBefore, missesBefore, hitsAfter, missesAfter;
+	getPreprocessorCacheStats(&hitsBefore, &missesBefore);
+	double start = getSeconds();
+	int status = worker->handler(argc, argv);
+	uint64_t microseconds = (uint64_t)((getSeconds() - start) * 1e6);
+	getPreprocessorCacheStats(&hitsAfter, &missesAfter);
+
+	atomic_fetch_add(&stats->requests, 1);
+	atomic_fetch_add(&stats->failures, status != 0);
+	atomic_fetch_add(&stats->totalMicroseconds, microseconds);
+	atomic_store(&stats->lastMicroseconds, microseconds);
+	updateMaximum(&stats->maxMicroseconds, microseconds);
+	atomic_fetch_add(&stats->sourceHits, hitsAfter - hitsBefore);
+	atomic_fetch_add(&stats->sourceMisses, missesAfter - missesBefore);
+	return status;
+}
+
+//
+// serveConnection
+// ---------------
+// Read one request, run it in the client's directory with the client's
+// stdout and stderr in place of the worker's own, and reply with the exit
+// status. Anything the command prints, including the output of clang, goes
+// straight to the client's terminal or pipe.
+//
+static void serveConnection(WorkerState* worker, int connection) {
+	RequestHeader header;
+	int fds[REQUEST_FD_COUNT];
+	if (!receiveHeader(connection, &header, fds)) {
+		return;
+	}
+
+	int32_t status = EXIT_FAILURE;
+	char* argData = NULL;
+	const char** argv = NULL;
+	bool valid = header.magic == SERVER_MAGIC && header.argBytes <= MAX_REQUEST_BYTES && header.argc <= header.argBytes;
+	if (valid) {
+		argData = (char*)malloc((size_t)header.argBytes + 1);
+		valid = argData != NULL && readFully(connection, argData, header.argBytes);
+	}
+	if (valid) {
+		argData[header.argBytes] = '\0';
+		for (size_t offset = 0; offset < header.argBytes; offset += strlen(argData + offset) + 1) {
+			arrput(argv, argData + offset);
+		}
+		valid = arrlenu(argv) == header.argc;
+	}
+
+	if (valid) {
+		fflush(stdout);
+		fflush(stderr);
+		dup2(fds[1], STDOUT_FILENO);
+		dup2(fds[2], STDERR_FILENO);
+		if (fchdir(fds[0]) != 0) {
+			fprintf(stderr, "Error: Could not enter the client's directory: %s\n", strerror(errno));
+		} else {
+			switch ((RequestKind)header.kind) {
+				case REQUEST_COMPILE:
+					status = runCompileRequest(worker, (int)header.argc, argv);
+					break;
+				case REQUEST_STATS:
+					printServerStats(worker->stats);
+					status = EXIT_SUCCESS;
+					break;
+				case REQUEST_STOP:
+					printf("Stopping vecc server %d\n", (int)worker->stats->serverPid);
+					kill(worker->stats->serverPid, SIGTERM);
+					status = EXIT_SUCCESS;
+					break;
+				default:
+					fprintf(stderr, "Error: Unknown server request %u\n", header.kind);
+					break;
+			}
+		}
+		fflush(stdout);
+		fflush(stderr);
+		clearerr(stdout);
+		clearerr(stderr);
+		dup2(worker->serverOut, STDOUT_FILENO);
+		dup2(worker->serverErr, STDERR_FILENO);
+		if (fchdir(worker->serverDirectory) != 0) {
+			perror("Error: Could not return to the server's directory");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	writeFully(connection, &status, sizeof(status));
+	arrfree(argv);
+	free(argData);
+	for (int i = 0; i < REQUEST_FD_COUNT; i++) {
+		close(fds[i]);
+	}
+}
+
+static void runWorker(WorkerState* worker) {
+	// A client that goes away mid-request must not take the worker with it.
+	signal(SIGPIPE, SIG_IGN);
+	worker->serverDirectory = open(".", O_RDONLY);
+	worker->serverOut = dup(STDOUT_FILENO);
+	worker->serverErr = dup(STDERR_FILENO);
+	if (worker->serverDirectory < 0 || worker->serverOut < 0 || worker->serverErr < 0) {
+		perror("Error: Could not start server worker");
+		_exit(EXIT_FAILURE);
+	}
+	setCloseOnExec(worker->serverDirectory);
+	setCloseOnExec(worker->serverOut);
+	setCloseOnExec(worker->serverErr);
+
+	int served = 0;
+	for (;;) {
+		// Headers and interned strings are kept so later requests start warm,
+		// but only up to a limit. Anything else a request leaves behind is
+		// bounded by replacing the worker every so often.
+		if (getPreprocessorCacheBytes() + getInternTableBytes() > WORKER_CACHE_LIMIT) {
+			destroyPreprocessorCache();
+			destroyInternTable();
+		}
+		if (served == WORKER_REQUEST_LIMIT) {
+			atomic_fetch_add(&worker->stats->recycled, 1);
+			_exit(EXIT_SUCCESS);
+		}
+		int connection = accept(worker->listener, NULL, NULL);
+		if (connection < 0) {
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			perror("Error: accept failed");
+			_exit(EXIT_FAILURE);
+		}
+		setCloseOnExec(connection);
+		// Requests run commands with our rights.
+		if (!isPeerSameUser(connection)) {
+			close(connection);
+			continue;
+		}
+		struct timeval timeout = { .tv_sec = REQUEST_TIMEOUT_SECONDS };
+		setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		serveConnection(worker, connection);
+		close(connection);
+		served++;
+	}
+}
+
+// Returns: the worker's process id, or -1 if it could not be forked.
+static pid_t startWorker(WorkerState* worker, const sigset_t* workerMask) {
+	fflush(stdout);
+	fflush(stderr);
+	pid_t pid = fork();
+	if (pid == 0) {
+		signal(SIGTERM, SIG_DFL);
+		signal(SIGINT, SIG_DFL);
+		signal(SIGCHLD, SIG_DFL);
+		sigprocmask(SIG_SETMASK, workerMask, NULL);
+		runWorker(worker);
+	}
+	return pid;
+}
+
+int runServer(const char* socketPath, ServerCommandHandler handler) {
+	char defaultPath[SOCKET_PATH_SIZE];
+	const char* path = getSocketPath(socketPath, defaultPath, sizeof(defaultPath), true);
+	int listener = path ? openListener(path) : -1;
+	if (listener < 0) {
+		return EXIT_FAILURE;
+	}
+
+	ServerStats* stats = (ServerStats*)mmap(NULL, sizeof(ServerStats), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (stats == MAP_FAILED) {
+		perror("Error: Could not map server statistics");
+		close(listener);
+		unlink(path);
+		return EXIT_FAILURE;
+	}
+	memset(stats, 0, sizeof(*stats));
+	stats->startSeconds = getSeconds();
+	stats->serverPid = getpid();
+	stats->workerCount = getProcessorCount();
+
+	// Signals are only taken inside sigsuspend, so a stop request or a
+	// worker exiting cannot slip in between the checks and the wait.
+	struct sigaction stopAction = { 0 };
+	stopAction.sa_handler = handleStopSignal;
+	sigaction(SIGTERM, &stopAction, NULL);
+	sigaction(SIGINT, &stopAction, NULL);
+	struct sigaction childAction = { 0 };
+	childAction.sa_handler = handleChildSignal;
+	sigaction(SIGCHLD, &childAction, NULL);
+	sigset_t blocked, waitMask;
+	sigemptyset(&blocked);
+	sigaddset(&blocked, SIGTERM);
+	sigaddset(&blocked, SIGINT);
+	sigaddset(&blocked, SIGCHLD);
+	sigprocmask(SIG_BLOCK, &blocked, &waitMask);
+
+	WorkerState worker = { .listener = listener, .stats = stats, .handler = handler };
+	pid_t* workers = (pid_t*)calloc((size_t)stats->workerCount, sizeof(pid_t));
+	if (workers == NULL) {
+		fprintf(stderr, "Error: Out of memory\n");
+		exit(EXIT_FAILURE);
+	}
+	for (int w = 0; w < stats->workerCount; w++) {
+		workers[w] = startWorker(&worker, &waitMask);
+	}
+	printf("vecc server %d listening on %s with %d workers\n", (int)stats->serverPid, path, stats->workerCount);
+	fflush(stdout);
+
+	while (!s_stopping) {
+		int status;
+		pid_t pid;
+		while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+			for (int w = 0; w < stats->workerCount; w++) {
+				if (workers[w] == pid) {
+					workers[w] = startWorker(&worker, &waitMask);
+					atomic_fetch_add(&stats->restarts, !(WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS));
+				}
+			}
+		}
+		if (!s_stopping) {
+			sigsuspend(&waitMask);
+		}
+	}
+
+	for (int w = 0; w < stats->workerCount; w++) {
+		if (workers[w] > 0) {
+			kill(workers[w], SIGTERM);
+		}
+	}
+	for (int w = 0; w < stats->workerCount; w++) {
+		if (workers[w] > 0) {
+			waitpid(workers[w], NULL, 0);
+		}
+	}
+	close(listener);
+	unlink(path);
+	printf("vecc server %d stopped after %llu requests\n", (int)stats->serverPid, (unsigned long long)atomic_load(&stats->requests));
+	free(workers);
+	munmap(stats, sizeof(ServerStats));
+	sigprocmask(SIG_SETMASK, &waitMask, NULL);
+	return EXIT_SUCCESS;
+}
+
+int runClient(const char* socketPath, int argc, const char* const* argv, ServerCommandHandler fallback) {
+	char defaultPath[SOCKET_PATH_SIZE];
+	const char* path = getSocketPath(socketPath, defaultPath, sizeof(defaultPath), false);
+	RequestKind kind = REQUEST_COMPILE;
+	if (argc == 1 && strcmp(argv[0], "--server-stats") == 0) {
+		kind = REQUEST_STATS;
+	} else if (argc == 1 && strcmp(argv[0], "--server-stop") == 0) {
+		kind = REQUEST_STOP;
+	}
+
+	int connection = path ? connectToServer(path) : -1;
+	if (connection < 0) {
+		if (kind == REQUEST_COMPILE) {
+			return fallback(argc, argv);
+		}
+		fprintf(stderr, "Error: No vecc server is listening on %s\n", path ? path : "the default socket");
+		return EXIT_FAILURE;
+	}
+	int directory = open(".", O_RDONLY);
+	if (directory < 0) {
+		fprintf(stderr, "Error: Could not open the current directory: %s\n", strerror(errno));
+		close(connection);
+		return EXIT_FAILURE;
+	}
+
+	char* argData = NULL;
+	for (int i = 0; i < argc; i++) {
+		size_t length = strlen(argv[i]) + 1;
+		memcpy(arraddnptr(argData, length), argv[i], length);
+	}
+	RequestHeader header = {
+		.magic = SERVER_MAGIC,
+		.kind = (uint32_t)kind,
+		.argc = (uint32_t)argc,
+		.argBytes = (uint32_t)arrlenu(argData),
+	};
+
+	int fds[REQUEST_FD_COUNT] = { directory, STDOUT_FILENO, STDERR_FILENO };
+	union {
+		char buffer[CMSG_SPACE(sizeof(fds))];
+		struct cmsghdr align;
+	} control;
+	memset(&control, 0, sizeof(control));
+	struct iovec io = { .iov_base = &header, .iov_len = sizeof(header) };
+	struct msghdr message = { 0 };
+	message.msg_iov = &io;
+	message.msg_iovlen = 1;
+	message.msg_control = control.buffer;
+	message.msg_controllen = sizeof(control.buffer);
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&message);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	// A server that dies mid-request shows up as a failed write or read.
+	signal(SIGPIPE, SIG_IGN);
+	fflush(stdout);
+	fflush(stderr);
+	int32_t status = EXIT_FAILURE;
+	bool sent = sendmsg(connection, &message, 0) == (ssize_t)sizeof(header) &&
+		writeFully(connection, argData, arrlenu(argData));
+	if (!sent || !readFully(connection, &status, sizeof(status))) {
+		fprintf(stderr, "Error: The vecc server on %s dropped the request\n", path);
+		status = EXIT_FAILURE;
+	}
+	arrfree(argData);
+	close(directory);
+	close(connection);
+	return status;
+}
+
+#endif
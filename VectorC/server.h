@@ -0,0 +1,46 @@
+//
+//  server.h
+//  VectorC
+//
+
+#ifndef server_h
+#define server_h
+
+// Runs one command line (without the program name) the way main would.
+typedef int (*ServerCommandHandler)(int argc, const char* const* argv);
+
+//
+// runServer
+// ---------
+// Listen on a Unix domain socket and run the command lines sent by
+// runClient. A pool of pre-forked worker processes, one per processor,
+// accepts the connections; each serves requests one at a time and keeps its
+// intern table and preprocessed headers warm across them, dropping both when
+// they outgrow a fixed budget. For the duration of a request a worker works
+// in the client's directory and writes to the client's stdout and stderr,
+// which arrive with the request. A worker that dies is replaced, and so is
+// one that has served a fixed number of requests. Runs until a --server-stop request or SIGINT/SIGTERM.
+// Connections from other users are refused.
+//
+// Parameters:
+//   socketPath - Path of the socket, or NULL for VECC_SERVER_SOCKET, else
+//                vecc.sock in $XDG_RUNTIME_DIR or in a private /tmp/vecc-<uid>.
+//
+// Returns:
+//   EXIT_SUCCESS after a clean shutdown, or EXIT_FAILURE.
+//
+int runServer(const char* socketPath, ServerCommandHandler handler);
+
+//
+// runClient
+// ---------
+// Forward a command line to the server and return its exit status, so a
+// build system can use `vecc --client` wherever it used `vecc`. When no
+// server is listening, or the socket belongs to another user, the command
+// runs in this process instead.
+// `--server-stats` prints the server's request counts, latencies and cache
+// hit rates; `--server-stop` shuts it down.
+//
+int runClient(const char* socketPath, int argc, const char* const* argv, ServerCommandHandler fallback);
+
+#endif /* server_h */
@@ -0,0 +1,29 @@
+//
+//  sha256.h
+//  VectorC
+//
+
+#ifndef sha256_h
+#define sha256_h
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+
+// Incremental SHA-256 (FIPS 180-4).
+typedef struct {
+	uint32_t state[8];
+	uint64_t length;			// Bytes hashed so far
+	uint8_t block[64];
+	size_t blockLength;
+} Sha256;
+
+void sha256Init(Sha256* hash);
+void sha256Update(Sha256* hash, const void* data, size_t length);
+void sha256Final(Sha256* hash, uint8_t digest[SHA256_DIGEST_SIZE]);
+
+// Format a digest as 64 lowercase hex digits and a terminator.
+void sha256ToHex(const uint8_t digest[SHA256_DIGEST_SIZE], char hex[SHA256_DIGEST_SIZE * 2 + 1]);
+
+#endif /* sha256_h */
@@ -0,0 +1,170 @@
+//
+//  source_file.c
+//  VectorC
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "source_file.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+//
+// readSourceFile
+// --------------
+// Load an entire file into a heap allocated buffer.
+//
+// Parameters:
+//   path - Path to the file to read.
+//   source - Receives a null-terminated heap copy of the contents.
+//
+// Returns:
+//   false, with errno set, if the file could not be read.
+//
+static bool readSourceFile(const char* path, SourceFile* source) {
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		return false;
+	}
+	long fileSize = -1;
+	if (fseek(file, 0L, SEEK_END) == 0) {
+		fileSize = ftell(file);
+		rewind(file);
+	}
+	if (fileSize < 0) {
+		fclose(file);
+		return false;
+	}
+
+	char* buffer = (char*)malloc((size_t)fileSize + 1);
+	if (buffer == NULL) {
+		fclose(file);
+		errno = ENOMEM;
+		return false;
+	}
+	size_t bytesRead = fread(buffer, sizeof(char), (size_t)fileSize, file);
+	if (bytesRead < (size_t)fileSize && ferror(file)) {
+		free(buffer);
+		fclose(file);
+		errno = EIO;
+		return false;
+	}
+	buffer[bytesRead] = '\0';
+
+	fclose(file);
+	*source = (SourceFile){ .data = buffer, .length = bytesRead };
+	return true;
+}
+
+bool readSourceStream(FILE* stream, SourceFile* source) {
+	size_t capacity = 64 * 1024;
+	size_t length = 0;
+	char* buffer = (char*)malloc(capacity);
+	while (buffer != NULL) {
+		length += fread(buffer + length, 1, capacity - length - 1, stream);
+		if (length < capacity - 1) {
+			break;
+		}
+		capacity *= 2;
+		char* grown = (char*)realloc(buffer, capacity);
+		if (grown == NULL) {
+			free(buffer);
+		}
+		buffer = grown;
+	}
+	if (buffer == NULL) {
+		errno = ENOMEM;
+		return false;
+	}
+	if (ferror(stream)) {
+		free(buffer);
+		errno = EIO;
+		return false;
+	}
+	buffer[length] = '\0';
+	*source = (SourceFile){ .data = buffer, .length = length };
+	return true;
+}
+
+//
+// openSourceFile
+// --------------
+// Map a file read-only. The mapping is sized to the file plus at least one
+// byte, rounded up to whole pages. The range is first reserved with zeroed
+// anonymous pages and the file is then mapped over the front of it, so the
+// byte after the contents is always a readable '\0' even when the file size
+// is an exact multiple of the page size.
+//
+// Parameters:
+//   path - Path to the file to map.
+//   source - Receives the mapping.
+//
+// Returns:
+//   false, with errno set, if the file could not be opened or read.
+//
+bool openSourceFile(const char* path, SourceFile* source) {
+#ifdef _WIN32
+	return readSourceFile(path, source);
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+	struct stat info;
+	if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+		// Pipes and devices cannot be mapped; read them instead.
+		close(fd);
+		return readSourceFile(path, source);
+	}
+
+	size_t fileSize = (size_t)info.st_size;
+	size_t pageSize = (size_t)sysconf(_SC_PAGESIZE);
+	size_t mappingSize = (fileSize + 1 + pageSize - 1) & ~(pageSize - 1);
+
+	void* base = mmap(NULL, mappingSize, PROT_READ, MAP_PRIVATE | MAP_ANON, -1, 0);
+	if (base == MAP_FAILED) {
+		close(fd);
+		return readSourceFile(path, source);
+	}
+	if (fileSize > 0) {
+		void* contents = mmap(base, fileSize, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0);
+		if (contents == MAP_FAILED) {
+			munmap(base, mappingSize);
+			close(fd);
+			return readSourceFile(path, source);
+		}
+#ifdef MADV_SEQUENTIAL
+		madvise(base, fileSize, MADV_SEQUENTIAL);
+#endif
+	}
+	close(fd);
+
+	*source = (SourceFile){
+		.data = (const char*)base,
+		.length = fileSize,
+		.mapping = base,
+		.mappingSize = mappingSize
+	};
+	return true;
+#endif
+}
+
+void closeSourceFile(SourceFile* file) {
+#ifndef _WIN32
+	if (file->mapping) {
+		munmap(file->mapping, file->mappingSize);
+	} else
+#endif
+	{
+		free((void*)file->data);
+	}
+	memset(file, 0, sizeof(SourceFile));
+}
@@ -0,0 +1,36 @@
+//
+//  source_file.h
+//  VectorC
+//
+
+#ifndef source_file_h
+#define source_file_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// Read-only view of a source file. `data` is always null-terminated and stays
+// valid (along with every token pointing into it) until closeSourceFile.
+typedef struct {
+	const char* data;		// File contents followed by a '\0' sentinel
+	size_t length;			// Bytes of file contents, excluding the sentinel
+	void* mapping;			// Base of the memory mapping, or NULL when heap allocated
+	size_t mappingSize;		// Bytes mapped at `mapping`
+} SourceFile;
+
+// Map a file into memory without copying it. Falls back to reading it into a
+// heap buffer on platforms without mmap. These run inside server workers, so
+// they never exit; the caller reports a failure.
+// Returns: false, with errno set, if the file could not be read.
+bool openSourceFile(const char* path, SourceFile* source);
+
+// Read a stream (such as the output of a child process) to its end into a
+// heap buffer.
+// Returns: false, with errno set, if the stream could not be read.
+bool readSourceStream(FILE* stream, SourceFile* source);
+
+// Release the view returned by openSourceFile.
+void closeSourceFile(SourceFile* file);
+
+#endif /* source_file_h */
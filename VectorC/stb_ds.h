@@ -846,7 +846,8 @@ typedef struct
 #define STBDS_HASH_EMPTY      0
 #define STBDS_HASH_DELETED    1
 
-static size_t stbds_hash_seed=0x31415926;
+// VectorC: per thread, as every new hash table updates it.
+static _Thread_local size_t stbds_hash_seed=0x31415926;
 
 void stbds_rand_seed(size_t seed)
 {
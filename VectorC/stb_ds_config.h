@@ -0,0 +1,20 @@
+//
+//  stb_ds_config.h
+//  VectorC
+//
+
+#ifndef stb_ds_config_h
+#define stb_ds_config_h
+
+#include "mem_report.h"
+
+// Every stb_ds array and hash map is allocated through countedRealloc so that
+// -fmem-report can charge it to a phase. stb_ds expands STBDS_FREE in arrfree
+// as well as in its implementation, so include this header instead of
+// stb_ds.h everywhere; the allocators must match in every file.
+#define STBDS_REALLOC(context, pointer, size) countedRealloc(pointer, size)
+#define STBDS_FREE(context, pointer) countedFree(pointer)
+
+#include "stb_ds.h"
+
+#endif /* stb_ds_config_h */
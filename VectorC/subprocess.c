@@ -0,0 +1,214 @@
+//
+//  subprocess.c
+//  VectorC
+//
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE				// pipe2
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "subprocess.h"
+#include "stb_ds_config.h"
+
+#ifndef _WIN32
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern char** environ;
+
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__NetBSD__) || defined(__OpenBSD__)
+#define HAVE_PIPE2
+#endif
+#endif
+
+static void printCommand(const char* const* argv) {
+	printf("Running:");
+	for (const char* const* arg = argv; *arg; arg++) {
+		printf(" %s", *arg);
+	}
+	printf("\n");
+	fflush(stdout);
+}
+
+#ifdef _WIN32
+
+//
+// startProcess (Windows)
+// ----------------------
+// Windows has no posix_spawn, so the arguments are quoted into a command
+// line for _popen, which still streams through a pipe rather than a file.
+//
+bool startProcess(Process* process, const char* const* argv, ProcessPipe pipe, bool verbose) {
+	if (verbose) {
+		printCommand(argv);
+	}
+	char* commandline = NULL;
+	for (const char* const* arg = argv; *arg; arg++) {
+		if (arg != argv) {
+			arrput(commandline, ' ');
+		}
+		arrput(commandline, '"');
+		for (const char* c = *arg; *c; c++) {
+			if (*c == '"') {
+				arrput(commandline, '\\');
+			}
+			arrput(commandline, *c);
+		}
+		arrput(commandline, '"');
+	}
+	arrput(commandline, '\0');
+
+	memset(process, 0, sizeof(Process));
+	bool started = true;
+	switch (pipe) {
+		case PROCESS_PIPE_NONE:
+			// system() runs to completion; waitProcess returns its status.
+			process->pid = system(commandline);
+			started = process->pid != -1;
+			break;
+		case PROCESS_PIPE_STDIN:
+			process->input = _popen(commandline, "wb");
+			started = process->input != NULL;
+			break;
+		case PROCESS_PIPE_STDOUT:
+			process->output = _popen(commandline, "rb");
+			started = process->output != NULL;
+			break;
+	}
+	arrfree(commandline);
+	return started;
+}
+
+int waitProcess(Process* process) {
+	int status = (int)process->pid;
+	if (process->input) {
+		status = _pclose(process->input);
+	} else if (process->output) {
+		status = _pclose(process->output);
+	}
+	memset(process, 0, sizeof(Process));
+	return status;
+}
+
+void initSubprocesses(void) {
+}
+
+#else
+
+void initSubprocesses(void) {
+	// A child that exits early must turn our writes into errors, not kill us.
+	signal(SIGPIPE, SIG_IGN);
+}
+
+#ifndef HAVE_PIPE2
+// Without pipe2 a pipe is briefly inheritable, so pipe creation and spawning
+// are serialized: no batch thread can spawn while another's pipe is open.
+static pthread_mutex_t s_spawnLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+// Create a pipe whose descriptors are not inherited by later children.
+static bool openPipe(int fds[2]) {
+#ifdef HAVE_PIPE2
+	return pipe2(fds, O_CLOEXEC) == 0;
+#else
+	if (pipe(fds) != 0) {
+		return false;
+	}
+	fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	return true;
+#endif
+}
+
+bool startProcess(Process* process, const char* const* argv, ProcessPipe pipe, bool verbose) {
+	if (verbose) {
+		printCommand(argv);
+	}
+	memset(process, 0, sizeof(Process));
+
+#ifndef HAVE_PIPE2
+	pthread_mutex_lock(&s_spawnLock);
+#endif
+	// fds[0] is the read end and fds[1] the write end.
+	int fds[2] = { -1, -1 };
+	if (pipe != PROCESS_PIPE_NONE && !openPipe(fds)) {
+		perror("Error creating pipe");
+#ifndef HAVE_PIPE2
+		pthread_mutex_unlock(&s_spawnLock);
+#endif
+		return false;
+	}
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	if (pipe == PROCESS_PIPE_STDIN) {
+		posix_spawn_file_actions_adddup2(&actions, fds[0], STDIN_FILENO);
+	} else if (pipe == PROCESS_PIPE_STDOUT) {
+		posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+	}
+
+	// Anything still buffered would otherwise appear after the child's output.
+	fflush(stdout);
+	pid_t pid;
+	int error = posix_spawnp(&pid, argv[0], &actions, NULL, (char* const*)argv, environ);
+	posix_spawn_file_actions_destroy(&actions);
+#ifndef HAVE_PIPE2
+	pthread_mutex_unlock(&s_spawnLock);
+#endif
+	if (error != 0) {
+		fprintf(stderr, "Error running %s: %s\n", argv[0], strerror(error));
+		if (pipe != PROCESS_PIPE_NONE) {
+			close(fds[0]);
+			close(fds[1]);
+		}
+		return false;
+	}
+	process->pid = pid;
+
+	if (pipe == PROCESS_PIPE_STDIN) {
+		close(fds[0]);
+		process->input = fdopen(fds[1], "wb");
+	} else if (pipe == PROCESS_PIPE_STDOUT) {
+		close(fds[1]);
+		process->output = fdopen(fds[0], "rb");
+	}
+	return true;
+}
+
+int waitProcess(Process* process) {
+	if (process->input) {
+		fclose(process->input);
+	}
+	if (process->output) {
+		fclose(process->output);
+	}
+
+	int status = -1;
+	pid_t pid = (pid_t)process->pid;
+	while (waitpid(pid, &status, 0) == -1) {
+		if (errno != EINTR) {
+			status = -1;
+			break;
+		}
+	}
+	memset(process, 0, sizeof(Process));
+	return (status != -1 && WIFEXITED(status)) ? WEXITSTATUS(status) : -1;
+}
+
+#endif
+
+int runProcess(const char* const* argv, bool verbose) {
+	Process process;
+	if (!startProcess(&process, argv, PROCESS_PIPE_NONE, verbose)) {
+		return -1;
+	}
+	return waitProcess(&process);
+}
@@ -0,0 +1,45 @@
+//
+//  subprocess.h
+//  VectorC
+//
+
+#ifndef subprocess_h
+#define subprocess_h
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Which of the child's standard streams are connected to the driver.
+typedef enum {
+	PROCESS_PIPE_NONE,
+	PROCESS_PIPE_STDIN,		// The driver writes to `input`
+	PROCESS_PIPE_STDOUT		// The driver reads from `output`
+} ProcessPipe;
+
+typedef struct {
+	intptr_t pid;			// Child process id (unused by the _popen fallback)
+	FILE* input;			// Write end of the child's stdin, or NULL
+	FILE* output;			// Read end of the child's stdout, or NULL
+} Process;
+
+// Call once at start-up, before any thread starts a process. On POSIX this
+// ignores SIGPIPE, so a child that exits before reading all its input shows
+// up as a failed write rather than killing the compiler.
+void initSubprocesses(void);
+
+// Start a program with a NULL-terminated argument vector, searching PATH for
+// argv[0]. No shell is involved, so arguments need no quoting. When `verbose`
+// is set the command is echoed first.
+// Returns: false if the program could not be started.
+bool startProcess(Process* process, const char* const* argv, ProcessPipe pipe, bool verbose);
+
+// Close any pipe to the child and wait for it to exit.
+// Returns: the child's exit status, or -1 if it did not exit normally.
+int waitProcess(Process* process);
+
+// Start a program without pipes and wait for it.
+// Returns: the child's exit status, or -1 if it could not be run.
+int runProcess(const char* const* argv, bool verbose);
+
+#endif /* subprocess_h */
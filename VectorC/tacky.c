@@ -4,42 +4,33 @@
 
 #include "ast_c.h"
 #include "tacky.h"
-#include "stb_ds.h"
+#include "compiler_context.h"
+#include "stb_ds_config.h"
 
-static int currentFunctionTempCounter = 0;
-static const char* currentFunctionName = NULL;
-
-// Generate a unique temporary variable name for the current function.
-// Returns: pointer to newly allocated string.
-static const char* newTempVarName() {
-	char* name = malloc(32);
-	if (currentFunctionName) {
-		sprintf(name, "%s.tmp.%d", currentFunctionName, currentFunctionTempCounter++);
-	} else {
-		sprintf(name, "tmp.%d", currentFunctionTempCounter++);
-	}
-	return name;
+// Allocate the next temporary of the function under construction.
+// Returns: dense index of the new temporary.
+static int32_t newTempVar(TackyFunction* func) {
+	return func->tempCount++;
 }
 
 // Recursively translate an AST expression into TACKY instructions, appending
 // results to the given function.
+// ctx  - compilation receiving errors.
 // expr - AST expression node to translate.
 // func - function under construction receiving generated instructions.
 // Returns: TackyValue representing the location of the expression's result.
-static TackyValue translateExpression(const ExpressionNode* expr, TackyFunction* func) {
+static TackyValue translateExpression(CompilerContext* ctx, const ExpressionNode* expr, TackyFunction* func) {
 	if (!expr) {
-		fprintf(stderr, "Null expression node encountered\n");
-		exit(EXIT_FAILURE);
+		compilerError(ctx, "Null expression node encountered");
 	}
 
 	if (expr->type == EXP_CONSTANT) {
 		return (TackyValue){ .type = TACKY_VAL_CONSTANT, .constantValue = expr->value.constant.intValue };
 	}
 	else if (expr->type == EXP_UNARY) {
-		TackyValue src = translateExpression(expr->value.unary.operand, func);
+		TackyValue src = translateExpression(ctx, expr->value.unary.operand, func);
 
-		const char* dstName = newTempVarName();
-		TackyValue dst = { .type = TACKY_VAL_VAR, .varName = dstName };
+		TackyValue dst = { .type = TACKY_VAL_VAR, .varIndex = newTempVar(func) };
 
 		TackyInstruction instr = {
 			.type = TACKY_INSTR_UNARY,
@@ -54,11 +45,10 @@ static TackyValue translateExpression(const ExpressionNode* expr, TackyFunction*
 		return dst;
 	}
 	else if (expr->type == EXP_BINARY) {
-		TackyValue lhs = translateExpression(expr->value.binary.left, func);
-		TackyValue rhs = translateExpression(expr->value.binary.right, func);
+		TackyValue lhs = translateExpression(ctx, expr->value.binary.left, func);
+		TackyValue rhs = translateExpression(ctx, expr->value.binary.right, func);
 
-		const char* dstName = newTempVarName();
-		TackyValue dst = { .type = TACKY_VAL_VAR, .varName = dstName };
+		TackyValue dst = { .type = TACKY_VAL_VAR, .varIndex = newTempVar(func) };
 
 		TackyBinaryOperator op;
 		switch (expr->value.binary.op) {
@@ -93,8 +83,7 @@ static TackyValue translateExpression(const ExpressionNode* expr, TackyFunction*
 				op = TACKY_SHIFT_RIGHT;
 				break;
 			default:
-				fprintf(stderr, "Unknown binary operator in TACKY generation\n");
-				exit(EXIT_FAILURE);
+				compilerError(ctx, "Unknown binary operator in TACKY generation");
 		}
 
 		TackyInstruction instr = {
@@ -111,31 +100,33 @@ static TackyValue translateExpression(const ExpressionNode* expr, TackyFunction*
 		return dst;
 	}
 	else {
-		fprintf(stderr, "Unsupported expression type in TACKY generation\n");
-		exit(EXIT_FAILURE);
+		compilerError(ctx, "Unsupported expression type in TACKY generation");
 	}
 }
 
 // Build a TackyProgram from the high-level AST.
+// ctx - compilation receiving errors.
 // ast - root of the AST produced by the parser.
+// reuse - optional, one flag per function; flagged functions keep only their name.
 // Returns: dynamically allocated TackyProgram structure.
-TackyProgram* generateTackyFromAst(const ProgramNode* ast) {
+TackyProgram* generateTackyFromAst(CompilerContext* ctx, const ProgramNode* ast, const bool* reuse) {
 	if (!ast) return NULL;
 
 	TackyProgram* program = (TackyProgram*)malloc(sizeof(TackyProgram));
 	program->functions = NULL;
 
-	for (FunctionNode* funcNode = ast->function; funcNode != NULL; funcNode = funcNode->next) {
-		currentFunctionName = funcNode->name;
-		currentFunctionTempCounter = 0;
+	size_t index = 0;
+	for (FunctionNode* funcNode = ast->function; funcNode != NULL; funcNode = funcNode->next, index++) {
 		TackyFunction func = {0};
 		func.name = funcNode->name;
 		func.instructions = NULL;
 		
-		if (funcNode->body && funcNode->body->type == STMT_RETURN) {
+		// A reused function's output already exists, so it needs no instructions.
+		bool reused = reuse != NULL && reuse[index];
+		if (!reused && funcNode->body && funcNode->body->type == STMT_RETURN) {
 			ExpressionNode* returnExpr = funcNode->body->expr;
 
-			TackyValue retVal = translateExpression(returnExpr, &func);
+			TackyValue retVal = translateExpression(ctx, returnExpr, &func);
 
 			TackyInstruction retInstr = {
 				.type = TACKY_INSTR_RETURN,
@@ -150,38 +141,59 @@ TackyProgram* generateTackyFromAst(const ProgramNode* ast) {
 	return program;
 }
 
+// Format the display name of a temporary. Names are only produced for
+// printing; the IR itself refers to temporaries by index.
+// Returns: buffer, for use directly in printf arguments.
+const char* getTackyVarName(const TackyFunction* func, int32_t varIndex, char* buffer, size_t bufferSize) {
+	if (func->name) {
+		snprintf(buffer, bufferSize, "%s.tmp.%d", func->name, varIndex);
+	} else {
+		snprintf(buffer, bufferSize, "tmp.%d", varIndex);
+	}
+	return buffer;
+}
+
 // Pretty-print a TackyProgram for debugging purposes.
+// out     - stream receiving the listing.
 // program - program to display.
-void printTackyProgram(const TackyProgram* program) {
+void printTackyProgram(FILE* out, const TackyProgram* program, const bool* reuse) {
 	if (!program) {
-		printf("TackyProgram(NULL)\n");
+		fprintf(out, "TackyProgram(NULL)\n");
 		return;
 	}
 
-	printf("TackyProgram(\n");
+	char nameBuffer[3][256];
+#define VAR_NAME(value, slot) getTackyVarName(func, (value).varIndex, nameBuffer[slot], sizeof(nameBuffer[slot]))
+
+	fprintf(out, "TackyProgram(\n");
 	for (size_t i = 0; i < arrlenu(program->functions); ++i) {
 		const TackyFunction* func = &program->functions[i];
-		printf("    Function(name=%s\n", func->name);
+		if (reuse && reuse[i]) {
+			// Never lowered: its output comes from the incremental index.
+			fprintf(out, "    Function(name=%s) (reused from index)\n", func->name);
+			continue;
+		}
+		fprintf(out, "    Function(name=%s\n", func->name);
 		for (size_t j = 0; j < arrlenu(func->instructions); ++j) {
 			const TackyInstruction* instr = &func->instructions[j];
 			switch (instr->type) {
 				case TACKY_INSTR_RETURN:
-					printf("        Return(");
+					fprintf(out, "        Return(");
 					if (instr->ret.value.type == TACKY_VAL_CONSTANT)
-						printf("%d", instr->ret.value.constantValue);
+						fprintf(out, "%d", instr->ret.value.constantValue);
 					else
-						printf("%s", instr->ret.value.varName);
-					printf(")\n");
+						fprintf(out, "%s", VAR_NAME(instr->ret.value, 0));
+					fprintf(out, ")\n");
 					break;
 
 				case TACKY_INSTR_UNARY:
-					printf("        Unary(%s, ",
+					fprintf(out, "        Unary(%s, ",
 						   instr->unary.op == TACKY_COMPLEMENT ? "Complement" : "Negate");
 					if (instr->unary.src.type == TACKY_VAL_CONSTANT)
-						printf("%d, ", instr->unary.src.constantValue);
+						fprintf(out, "%d, ", instr->unary.src.constantValue);
 					else
-						printf("%s, ", instr->unary.src.varName);
-					printf("%s)\n", instr->unary.dst.varName);
+						fprintf(out, "%s, ", VAR_NAME(instr->unary.src, 0));
+					fprintf(out, "%s)\n", VAR_NAME(instr->unary.dst, 1));
 					break;
 
 				case TACKY_INSTR_BINARY:
@@ -220,22 +232,34 @@ void printTackyProgram(const TackyProgram* program) {
 							opString = "Shr";
 							break;
 					}
-					printf("        Binary(%s, ", opString);
+					fprintf(out, "        Binary(%s, ", opString);
 					if (instr->binary.lhs.type == TACKY_VAL_CONSTANT)
-						printf("%d, ", instr->binary.lhs.constantValue);
+						fprintf(out, "%d, ", instr->binary.lhs.constantValue);
 					else
-						printf("%s, ", instr->binary.lhs.varName);
+						fprintf(out, "%s, ", VAR_NAME(instr->binary.lhs, 0));
 					if (instr->binary.rhs.type == TACKY_VAL_CONSTANT)
-						printf("%d, ", instr->binary.rhs.constantValue);
+						fprintf(out, "%d, ", instr->binary.rhs.constantValue);
 					else
-						printf("%s, ", instr->binary.rhs.varName);
-					printf("%s)\n", instr->binary.dst.varName);
+						fprintf(out, "%s, ", VAR_NAME(instr->binary.rhs, 1));
+					fprintf(out, "%s)\n", VAR_NAME(instr->binary.dst, 2));
 					break;
 				}
 
 			}
 		}
-		printf("    )\n");
+		fprintf(out, "    )\n");
+	}
+	fprintf(out, ")\n");
+#undef VAR_NAME
+}
+
+// Release a program returned by generateTackyFromAst.
+// program - program to free (may be NULL).
+void freeTackyProgram(TackyProgram* program) {
+	if (!program) return;
+	for (size_t i = 0; i < arrlenu(program->functions); i++) {
+		arrfree(program->functions[i].instructions);
 	}
-	printf(")\n");
+	arrfree(program->functions);
+	free(program);
 }
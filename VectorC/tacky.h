@@ -9,7 +9,9 @@
 #ifndef TACKY_H
 #define TACKY_H
 
+#include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
 
 #include "ast_c.h"
 // --------------------------------------------------
@@ -47,7 +49,7 @@ typedef struct {
     TackyValueType type;
     union {
         int constantValue;    // for TACKY_VAL_CONSTANT
-        const char* varName;  // for TACKY_VAL_VAR
+        int32_t varIndex;     // for TACKY_VAL_VAR, dense per function (0 .. tempCount-1)
     };
 } TackyValue;
 
@@ -88,8 +90,9 @@ typedef struct {
 // --------------------------------------------------
 
 typedef struct {
-    const char* name;
+    const char* name;                // interned
     TackyInstruction* instructions;  // stb_ds dynamic array
+    int32_t tempCount;               // number of temporaries used by the function
 } TackyFunction;
 
 // --------------------------------------------------
@@ -100,10 +103,20 @@ typedef struct {
     TackyFunction* functions;  // stb_ds dynamic array
 } TackyProgram;
 
-// Convert a high-level AST into TACKY intermediate representation.
-TackyProgram* generateTackyFromAst(const ProgramNode* ast);
+struct CompilerContext;
 
-// Print a human-readable representation of a TACKY program.
-void printTackyProgram(const TackyProgram* program);
+// Convert a high-level AST into TACKY intermediate representation. Functions
+// flagged in `reuse` (optional, one flag per function) are left empty.
+TackyProgram* generateTackyFromAst(struct CompilerContext* ctx, const ProgramNode* ast, const bool* reuse);
+
+// Format the name of a temporary for display, e.g. "main.tmp.3".
+const char* getTackyVarName(const TackyFunction* func, int32_t varIndex, char* buffer, size_t bufferSize);
+
+// Print a human-readable representation of a TACKY program. Functions flagged
+// in `reuse` (optional) are listed by name only.
+void printTackyProgram(FILE* out, const TackyProgram* program, const bool* reuse);
+
+// Release a program and all of its instructions.
+void freeTackyProgram(TackyProgram* program);
 
 #endif // TACKY_H
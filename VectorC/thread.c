@@ -0,0 +1,106 @@
+//
+//  thread.c
+//  VectorC
+//
+
+#include "thread.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// Worker threads run the same recursive parser and code generator as the main
+// thread, so they get a main-thread-sized stack rather than the much smaller
+// platform default (as little as 512 KB on macOS and 1 MB on Windows).
+#define THREAD_STACK_SIZE (16 * 1024 * 1024)
+
+#ifdef _WIN32
+
+static DWORD WINAPI threadEntry(LPVOID parameter) {
+	Thread* thread = (Thread*)parameter;
+	thread->function(thread->argument);
+	return 0;
+}
+
+bool threadStart(Thread* thread, ThreadFunction function, void* argument) {
+	thread->function = function;
+	thread->argument = argument;
+	thread->handle = CreateThread(NULL, THREAD_STACK_SIZE, threadEntry, thread,
+		STACK_SIZE_PARAM_IS_A_RESERVATION, NULL);
+	return thread->handle != NULL;
+}
+
+void threadJoin(Thread* thread) {
+	WaitForSingleObject(thread->handle, INFINITE);
+	CloseHandle(thread->handle);
+}
+
+void mutexInit(Mutex* mutex) {
+	InitializeSRWLock(&mutex->lock);
+}
+
+void mutexLock(Mutex* mutex) {
+	AcquireSRWLockExclusive(&mutex->lock);
+}
+
+void mutexUnlock(Mutex* mutex) {
+	ReleaseSRWLockExclusive(&mutex->lock);
+}
+
+void mutexDestroy(Mutex* mutex) {
+	(void)mutex;
+}
+
+int getProcessorCount(void) {
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+#else
+
+static void* threadEntry(void* parameter) {
+	Thread* thread = (Thread*)parameter;
+	thread->function(thread->argument);
+	return NULL;
+}
+
+bool threadStart(Thread* thread, ThreadFunction function, void* argument) {
+	thread->function = function;
+	thread->argument = argument;
+	pthread_attr_t attributes;
+	if (pthread_attr_init(&attributes) != 0) {
+		return false;
+	}
+	pthread_attr_setstacksize(&attributes, THREAD_STACK_SIZE);
+	bool started = pthread_create(&thread->handle, &attributes, threadEntry, thread) == 0;
+	pthread_attr_destroy(&attributes);
+	return started;
+}
+
+void threadJoin(Thread* thread) {
+	pthread_join(thread->handle, NULL);
+}
+
+void mutexInit(Mutex* mutex) {
+	pthread_mutex_init(&mutex->lock, NULL);
+}
+
+void mutexLock(Mutex* mutex) {
+	pthread_mutex_lock(&mutex->lock);
+}
+
+void mutexUnlock(Mutex* mutex) {
+	pthread_mutex_unlock(&mutex->lock);
+}
+
+void mutexDestroy(Mutex* mutex) {
+	pthread_mutex_destroy(&mutex->lock);
+}
+
+int getProcessorCount(void) {
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (int)count : 1;
+}
+
+#endif
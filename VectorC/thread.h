@@ -0,0 +1,51 @@
+//
+//  thread.h
+//  VectorC
+//
+
+#ifndef thread_h
+#define thread_h
+
+#include <stdbool.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+typedef void (*ThreadFunction)(void* argument);
+
+// A joinable thread. Must stay at the same address until threadJoin returns.
+typedef struct {
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	pthread_t handle;
+#endif
+	ThreadFunction function;
+	void* argument;
+} Thread;
+
+typedef struct {
+#ifdef _WIN32
+	SRWLOCK lock;
+#else
+	pthread_mutex_t lock;
+#endif
+} Mutex;
+
+// Returns: false if the thread could not be created.
+bool threadStart(Thread* thread, ThreadFunction function, void* argument);
+void threadJoin(Thread* thread);
+
+void mutexInit(Mutex* mutex);
+void mutexLock(Mutex* mutex);
+void mutexUnlock(Mutex* mutex);
+void mutexDestroy(Mutex* mutex);
+
+// Number of processors available to the process (at least 1).
+int getProcessorCount(void);
+
+#endif /* thread_h */
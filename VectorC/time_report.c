@@ -0,0 +1,240 @@
+//
+//  time_report.c
+//  VectorC
+//
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "time_report.h"
+#include "mem_report.h"
+#include "perf_counters.h"
+#include "time_trace.h"
+#include "version.h"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+typedef struct {
+	const char* label;				// Table row
+	const char* key;				// JSON member
+} PhaseName;
+
+static const PhaseName s_phaseNames[PHASE_COUNT] = {
+	[PHASE_OTHER] = { "Other", "other" },
+	[PHASE_READ_FILE] = { "Read files", "readFile" },
+	[PHASE_PREPROCESS] = { "Preprocess", "preprocess" },
+	[PHASE_LEX] = { "Lex", "lex" },
+	[PHASE_PARSE] = { "Parse", "parse" },
+	[PHASE_TACKY] = { "TACKY", "tacky" },
+	[PHASE_TRANSLATE] = { "Translate", "translate" },
+	[PHASE_REPLACE_PSEUDOS] = { "Replace pseudo registers", "replacePseudos" },
+	[PHASE_FIXUP] = { "Fix up instructions", "fixup" },
+	[PHASE_EMIT] = { "Emit", "emit" },
+	[PHASE_WRITE_OUTPUT] = { "Write output", "writeOutput" },
+	[PHASE_ASSEMBLE] = { "Assemble and link", "assemble" },
+};
+
+static _Thread_local CompilerPhase s_currentPhase = PHASE_OTHER;
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+uint64_t readWallNanoseconds(void) {
+	static LARGE_INTEGER frequency;
+	if (frequency.QuadPart == 0) {
+		QueryPerformanceFrequency(&frequency);
+	}
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+}
+
+TimeStamp readTimeStamp(void) {
+	FILETIME creation, exit, kernel, user;
+	GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+	uint64_t cpu = (((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime) +
+		(((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime);
+	return (TimeStamp){
+		.wallNanoseconds = readWallNanoseconds(),
+		.cpuNanoseconds = cpu * 100,
+	};
+}
+
+uint64_t readChildCpuNanoseconds(void) {
+	return 0;
+}
+
+#else
+
+static uint64_t readClock(clockid_t clock) {
+	struct timespec now;
+	clock_gettime(clock, &now);
+	return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+uint64_t readWallNanoseconds(void) {
+	return readClock(CLOCK_MONOTONIC);
+}
+
+TimeStamp readTimeStamp(void) {
+	return (TimeStamp){
+		.wallNanoseconds = readClock(CLOCK_MONOTONIC),
+		.cpuNanoseconds = readClock(CLOCK_THREAD_CPUTIME_ID),
+	};
+}
+
+uint64_t readChildCpuNanoseconds(void) {
+	struct rusage usage;
+	if (getrusage(RUSAGE_CHILDREN, &usage) != 0) {
+		return 0;
+	}
+	return ((uint64_t)usage.ru_utime.tv_sec + (uint64_t)usage.ru_stime.tv_sec) * 1000000000u +
+		((uint64_t)usage.ru_utime.tv_usec + (uint64_t)usage.ru_stime.tv_usec) * 1000u;
+}
+
+#endif
+
+void addChildCpuTime(PhaseTimes* times, uint64_t since) {
+	if (times != NULL) {
+		times->cpuNanoseconds[s_currentPhase] += readChildCpuNanoseconds() - since;
+	}
+}
+
+const char* getPhaseName(CompilerPhase phase) {
+	return s_phaseNames[phase].label;
+}
+
+const char* getPhaseKey(CompilerPhase phase) {
+	return s_phaseNames[phase].key;
+}
+
+CompilerPhase getCurrentPhase(void) {
+	return s_currentPhase;
+}
+
+void startPhaseTimes(PhaseTimes* times) {
+	memset(times, 0, sizeof(*times));
+	s_currentPhase = PHASE_OTHER;
+	times->since = readTimeStamp();
+}
+
+CompilerPhase switchPhase(PhaseTimes* times, CompilerPhase phase) {
+	CompilerPhase previous = s_currentPhase;
+	s_currentPhase = phase;
+	if (isMemoryReportEnabled()) {
+		sampleMemoryPhase(previous);
+	}
+	if (arePerfCountersEnabled()) {
+		samplePerfCounters(previous);
+	}
+	if (isTimeTraceEnabled()) {
+		traceSwitchPhase(previous);
+	}
+	if (times != NULL) {
+		TimeStamp now = readTimeStamp();
+		times->wallNanoseconds[previous] += now.wallNanoseconds - times->since.wallNanoseconds;
+		times->cpuNanoseconds[previous] += now.cpuNanoseconds - times->since.cpuNanoseconds;
+		times->since = now;
+	}
+	return previous;
+}
+
+void addPhaseTimes(PhaseTimes* times, const PhaseTimes* other) {
+	for (int p = 0; p < PHASE_COUNT; p++) {
+		times->wallNanoseconds[p] += other->wallNanoseconds[p];
+		times->cpuNanoseconds[p] += other->cpuNanoseconds[p];
+	}
+}
+
+void addToTimeReport(TimeReport* report, PhaseTimes* times) {
+	switchPhase(times, s_currentPhase);
+	mutexLock(&report->lock);
+	addPhaseTimes(&report->total, times);
+	report->fileCount++;
+	mutexUnlock(&report->lock);
+}
+
+void initTimeReport(TimeReport* report) {
+	memset(report, 0, sizeof(*report));
+	mutexInit(&report->lock);
+}
+
+void destroyTimeReport(TimeReport* report) {
+	mutexDestroy(&report->lock);
+}
+
+// Phases in decreasing order of wall time; ties keep pipeline order.
+static void sortPhases(const TimeReport* report, CompilerPhase order[PHASE_COUNT]) {
+	for (int p = 0; p < PHASE_COUNT; p++) {
+		int slot = p;
+		while (slot > 0 && report->total.wallNanoseconds[order[slot - 1]] < report->total.wallNanoseconds[p]) {
+			order[slot] = order[slot - 1];
+			slot--;
+		}
+		order[slot] = (CompilerPhase)p;
+	}
+}
+
+static uint64_t sumWallNanoseconds(const TimeReport* report) {
+	uint64_t total = 0;
+	for (int p = 0; p < PHASE_COUNT; p++) {
+		total += report->total.wallNanoseconds[p];
+	}
+	return total;
+}
+
+void printTimeReport(FILE* out, const TimeReport* report) {
+	CompilerPhase order[PHASE_COUNT];
+	sortPhases(report, order);
+	uint64_t totalWall = sumWallNanoseconds(report);
+	uint64_t totalCpu = 0;
+
+	// Backend passes on several threads are summed, so the total is thread
+	// time and can exceed the elapsed time.
+	fprintf(out, "Time report: %zu file%s in %.3f ms\n", report->fileCount, report->fileCount == 1 ? "" : "s",
+			(double)report->elapsedNanoseconds * 1e-6);
+	fprintf(out, "  %12s  %6s  %12s  %s\n", "Wall (ms)", "Wall", "CPU (ms)", "Phase");
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		CompilerPhase phase = order[i];
+		uint64_t wall = report->total.wallNanoseconds[phase];
+		uint64_t cpu = report->total.cpuNanoseconds[phase];
+		totalCpu += cpu;
+		if (wall == 0 && cpu == 0) {
+			continue;
+		}
+		fprintf(out, "  %12.3f  %5.1f%%  %12.3f  %s\n", (double)wall * 1e-6,
+				totalWall > 0 ? 100.0 * (double)wall / (double)totalWall : 0.0, (double)cpu * 1e-6, s_phaseNames[phase].label);
+	}
+	fprintf(out, "  %12.3f  %5.1f%%  %12.3f  %s\n", (double)totalWall * 1e-6, 100.0, (double)totalCpu * 1e-6, "Total");
+}
+
+bool writeTimeReportJson(const char* path, const TimeReport* report) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+	CompilerPhase order[PHASE_COUNT];
+	sortPhases(report, order);
+	uint64_t totalWall = sumWallNanoseconds(report);
+
+	fprintf(file, "{\n");
+	fprintf(file, "  \"version\": \"%s\",\n", VECTORC_VERSION);
+	fprintf(file, "  \"files\": %zu,\n", report->fileCount);
+	fprintf(file, "  \"elapsedMilliseconds\": %.6f,\n", (double)report->elapsedNanoseconds * 1e-6);
+	fprintf(file, "  \"phases\": [\n");
+	for (int i = 0; i < PHASE_COUNT; i++) {
+		CompilerPhase phase = order[i];
+		uint64_t wall = report->total.wallNanoseconds[phase];
+		fprintf(file, "    { \"name\": \"%s\", \"wallMilliseconds\": %.6f, \"cpuMilliseconds\": %.6f, \"percent\": %.2f }%s\n",
+				s_phaseNames[phase].key, (double)wall * 1e-6, (double)report->total.cpuNanoseconds[phase] * 1e-6,
+				totalWall > 0 ? 100.0 * (double)wall / (double)totalWall : 0.0, i + 1 < PHASE_COUNT ? "," : "");
+	}
+	fprintf(file, "  ]\n");
+	fprintf(file, "}\n");
+	return fclose(file) == 0;
+}
@@ -0,0 +1,114 @@
+//
+//  time_report.h
+//  VectorC
+//
+
+#ifndef time_report_h
+#define time_report_h
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "thread.h"
+
+// What -ftime-report charges time to. Phases do not nest: entering one
+// pauses the one it interrupts, so the times add up to the whole run.
+typedef enum {
+	PHASE_OTHER,					// Driver work between phases, waiting for threads
+	PHASE_READ_FILE,				// Reading sources and headers from disk
+	PHASE_PREPROCESS,
+	PHASE_LEX,						// scanTokens
+	PHASE_PARSE,					// parseProgramTokens
+	PHASE_TACKY,					// generateTackyFromAst
+	PHASE_TRANSLATE,				// Backend pass 1: TACKY to instructions
+	PHASE_REPLACE_PSEUDOS,			// Backend pass 2: stack slots for temporaries
+	PHASE_FIXUP,					// Backend pass 3: legalize operands
+	PHASE_EMIT,						// Assembly text or machine code
+	PHASE_WRITE_OUTPUT,				// The .s, object or executable
+	PHASE_ASSEMBLE,					// clang as assembler or linker
+	PHASE_COUNT
+} CompilerPhase;
+
+// A reading of the monotonic clock and of the calling thread's CPU clock.
+typedef struct {
+	uint64_t wallNanoseconds;
+	uint64_t cpuNanoseconds;
+} TimeStamp;
+
+// The time one thread has spent in each phase.
+typedef struct {
+	uint64_t wallNanoseconds[PHASE_COUNT];
+	uint64_t cpuNanoseconds[PHASE_COUNT];
+	TimeStamp since;				// When the current phase was entered
+} PhaseTimes;
+
+// Phase times of every compilation of a run, with the run's elapsed time.
+typedef struct {
+	Mutex lock;						// Guards everything below
+	PhaseTimes total;
+	size_t fileCount;
+	uint64_t elapsedNanoseconds;
+} TimeReport;
+
+TimeStamp readTimeStamp(void);
+
+// The monotonic clock alone.
+uint64_t readWallNanoseconds(void);
+
+// CPU time used so far by child processes that have been waited for.
+uint64_t readChildCpuNanoseconds(void);
+
+// Charge the CPU time of child processes waited for since `since`, an
+// earlier readChildCpuNanoseconds, to the current phase. The count is per
+// process, so children of concurrent compilations are included too.
+void addChildCpuTime(PhaseTimes* times, uint64_t since);
+
+// A phase's name as the reports print it.
+const char* getPhaseName(CompilerPhase phase);
+
+// A phase's name as one camelCase word, as in the JSON report.
+const char* getPhaseKey(CompilerPhase phase);
+
+// The phase the calling thread is in; PHASE_OTHER until it first switches.
+CompilerPhase getCurrentPhase(void);
+
+// Start timing on the calling thread, in PHASE_OTHER.
+void startPhaseTimes(PhaseTimes* times);
+
+//
+// switchPhase
+// -----------
+// Make `phase` the calling thread's current phase, first charging the time
+// since the last switch to the phase it leaves. Nothing is timed when
+// `times` is NULL, which is how every phase runs without -ftime-report.
+// With -fmem-report, the memory report samples the peak RSS here; with
+// -ftime-trace the phase left becomes a trace event; and with -fperf-counters
+// the thread's hardware counters are read and charged to it.
+//
+// Returns:
+//   The phase that was running, to switch back to afterwards.
+//
+CompilerPhase switchPhase(PhaseTimes* times, CompilerPhase phase);
+
+// Add the phases of `other` to `times`, as when a helper thread's times are
+// folded into its compilation's. Only the time up to other's last switch is
+// included; the clock it reads belongs to the thread that kept it.
+void addPhaseTimes(PhaseTimes* times, const PhaseTimes* other);
+
+// Charge the time since the last switch, then add the phase times of one
+// compilation, timed on the calling thread, to the run's report.
+void addToTimeReport(TimeReport* report, PhaseTimes* times);
+
+void initTimeReport(TimeReport* report);
+void destroyTimeReport(TimeReport* report);
+
+// A table of the phases, slowest first, with their share of the total.
+void printTimeReport(FILE* out, const TimeReport* report);
+
+// The same figures as a JSON object, for tracking compile time over releases.
+// Returns: false if the file could not be written.
+bool writeTimeReportJson(const char* path, const TimeReport* report);
+
+#endif /* time_report_h */
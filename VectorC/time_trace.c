@@ -0,0 +1,182 @@
+//
+//  time_trace.c
+//  VectorC
+//
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "time_trace.h"
+#include "thread.h"
+
+typedef struct {
+	const char* category;			// NULL for a thread name
+	size_t name;					// Offset in TimeTrace::names
+	const char* file;
+	uint64_t start;					// Nanoseconds since the trace started
+	uint64_t duration;
+	uint32_t thread;
+} TraceEvent;
+
+// The trace's storage uses plain malloc rather than the counted allocator, so
+// -fmem-report does not charge the profiler's own memory to compiler phases.
+typedef struct {
+	Mutex lock;						// Guards everything below
+	TraceEvent* events;
+	size_t eventCount;
+	size_t eventCapacity;
+	char* names;					// Copies of event and thread names, NUL-separated
+	size_t namesLength;
+	size_t namesCapacity;
+} TimeTrace;
+
+static TimeTrace s_trace;
+static atomic_bool s_enabled;
+static uint64_t s_origin;			// When tracing was enabled
+static _Atomic uint32_t s_nextThread = 1;
+
+static _Thread_local uint32_t s_thread;
+static _Thread_local const char* s_file;
+static _Thread_local uint64_t s_phaseStart;
+
+void enableTimeTrace(void) {
+	mutexInit(&s_trace.lock);
+	s_origin = readWallNanoseconds();
+	atomic_store(&s_enabled, true);
+}
+
+bool isTimeTraceEnabled(void) {
+	return atomic_load_explicit(&s_enabled, memory_order_relaxed);
+}
+
+// Trace viewers want small thread ids; hand them out on first use.
+static uint32_t getTraceThread(void) {
+	if (s_thread == 0) {
+		s_thread = atomic_fetch_add(&s_nextThread, 1);
+	}
+	return s_thread;
+}
+
+// Grow a buffer to hold at least `needed` items.
+static void* growBuffer(void* buffer, size_t* capacity, size_t needed, size_t itemSize) {
+	if (needed <= *capacity) {
+		return buffer;
+	}
+	size_t newCapacity = *capacity ? *capacity * 2 : 256;
+	while (newCapacity < needed) {
+		newCapacity *= 2;
+	}
+	buffer = realloc(buffer, newCapacity * itemSize);
+	if (buffer == NULL) {
+		perror("Failed to grow the time trace");
+		exit(EXIT_FAILURE);
+	}
+	*capacity = newCapacity;
+	return buffer;
+}
+
+static void addEvent(const char* category, const char* name, uint64_t start, uint64_t end) {
+	TraceEvent event = {
+		.category = category,
+		.file = s_file,
+		.start = start - s_origin,
+		.duration = end - start,
+		.thread = getTraceThread(),
+	};
+	size_t nameLength = strlen(name) + 1;
+	mutexLock(&s_trace.lock);
+	s_trace.names = growBuffer(s_trace.names, &s_trace.namesCapacity, s_trace.namesLength + nameLength, 1);
+	memcpy(s_trace.names + s_trace.namesLength, name, nameLength);
+	event.name = s_trace.namesLength;
+	s_trace.namesLength += nameLength;
+	s_trace.events = growBuffer(s_trace.events, &s_trace.eventCapacity, s_trace.eventCount + 1, sizeof(TraceEvent));
+	s_trace.events[s_trace.eventCount++] = event;
+	mutexUnlock(&s_trace.lock);
+}
+
+void traceEvent(const char* category, const char* name, uint64_t start) {
+	if (isTimeTraceEnabled()) {
+		addEvent(category, name, start, readWallNanoseconds());
+	}
+}
+
+void setTraceThreadName(const char* name) {
+	if (isTimeTraceEnabled()) {
+		addEvent(NULL, name, s_origin, s_origin);
+	}
+}
+
+void setTraceFile(const char* path) {
+	s_file = path;
+}
+
+void traceSwitchPhase(CompilerPhase previous) {
+	uint64_t now = readWallNanoseconds();
+	// Time outside the phases is left as a gap.
+	if (previous != PHASE_OTHER && s_phaseStart != 0) {
+		addEvent("Phase", getPhaseName(previous), s_phaseStart, now);
+	}
+	s_phaseStart = now;
+}
+
+static void writeJsonString(FILE* file, const char* text) {
+	fputc('"', file);
+	for (const unsigned char* c = (const unsigned char*)text; *c; c++) {
+		if (*c == '"' || *c == '\\') {
+			fprintf(file, "\\%c", *c);
+		} else if (*c < 0x20) {
+			fprintf(file, "\\u%04x", *c);
+		} else {
+			fputc(*c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+bool writeTimeTrace(const char* path) {
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+	mutexLock(&s_trace.lock);
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (size_t i = 0; i < s_trace.eventCount; i++) {
+		const TraceEvent* event = &s_trace.events[i];
+		const char* name = s_trace.names + event->name;
+		if (event->category == NULL) {
+			fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", event->thread);
+			writeJsonString(file, name);
+			fprintf(file, "}}");
+		} else {
+			fprintf(file, "{\"name\":");
+			writeJsonString(file, name);
+			fprintf(file, ",\"cat\":");
+			writeJsonString(file, event->category);
+			fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u",
+					(double)event->start * 1e-3, (double)event->duration * 1e-3, event->thread);
+			if (event->file != NULL) {
+				fprintf(file, ",\"args\":{\"file\":");
+				writeJsonString(file, event->file);
+				fprintf(file, "}");
+			}
+			fprintf(file, "}");
+		}
+		fprintf(file, "%s\n", i + 1 < s_trace.eventCount ? "," : "");
+	}
+	fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+	mutexUnlock(&s_trace.lock);
+	return fclose(file) == 0;
+}
+
+void destroyTimeTrace(void) {
+	if (!isTimeTraceEnabled()) {
+		return;
+	}
+	atomic_store(&s_enabled, false);
+	free(s_trace.events);
+	free(s_trace.names);
+	mutexDestroy(&s_trace.lock);
+	memset(&s_trace, 0, sizeof(s_trace));
+}
@@ -0,0 +1,48 @@
+//
+//  time_trace.h
+//  VectorC
+//
+
+#ifndef time_trace_h
+#define time_trace_h
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "time_report.h"
+
+// Start recording trace events for -ftime-trace. Every phase switch becomes
+// an event on the thread that made it.
+void enableTimeTrace(void);
+bool isTimeTraceEnabled(void);
+
+// Record an event on the calling thread lasting from `start` (a reading of
+// readWallNanoseconds) until now. `name` is copied; `category` must outlive
+// the trace.
+void traceEvent(const char* category, const char* name, uint64_t start);
+
+// Name the calling thread in the trace viewer.
+void setTraceThreadName(const char* name);
+
+// The source file events on the calling thread belong to, shown with each
+// event; NULL for none. Must outlive the trace.
+void setTraceFile(const char* path);
+
+// Called by switchPhase: close the event of the phase the thread is leaving.
+void traceSwitchPhase(CompilerPhase previous);
+
+//
+// writeTimeTrace
+// --------------
+// Write every event recorded so far as a Chrome trace-event JSON file, for
+// chrome://tracing or Perfetto.
+//
+// Returns:
+//   false if the file could not be written.
+//
+bool writeTimeTrace(const char* path);
+
+// Stop tracing and release the events.
+void destroyTimeTrace(void);
+
+#endif /* time_trace_h */
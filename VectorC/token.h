@@ -21,7 +21,7 @@ typedef enum {
 	TOKEN_IDENTIFIER, TOKEN_STRING, TOKEN_NUMBER,
 
 	// Keyworkds.
-	TOKEN_ELSE, TOKEN_FALSE, TOKEN_FOR, TOKEN_IF, TOKEN_INT, TOKEN_RETURN, TOKEN_VOID, TOKEN_WHILE,
+	TOKEN_AUTO, TOKEN_BREAK, TOKEN_CASE, TOKEN_CHAR, TOKEN_CONST, TOKEN_CONTINUE, TOKEN_DEFAULT, TOKEN_DO, TOKEN_DOUBLE, TOKEN_ELSE, TOKEN_ENUM, TOKEN_EXTERN, TOKEN_FALSE, TOKEN_FLOAT, TOKEN_FOR, TOKEN_GOTO, TOKEN_IF, TOKEN_INLINE, TOKEN_INT, TOKEN_LONG, TOKEN_REGISTER, TOKEN_RESTRICT, TOKEN_RETURN, TOKEN_SHORT, TOKEN_SIGNED, TOKEN_SIZEOF, TOKEN_STATIC, TOKEN_STRUCT, TOKEN_SWITCH, TOKEN_TYPEDEF, TOKEN_UNION, TOKEN_UNSIGNED, TOKEN_VOID, TOKEN_VOLATILE, TOKEN_WHILE,
 
 	TOKEN_ERROR, TOKEN_EOF,
 	
@@ -36,6 +36,7 @@ typedef struct {
 	union {               // Union for different value types
 		int intValue;
 		double doubleValue;
+		const char* name;	// Interned lexeme of a TOKEN_IDENTIFIER
 		// Add more types here as needed
 	} value;
 } Token;
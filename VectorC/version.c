@@ -0,0 +1,82 @@
+//
+//  version.c
+//  VectorC
+//
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "version.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#elif defined(__APPLE__)
+#include <mach-o/dyld.h>
+#endif
+
+#define STRINGIFY_(x) #x
+#define STRINGIFY(x) STRINGIFY_(x)
+
+static const char s_fallbackId[] = "vecc " VECTORC_VERSION " output " STRINGIFY(VECTORC_OUTPUT_VERSION);
+
+static uint8_t s_executableDigest[SHA256_DIGEST_SIZE];
+static bool s_haveExecutableDigest;
+static bool s_initialized;
+
+// Path of the running executable.
+// Returns: false if the platform cannot say.
+static bool getExecutablePath(char* path, size_t size) {
+#if defined(_WIN32)
+	DWORD length = GetModuleFileNameA(NULL, path, (DWORD)size);
+	return length > 0 && length < size;
+#elif defined(__APPLE__)
+	uint32_t length = (uint32_t)size;
+	return _NSGetExecutablePath(path, &length) == 0;
+#elif defined(__linux__)
+	// Opens the file that was executed even if it has since been replaced.
+	snprintf(path, size, "/proc/self/exe");
+	return true;
+#else
+	(void)path;
+	(void)size;
+	return false;
+#endif
+}
+
+static bool hashExecutable(uint8_t digest[SHA256_DIGEST_SIZE]) {
+	char path[4096];
+	if (!getExecutablePath(path, sizeof(path))) {
+		return false;
+	}
+	FILE* file = fopen(path, "rb");
+	if (file == NULL) {
+		return false;
+	}
+	Sha256 hash;
+	sha256Init(&hash);
+	uint8_t buffer[65536];
+	size_t length;
+	while ((length = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+		sha256Update(&hash, buffer, length);
+	}
+	bool ok = !ferror(file);
+	fclose(file);
+	sha256Final(&hash, digest);
+	return ok;
+}
+
+void initBuildId(void) {
+	if (s_initialized) {
+		return;
+	}
+	s_haveExecutableDigest = hashExecutable(s_executableDigest);
+	s_initialized = true;
+}
+
+void hashBuildId(Sha256* hash) {
+	sha256Update(hash, s_fallbackId, sizeof(s_fallbackId));
+	if (s_haveExecutableDigest) {
+		sha256Update(hash, s_executableDigest, sizeof(s_executableDigest));
+	}
+}
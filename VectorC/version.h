@@ -0,0 +1,31 @@
+//
+//  version.h
+//  VectorC
+//
+
+#ifndef version_h
+#define version_h
+
+#include "sha256.h"
+
+#define VECTORC_VERSION "0.1.0"
+
+// Bump whenever a change to code generation makes the same input compile to
+// different output. Cache keys include it, so builds that cannot hash their
+// own executable still stop reusing output from an older code generator.
+#define VECTORC_OUTPUT_VERSION 1
+
+//
+// initBuildId
+// -----------
+// Hash the running executable, so output cached by one build of the compiler
+// is never reused by another. Call it before any thread computes a cache key;
+// later calls do nothing. If the executable cannot be read the build is
+// identified by VECTORC_VERSION and VECTORC_OUTPUT_VERSION alone.
+//
+void initBuildId(void);
+
+// Feed the build id into a cache key.
+void hashBuildId(Sha256* hash);
+
+#endif /* version_h */
@@ -0,0 +1,318 @@
+//
+//  x64_encoder.c
+//  VectorC
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "x64_encoder.h"
+#include "elf_writer.h"
+#include "compiler_context.h"
+#include "intern.h"
+#include "stb_ds_config.h"
+
+// Encodings of the two-operand ALU instructions. Where the assembler has a
+// choice, the same form as GNU as is picked so `objdump -d` of an object
+// written here matches one assembled from emitX64Function's output.
+typedef struct {
+	uint8_t storeOpcode;		// op r32, r/m32
+	uint8_t loadOpcode;			// op r/m32, r32
+	uint8_t accumulatorOpcode;	// op imm32, %eax
+	uint8_t extension;			// ModRM.reg of the 0x81 / 0x83 immediate forms
+} AluEncoding;
+
+static const AluEncoding s_aluEncodings[] = {
+	[X64_ADD] = { 0x01, 0x03, 0x05, 0 },
+	[X64_OR]  = { 0x09, 0x0B, 0x0D, 1 },
+	[X64_AND] = { 0x21, 0x23, 0x25, 4 },
+	[X64_SUB] = { 0x29, 0x2B, 0x2D, 5 },
+	[X64_XOR] = { 0x31, 0x33, 0x35, 6 },
+};
+
+static void encodingError(const Function* func, const char* message) {
+	fprintf(stderr, "Error: Cannot encode instruction in '%s': %s\n", func->name, message);
+	exit(EXIT_FAILURE);
+}
+
+static void emitByte(uint8_t** code, uint8_t byte) {
+	arrput(*code, byte);
+}
+
+static void emitImm32(uint8_t** code, int32_t value) {
+	uint32_t bits = (uint32_t)value;
+	for (int i = 0; i < 4; i++) {
+		emitByte(code, (uint8_t)(bits >> (i * 8)));
+	}
+}
+
+static bool fitsInt8(int32_t value) {
+	return value >= -128 && value <= 127;
+}
+
+// Hardware number of a register; bit 3 goes into a REX prefix.
+static uint8_t registerNumber(const Function* func, Register reg) {
+	switch (reg) {
+		case REG_EAX: return 0;
+		case REG_ECX: return 1;
+		case REG_EDX: return 2;
+		case REG_R10D: return 10;
+		default:
+			encodingError(func, "not an x64 register");
+			return 0;
+	}
+}
+
+//
+// emitModRM
+// ---------
+// Emit an instruction of the form [REX] opcode ModRM [disp]. `regField` is
+// either a register number or an opcode extension; `rm` is a register or a
+// %rbp-relative stack slot.
+//
+static void emitModRM(uint8_t** code, const Function* func, const uint8_t* opcode, size_t opcodeLength, uint8_t regField, const Operand* rm) {
+	uint8_t rmNumber = 5;	// %rbp
+	if (rm->type == OPERAND_REGISTER) {
+		rmNumber = registerNumber(func, rm->reg);
+	} else if (rm->type != OPERAND_STACK_SLOT) {
+		encodingError(func, "expected a register or stack slot operand");
+	}
+
+	uint8_t rex = (uint8_t)(((regField & 8) ? 0x04 : 0) | ((rmNumber & 8) ? 0x01 : 0));
+	if (rex) {
+		emitByte(code, 0x40 | rex);
+	}
+	for (size_t i = 0; i < opcodeLength; i++) {
+		emitByte(code, opcode[i]);
+	}
+
+	uint8_t reg = (uint8_t)((regField & 7) << 3);
+	if (rm->type == OPERAND_REGISTER) {
+		emitByte(code, 0xC0 | reg | (rmNumber & 7));
+	} else if (fitsInt8(rm->stackOffset)) {
+		emitByte(code, 0x45 | reg);
+		emitByte(code, (uint8_t)(int8_t)rm->stackOffset);
+	} else {
+		emitByte(code, 0x85 | reg);
+		emitImm32(code, rm->stackOffset);
+	}
+}
+
+static void emitOpcodeModRM(uint8_t** code, const Function* func, uint8_t opcode, uint8_t regField, const Operand* rm) {
+	emitModRM(code, func, &opcode, 1, regField, rm);
+}
+
+static void encodeAlu(uint8_t** code, const Function* func, const AluEncoding* encoding, const Operand* src, const Operand* dst) {
+	if (src->type == OPERAND_IMM) {
+		if (fitsInt8(src->immValue)) {
+			emitOpcodeModRM(code, func, 0x83, encoding->extension, dst);
+			emitByte(code, (uint8_t)(int8_t)src->immValue);
+		} else if (dst->type == OPERAND_REGISTER && dst->reg == REG_EAX) {
+			emitByte(code, encoding->accumulatorOpcode);
+			emitImm32(code, src->immValue);
+		} else {
+			emitOpcodeModRM(code, func, 0x81, encoding->extension, dst);
+			emitImm32(code, src->immValue);
+		}
+	} else if (src->type == OPERAND_REGISTER) {
+		emitOpcodeModRM(code, func, encoding->storeOpcode, registerNumber(func, src->reg), dst);
+	} else if (dst->type == OPERAND_REGISTER) {
+		emitOpcodeModRM(code, func, encoding->loadOpcode, registerNumber(func, dst->reg), src);
+	} else {
+		encodingError(func, "memory to memory operation");
+	}
+}
+
+static void encodeMov(uint8_t** code, const Function* func, const Operand* src, const Operand* dst) {
+	if (src->type == OPERAND_IMM) {
+		if (dst->type == OPERAND_REGISTER) {
+			uint8_t reg = registerNumber(func, dst->reg);
+			if (reg & 8) {
+				emitByte(code, 0x41);
+			}
+			emitByte(code, 0xB8 + (reg & 7));
+		} else {
+			emitOpcodeModRM(code, func, 0xC7, 0, dst);
+		}
+		emitImm32(code, src->immValue);
+	} else if (src->type == OPERAND_REGISTER) {
+		emitOpcodeModRM(code, func, 0x89, registerNumber(func, src->reg), dst);
+	} else if (dst->type == OPERAND_REGISTER) {
+		emitOpcodeModRM(code, func, 0x8B, registerNumber(func, dst->reg), src);
+	} else {
+		encodingError(func, "memory to memory mov");
+	}
+}
+
+static void encodeImul(uint8_t** code, const Function* func, const Operand* src, const Operand* dst) {
+	if (dst->type != OPERAND_REGISTER) {
+		encodingError(func, "imul destination must be a register");
+	}
+	uint8_t reg = registerNumber(func, dst->reg);
+	if (src->type == OPERAND_IMM) {
+		// Three-operand form with the destination as both source and target.
+		if (fitsInt8(src->immValue)) {
+			emitOpcodeModRM(code, func, 0x6B, reg, dst);
+			emitByte(code, (uint8_t)(int8_t)src->immValue);
+		} else {
+			emitOpcodeModRM(code, func, 0x69, reg, dst);
+			emitImm32(code, src->immValue);
+		}
+	} else {
+		static const uint8_t opcode[] = { 0x0F, 0xAF };
+		emitModRM(code, func, opcode, sizeof(opcode), reg, src);
+	}
+}
+
+static void encodeShift(uint8_t** code, const Function* func, uint8_t extension, const Operand* src, const Operand* dst, bool byCl) {
+	if (byCl) {
+		emitOpcodeModRM(code, func, 0xD3, extension, dst);
+	} else if (src->type != OPERAND_IMM) {
+		encodingError(func, "shift count must be an immediate or %cl");
+	} else if (src->immValue == 1) {
+		emitOpcodeModRM(code, func, 0xD1, extension, dst);
+	} else {
+		emitOpcodeModRM(code, func, 0xC1, extension, dst);
+		emitByte(code, (uint8_t)src->immValue);
+	}
+}
+
+void encodeX64Function(const Function* func, uint8_t** code) {
+	// pushq %rbp; movq %rsp, %rbp; subq $n, %rsp
+	int bytesToAllocate = alignTo(func->stackSize, 16);
+	emitByte(code, 0x55);
+	emitByte(code, 0x48); emitByte(code, 0x89); emitByte(code, 0xE5);
+	emitByte(code, 0x48);
+	if (fitsInt8(bytesToAllocate)) {
+		emitByte(code, 0x83); emitByte(code, 0xEC); emitByte(code, (uint8_t)bytesToAllocate);
+	} else {
+		emitByte(code, 0x81); emitByte(code, 0xEC); emitImm32(code, bytesToAllocate);
+	}
+
+	const X64Instruction* instructions = (const X64Instruction*)func->instructions;
+	for (size_t i = 0; i < func->instructionCount; i++) {
+		const X64Instruction* instr = &instructions[i];
+		switch (instr->type) {
+			case X64_ADD:
+			case X64_AND:
+			case X64_OR:
+			case X64_SUB:
+			case X64_XOR:
+				encodeAlu(code, func, &s_aluEncodings[instr->type], &instr->src, &instr->dst);
+				break;
+			case X64_CDQ:
+				emitByte(code, 0x99);
+				break;
+			case X64_IDIV:
+				emitOpcodeModRM(code, func, 0xF7, 7, &instr->src);
+				break;
+			case X64_IMUL:
+				encodeImul(code, func, &instr->src, &instr->dst);
+				break;
+			case X64_MOV:
+				encodeMov(code, func, &instr->src, &instr->dst);
+				break;
+			case X64_NEG:
+				emitOpcodeModRM(code, func, 0xF7, 3, &instr->src);
+				break;
+			case X64_NOT:
+				emitOpcodeModRM(code, func, 0xF7, 2, &instr->src);
+				break;
+			case X64_RET:
+				// movq %rbp, %rsp; popq %rbp; ret
+				emitByte(code, 0x48); emitByte(code, 0x89); emitByte(code, 0xEC);
+				emitByte(code, 0x5D);
+				emitByte(code, 0xC3);
+				break;
+			case X64_SAR_CL:
+				encodeShift(code, func, 7, &instr->src, &instr->dst, true);
+				break;
+			case X64_SAR_IMM:
+				encodeShift(code, func, 7, &instr->src, &instr->dst, false);
+				break;
+			case X64_SHL_CL:
+				encodeShift(code, func, 4, &instr->src, &instr->dst, true);
+				break;
+			case X64_SHL_IMM:
+				encodeShift(code, func, 4, &instr->src, &instr->dst, false);
+				break;
+		}
+	}
+}
+
+// Concatenate the functions' code in source order, adding a symbol for each.
+static void appendFunctionCode(const Program* program, const BackendOutput* output, uint8_t** code, ElfSymbol** symbols) {
+	for (size_t i = 0; i < program->functionCount; i++) {
+		size_t length;
+		const uint8_t* bytes = getFunctionOutput(output, i, &length);
+		size_t start = arrlenu(*code);
+		memcpy(arraddnptr(*code, length), bytes, length);
+		arrput(*symbols, ((ElfSymbol){ .name = program->functions[i].name, .offset = start, .size = length }));
+	}
+}
+
+void generateX64ObjectFile(CompilerContext* ctx, const Program* program, const BackendOutput* output, const char* outputFilename) {
+	uint8_t* code = NULL;
+	ElfSymbol* symbols = NULL;
+	appendFunctionCode(program, output, &code, &symbols);
+
+	bool written = writeElfObject(outputFilename, code, arrlenu(code), symbols, arrlenu(symbols));
+	arrfree(symbols);
+	arrfree(code);
+	if (!written) {
+		compilerError(ctx, "Could not write object file '%s': %s", outputFilename, strerror(errno));
+	}
+}
+
+void generateX64Executable(CompilerContext* ctx, const Program* program, const BackendOutput* output, const char* outputFilename) {
+	// _start: the kernel enters with argc at (%rsp) and the stack 16-byte
+	// aligned, so a plain call leaves main with the alignment the ABI expects.
+	//   xorl %ebp, %ebp        ; mark the outermost frame
+	//   call main
+	//   movl %eax, %edi        ; exit status
+	//   movl $60, %eax         ; SYS_exit
+	//   syscall
+	static const uint8_t startCode[] = {
+		0x31, 0xED,
+		0xE8, 0x00, 0x00, 0x00, 0x00,
+		0x89, 0xC7,
+		0xB8, 0x3C, 0x00, 0x00, 0x00,
+		0x0F, 0x05
+	};
+	const size_t callEnd = 7;		// Offset of the byte after the call's rel32
+
+	uint8_t* code = NULL;
+	ElfSymbol* symbols = NULL;
+	memcpy(arraddnptr(code, sizeof(startCode)), startCode, sizeof(startCode));
+	arrput(symbols, ((ElfSymbol){ .name = "_start", .offset = 0, .size = sizeof(startCode) }));
+
+	const char* mainName = internCString("main");
+	size_t firstSymbol = arrlenu(symbols);
+	appendFunctionCode(program, output, &code, &symbols);
+	int64_t mainOffset = -1;
+	for (size_t i = firstSymbol; i < arrlenu(symbols); i++) {
+		if (symbols[i].name == mainName) {
+			mainOffset = (int64_t)symbols[i].offset;
+		}
+	}
+	if (mainOffset < 0) {
+		arrfree(symbols);
+		arrfree(code);
+		compilerError(ctx, "No 'main' function to use as the program entry point.");
+	}
+
+	int32_t displacement = (int32_t)(mainOffset - (int64_t)callEnd);
+	for (int i = 0; i < 4; i++) {
+		code[callEnd - 4 + i] = (uint8_t)((uint32_t)displacement >> (i * 8));
+	}
+
+	bool written = writeElfExecutable(outputFilename, code, arrlenu(code), symbols, arrlenu(symbols), 0);
+	arrfree(symbols);
+	arrfree(code);
+	if (!written) {
+		compilerError(ctx, "Could not write executable '%s': %s", outputFilename, strerror(errno));
+	}
+}
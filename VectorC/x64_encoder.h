@@ -0,0 +1,31 @@
+//
+//  x64_encoder.h
+//  VectorC
+//
+
+#ifndef x64_encoder_h
+#define x64_encoder_h
+
+#include <stdint.h>
+
+#include "ast_x64.h"
+#include "backend.h"
+
+struct CompilerContext;
+
+// Append the machine code for a function (prologue included) to an stb_ds
+// byte array. The function must have been through fixupIllegalInstructionsX64.
+void encodeX64Function(const Function* func, uint8_t** code);
+
+// Write the machine code runBackend encoded for every function of a program
+// to an ELF64 relocatable object, bypassing the assembler. Failures are
+// reported through the context.
+void generateX64ObjectFile(struct CompilerContext* ctx, const Program* program, const BackendOutput* output, const char* outputFilename);
+
+// Link the encoded functions into a static Linux executable with a built-in
+// _start that calls main and passes its result to the exit system call, so
+// no linker or C runtime is involved. Failures are reported through the
+// context.
+void generateX64Executable(struct CompilerContext* ctx, const Program* program, const BackendOutput* output, const char* outputFilename);
+
+#endif /* x64_encoder_h */
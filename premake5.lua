@@ -89,6 +89,9 @@ project "VectorC"
    {
    }
 
+ filter { "system:not windows" }
+   links { "pthread", "m" }
+
  filter { "action:vs*" }
    defines("WIN64", "_CRT_NONSTDC_NO_DEPRECATE", "_CRT_NONSTDC_NO_WARNINGS")    
    buildoptions { "-march=native" } 
@@ -0,0 +1,4 @@
+/* Constants are int, and this one does not fit in 32 bits. */
+int main(void) {
+    return 4294967298;
+}
\ No newline at end of file
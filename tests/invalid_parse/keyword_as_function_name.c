@@ -0,0 +1,3 @@
+int while(void) {
+    return 0;
+}
@@ -0,0 +1,14 @@
+#define ANSWER 6
+#define TWICE(x) ((x) * 2)
+#define NAME(prefix) prefix ## ain
+
+int NAME(m)(void) {
+    /* test case w/ object-like, function-like
+       and token-pasting macros */
+#if defined(ANSWER) && TWICE(ANSWER) == 12
+    return TWICE(ANSWER) + \
+        1;
+#else
+    return 0;
+#endif
+}